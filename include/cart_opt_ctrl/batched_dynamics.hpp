@@ -0,0 +1,107 @@
+#ifndef CARTOPTCTRL_BATCHEDDYNAMICS_HPP_
+#define CARTOPTCTRL_BATCHEDDYNAMICS_HPP_
+
+#include <kdl/chain.hpp>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <functional>
+#include <vector>
+
+// Evaluates the chain dynamics for many configurations at once.
+// Configurations are given structure-of-arrays : q is (nb_joints x N), one row per joint,
+// so that consecutive configurations of a joint are contiguous in memory.
+// Each SIMD lane handles one configuration (Lanes configurations per pack)
+// and the packs are spread over threads.
+// The algorithms are the usual ones (forward kinematics, composite rigid body, Cholesky, Newton-Euler)
+// written on packs, the results match KDL's ChainJntToJacSolver, ChainDynParam, ChainIdSolver_RNE for the tip segment.
+struct BatchedDynamicsResult{
+  typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> Matrix;
+  // Tip pose : 12 rows, [px, py, pz, R00, R01, R02, R10, ..., R22]
+  Matrix pose;
+  // Tip jacobian (reference point at the tip, base frame) : 6 x nb_joints rows, row major (row r, column c) -> r * nb_joints + c
+  Matrix jacobian;
+  // Gravity torques : nb_joints rows
+  Matrix gravity;
+  // Joint space inertia matrix and its inverse : nb_joints x nb_joints rows, row major
+  Matrix inertia, inertia_inverse;
+};
+
+class BatchedDynamics{
+  public:
+    enum Outputs { POSE = 1, JACOBIAN = 2, GRAVITY = 4, INERTIA = 8, INERTIA_INVERSE = 16, ALL = 31 };
+    static const int Lanes = 4;
+    typedef Eigen::Array<double,Lanes,1> Pack;
+    typedef std::vector<Pack, Eigen::aligned_allocator<Pack> > PackVector;
+
+    // Plain description of a segment, extracted once from the KDL chain
+    struct SegmentModel{
+      enum JointType { FIXED = 0, ROTATIONAL = 1, TRANSLATIONAL = 2 };
+      JointType type;
+      int joint_index;
+      Eigen::Vector3d axis, origin;   // joint axis and point on the axis, in the parent frame
+      Eigen::Matrix3d tip_rot;        // joint frame to segment frame
+      Eigen::Vector3d tip_pos;
+      double mass;                    // inertia in the segment frame, about its origin
+      Eigen::Vector3d first_moment;
+      Eigen::Matrix3d rot_inertia;
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    typedef std::vector<SegmentModel, Eigen::aligned_allocator<SegmentModel> > SegmentModels;
+
+    // Inertial parameters of a segment the dynamics are linear in :
+    // [mass, first moment (x, y, z), rotational inertia (xx, xy, xz, yy, yz, zz)], in the segment frame about its origin
+    static const int NB_SEGMENT_PARAMETERS = 10;
+
+    BatchedDynamics();
+
+    // Segment models of a KDL chain, false on joints with a scale or offset (not produced by kdl_parser)
+    static bool extractSegments(const KDL::Chain& chain, SegmentModels& segments, int& nb_joints);
+
+    // Extracts the segment models, fails on joints with a scale or offset (not produced by kdl_parser)
+    bool init(const KDL::Chain& chain, const Eigen::Vector3d& gravity = Eigen::Vector3d(0.0,0.0,-9.81));
+    bool init(const SegmentModels& segments, int nb_joints, const Eigen::Vector3d& gravity = Eigen::Vector3d(0.0,0.0,-9.81));
+
+    // Number of worker threads, 0 means one per hardware thread
+    void setNbThreads(unsigned int nb_threads);
+
+    // Evaluates the requested outputs for every column of q (nb_joints x N), resizes the result if needed
+    void compute(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q, BatchedDynamicsResult& result, int outputs = ALL) const;
+
+    // Inverse dynamics tau = M(q).qdd + C(q,qd).qd + g(q) for every column (nb_joints x N each), resizes tau if needed
+    void computeInverseDynamics(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q, const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qd,
+                                const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qdd, BatchedDynamicsResult::Matrix& tau) const;
+    // Regressor Y of the inverse dynamics, tau = Y.pi with pi the parameters of all the segments in chain order
+    // (see NB_SEGMENT_PARAMETERS) : nb_joints x nb_segments x NB_SEGMENT_PARAMETERS rows, row (j, p) -> j * nb_parameters + p.
+    // The masses of the model are not used.
+    void computeRegressor(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q, const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qd,
+                          const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qdd, BatchedDynamicsResult::Matrix& regressor) const;
+
+    static void getParameters(const SegmentModel& segment, double* parameters);
+    static void setParameters(const double* parameters, SegmentModel& segment);
+
+    int getNrOfJoints() const { return nb_joints_; }
+    int getNrOfSegments() const { return segments_.size(); }
+    int getNrOfParameters() const { return segments_.size() * NB_SEGMENT_PARAMETERS; }
+    const SegmentModels& getSegments() const { return segments_; }
+
+  protected:
+    struct Workspace;
+    // Calls range(first_pack, last_pack) on contiguous blocks of packs, one per thread
+    void forEachPackRange(int nb_packs, const std::function<void(int,int)>& range) const;
+    void computeRange(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q, BatchedDynamicsResult& result,
+                      int outputs, int first_pack, int last_pack) const;
+    void computeMotionRange(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q, const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qd,
+                            const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qdd, BatchedDynamicsResult::Matrix& out,
+                            bool regressor, int first_pack, int last_pack) const;
+    void computePack(Workspace& ws, int outputs) const;
+    // Newton-Euler on the kinematics of computePack, tau or the regressor
+    void computeMotionPack(Workspace& ws, bool regressor) const;
+
+    SegmentModels segments_;
+    std::vector<int> joint_segments_;
+    int nb_joints_;
+    unsigned int nb_threads_;
+    Eigen::Vector3d gravity_;
+};
+
+#endif // CARTOPTCTRL_BATCHEDDYNAMICS_HPP_
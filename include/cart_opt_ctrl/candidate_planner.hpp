@@ -0,0 +1,125 @@
+#ifndef CARTOPTCTRL_CANDIDATEPLANNER_HPP_
+#define CARTOPTCTRL_CANDIDATEPLANNER_HPP_
+
+#include <cart_opt_ctrl/multi_frame_kinematics.hpp>
+#include <cart_opt_ctrl/trajectory_plan.hpp>
+#include <kdl/chain.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One way of timing a waypoint path : blend radii, velocity profile and its limits
+struct PlanningCandidate{
+  double radius, eqradius, vel_max, acc_max;
+  TrajectoryPlan::Profile profile;
+};
+
+// Hard limits a candidate must respect over its whole duration
+struct PlanningLimits{
+  // Cartesian velocity and acceleration of the tip (m/s, m/s^2, rad/s, rad/s^2), the blends add v^2/radius
+  double vel, acc, rot_vel, rot_acc;
+  // Joint limits, used only with a model and a start configuration, an empty joint_vel skips the velocity check
+  Eigen::VectorXd joint_lower, joint_upper, joint_vel;
+  // Sampling period of the check (s) and max distance between the tip and the trajectory (m, rad)
+  double check_period, tracking_tolerance;
+};
+
+// Layout of the PlanningStats vector sent by KDLTrajCompute after each plan.
+// Times are in seconds, DURATION and NOMINAL_DURATION are the cycle times of the selected and nominal candidates
+// (the nominal one is 0 if it could not be built), the MEAN_ and MAX_ entries cover all the plans since configure.
+namespace PlanningStats
+{
+  enum Index {
+    PLANNING_TIME = 0,
+    CANDIDATES,
+    EVALUATED,            // checked before the budget ran out, the others are longer than a feasible one or not reached
+    FEASIBLE,
+    BUDGET_EXCEEDED,
+    DURATION,
+    NOMINAL_DURATION,
+    NB_PLANS,
+    MEAN_PLANNING_TIME,
+    MAX_PLANNING_TIME,
+    MEAN_DURATION,
+    MEMORY,               // bytes reserved by the arenas of the candidate plans
+    SIZE
+  };
+}
+
+// Plans many candidates for the same waypoints on a pool of threads and keeps the shortest feasible one.
+// The candidates are built in parallel into plans kept from one request to the next, sorted by duration,
+// then checked from the shortest : the first feasible one wins, so the longer ones are never checked.
+// The check samples the trajectory every check_period against the cartesian limits and, when a model and
+// a start configuration are given, follows it with a damped least squares IK from that configuration :
+// the joints must stay within their limits and the tip within tracking_tolerance (reachability, singularities).
+// The workers are created once by init(), each has its own kinematics. plan() stops taking candidates at the
+// latency budget and returns the best of those checked.
+class CandidatePlanner{
+  public:
+    struct Report{
+      int candidates, evaluated, feasible;
+      bool budget_exceeded;
+      double planning_time, duration, nominal_duration;
+      size_t memory;
+    };
+
+    CandidatePlanner();
+    ~CandidatePlanner();
+
+    // Starts nb_threads workers (0 means one per hardware thread), the joint check needs the chain and its tip segment
+    bool init(unsigned int nb_threads, const KDL::Chain* chain = 0, const std::string& tip_segment = "");
+    void setLimits(const PlanningLimits& limits){ limits_ = limits; }
+    unsigned int getNrOfThreads() const { return workers_.size(); }
+    // Started with the chain, the joint limits are checked
+    bool usesModel() const { return use_model_; }
+
+    // Shortest feasible trajectory among the candidates (the first one is the nominal) found within budget seconds,
+    // swapped into result, false if none. q_start empty skips the joint check. Not reentrant.
+    bool plan(const std::vector<KDL::Frame>& waypoints, const std::vector<PlanningCandidate>& candidates, double end_pause,
+              const Eigen::VectorXd& q_start, double budget, TrajectoryPlan& result, Report& report);
+
+  protected:
+    typedef std::chrono::steady_clock Clock;
+    enum Phase { BUILD, CHECK };
+
+    struct Worker{
+      MultiFrameKinematics kinematics;
+      int tip;
+      Eigen::VectorXd q, qd, dq;
+      bool aborted;
+    };
+
+    void workerLoop(unsigned int index);
+    void dispatch(Phase phase, int nb_tasks);
+    void runTasks(Worker& worker);
+    bool isFeasible(Worker& worker, const TrajectoryPlan& trajectory);
+    bool followTrajectory(Worker& worker, const TrajectoryPlan& trajectory);
+
+    std::vector<std::thread> workers_;
+    std::vector<Worker> worker_data_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    unsigned int generation_, active_;
+    bool stop_, use_model_;
+
+    // Current job, set by plan() before each phase
+    Phase phase_;
+    int nb_tasks_;
+    std::atomic<int> next_task_, best_rank_, evaluated_, feasible_;
+    std::atomic<bool> budget_exceeded_;
+    Clock::time_point deadline_;
+    double end_pause_;
+    const std::vector<KDL::Frame>* waypoints_;
+    const std::vector<PlanningCandidate>* candidates_;
+    Eigen::VectorXd q_start_;
+    std::vector<std::unique_ptr<TrajectoryPlan> > plans_;
+    std::vector<double> durations_;
+    std::vector<int> order_;
+
+    PlanningLimits limits_;
+};
+
+#endif // CARTOPTCTRL_CANDIDATEPLANNER_HPP_
@@ -7,9 +7,16 @@
 #include <rtt/TaskContext.hpp>
 #include <rtt/InputPort.hpp>
 #include <rtt/OutputPort.hpp>
+#include <rtt/os/Timer.hpp>
+#include <rtt/os/TimeService.hpp>
 #include <kdl/frameacc.hpp>
+#include <kdl/chaindynparam.hpp>
 #include <qpOASES.hpp>
+#include <pluginlib/class_loader.h>
+#include <ros/ros.h>
+#include <atomic>
 #include <memory>
+#include <sstream>
 
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/Twist.h>
@@ -20,9 +27,22 @@
 #include <std_msgs/Float32.h>
 
 #include <eigen_conversions/eigen_kdl.h>
+#include <Eigen/Eigenvalues>
+#include <Eigen/Cholesky>
 #include <kdl/frames_io.hpp>
 #include <kdl_conversions/kdl_msg.h>
 #include <cart_opt_ctrl/GetCurrentPose.h>
+#include <cart_opt_ctrl/gain_scheduler.hpp>
+#include <cart_opt_ctrl/payload_estimator.hpp>
+#include <cart_opt_ctrl/momentum_observer.hpp>
+#include <cart_opt_ctrl/tracking_feedback.hpp>
+#include <cart_opt_ctrl/woodbury_hessian.hpp>
+#include <cart_opt_ctrl/qp_plugin.hpp>
+#include <cart_opt_ctrl/qp_options.hpp>
+#include <cart_opt_ctrl/qp_record.hpp>
+#include <cart_opt_ctrl/joint_record.hpp>
+#include <cart_opt_ctrl/multi_frame_kinematics.hpp>
+#include <cart_opt_ctrl/friction_model.hpp>
 
 
 class CartOptCtrl : public RTT::TaskContext{
@@ -38,12 +58,39 @@ class CartOptCtrl : public RTT::TaskContext{
     bool getCurrentPose(cart_opt_ctrl::GetCurrentPose::Request& req, cart_opt_ctrl::GetCurrentPose::Response& resp);
     
   protected:
+    // Triggers the component when no joint state arrived during watchdog_timeout
+    class Watchdog : public RTT::os::Timer{
+      public:
+        Watchdog(RTT::TaskContext* owner) : RTT::os::Timer(1, ORO_SCHED_RT, RTT::os::HighestPriority), owner_(owner){}
+        void timeout(RTT::os::Timer::TimerId /*id*/){ owner_->trigger(); }
+      protected:
+        RTT::TaskContext* owner_;
+    };
+
+    bool dataOnPortHook(RTT::base::PortInterface* port);
+    void addPayloadToModel();
+    void detectCollision();
+    void updateTrackingFeedback(bool qp_solved);
+    void addSlackVariables();
+    bool solveUnconstrained();
+    bool loadPlugins(int dof);
+    bool resolveFrames();
+    void computeFrameTask(int task);
+    void updatePlugins();
+
     // Output ports
     RTT::OutputPort<Eigen::VectorXd> port_joint_torque_out_;
     RTT::OutputPort<geometry_msgs::PoseStamped> port_x_des_;
     RTT::OutputPort<trajectory_msgs::JointTrajectoryPoint> port_joint_pos_vel_in_; 
     RTT::OutputPort<geometry_msgs::Twist> port_error_out_; 
     RTT::OutputPort<std_msgs::Float32> port_ec_lim_out_, port_ec_predicted_out_;
+    RTT::OutputPort<Eigen::VectorXd> port_gains_active_out_;
+    RTT::OutputPort<Eigen::VectorXd> port_residual_out_;
+    RTT::OutputPort<std_msgs::Bool> port_collision_out_;
+    RTT::OutputPort<Eigen::VectorXd> port_tracking_feedback_out_;
+    RTT::OutputPort<Eigen::VectorXd> port_slack_out_;
+    RTT::OutputPort<std_msgs::Float32> port_latency_out_;
+    RTT::OutputPort<Eigen::VectorXd> port_plugin_timings_out_;
     
     // Input ports
     RTT::InputPort<KDL::Frame> port_pnt_pos_in_;
@@ -51,15 +98,21 @@ class CartOptCtrl : public RTT::TaskContext{
     RTT::InputPort<KDL::Twist> port_pnt_acc_in_;
     RTT::InputPort<Eigen::VectorXd> port_joint_position_in_;
     RTT::InputPort<Eigen::VectorXd> port_joint_velocity_in_;
+    RTT::InputPort<Eigen::VectorXd> port_joint_torque_in_;
     RTT::InputPort<bool> port_button_pressed_in_;
     RTT::InputPort<geometry_msgs::PointStamped> port_human_pos_in_;
     RTT::InputPort<geometry_msgs::WrenchStamped> port_ftdata_;
+    RTT::InputPort<Eigen::VectorXd> port_payload_in_;
     
     KDL::Jacobian J_;
     KDL::JntSpaceInertiaMatrix M_inv_;
     KDL::JntArray coriolis_;
     KDL::JntArray gravity_;
-    KDL::Twist Jdotqdot_;
+    // Dynamics of the arm without payload, the kinematics come from kinematics_
+    std::unique_ptr<KDL::ChainDynParam> dyn_param_;
+    KDL::JntArray q_kdl_, qd_kdl_, arm_gravity_;
+    KDL::JntSpaceInertiaMatrix arm_inertia_;
+    Eigen::LLT<Eigen::MatrixXd> arm_inertia_llt_;
     Eigen::Matrix<double,6,1> jdot_qdot_;
     Eigen::Matrix<double,6,1> xdd_des_;
 
@@ -73,7 +126,6 @@ class CartOptCtrl : public RTT::TaskContext{
     Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> A_;
     Eigen::VectorXd lbA_, ubA_, qd_min_, qd_max_;
     Eigen::VectorXd nonLinearTerms_;
-    Eigen::VectorXd x_max_, x_min_;
     Eigen::Matrix<double,6,1> xd_curr_, x_curr_;
     Eigen::Matrix<double,3,1> x_curr_lin_;
     Eigen::Matrix<double,6,6> Lambda_;
@@ -89,11 +141,13 @@ class CartOptCtrl : public RTT::TaskContext{
     
     bool button_pressed_;
 
-    // Chain chain_utils
+    // Chain chain_utils, from the URDF in the robot_description parameter
     rtt_ros_kdl_tools::ChainUtils arm_;
+    std::string robot_description_;
     Eigen::VectorXd joint_torque_out_,
                     joint_position_in_,
-                    joint_velocity_in_;
+                    joint_velocity_in_,
+                    joint_torque_in_;
     
     double distance_to_contact_;
 
@@ -116,11 +170,119 @@ class CartOptCtrl : public RTT::TaskContext{
     double max_viscous_coeff_, viscous_walls_thickness_;
     bool compensate_gravity_, viscous_walls_;
     Eigen::VectorXd p_gains_, i_gains_, d_gains_, torque_max_, jnt_vel_max_;
+    Eigen::VectorXd p_gains_active_, d_gains_active_, gains_active_;
     std::vector<Eigen::VectorXd> select_components_, select_axes_;
+
+    // Frames resolved at configure into handles, their kinematics come from one sweep.
+    // Tasks on another frame than frame_of_interest hold the pose it had at the first command,
+    // the cartesian walls apply to each frame of wall_frames (frame_of_interest if empty)
+    MultiFrameKinematics kinematics_;
+    int ee_handle_, ee_segment_index_;
+    std::vector<std::string> task_frames_;
+    std::vector<int> task_handles_, wall_handles_;
+    std::vector<KDL::Frame> task_hold_poses_;
+    std::string wall_frames_;
+    KDL::Twist frame_err_;
+    Eigen::Matrix<double,6,1> frame_xdd_des_;
     double ec_lim_, ec_max_, ec_safe_, human_min_dist_, human_max_dist_;
 
+    // Gain scheduling
+    GainScheduler gain_scheduler_;
+    bool gain_scheduling_;
+    double payload_mass_;
+    Eigen::VectorXd gs_axis_min_, gs_axis_max_, gs_axis_samples_, gs_p_table_, gs_d_table_;
+
+    // Operational space impedance
+    bool impedance_mode_;
+    Eigen::VectorXd stiffness_, damping_ratio_;
+    Eigen::Matrix<double,6,6> lambda_inv_, lambda_sqrt_, damping_half_, damping_matrix_;
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double,6,6> > lambda_inv_eig_;
+    Eigen::Matrix<double,6,1> lambda_eigenvalues_, x_err_, xdd_traj_, integral_err_, impedance_wrench_;
+
+    // Payload model
+    bool use_payload_model_;
+    Eigen::VectorXd payload_params_, payload_in_;
+    Eigen::Matrix3d payload_rot_, payload_inertia_;
+    Eigen::Vector3d payload_first_moment_;
+    const Eigen::Vector3d gravity_vector_ = Eigen::Vector3d(0.0,0.0,-9.81);
+    Eigen::Matrix<double,6,6> payload_spatial_inertia_;
+    Eigen::Matrix<double,6,1> payload_wrench_;
+    Eigen::MatrixXd mass_matrix_;
+    Eigen::LDLT<Eigen::MatrixXd> mass_matrix_ldlt_;
+
+    // Collision detection, reaction : 0 detection only, 1 lower Ec_lim, 2 compliant
+    MomentumObserver momentum_observer_;
+    bool collision_detection_, collision_detected_;
+    int collision_reaction_;
+    double collision_ec_lim_, collision_hold_time_, collision_time_left_;
+    Eigen::VectorXd observer_gains_, collision_thresholds_, applied_torque_;
+    std_msgs::Bool collision_msg_;
+
+    // Tracking feedback for the trajectory generator, see TrackingFeedback
+    Eigen::VectorXd tracking_feedback_, dual_solution_;
+    bool error_saturated_;
+
+    // Soft constraints, slack_weights per class [joint, cartesian, energy], <= 0 keeps the class hard
+    bool soft_constraints_;
+    Eigen::VectorXd slack_weights_, slack_out_, primal_solution_;
+    // Slack weight of each constraint row, from its class or its plugin
+    Eigen::VectorXd slack_row_weights_;
+
+    // Event triggered cycle, period_ is the activity period or nominal_period if it is not periodic
+    bool event_triggered_;
+    double period_, nominal_period_, watchdog_timeout_;
+    std::unique_ptr<Watchdog> watchdog_;
+    // Stamped by dataOnPortHook, which may run in another thread than updateHook
+    std::atomic<RTT::os::TimeService::nsecs> joint_state_time_;
+    // Start of the last computed cycle and the time elapsed since the one before (skipped cycles included), period_ until it is known
+    RTT::os::TimeService::nsecs cycle_time_;
+    double cycle_dt_;
+    std_msgs::Float32 latency_msg_;
+
+    // Cycles with no new joint state, setpoint or button are skipped
+    bool skip_unchanged_inputs_;
+    int skipped_cycles_, computed_cycles_;
+
+    // Unconstrained fast path, -H^-1.g is used when it satisfies every bound and row
+    bool fast_path_, fast_path_hit_;
+    int fast_path_hits_, qp_calls_;
+    double fast_path_hit_rate_;
+    Eigen::LLT<Eigen::MatrixXd> hessian_llt_;
+    Eigen::VectorXd unconstrained_tau_, constraint_rows_;
+    // Factorization of the fast path from the structure of H instead of a dense LLT
+    bool woodbury_hessian_;
+    WoodburyHessian woodbury_;
+
+    // Task and constraint plugins, the loader must outlive the instances.
+    // Plugin i owns the constraint rows [plugin_row_offsets_[i], plugin_row_offsets_[i] + rows())
+    std::vector<std::string> qp_plugin_types_;
+    std::unique_ptr<pluginlib::ClassLoader<cart_opt_ctrl::QPPlugin> > plugin_loader_;
+    std::vector<boost::shared_ptr<cart_opt_ctrl::QPPlugin> > plugins_;
+    std::vector<int> plugin_row_offsets_;
+    cart_opt_ctrl::QPState qp_state_;
+    Eigen::VectorXd plugin_timings_;
+
+    // Solver options from CartOptCtrl/qp_options, the problems given to the solver are recorded
+    // in a ring of qp_record_size and written to qp_record_file on stop (see qp_option_tuner)
+    QPSolverOptions qp_options_;
+    QPRecord qp_record_;
+    int qp_record_size_;
+    std::string qp_record_file_;
+
+    // Joint states and torques of the computed cycles, in a ring of joint_record_size written to joint_record_file
+    // on stop (see dynamic_identifier). The torques are the measured ones when JointTorque is connected.
+    JointRecord joint_record_;
+    int joint_record_size_;
+    std::string joint_record_file_;
+
+    // Joint friction (see FrictionIdentComp) added to the solution of the QP, from tables built at configure
+    bool friction_compensation_;
+    Eigen::VectorXd friction_coulomb_, friction_static_, friction_stribeck_velocity_, friction_viscous_, friction_torque_;
+    double friction_deadband_;
+    FrictionTable friction_table_;
+
     std::unique_ptr<qpOASES::SQProblem> qpoases_solver_;
-    int number_of_constraints_;
+    int number_of_variables_, number_of_constraints_;
 };
 
 ORO_CREATE_COMPONENT_LIBRARY()
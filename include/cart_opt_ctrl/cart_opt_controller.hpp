@@ -5,9 +5,9 @@
 #include <rtt_ros_kdl_tools/chain_utils.hpp>
 #include <kdl_conversions/kdl_msg.h>
 #include <eigen_conversions/eigen_kdl.h>
-#include <qpOASES.hpp>
 #include <boost/graph/graph_concepts.hpp>
 #include <geometry_msgs/Pose.h>
+#include <cart_opt_ctrl/cartesian_qp.hpp>
 
 #define M_PI 3.14159265358979323846  /* pi */
 
@@ -225,17 +225,12 @@ class HardwareInterfaceAdapter<hardware_interface::CartOptEffortJointInterface,
 	controller_nh.getParam("regularisation_weights/tau", regularisation_weight_);
       
       // Initialize qpoases solver
-      int number_of_variables = dof;
-      int number_of_constraints = dof;
-      qpoases_solver_.reset(new qpOASES::SQProblem(number_of_variables,number_of_constraints,qpOASES::HST_POSDEF));
-      
-      // QPOases options
-      qpOASES::Options options;
-      options.setToMPC(); // setToReliable() // setToDefault()
-      options.enableRegularisation = qpOASES::BT_FALSE; // since we specify the type of Hessian matrix, we do not need automatic regularisation
-      options.enableEqualities = qpOASES::BT_TRUE; // Specifies whether equalities shall be  always treated as active constraints.
-      qpoases_solver_->setOptions( options );
-      qpoases_solver_->setPrintLevel(qpOASES::PL_NONE); // PL_HIGH for full output, PL_NONE for... none
+      qp_.init(dof);
+      b2_.setZero(dof);
+      // TODO: get this from URDF
+      torque_max_.resize(dof);
+      torque_max_ << 200,200,100,100,100,30,30; // N.m
+      qd_max_.setOnes(dof);
       
       // Instantiate other solvers
       fk_solver_vel_.reset(new KDL::ChainFkSolverVel_recursive(arm_.Chain()));
@@ -257,6 +252,7 @@ class HardwareInterfaceAdapter<hardware_interface::CartOptEffortJointInterface,
       // Reset zero effort commands
       for (unsigned int i = 0; i < joint_handles_ptr_->size(); ++i)
 	(*joint_handles_ptr_)[i].setCommand(0.0);
+      qp_.reset();
     }
 
     void stopping(const ros::Time& /*time*/) {}
@@ -380,113 +376,20 @@ class HardwareInterfaceAdapter<hardware_interface::CartOptEffortJointInterface,
       Eigen::Matrix<double,6,1> jdot_qdot;
       tf::twistKDLToEigen(Jdotqdot,jdot_qdot);
       
-      Eigen::Matrix<double,6,Eigen::Dynamic> a;
-      a.resize(6,n_joints);
-      Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> a2;
-      a2.resize(n_joints,n_joints);
-      
-      Eigen::Matrix<double,6,1> b;
-      Eigen::Matrix<double,Eigen::Dynamic,1> b2;
-      b2.resize(n_joints,1);
-      
-      a.noalias() = J.data * M_inv.data;
-      a2.noalias() = M_inv.data;
-      b.noalias() = - a * ( coriolis.data + gravity.data ) + jdot_qdot - xdd_des;
-      b2.noalias() = - a2 * ( coriolis.data + gravity.data ) - qdd_des_;
-      
-      // Matrices for qpOASES
-      // NOTE: We need RowMajor (see qpoases doc)
-      Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> H;
-      H.resize(n_joints,n_joints);
-      
-      Eigen::VectorXd g(n_joints);
-      
-      Eigen::MatrixXd regularisation;
-      regularisation.resize(n_joints, n_joints);
-      regularisation.setIdentity();
-      regularisation *= regularisation_weight_;
-      
-      H = 2.0 * a.transpose() * a + jnt_task_weight_* 2.0 * a2.transpose() * a2 + regularisation;
-      g = 2.0 * a.transpose() * b + jnt_task_weight_* 2.0 * a2.transpose() * b2;
-      
-      // TODO: get this from URDF
-      Eigen::VectorXd torque_max;
-      torque_max.resize(n_joints);
-      torque_max << 200,200,100,100,100,30,30; // N.m
-
-      Eigen::VectorXd torque_min;
-      torque_min.resize(n_joints);
-      torque_min = -torque_max; // N.m
-      
-      // Compute bounds
-      Eigen::VectorXd lb(n_joints),
-		      ub(n_joints);
-      
-      //TODO : write constraints for q and qdot
-      lb = torque_min;
-      ub = torque_max;
-      
-      // Update Constraints
-      Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> A(n_joints,n_joints);
-      Eigen::VectorXd lbA(n_joints),
-		      ubA(n_joints),
-		      qd_min(n_joints),
-		      qd_max(n_joints);
-      
-      qd_min.setConstant(-1.0);
-      qd_max.setConstant(1.0);
-      
-      A = M_inv.data;
+      // Cartesian task, the joint task qdd = Minv.( T - B - G ) and the regularisation on tau
+      qp_.setCartesianTask(J.data, M_inv.data, coriolis.data, gravity.data, jdot_qdot, xdd_des);
+      b2_ = - qp_.nonlinear_terms - qdd_des_;
+      qp_.H.noalias() += jnt_task_weight_* 2.0 * M_inv.data.transpose() * M_inv.data;
+      qp_.H.diagonal().array() += regularisation_weight_;
+      qp_.g.noalias() += jnt_task_weight_* 2.0 * M_inv.data.transpose() * b2_;
       
-      double horizon_dt = 0.015;
-      
-      Eigen::VectorXd nonLinearTerms(n_joints);
-      nonLinearTerms = M_inv.data * ( coriolis.data + gravity.data );    
-      
-      lbA = (( qd_min - joint_velocity_in_ ) / horizon_dt + nonLinearTerms).cwiseMax(
-		  2*(arm_.getJointLowerLimit() - joint_position_in_ - joint_velocity_in_ * horizon_dt)/ (horizon_dt*horizon_dt) + nonLinearTerms );
-      
-      ubA = (( qd_max - joint_velocity_in_ ) / horizon_dt + nonLinearTerms).cwiseMin(
-		  2*(arm_.getJointUpperLimit() - joint_position_in_ - joint_velocity_in_ * horizon_dt)/ (horizon_dt*horizon_dt) + nonLinearTerms );
-      
-      
-      // number of allowed compute steps
-      int nWSR = 1e6; 
-      
-      // Let's compute !
-      qpOASES::returnValue ret;
-      static bool qpoases_initialized = false;
-      
-      if(!qpoases_initialized)
-      {
-	// Initialise the problem, once it has found a solution, we can hotstart
-	ret = qpoases_solver_->init(H.data(),g.data(),A.data(),lb.data(),ub.data(),lbA.data(),ubA.data(),nWSR);
-	
-	// Keep init if it didn't work
-	if(ret == qpOASES::SUCCESSFUL_RETURN)
-	{
-	  qpoases_initialized = true;
-	}
-      }
-      else{
-	// Otherwise let's reuse the previous solution to find a solution faster
-	ret = qpoases_solver_->hotstart(H.data(),g.data(),A.data(),lb.data(),ub.data(),lbA.data(),ubA.data(),nWSR);
-	
-	if(ret != qpOASES::SUCCESSFUL_RETURN){
-	  qpoases_initialized = false;
-	}
-      }
+      // Torque bounds, joint position and velocity constraints
+      qp_.setLimits(M_inv.data, joint_position_in_, joint_velocity_in_, arm_.getJointLowerLimit(), arm_.getJointUpperLimit(),
+                    qd_max_, torque_max_, 0.015);
       
       // Zero grav if not found
       // TODO: find a better alternative
-      joint_torque_out_.setZero();
-      
-      if(ret == qpOASES::SUCCESSFUL_RETURN){
-	// Get the solution
-	qpoases_solver_->getPrimalSolution(joint_torque_out_.data());
-	// Remove gravity because Kuka already adds it
-	joint_torque_out_ -= gravity.data;
-      }
+      qp_.solve(gravity.data, joint_torque_out_);
       
       // Send commands
       for (unsigned int i = 0; i < n_joints; ++i){    
@@ -522,7 +425,7 @@ class HardwareInterfaceAdapter<hardware_interface::CartOptEffortJointInterface,
     KDL::Twist Xd_curr_,Xdd_curr_,Xd_traj_,Xdd_traj_;
     KDL::JntArray q_curr_, qd_curr_, q_traj_, qd_traj_, qdd_traj_;
     KDL::Twist Xdd_des_;
-    Eigen::VectorXd qdd_des_;
+    Eigen::VectorXd qdd_des_, b2_, torque_max_, qd_max_;
     double jnt_task_weight_, regularisation_weight_;
     
     Eigen::VectorXd p_gains_,d_gains_,p_jnt_gains_,d_jnt_gains_;
@@ -530,7 +433,7 @@ class HardwareInterfaceAdapter<hardware_interface::CartOptEffortJointInterface,
     // Solvers
     boost::scoped_ptr<KDL::ChainFkSolverVel_recursive> fk_solver_vel_;
     boost::scoped_ptr<KDL::ChainJntToJacDotSolver> jntToJacDotSolver_;
-    std::unique_ptr<qpOASES::SQProblem> qpoases_solver_;
+    cart_opt_controllers::CartesianQP qp_;
     
     // Publishers for debug
     ros::Publisher xdes_pub_, xcurr_pub_, xerr_pub_;
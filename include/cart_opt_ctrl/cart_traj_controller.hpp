@@ -0,0 +1,86 @@
+#ifndef CARTOPTCTRL_CARTTRAJCONTROLLER_HPP_
+#define CARTOPTCTRL_CARTTRAJCONTROLLER_HPP_
+
+#include <controller_interface/controller.h>
+#include <realtime_tools/realtime_buffer.h>
+#include <rtt_ros_kdl_tools/chain_utils.hpp>
+#include <kdl_conversions/kdl_msg.h>
+#include <eigen_conversions/eigen_kdl.h>
+#include <boost/shared_ptr.hpp>
+
+#include <cart_opt_ctrl/cart_opt_controller.hpp>
+#include <cart_opt_ctrl/cartesian_segment.hpp>
+#include <cart_opt_ctrl/cartesian_qp.hpp>
+#include <cart_opt_ctrl/CartesianTrajectory.h>
+
+namespace cart_opt_controllers
+{
+  /**
+   * \brief Tracks cartesian trajectories (pose, twist and acceleration per point) with the CartOptEffort QP.
+   * The trajectory is converted to quintic segments when received, the update only samples them
+   * so there is no chain traversal for the reference, only for the current state.
+   * Trajectories are sent on the command topic (cart_opt_ctrl/CartesianTrajectory) and replace the current one,
+   * the controller joins the first point from the current reference.
+   *
+   * \code
+   * cart_traj_controller:
+   *   type: "cart_opt_controllers/CartesianTrajectoryController"
+   *   joints: [joint_0, joint_1, joint_2, joint_3, joint_4, joint_5, joint_6]
+   *   cartesian_gains:
+   *     p_gains: [1000.0, 1000.0, 1000.0, 300.0, 300.0, 300.0]
+   *     d_gains: [50.0, 50.0, 50.0, 10.0, 10.0, 10.0]
+   *   regularisation_weights:
+   *     tau: 1.0e-05
+   *   damping_weight: [1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0]
+   *   torque_max: [200.0, 200.0, 100.0, 100.0, 100.0, 30.0, 30.0]
+   *   joint_vel_max: [1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0]
+   *   horizon_steps: 15
+   * \endcode
+   */
+  class CartesianTrajectoryController : public controller_interface::Controller<hardware_interface::CartOptEffortJointInterface>{
+    public:
+      CartesianTrajectoryController();
+
+      bool init(hardware_interface::CartOptEffortJointInterface* hw, ros::NodeHandle& root_nh, ros::NodeHandle& controller_nh);
+      void starting(const ros::Time& time);
+      void stopping(const ros::Time& time);
+      void update(const ros::Time& time, const ros::Duration& period);
+
+    protected:
+      // Segments between consecutive points, the time is relative to start_time
+      struct Trajectory{
+        ros::Time start_time;
+        double first_time;
+        KDL::Frame first_pose;
+        KDL::Twist first_vel, first_acc;
+        std::vector<CartesianSegment> segments;
+      };
+      typedef boost::shared_ptr<const Trajectory> TrajectoryPtr;
+
+      void commandCB(const cart_opt_ctrl::CartesianTrajectoryConstPtr& msg);
+      void sampleTrajectory(const ros::Time& time);
+
+      std::vector<hardware_interface::JointHandle> joint_handles_;
+      ros::Subscriber trajectory_command_sub_;
+      realtime_tools::RealtimeBuffer<TrajectoryPtr> trajectory_buffer_;
+      TrajectoryPtr trajectory_;
+      CartesianSegment entry_segment_;
+      unsigned int segment_index_;
+
+      // Chain chain_utils
+      rtt_ros_kdl_tools::ChainUtils arm_;
+      std::string ee_frame_;
+      Eigen::VectorXd joint_torque_out_, joint_position_in_, joint_velocity_in_;
+
+      KDL::Frame X_traj_, X_curr_;
+      KDL::Twist Xd_traj_, Xdd_traj_, Xd_curr_, X_err_, Xd_err_, Xdd_des_;
+      Eigen::Matrix<double,6,1> xdd_des_, jdot_qdot_;
+
+      CartesianQP qp_;
+
+      Eigen::VectorXd p_gains_, d_gains_, damping_weight_, torque_max_, jnt_vel_max_;
+      double regularisation_weight_, horizon_steps_, position_saturation_, orientation_saturation_;
+  };
+}
+
+#endif // CARTOPTCTRL_CARTTRAJCONTROLLER_HPP_
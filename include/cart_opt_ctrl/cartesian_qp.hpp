@@ -0,0 +1,51 @@
+#ifndef CARTOPTCTRL_CARTESIANQP_HPP_
+#define CARTOPTCTRL_CARTESIANQP_HPP_
+
+#include <Eigen/Core>
+#include <qpOASES.hpp>
+#include <memory>
+
+namespace cart_opt_controllers
+{
+  /**
+   * \brief QP of the ros_control controllers, over the joint torques :
+   * min || J.M^-1.( tau - C - G ) + Jdot.qdot - xdd_des ||^2 + the terms the controller adds to H and g,
+   * with tau within torque_max and the joint positions and velocities within their limits over horizon_dt
+   * (constraint rows M^-1.tau). The buffers are allocated in init(), the rest is allocation free.
+   */
+  class CartesianQP{
+    public:
+      CartesianQP();
+
+      // Allocates the buffers and the solver for dof joints
+      void init(int dof);
+
+      // The next solve starts from scratch
+      void reset() { initialized_ = false; }
+
+      // Sets H and g to the cartesian acceleration task, nonlinear_terms to M^-1.( C + G )
+      void setCartesianTask(const Eigen::Ref<const Eigen::MatrixXd>& jacobian, const Eigen::MatrixXd& mass_inv,
+                            const Eigen::VectorXd& coriolis, const Eigen::VectorXd& gravity,
+                            const Eigen::Matrix<double,6,1>& jdot_qdot, const Eigen::Matrix<double,6,1>& xdd_des);
+
+      // Torque bounds and joint limits, after setCartesianTask
+      void setLimits(const Eigen::MatrixXd& mass_inv, const Eigen::VectorXd& q, const Eigen::VectorXd& qd,
+                     const Eigen::VectorXd& q_min, const Eigen::VectorXd& q_max, const Eigen::VectorXd& qd_max,
+                     const Eigen::VectorXd& torque_max, double horizon_dt);
+
+      // Torque to send (without gravity, the robot adds it), zero if there is no solution
+      bool solve(const Eigen::VectorXd& gravity, Eigen::VectorXd& torque);
+
+      // NOTE: We need RowMajor (see qpoases doc)
+      Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> H, A;
+      Eigen::VectorXd g, lb, ub, lbA, ubA, nonlinear_terms;
+
+    protected:
+      Eigen::Matrix<double,6,Eigen::Dynamic> a_;
+      Eigen::Matrix<double,6,1> b_;
+      std::unique_ptr<qpOASES::SQProblem> solver_;
+      bool initialized_;
+  };
+}
+
+#endif // CARTOPTCTRL_CARTESIANQP_HPP_
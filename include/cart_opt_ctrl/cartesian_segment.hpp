@@ -0,0 +1,34 @@
+#ifndef CARTOPTCTRL_CARTESIANSEGMENT_HPP_
+#define CARTOPTCTRL_CARTESIANSEGMENT_HPP_
+
+#include <kdl/frames.hpp>
+#include <Eigen/Core>
+
+// Quintic interpolation between two cartesian states (pose, twist, acceleration).
+// The position is interpolated per axis, the orientation as a rotation vector
+// relative to the start orientation : R(t) = R0.Exp(theta(t)). The angular velocity is then
+// w = R0.Jl(theta).dtheta/dt with Jl the left jacobian of SO(3) (the identity at theta = 0 only),
+// the boundary angular velocities and accelerations are mapped through it so that they are met exactly.
+// The coefficients are computed once in init(), sample() evaluates polynomials and Jl.
+class CartesianSegment{
+  public:
+    CartesianSegment();
+
+    void init(double start_time, double duration,
+              const KDL::Frame& start_pose, const KDL::Twist& start_vel, const KDL::Twist& start_acc,
+              const KDL::Frame& end_pose, const KDL::Twist& end_vel, const KDL::Twist& end_acc);
+
+    // t is clamped to the segment
+    void sample(double t, KDL::Frame& pose, KDL::Twist& vel, KDL::Twist& acc) const;
+
+    double startTime() const { return start_time_; }
+    double endTime() const { return start_time_ + duration_; }
+
+  protected:
+    double start_time_, duration_;
+    KDL::Rotation start_rot_;
+    // One row per axis [x, y, z, theta_x, theta_y, theta_z], columns are the polynomial coefficients
+    Eigen::Matrix<double,6,6> coeffs_;
+};
+
+#endif // CARTOPTCTRL_CARTESIANSEGMENT_HPP_
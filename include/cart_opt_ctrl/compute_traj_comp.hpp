@@ -5,18 +5,15 @@
 #include <rtt/TaskContext.hpp>
 #include <rtt/InputPort.hpp>
 #include <rtt/OutputPort.hpp>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <rtt_ros_kdl_tools/tools.hpp>
+#include <rtt_ros_kdl_tools/chain_utils.hpp>
 
-#include <kdl/velocityprofile_trap.hpp>
-#include <kdl/trajectory_composite.hpp>
-#include <kdl/path_roundedcomposite.hpp>
-#include <kdl/path_point.hpp>
 #include <kdl/framevel.hpp>
-#include <kdl/rotational_interpolation_sa.hpp>
-#include <kdl/trajectory_stationary.hpp>
-#include <kdl/trajectory_segment.hpp>
 #include <kdl/utilities/error.h>
+#include <chrono>
 
 #include <tf_conversions/tf_kdl.h>
 #include <tf/transform_listener.h>
@@ -24,7 +21,12 @@
 #include <geometry_msgs/PoseArray.h>
 #include <nav_msgs/Path.h>
 #include <cart_opt_ctrl/UpdateWaypoints.h>
+#include <cart_opt_ctrl/PlayTrajectory.h>
+#include <cart_opt_ctrl/tracking_feedback.hpp>
+#include <cart_opt_ctrl/candidate_planner.hpp>
+#include <cart_opt_ctrl/trajectory_library.hpp>
 #include <std_msgs/Bool.h>
+#include <std_msgs/Float32.h>
 
 class KDLTrajCompute : public RTT::TaskContext{
   public:
@@ -36,9 +38,13 @@ class KDLTrajCompute : public RTT::TaskContext{
     void updateHook();
     void stopHook();
     
-    void publishTrajectory();
-    bool computeTrajectory();
+    // Path of a trajectory source (see below)
+    void publishTrajectory(int source);
+    // Plans the waypoints into plans_[plan]
+    bool computeTrajectory(int plan, double planning_budget = 0.0);
     bool updateWaypoints(cart_opt_ctrl::UpdateWaypoints::Request& req, cart_opt_ctrl::UpdateWaypoints::Response& resp);
+    // Plays a trajectory of the library by name, from its first sample
+    bool playTrajectory(cart_opt_ctrl::PlayTrajectory::Request& req, cart_opt_ctrl::PlayTrajectory::Response& resp);
     
   protected:
     // Output ports
@@ -46,24 +52,75 @@ class KDLTrajCompute : public RTT::TaskContext{
     RTT::OutputPort<KDL::Twist> port_pnt_vel_out_, port_pnt_acc_out_;
     RTT::OutputPort<nav_msgs::Path> port_path_out_;
     RTT::OutputPort<geometry_msgs::PoseArray> port_pose_array_out_;
+    RTT::OutputPort<double> port_speed_scale_out_;
+    RTT::OutputPort<Eigen::VectorXd> port_planning_stats_out_;
     
     // Input ports
     RTT::InputPort<bool> port_button_pressed_in_;
+    RTT::InputPort<double> port_speed_scale_in_;
+    RTT::InputPort<std_msgs::Float32> port_ec_lim_in_;
+    RTT::InputPort<Eigen::VectorXd> port_tracking_feedback_in_;
+    RTT::InputPort<Eigen::VectorXd> port_joint_position_in_;
     
+    // Trajectory sources : none, plans_[0] and plans_[1], then trajectory k of the library is LIBRARY + k
+    enum { NO_REQUEST = -2, NO_TRAJECTORY = -1, LIBRARY = 2 };
+
+    void updateSpeedScale();
+    // Asks updateHook to play source from its first sample at its next cycle, replacing a request it did not take yet.
+    // Returns the source updateHook plays
+    int requestTrajectory(int source);
+    bool waitForTrajectory();
+    double trajectoryDuration(int source) const;
+    void trajectoryPoint(int source, double time, KDL::Frame& pos, KDL::Twist& vel, KDL::Twist& acc) const;
+    void extractWaypoints(std::vector<KDL::Frame>& waypoints);
+    void makeCandidates();
+    void updatePlanningStats(const CandidatePlanner::Report& report);
+
     bool button_pressed_;
     geometry_msgs::PoseArray waypoints_in_;
     KDL::Frame current_pos_;
     KDL::Twist current_vel_, current_acc_;
     
     double current_traj_time_, vel_max_, acc_max_, radius_, eqradius_;
-    bool traj_computed_;
+    std::atomic<bool> traj_computed_;
     std::string base_frame_;
+
+    // Time scaling : the trajectory time progresses at speed_scale_ times the real time
+    double speed_scale_, speed_scale_rate_, speed_scale_in_, max_scale_rate_;
+    bool speed_scaling_policy_;
+    double reference_mass_;
+    std_msgs::Float32 ec_lim_in_;
+
+    // Path following : slow down when the controller cannot keep up
+    bool tracking_feedback_enabled_;
+    double slowdown_error_, pause_error_, limited_speed_scale_;
+    Eigen::VectorXd tracking_feedback_in_;
+
+    // Candidate planning : many timings of the same waypoints, the shortest feasible one is kept
+    bool candidate_planning_;
+    int planning_threads_;
+    double planning_budget_;
+    Eigen::VectorXd blend_scales_, vel_scales_, acc_scales_, joint_vel_max_;
+    double vel_limit_, acc_limit_, rot_vel_limit_, rot_acc_limit_, check_period_, tracking_tolerance_;
+    rtt_ros_kdl_tools::ChainUtils arm_;
+    CandidatePlanner planner_;
+    std::vector<PlanningCandidate> candidates_;
+    Eigen::VectorXd joint_position_in_, planning_stats_;
       
-    KDL::Path_RoundedComposite* path_;
-    KDL::Trajectory* traject_;
-    KDL::Trajectory_Composite* ctraject_;
-    KDL::VelocityProfile* vel_profile_;
-    KDL::RotationalInterpolation_SingleAxis* interpolator_;
+    // Two plans : the running one and the next one
+    TrajectoryPlan plans_[2];
+
+    // Pre-sampled trajectories, played by name
+    std::string trajectory_library_file_;
+    TrajectoryLibrary library_;
+
+    // Handover from the services to updateHook : a single atomic word holds the source updateHook plays and the one
+    // requested, taken at its next cycle. The services (one at a time) only plan into the plan that is neither played
+    // nor requested, so a plan is never rebuilt while updateHook samples it.
+    std::atomic<int64_t> handover_;
+    std::mutex service_mutex_;
+    // Played source, updateHook only
+    int source_;
     
     tf::TransformListener* tf_;
 };
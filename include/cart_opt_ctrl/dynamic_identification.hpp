@@ -0,0 +1,114 @@
+#ifndef CARTOPTCTRL_DYNAMICIDENTIFICATION_HPP_
+#define CARTOPTCTRL_DYNAMICIDENTIFICATION_HPP_
+
+#include <cart_opt_ctrl/batched_dynamics.hpp>
+#include <Eigen/Core>
+#include <cmath>
+#include <vector>
+
+// Periodic joint excitation, a finite Fourier series of nb_harmonics multiples of the base frequency w :
+//   q_j(t) = c_j + sum_l a_jl / (w.l).sin(w.l.t) - b_jl / (w.l).cos(w.l.t)
+// c_j puts q(0) at the start configuration. project() makes the velocity and the acceleration zero at t = 0,
+// so the trajectory starts and ends (after whole periods) at rest.
+class FourierExcitation{
+  public:
+    typedef BatchedDynamicsResult::Matrix Matrix;
+
+    FourierExcitation();
+
+    void init(const Eigen::VectorXd& start, int nb_harmonics, double base_frequency);
+    // Smallest change of the coefficients giving sum_l a_jl = 0 and sum_l l.b_jl = 0
+    void project();
+    // Largest scale of the coefficients keeping the samples of a period within [lower, upper], |qd| <= qd_max
+    // and |qdd| <= qdd_max, applied to the coefficients and returned
+    double scaleToLimits(const Eigen::VectorXd& lower, const Eigen::VectorXd& upper, const Eigen::VectorXd& qd_max,
+                         const Eigen::VectorXd& qdd_max, int nb_samples);
+
+    // q, qd, qdd sized to the number of joints
+    void sample(double t, Eigen::VectorXd& q, Eigen::VectorXd& qd, Eigen::VectorXd& qdd) const;
+    // nb_samples of [first, first + nb_samples.step[, one column per sample
+    void sample(double first, double step, int nb_samples, Matrix& q, Matrix& qd, Matrix& qdd) const;
+
+    int getNrOfJoints() const { return start_.size(); }
+    int getNrOfHarmonics() const { return sine_.cols(); }
+    double period() const { return 2.0 * M_PI / omega_; }
+    const Eigen::VectorXd& start() const { return start_; }
+    // nb_joints x nb_harmonics
+    Eigen::MatrixXd& sineCoefficients() { return sine_; }
+    Eigen::MatrixXd& cosineCoefficients() { return cosine_; }
+    const Eigen::MatrixXd& sineCoefficients() const { return sine_; }
+    const Eigen::MatrixXd& cosineCoefficients() const { return cosine_; }
+
+  protected:
+    Eigen::VectorXd start_;
+    Eigen::MatrixXd sine_, cosine_;
+    double omega_;
+};
+
+// Least squares identification of the inertial parameters of the segments (see BatchedDynamics::computeRegressor)
+// and optionally of a Coulomb and a viscous friction per joint, from joint samples (q, qd, qdd, tau).
+// Each batch of samples is reduced right away to the triangular factor R_j of the QR of [Y_j | tau_j] of every
+// joint (TSQR) : the memory does not depend on the amount of data and the batches are reduced by several threads.
+// solve() first does an ordinary least squares, takes the noise of each joint from its residuals, then solves
+// again with the rows of each joint weighted by 1/sigma_j. Only the identifiable combinations (base parameters)
+// are fitted, the change from the prior (the parameters of the model) is the smallest one in units of the mass
+// of each segment and of its length, so the directions the data does not see keep the prior.
+// Among the parameters that fit the data as well, a physically consistent set is then searched by alternate
+// projections, the segments that stay inconsistent are set back to the prior and the others solved again.
+class DynamicIdentification{
+  public:
+    struct Result{
+      // Segments in chain order (BatchedDynamics::NB_SEGMENT_PARAMETERS each), then with friction
+      // the coulomb friction of each joint followed by the viscous friction of each joint
+      Eigen::VectorXd parameters;
+      // Noise of each joint from the ordinary least squares, RMS residual of each joint
+      // with the prior and with the identified parameters (N.m)
+      Eigen::VectorXd sigma, prior_rms, rms;
+      int rank;
+      // Of the weighted regressor, columns scaled to unit norm, over the identified directions
+      double condition_number;
+      std::vector<int> prior_segments;
+    };
+
+    DynamicIdentification();
+
+    // friction_deadband : velocity under which the Coulomb friction column is 0
+    bool init(const BatchedDynamics& dynamics, bool friction, double friction_deadband = 0.01);
+    void clear();
+
+    // Samples are nb_joints x N each, reduced in batches of batch_size by nb_threads (0 means one per hardware thread)
+    void addSamples(const BatchedDynamicsResult::Matrix& q, const BatchedDynamicsResult::Matrix& qd,
+                    const BatchedDynamicsResult::Matrix& qdd, const BatchedDynamicsResult::Matrix& tau,
+                    unsigned int nb_threads = 0, int batch_size = 2048);
+
+    // rank_threshold : directions under this fraction of the largest are left to the prior
+    bool solve(Result& result, double rank_threshold = 1e-6) const;
+
+    long getNrOfSamples() const { return nb_samples_; }
+    int getNrOfParameters() const { return prior_.size(); }
+    const Eigen::VectorXd& prior() const { return prior_; }
+
+  protected:
+    // Triangular factor of [stacked; block]
+    static void reduce(Eigen::MatrixXd& r, const Eigen::MatrixXd& block);
+    // Samples [first, last[ into the factors r of each joint, with a single threaded copy of the dynamics
+    void reduceBatch(const BatchedDynamics& dynamics, const BatchedDynamicsResult::Matrix& q, const BatchedDynamicsResult::Matrix& qd,
+                     const BatchedDynamicsResult::Matrix& qdd, const BatchedDynamicsResult::Matrix& tau,
+                     int first, int last, std::vector<Eigen::MatrixXd>& r) const;
+    // Weighted least squares keeping the fixed segments at the prior, the columns of null_space
+    // are the directions the data does not see (orthonormal in the units of the segments)
+    void solveWeighted(const Eigen::VectorXd& weights, const std::vector<bool>& fixed, double rank_threshold,
+                       Eigen::VectorXd& parameters, int& rank, double& condition_number, Eigen::MatrixXd* null_space = 0) const;
+    // Alternate projections on the physically consistent segments and on parameters + null_space, true when consistent
+    bool makePhysical(const std::vector<bool>& fixed, const Eigen::MatrixXd& null_space, Eigen::VectorXd& parameters) const;
+    double residual(int joint, const Eigen::VectorXd& parameters) const;
+
+    BatchedDynamics dynamics_;
+    bool friction_;
+    double friction_deadband_;
+    Eigen::VectorXd prior_, scales_;
+    std::vector<Eigen::MatrixXd> r_;
+    long nb_samples_;
+};
+
+#endif // CARTOPTCTRL_DYNAMICIDENTIFICATION_HPP_
@@ -0,0 +1,76 @@
+#ifndef CARTOPTCTRL_FREQUENCYRESPONSE_HPP_
+#define CARTOPTCTRL_FREQUENCYRESPONSE_HPP_
+
+#include <complex>
+#include <string>
+#include <vector>
+
+// Excitation setpoints for the closed loop frequency response, normalized to a peak of 1 and sampled every period.
+//  - CHIRP : logarithmic sweep from f_min to f_max over duration, faded in and out over a tenth of it
+//  - MULTISINE : nb_sines log spaced sines with Schroeder phases (low crest factor) on the bins of a period of
+//    a power of two samples, at least 1/f_min long. The period is played after a fade in period, nb_periods times,
+//    then once more faded out : the response is periodic over the measured periods, no leakage.
+// The frequencies are fixed by init(), sample() is RT safe.
+class ExcitationSignal{
+  public:
+    enum Type {CHIRP, MULTISINE};
+
+    ExcitationSignal();
+
+    bool init(Type type, double f_min, double f_max, double duration, double period, int nb_sines, int nb_periods);
+    // Setpoint and its derivatives at sample k, 0 outside the signal
+    void sample(int k, double& x, double& xd, double& xdd) const;
+
+    Type type() const { return type_; }
+    int size() const { return size_; }
+    double period() const { return period_; }
+    double duration() const { return size_ * period_; }
+    double minFrequency() const { return f_min_; }
+    double maxFrequency() const { return f_max_; }
+    // Samples used by the estimation
+    int analysisStart() const { return analysis_start_; }
+    int analysisSize() const { return analysis_size_; }
+    // Multisine : samples in a period and excited FFT bins of a period
+    int periodSize() const { return period_size_; }
+    const std::vector<int>& bins() const { return bins_; }
+
+  protected:
+    void window(double t, double& w, double& wd, double& wdd) const;
+
+    Type type_;
+    double f_min_, f_max_, period_, end_, fade_, rate_, scale_;
+    int size_, analysis_start_, analysis_size_, period_size_;
+    std::vector<int> bins_;
+    std::vector<double> omegas_, phases_;
+};
+
+// Closed loop response H = Y/U of the captured output (measured displacement) to the input (setpoint)
+// with the H1 estimate sum(Y.U*) / sum(|U|^2) : over the measured periods for a multisine,
+// over log spaced bands (10 per decade) of the zero padded record for a chirp.
+// The loop is assumed to have unity feedback for the phase margin : L = H / (1 - H).
+class FrequencyResponse{
+  public:
+    struct Resonance{
+      double frequency, gain;
+    };
+    struct Result{
+      // Hz, linear gain and degrees (unwrapped)
+      std::vector<double> frequencies, gains, phases;
+      double low_frequency_gain;
+      // -3dB from the low frequency gain, where |L| crosses 1 and 180 + arg(L) there
+      double bandwidth, crossover, phase_margin;
+      bool bandwidth_found, margin_found;
+      // Local maxima above resonance_ratio times the low frequency gain, highest first
+      std::vector<Resonance> resonances;
+    };
+
+    // Allocates, not for the RT thread
+    static bool estimate(const ExcitationSignal& signal, const double* input, const double* output, Result& result,
+                         double resonance_ratio = 1.1);
+    // frequency (Hz), gain (dB), phase (deg) per line
+    static bool save(const std::string& file, const Result& result);
+    // In place radix 2 FFT, the size must be a power of two
+    static void fft(std::vector<std::complex<double> >& data);
+};
+
+#endif // CARTOPTCTRL_FREQUENCYRESPONSE_HPP_
@@ -0,0 +1,74 @@
+#ifndef CARTOPTCTRL_FRICTIONIDENTCOMP_HPP_
+#define CARTOPTCTRL_FRICTIONIDENTCOMP_HPP_
+
+#include <rtt/Component.hpp>
+#include <rtt/TaskContext.hpp>
+#include <rtt/InputPort.hpp>
+#include <rtt/OutputPort.hpp>
+#include <rtt_ros_kdl_tools/tools.hpp>
+#include <rtt_ros_kdl_tools/chain_utils.hpp>
+
+#include <cart_opt_ctrl/friction_model.hpp>
+
+// Identification of the joint friction (see FrictionModel) with slow constant velocity sweeps, one joint at a time
+// while the others hold their initial position. It takes the place of CartOptCtrl on JointTorqueCommand : the joints
+// follow trapezoidal profiles with a joint PD and the inertia and Coriolis feedforward (the robot adds the gravity),
+// so the PD torque on the constant velocity part of a sweep is the friction at that velocity.
+// Each selected joint sweeps sweep_range around its initial position at each of sweep_velocities, in both directions.
+// The sweeps are then played again with the identified compensation (see FrictionTable) and the RMS position error
+// of both passes is logged. The parameters are written to friction_file on stop, as CartOptCtrl rosparams.
+class FrictionIdentComp : public RTT::TaskContext{
+  public:
+    FrictionIdentComp(const std::string& name);
+    virtual ~FrictionIdentComp(){}
+
+    bool configureHook();
+    bool startHook();
+    void updateHook();
+    void stopHook();
+
+  protected:
+    // Offsets from the initial position of the joint
+    struct Sweep{
+      int joint;
+      double from, to, velocity;
+      bool recorded, compensated;
+    };
+
+    double sweepDuration(const Sweep& sweep) const;
+    // Offset and its derivatives at t, steady on the recorded part of the constant velocity phase
+    void sampleSweep(const Sweep& sweep, double t, double& s, double& sd, double& sdd, bool& steady) const;
+    bool identify();
+    bool writeParameters(const std::string& file) const;
+
+    // Input ports
+    RTT::InputPort<Eigen::VectorXd> port_joint_position_in_;
+    RTT::InputPort<Eigen::VectorXd> port_joint_velocity_in_;
+
+    // Output ports
+    RTT::OutputPort<Eigen::VectorXd> port_joint_torque_out_;
+
+    rtt_ros_kdl_tools::ChainUtils arm_;
+    Eigen::VectorXd joint_position_in_, joint_velocity_in_, joint_torque_out_;
+    Eigen::VectorXd q_start_, q_des_, qd_des_, qdd_des_, friction_torque_;
+
+    Eigen::VectorXd p_gains_, d_gains_, select_joints_, sweep_velocities_, jnt_vel_max_;
+    double sweep_range_, sweep_acc_, settle_time_, deadband_;
+    std::string friction_file_;
+
+    std::vector<Sweep> sweeps_;
+    int current_sweep_;
+    double sweep_time_;
+    bool has_start_, identified_, done_;
+
+    // Mean velocity and torque of each sweep, squared position errors (joint x pass)
+    std::vector<double> sum_vel_, sum_torque_;
+    std::vector<int> nb_samples_;
+    Eigen::MatrixXd error_sq_, error_count_;
+
+    std::vector<FrictionModel::Parameters> params_;
+    FrictionTable table_;
+};
+
+ORO_LIST_COMPONENT_TYPE( FrictionIdentComp )
+#endif // CARTOPTCTRL_FRICTIONIDENTCOMP_HPP_
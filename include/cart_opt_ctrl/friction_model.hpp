@@ -0,0 +1,68 @@
+#ifndef CARTOPTCTRL_FRICTIONMODEL_HPP_
+#define CARTOPTCTRL_FRICTIONMODEL_HPP_
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <vector>
+
+// Joint friction with Coulomb, Stribeck and viscous terms :
+//   tau_f(v) = (fc + (fs - fc).exp(-(v/vs)^2)).sign(v) + fv.v
+// identified from steady state (velocity, torque) points of constant velocity sweeps in both directions.
+class FrictionModel{
+  public:
+    struct Parameters{
+      double coulomb, stat, stribeck_velocity, viscous;
+    };
+
+    static double torque(const Parameters& p, double v);
+
+    // Least squares fit, linear in fc, fs, fv and an offset for a given vs : vs is searched on a log grid
+    // and the one with the smallest residual is kept. The offset absorbs the part of the torques that does not
+    // change sign with the velocity (gravity model error), it is not part of the model.
+    // Needs points at 2 velocities at least in each direction.
+    static bool fit(const std::vector<double>& velocities, const std::vector<double>& torques, Parameters& p, double* rms = 0);
+};
+
+// tau_f of every joint from tables of nb_samples over [-v_max, v_max], linearly interpolated and clamped
+// beyond, without branches so the cost does not depend on the velocities. Under deadband the sign is replaced
+// by a linear ramp so the compensation does not chatter at rest : the step is deadband/2 at most so that
+// the interpolation keeps the ramp (a coarser step would spread the step of the sign over a whole cell).
+class FrictionTable{
+  public:
+    // Size without deadband, and largest table of a joint
+    static const int DEFAULT_SIZE = 257;
+    static const int MAX_SIZE = 65537;
+
+    FrictionTable();
+
+    // Smallest number of samples with a step of deadband/2 at most over [-v_max, v_max]
+    static int requiredSize(double v_max, double deadband);
+
+    // Allocates the tables (not RT safe), nb_samples = 0 takes the smallest size that keeps the ramp of all the joints.
+    // Fails if nb_samples is too small for the deadband or the size is over MAX_SIZE.
+    bool configure(const std::vector<FrictionModel::Parameters>& params, const Eigen::VectorXd& v_max, double deadband,
+                   int nb_samples = 0);
+
+    double torque(int joint, double v) const{
+      const double s = std::min(std::max((v - v_min_[joint]) * inv_step_[joint], 0.0), last_);
+      const int i = static_cast<int>(s);
+      const double* t = &table_[joint * nb_samples_ + i];
+      return t[0] + (s - i) * (t[1] - t[0]);
+    }
+
+    // Allocation free
+    void compute(const Eigen::VectorXd& v, Eigen::VectorXd& torque) const{
+      for(int j=0; j<v.size(); j++)
+        torque[j] = this->torque(j,v[j]);
+    }
+
+    int getNrOfJoints() const { return v_min_.size(); }
+
+  protected:
+    int nb_samples_;
+    double last_;
+    Eigen::VectorXd v_min_, inv_step_;
+    std::vector<double> table_;
+};
+
+#endif // CARTOPTCTRL_FRICTIONMODEL_HPP_
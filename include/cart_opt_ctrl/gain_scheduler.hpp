@@ -0,0 +1,34 @@
+#ifndef CARTOPTCTRL_GAINSCHEDULER_HPP_
+#define CARTOPTCTRL_GAINSCHEDULER_HPP_
+
+#include <Eigen/Core>
+
+// Maps (effective inertia, payload, cartesian speed) to a set of cartesian PD gains.
+// The table is a regular grid, flattened in row major order :
+//   gains( (i_lambda * n_payload + i_payload) * n_speed + i_speed ) = [g_x, g_y, g_z, g_rx, g_ry, g_rz]
+// Queries outside the grid are clamped to its border.
+class GainScheduler{
+  public:
+    static const int NB_AXES = 3;
+    static const int NB_GAINS = 6;
+
+    GainScheduler();
+
+    // Checks the table dimensions and precomputes the grid steps (not RT safe)
+    bool configure(const Eigen::VectorXd& axis_min, const Eigen::VectorXd& axis_max, const Eigen::VectorXd& axis_samples,
+                   const Eigen::VectorXd& p_table, const Eigen::VectorXd& d_table);
+
+    // Trilinear interpolation of the gains, no allocation and no branching on the query values.
+    // Returns false, leaving the gains untouched, if a query value is not finite
+    bool interpolate(double lambda, double payload, double speed, Eigen::VectorXd& p_gains, Eigen::VectorXd& d_gains) const;
+
+    bool isConfigured() const { return configured_; }
+
+  protected:
+    bool configured_;
+    Eigen::Matrix<double,NB_AXES,1> min_, inv_step_, max_index_;
+    Eigen::Matrix<int,NB_AXES,1> samples_, strides_;
+    Eigen::Matrix<double,NB_GAINS,Eigen::Dynamic> p_table_, d_table_;
+};
+
+#endif // CARTOPTCTRL_GAINSCHEDULER_HPP_
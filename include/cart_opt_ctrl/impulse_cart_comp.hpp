@@ -10,18 +10,52 @@
 #include <rtt_ros_kdl_tools/chain_utils.hpp>
 
 #include <kdl/utilities/error.h>
+#include <cart_opt_ctrl/frequency_response.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
+// Layout of the FrequencyResponse vector sent by ImpulseComp after each excitation,
+// frequencies in Hz, phase margin in degrees, 0 when not found in the excited range
+namespace ResponseSummary
+{
+  enum Index {
+    LOW_FREQUENCY_GAIN = 0,
+    BANDWIDTH,
+    CROSSOVER,
+    PHASE_MARGIN,
+    PEAK_FREQUENCY,         // highest resonance
+    PEAK_GAIN,
+    NB_RESONANCES,
+    SIZE
+  };
+}
+
+// Sends a step (mode "step") or an excitation (mode "chirp" or "multisine", see ExcitationSignal)
+// along an axis of the end effector when send_impulse is set.
+// During an excitation the setpoint offset and the measured offset along the axis are captured in buffers
+// allocated at configure, then a thread estimates the closed loop frequency response (see FrequencyResponse)
+// and logs the bandwidth, phase margin and resonances. The excitation frequencies are read at configure.
 class ImpulseComp : public RTT::TaskContext{
   public:
     ImpulseComp(const std::string& name);
-    virtual ~ImpulseComp(){}
+    virtual ~ImpulseComp();
 
     bool configureHook();
     bool startHook();
     void updateHook();
     void stopHook();
+    void cleanupHook();
     
   protected:
+    enum ExcitationState {IDLE, EXCITING, ANALYSING};
+
+    bool startExcitation();
+    void updateExcitation();
+    void analysisLoop();
+    void stopAnalysis();
+
     // Input ports
     RTT::InputPort<Eigen::VectorXd> port_joint_position_in_;
     RTT::InputPort<Eigen::VectorXd> port_joint_velocity_in_;
@@ -30,6 +64,7 @@ class ImpulseComp : public RTT::TaskContext{
     RTT::OutputPort<KDL::Frame> port_pnt_pos_out_;
     RTT::OutputPort<KDL::Twist> port_pnt_vel_out_;
     RTT::OutputPort<KDL::Twist> port_pnt_acc_out_;
+    RTT::OutputPort<Eigen::VectorXd> port_response_out_;
     
     KDL::Frame current_pos_;
     KDL::Twist current_vel_, current_acc_;
@@ -45,6 +80,24 @@ class ImpulseComp : public RTT::TaskContext{
     
     KDL::Frame start_pose_, goal_pose_;
     KDL::Twist zero_vel_, zero_acc_;
+
+    // Excitation
+    std::string mode_, response_file_;
+    double f_min_, f_max_, excitation_duration_;
+    int nb_sines_, nb_periods_;
+    ExcitationSignal signal_;
+    KDL::Vector excitation_axis_;
+    bool excitation_rot_;
+    int excitation_sample_;
+    std::vector<double> input_, output_;
+    Eigen::VectorXd response_summary_;
+
+    // Analysis thread, woken when the capture is complete
+    std::atomic<int> state_;
+    std::thread analysis_thread_;
+    std::mutex analysis_mutex_;
+    std::condition_variable analysis_wake_;
+    bool stop_analysis_;
 };
 
 ORO_LIST_COMPONENT_TYPE( ImpulseComp )
@@ -0,0 +1,26 @@
+#ifndef CARTOPTCTRL_JOINTACCELERATIONLIMIT_HPP_
+#define CARTOPTCTRL_JOINTACCELERATIONLIMIT_HPP_
+
+#include <cart_opt_ctrl/qp_plugin.hpp>
+
+namespace cart_opt_ctrl
+{
+  // Bounds the joint accelerations : qdd_min <= M^-1.tau - M^-1.(C.qd + G) <= qdd_max
+  // Parameters (in the plugin namespace) :
+  //   joint_acc_max : [..] one per joint (rad/s^2)
+  //   slack_weight : L1 penalty with soft_constraints (default 0, hard)
+  class JointAccelerationLimit : public QPPlugin{
+    public:
+      bool configure(const std::string& ns, int dof);
+      int rows() const { return dof_; }
+      double slackWeight() const { return slack_weight_; }
+      void update(const QPState& state, QPSlice& slice);
+
+    protected:
+      int dof_;
+      double slack_weight_;
+      Eigen::VectorXd joint_acc_max_;
+  };
+}
+
+#endif // CARTOPTCTRL_JOINTACCELERATIONLIMIT_HPP_
@@ -0,0 +1,44 @@
+#ifndef CARTOPTCTRL_JOINTRECORD_HPP_
+#define CARTOPTCTRL_JOINTRECORD_HPP_
+
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+
+// Joint states and torques of the control loop, for the offline identification of the dynamic parameters
+// (see dynamic_identifier). Same ring as QPRecord : the buffer is allocated in configure(), push() only copies
+// so it can run in the control loop, save() writes the samples from the oldest on.
+// File : "CJRC", int32 nb_joints, count, flags, then per sample t (s), q, qd, measured torque, commanded torque (nb_joints each).
+// Without MEASURED_TORQUE in the flags there was no torque sensor and the measured torque is a copy of the command.
+class JointRecord{
+  public:
+    enum Flags { MEASURED_TORQUE = 1 };
+
+    JointRecord();
+
+    // Allocates capacity samples (not RT safe)
+    void configure(int nb_joints, int capacity, int flags = 0);
+    void clear();
+    void push(double time, const Eigen::VectorXd& q, const Eigen::VectorXd& qd, const Eigen::VectorXd& tau_measured, const Eigen::VectorXd& tau_command);
+
+    bool save(const std::string& file) const;
+    bool load(const std::string& file);
+
+    int size() const { return count_; }
+    int getNrOfJoints() const { return nb_joints_; }
+    int flags() const { return flags_; }
+    // Sample i, 0 is the oldest
+    double time(int i) const { return *sample(i); }
+    const double* q(int i) const { return sample(i) + 1; }
+    const double* qd(int i) const { return q(i) + nb_joints_; }
+    const double* tauMeasured(int i) const { return qd(i) + nb_joints_; }
+    const double* tauCommand(int i) const { return tauMeasured(i) + nb_joints_; }
+
+  protected:
+    const double* sample(int i) const { return data_.data() + ((first_ + i) % capacity_) * sample_size_; }
+
+    int nb_joints_, flags_, capacity_, sample_size_, first_, count_;
+    std::vector<double> data_;
+};
+
+#endif // CARTOPTCTRL_JOINTRECORD_HPP_
@@ -0,0 +1,38 @@
+#ifndef CARTOPTCTRL_MOMENTUMOBSERVER_HPP_
+#define CARTOPTCTRL_MOMENTUMOBSERVER_HPP_
+
+#include <Eigen/Core>
+
+// Generalized momentum residual (De Luca et al.) :
+//   r = K_O.( M.qd - p0 - integral( tau + C^T.qd - g + r ) )
+// which is a first order filtered estimate of the external joint torques, dr/dt = K_O.(tau_ext - r).
+// C^T.qd is not available from the model, it is obtained with C^T.qd = Mdot.qd - C.qd
+// and Mdot by finite differences of the inertia matrix over the interval since the previous update.
+// All the buffers are allocated in configure(), update() is O(dof^2) and allocation free.
+class MomentumObserver{
+  public:
+    MomentumObserver();
+
+    // Resizes the buffers (not RT safe)
+    bool configure(int dof, const Eigen::VectorXd& gains);
+
+    // The next update restarts the integration from the current momentum
+    void reset();
+
+    // coriolis is C(q,qd).qd, tau the torque applied on the joints since the previous update (gravity included)
+    // and dt the time elapsed since then, the residual is kept when dt is not positive
+    const Eigen::VectorXd& update(const Eigen::MatrixXd& inertia, const Eigen::VectorXd& coriolis, const Eigen::VectorXd& gravity,
+                                  const Eigen::VectorXd& qd, const Eigen::VectorXd& tau, double dt);
+
+    // True if one of the residuals exceeds its threshold
+    bool exceeds(const Eigen::VectorXd& thresholds) const;
+
+    const Eigen::VectorXd& getResidual() const { return residual_; }
+
+  protected:
+    bool initialized_;
+    Eigen::VectorXd gains_, residual_, p0_, integral_, momentum_, beta_;
+    Eigen::MatrixXd inertia_prev_, inertia_dot_;
+};
+
+#endif // CARTOPTCTRL_MOMENTUMOBSERVER_HPP_
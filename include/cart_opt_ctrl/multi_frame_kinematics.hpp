@@ -0,0 +1,78 @@
+#ifndef CARTOPTCTRL_MULTIFRAMEKINEMATICS_HPP_
+#define CARTOPTCTRL_MULTIFRAMEKINEMATICS_HPP_
+
+#include <cart_opt_ctrl/batched_dynamics.hpp>
+#include <kdl/frames.hpp>
+#include <string>
+
+// Pose, velocity, jacobian and Jdot.qdot of several frames of the chain from a single sweep.
+// The frames are segment names resolved once into handles by addFrame() (not RT safe),
+// update() then walks the chain once and fills every registered frame without any lookup or allocation.
+// Jacobians and Jdot.qdot have their reference point at the frame origin and are expressed in the base frame
+// (same as ChainUtils::getSegmentJacobian and getSegmentJdotQdot).
+class MultiFrameKinematics{
+  public:
+    typedef Eigen::Matrix<double,6,1> Vector6d;
+    typedef Eigen::Matrix<double,6,Eigen::Dynamic> Jacobian;
+
+    MultiFrameKinematics();
+
+    bool init(const KDL::Chain& chain);
+    // segment_names in chain order, one per segment
+    bool init(const BatchedDynamics::SegmentModels& segments, const std::vector<std::string>& segment_names, int nb_joints);
+
+    // Handle of the frame at the tip of the segment, the same for a name already added, -1 if unknown
+    int addFrame(const std::string& segment_name);
+    void clearFrames();
+    int getNrOfFrames() const { return frames_.size(); }
+    int getNrOfJoints() const { return nb_joints_; }
+    int getSegmentIndex(int handle) const { return frames_[handle].segment; }
+    const std::string& getFrameName(int handle) const { return segment_names_[frames_[handle].segment]; }
+
+    // One pass over the chain for all the frames, q and qd have getNrOfJoints() elements
+    void update(const Eigen::VectorXd& q, const Eigen::VectorXd& qd);
+
+    const KDL::Frame& getPose(int handle) const { return frames_[handle].pose; }
+    const Eigen::Matrix3d& getRotation(int handle) const { return frames_[handle].rotation; }
+    const Eigen::Vector3d& getPosition(int handle) const { return frames_[handle].position; }
+    // [linear, angular]
+    const Vector6d& getTwist(int handle) const { return frames_[handle].twist; }
+    const Jacobian& getJacobian(int handle) const { return frames_[handle].jacobian; }
+    const Vector6d& getJdotQdot(int handle) const { return frames_[handle].jdot_qdot; }
+
+  protected:
+    struct Frame{
+      int segment;
+      KDL::Frame pose;
+      Eigen::Matrix3d rotation;
+      Eigen::Vector3d position;
+      Vector6d twist, jdot_qdot;
+      Jacobian jacobian;
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    // State of a joint in the base frame : axis, point on the axis and its velocity,
+    // angular velocity of the parent link (the axis turns with it)
+    struct JointState{
+      Eigen::Vector3d z, o, o_dot, w_parent;
+      bool rotational;
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+    // Tip frame of a segment and the velocity of its origin
+    struct SegmentState{
+      Eigen::Matrix3d rotation;
+      Eigen::Vector3d position, w, v;
+      int nb_joints;  // joints between the base and the tip
+      EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    };
+
+    void computeFrame(Frame& frame, const Eigen::VectorXd& qd);
+
+    BatchedDynamics::SegmentModels segments_;
+    std::vector<std::string> segment_names_;
+    int nb_joints_;
+    std::vector<JointState, Eigen::aligned_allocator<JointState> > joints_;
+    std::vector<SegmentState, Eigen::aligned_allocator<SegmentState> > segment_states_;
+    std::vector<Frame, Eigen::aligned_allocator<Frame> > frames_;
+};
+
+#endif // CARTOPTCTRL_MULTIFRAMEKINEMATICS_HPP_
@@ -0,0 +1,63 @@
+#ifndef CARTOPTCTRL_ONLINETRAJCOMP_HPP_
+#define CARTOPTCTRL_ONLINETRAJCOMP_HPP_
+
+#include <rtt/Component.hpp>
+#include <rtt/TaskContext.hpp>
+#include <rtt/InputPort.hpp>
+#include <rtt/OutputPort.hpp>
+#include <rtt_ros_kdl_tools/tools.hpp>
+#include <rtt_ros_kdl_tools/chain_utils.hpp>
+#include <kdl_conversions/kdl_msg.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/Twist.h>
+
+#include <cart_opt_ctrl/online_traj_gen.hpp>
+
+// Reactive setpoints for CartOptCtrl (teleoperation, visual servoing) : the targets sent on
+// TargetPose / TargetTwist can change at every period, the reference is moved one jerk limited
+// step towards the last one and written on the same ports as KDLTrajCompute.
+// The reference starts from the current end effector pose at the first update.
+// The targets are expressed in the base frame of the chain.
+class OnlineTrajComp : public RTT::TaskContext{
+  public:
+    OnlineTrajComp(const std::string& name);
+    virtual ~OnlineTrajComp(){}
+
+    bool configureHook();
+    bool startHook();
+    void updateHook();
+    void stopHook();
+
+  protected:
+    // Input ports
+    RTT::InputPort<Eigen::VectorXd> port_joint_position_in_;
+    RTT::InputPort<Eigen::VectorXd> port_joint_velocity_in_;
+    RTT::InputPort<geometry_msgs::PoseStamped> port_target_pose_in_;
+    RTT::InputPort<geometry_msgs::Twist> port_target_twist_in_;
+
+    // Output ports
+    RTT::OutputPort<KDL::Frame> port_pnt_pos_out_;
+    RTT::OutputPort<KDL::Twist> port_pnt_vel_out_;
+    RTT::OutputPort<KDL::Twist> port_pnt_acc_out_;
+    RTT::OutputPort<bool> port_target_reached_out_;
+
+    OnlineTrajectoryGenerator otg_;
+    bool reference_initialized_;
+    double twist_elapsed_;
+
+    rtt_ros_kdl_tools::ChainUtils arm_;
+    Eigen::VectorXd joint_position_in_,
+                joint_velocity_in_;
+    std::string ee_frame_;
+
+    geometry_msgs::PoseStamped target_pose_in_;
+    geometry_msgs::Twist target_twist_in_;
+    KDL::Frame target_pose_;
+    KDL::Twist target_twist_;
+
+    double vel_max_, acc_max_, jerk_max_, rot_vel_max_, rot_acc_max_, rot_jerk_max_;
+    double twist_timeout_, position_tolerance_, rotation_tolerance_;
+};
+
+ORO_LIST_COMPONENT_TYPE( OnlineTrajComp )
+#endif // CARTOPTCTRL_ONLINETRAJCOMP_HPP_
@@ -0,0 +1,56 @@
+#ifndef CARTOPTCTRL_ONLINETRAJGEN_HPP_
+#define CARTOPTCTRL_ONLINETRAJGEN_HPP_
+
+#include <kdl/frames.hpp>
+#include <Eigen/Core>
+
+// Single cycle jerk limited trajectory generator : the reference state (pose, twist, acceleration)
+// is moved one period towards the target every update, the target can change at any time
+// and the reference continues from its current state (no restart from rest).
+// Each axis [x, y, z, rot_x, rot_y, rot_z] is limited independently, the orientation is handled
+// as the rotation vector from the reference to the target (in the base frame).
+// Per axis the jerk is chosen from cascaded braking curves evaluated on the state reached
+// once the acceleration is brought back to zero : position error -> velocity -> acceleration -> jerk.
+// Near the target the curves are replaced by linear ones so the discrete loop does not chatter.
+// update() is O(1) and allocation free.
+class OnlineTrajectoryGenerator{
+  public:
+    OnlineTrajectoryGenerator();
+
+    // Limits, first 3 components for the translation, last 3 for the rotation
+    bool setLimits(const Eigen::Matrix<double,6,1>& vel_max,
+                   const Eigen::Matrix<double,6,1>& acc_max,
+                   const Eigen::Matrix<double,6,1>& jerk_max);
+
+    // Restarts from the given state, the target is set to the pose
+    void reset(const KDL::Frame& pose, const KDL::Twist& vel = KDL::Twist::Zero(), const KDL::Twist& acc = KDL::Twist::Zero());
+
+    // Reach the pose with zero velocity
+    void setTargetPose(const KDL::Frame& target);
+    // Reach the twist (clamped to vel_max) and keep it
+    void setTargetTwist(const KDL::Twist& target);
+
+    // Moves the reference dt forward
+    void update(double dt);
+
+    // True when tracking a pose, close to it and (almost) stopped
+    bool targetReached(double position_tolerance, double rotation_tolerance) const;
+
+    bool trackingTwist() const { return !position_mode_; }
+    const KDL::Frame& getPose() const { return pose_; }
+    const KDL::Twist& getTwist() const { return vel_; }
+    const KDL::Twist& getAcceleration() const { return acc_; }
+
+  protected:
+    // One axis step, error is target - position, returns the position increment
+    static double axisStep(bool position_mode, double error, double target_vel,
+                           double vel_max, double acc_max, double jerk_max, double dt,
+                           double& vel, double& acc);
+
+    bool position_mode_;
+    KDL::Frame pose_, target_pose_;
+    KDL::Twist vel_, acc_, target_vel_;
+    Eigen::Matrix<double,6,1> vel_max_, acc_max_, jerk_max_;
+};
+
+#endif // CARTOPTCTRL_ONLINETRAJGEN_HPP_
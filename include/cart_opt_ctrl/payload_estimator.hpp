@@ -0,0 +1,67 @@
+#ifndef CARTOPTCTRL_PAYLOADESTIMATOR_HPP_
+#define CARTOPTCTRL_PAYLOADESTIMATOR_HPP_
+
+#include <Eigen/Core>
+
+// Recursive least squares identification of the inertial parameters of a payload
+// rigidly attached to a frame (usually the FT sensor frame).
+// The parameters are expressed in that frame, about its origin :
+//   phi = [m, m.cx, m.cy, m.cz, Ixx, Ixy, Ixz, Iyy, Iyz, Izz]
+// and relate to the wrench applied by the frame on the payload with w = A(a, w, dw, g).phi
+class PayloadEstimator{
+  public:
+    static const int NB_PARAMS = 10;
+    typedef Eigen::Matrix<double,NB_PARAMS,1> Parameters;
+    typedef Eigen::Matrix<double,6,NB_PARAMS> Regressor;
+
+    PayloadEstimator();
+
+    // Also bounds the trace of the covariance to its initial value
+    void reset(double initial_covariance);
+    void setForgettingFactor(double lambda){ forgetting_factor_ = lambda; }
+
+    // Builds A from the frame kinematics, everything expressed in the payload frame :
+    // linear acceleration of the origin, angular velocity, angular acceleration and gravity
+    static void computeRegressor(const Eigen::Vector3d& acc, const Eigen::Vector3d& omega,
+                                 const Eigen::Vector3d& domega, const Eigen::Vector3d& gravity, Regressor& A);
+
+    // Positive mass and inertia about the center of mass satisfying the triangle inequalities, or all zero.
+    // Same layout as the segment parameters of BatchedDynamics, so these also apply to the identified segments
+    static bool isPhysical(const double* parameters);
+    // Nearest parameters with the eigenvalues of the pseudo inertia [0.5.tr(I).Id - I, h; h^T, m] over min_eigenvalue
+    static void projectPhysical(double* parameters, double min_eigenvalue);
+
+    // One RLS step for a block of measurements y = Y.phi, rows are processed one after the other
+    // so that there is no matrix inversion, the forgetting factor is applied once per block
+    template<typename Derived, typename DerivedY>
+    void update(const Eigen::MatrixBase<Derived>& Y, const Eigen::MatrixBase<DerivedY>& y){
+      for(int i=0; i<Y.rows(); i++){
+        const double lambda = (i == Y.rows() - 1) ? forgetting_factor_ : 1.0;
+        row_ = Y.row(i).transpose();
+        p_row_.noalias() = P_ * row_;
+        gain_ = p_row_ / (lambda + row_.dot(p_row_));
+        phi_ += gain_ * (y(i) - row_.dot(phi_));
+        P_ -= gain_ * p_row_.transpose();
+        P_ /= lambda;
+      }
+      // The rank one updates drift from symmetric, with forgetting P then stops being positive definite
+      P_ = 0.5 * (P_ + P_.transpose()).eval();
+      // Without excitation the forgetting factor inflates P without bound, the next noisy sample would then throw the estimate off
+      const double trace = P_.trace();
+      if(trace > max_covariance_trace_)
+        P_ *= max_covariance_trace_ / trace;
+      nb_updates_++;
+    }
+
+    const Parameters& getParameters() const { return phi_; }
+    const Eigen::Matrix<double,NB_PARAMS,NB_PARAMS>& getCovariance() const { return P_; }
+    unsigned int getNbUpdates() const { return nb_updates_; }
+
+  protected:
+    double forgetting_factor_, max_covariance_trace_;
+    unsigned int nb_updates_;
+    Parameters phi_, row_, p_row_, gain_;
+    Eigen::Matrix<double,NB_PARAMS,NB_PARAMS> P_;
+};
+
+#endif // CARTOPTCTRL_PAYLOADESTIMATOR_HPP_
@@ -0,0 +1,65 @@
+#ifndef CARTOPTCTRL_PAYLOADIDENTCOMP_HPP_
+#define CARTOPTCTRL_PAYLOADIDENTCOMP_HPP_
+
+#include <rtt/Component.hpp>
+#include <rtt/TaskContext.hpp>
+#include <rtt/InputPort.hpp>
+#include <rtt/OutputPort.hpp>
+#include <rtt_ros_kdl_tools/tools.hpp>
+#include <rtt_ros_kdl_tools/chain_utils.hpp>
+
+#include <geometry_msgs/WrenchStamped.h>
+#include <eigen_conversions/eigen_kdl.h>
+#include <kdl_conversions/kdl_msg.h>
+#include <cart_opt_ctrl/payload_estimator.hpp>
+
+// Background identification of the payload carried by the robot.
+// Runs at a low rate next to CartOptCtrl and publishes the payload inertial parameters
+// (see PayloadEstimator) that CartOptCtrl swaps in its model when use_payload_model is set.
+// The FT sensor is expected to be biased without payload and to measure the wrench applied on the payload,
+// use ft_sign = -1 if it measures the wrench applied by the payload.
+// The mass and first moment are published once the trace of their covariance is under convergence_trace, the inertia
+// when its own is (it needs rotations of the payload), otherwise the one of a point mass at the center of mass is sent.
+// The published parameters are physically consistent : estimates that are not are projected on the nearest ones.
+class PayloadIdentComp : public RTT::TaskContext{
+  public:
+    PayloadIdentComp(const std::string& name);
+    virtual ~PayloadIdentComp(){}
+
+    bool configureHook();
+    bool startHook();
+    void updateHook();
+    void stopHook();
+
+    void resetEstimate();
+
+  protected:
+    // Input ports
+    RTT::InputPort<Eigen::VectorXd> port_joint_position_in_;
+    RTT::InputPort<Eigen::VectorXd> port_joint_velocity_in_;
+    RTT::InputPort<Eigen::VectorXd> port_joint_ext_torque_in_;
+    RTT::InputPort<geometry_msgs::WrenchStamped> port_ftdata_;
+
+    // Output ports
+    RTT::OutputPort<Eigen::VectorXd> port_payload_out_;
+
+    rtt_ros_kdl_tools::ChainUtils arm_;
+    Eigen::VectorXd joint_position_in_, joint_velocity_in_, joint_velocity_prev_, joint_acc_, joint_ext_torque_in_;
+    Eigen::VectorXd payload_out_;
+
+    PayloadEstimator estimator_;
+    PayloadEstimator::Regressor regressor_;
+    Eigen::Matrix<double,6,PayloadEstimator::NB_PARAMS> regressor_base_;
+    Eigen::Matrix<double,Eigen::Dynamic,PayloadEstimator::NB_PARAMS> torque_regressor_;
+    Eigen::Matrix<double,6,1> wrench_, acc_base_, vel_base_;
+    Eigen::Matrix3d rot_;
+    Eigen::Vector3d acc_, omega_, domega_, gravity_;
+    geometry_msgs::WrenchStamped ft_msg_;
+
+    std::string ee_frame_;
+    bool use_ft_data_, use_torque_residuals_, has_previous_state_;
+    double forgetting_factor_, initial_covariance_, acc_filter_gain_, ft_sign_, convergence_trace_;
+};
+
+ORO_LIST_COMPONENT_TYPE( PayloadIdentComp )
+#endif // CARTOPTCTRL_PAYLOADIDENTCOMP_HPP_
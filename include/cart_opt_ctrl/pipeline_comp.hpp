@@ -0,0 +1,58 @@
+#ifndef CARTOPTCTRL_PIPELINECOMP_HPP_
+#define CARTOPTCTRL_PIPELINECOMP_HPP_
+
+#include <rtt/Component.hpp>
+#include <rtt/TaskContext.hpp>
+#include <rtt/OutputPort.hpp>
+#include <rtt/extras/SlaveActivity.hpp>
+#include <rtt/os/TimeService.hpp>
+#include <rtt_ros_kdl_tools/tools.hpp>
+
+// Layout of the PipelineStats vector, computed over stats_window cycles (seconds)
+namespace PipelineStats
+{
+  enum Index {
+    LATENCY_MEAN = 0,     // start of the cycle to the end of the controller
+    LATENCY_MAX,
+    JITTER_MEAN,          // |start to start - period|
+    JITTER_MAX,
+    TRAJECTORY_MEAN,      // trajectory stage duration
+    CONTROLLER_MEAN,      // controller stage duration
+    OVERRUNS,             // number of cycles longer than the period
+    SIZE
+  };
+}
+
+// Composite execution : runs the trajectory generator, the controller and optionally a telemetry
+// component one after the other from its own periodic activity, so the controller always uses
+// the setpoint computed in the same period and they never run concurrently.
+// The stages need a slave activity of this component (setMasterSlaveActivity in the deployer),
+// the ports between them then behave as a direct in-thread handoff.
+class PipelineComp : public RTT::TaskContext{
+  public:
+    PipelineComp(const std::string& name);
+    virtual ~PipelineComp(){}
+
+    bool configureHook();
+    bool startHook();
+    void updateHook();
+    void stopHook();
+
+  protected:
+    RTT::TaskContext* getStage(const std::string& name);
+    void resetStats();
+
+    // Output ports
+    RTT::OutputPort<Eigen::VectorXd> port_stats_out_;
+
+    std::string trajectory_component_, controller_component_, telemetry_component_;
+    RTT::TaskContext *trajectory_, *controller_, *telemetry_;
+
+    // The first cycle has no jitter sample, stats_count_ counts the cycles and jitter_count_ the jitter samples
+    int stats_window_, stats_count_, jitter_count_;
+    RTT::os::TimeService::nsecs last_start_;
+    Eigen::VectorXd stats_, stats_out_;
+};
+
+ORO_LIST_COMPONENT_TYPE( PipelineComp )
+#endif // CARTOPTCTRL_PIPELINECOMP_HPP_
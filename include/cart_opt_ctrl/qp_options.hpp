@@ -0,0 +1,27 @@
+#ifndef CARTOPTCTRL_QPOPTIONS_HPP_
+#define CARTOPTCTRL_QPOPTIONS_HPP_
+
+#include <qpOASES.hpp>
+#include <string>
+
+// qpOASES options of CartOptCtrl, a preset and the settings tuned by qp_option_tuner on top of it.
+// Stored as rosparams (config/qp_options.yaml is loaded in CartOptCtrl/qp_options)
+struct QPSolverOptions{
+  QPSolverOptions();
+
+  // Overwrites the fields found in the namespace ns (not RT safe)
+  void getFromROSParam(const std::string& ns);
+  // false if the preset is not one of MPC, Default, Reliable
+  bool toOptions(qpOASES::Options& options) const;
+  bool writeYAML(const std::string& file, const std::string& comment) const;
+  std::string toString() const;
+
+  std::string preset;
+  // -1 keeps the value of the preset, 0 disables, 1 enables
+  int flipping_bounds, ramping, far_bounds;
+  bool regularisation, equalities;
+  // <= 0 keeps the value of the preset
+  double termination_tolerance;
+};
+
+#endif // CARTOPTCTRL_QPOPTIONS_HPP_
@@ -0,0 +1,67 @@
+#ifndef CARTOPTCTRL_QPPLUGIN_HPP_
+#define CARTOPTCTRL_QPPLUGIN_HPP_
+
+#include <rtt_ros_kdl_tools/chain_utils.hpp>
+#include <cart_opt_ctrl/multi_frame_kinematics.hpp>
+#include <kdl/frames.hpp>
+#include <Eigen/Core>
+#include <string>
+
+namespace cart_opt_ctrl
+{
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrix;
+
+  // Model of the current cycle, computed once by CartOptCtrl before the plugins are called
+  struct QPState{
+    int dof;
+    double period, horizon_dt;
+    const Eigen::VectorXd* joint_position;
+    const Eigen::VectorXd* joint_velocity;
+    const Eigen::MatrixXd* inertia_inverse;
+    const Eigen::VectorXd* nonlinear_terms;      // M^-1.(C.qd + G), qdd = M^-1.tau - nonlinear_terms
+    const Eigen::Matrix<double,6,Eigen::Dynamic>* jacobian;
+    const Eigen::Matrix<double,6,1>* jdot_qdot;
+    const KDL::Frame* pose;
+    const Eigen::Matrix<double,6,1>* velocity;
+    rtt_ros_kdl_tools::ChainUtils* arm;          // the model is already updated
+    const MultiFrameKinematics* kinematics;      // frames registered in registerFrames(), already updated
+  };
+
+  // Views on the preassigned part of the QP, nothing is copied :
+  // H and g are the torque block of the cost (tasks add to them),
+  // A, lbA and ubA are the rows reserved for the plugin (torque columns only).
+  struct QPSlice{
+    QPSlice(Eigen::Ref<RowMatrix> H_, Eigen::Ref<Eigen::VectorXd> g_,
+            Eigen::Ref<RowMatrix> A_, Eigen::Ref<Eigen::VectorXd> lbA_, Eigen::Ref<Eigen::VectorXd> ubA_)
+      : H(H_), g(g_), A(A_), lbA(lbA_), ubA(ubA_) {}
+    Eigen::Ref<RowMatrix> H;
+    Eigen::Ref<Eigen::VectorXd> g;
+    Eigen::Ref<RowMatrix> A;
+    Eigen::Ref<Eigen::VectorXd> lbA, ubA;
+  };
+
+  // Task or constraint added to the CartOptCtrl QP, loaded with pluginlib (see qp_plugins.xml).
+  // The number of rows is fixed in configure(), the problem is allocated once for all the plugins
+  // and update() is called every cycle in the order of the qp_plugins parameter.
+  class QPPlugin{
+    public:
+      virtual ~QPPlugin(){}
+
+      // Reads the parameters in the ros namespace ns (not RT safe)
+      virtual bool configure(const std::string& ns, int dof) = 0;
+
+      // Adds the frames the plugin needs and keeps their handles (not RT safe)
+      virtual bool registerFrames(MultiFrameKinematics& /*kinematics*/) { return true; }
+
+      // Constraint rows, 0 for a pure task
+      virtual int rows() const { return 0; }
+
+      // L1 penalty of the rows with soft_constraints, <= 0 keeps them hard
+      virtual double slackWeight() const { return 0.0; }
+
+      // Writes the rows, adds the task terms. Must be RT safe
+      virtual void update(const QPState& state, QPSlice& slice) = 0;
+  };
+}
+
+#endif // CARTOPTCTRL_QPPLUGIN_HPP_
@@ -0,0 +1,43 @@
+#ifndef CARTOPTCTRL_QPRECORD_HPP_
+#define CARTOPTCTRL_QPRECORD_HPP_
+
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+
+// Sequence of QPs as given to qpOASES, to replay them offline (see qp_option_tuner).
+// The buffer is allocated in configure() and used as a ring, push() only copies so it can run
+// in the control loop, save() writes the problems from the oldest on.
+// File : "CQPR", int32 nv, nc, count, then per problem H (nv x nv, row major), g, lb, ub (nv), A (nc x nv, row major), lbA, ubA (nc)
+class QPRecord{
+  public:
+    QPRecord();
+
+    // Allocates capacity problems of nv variables and nc constraints (not RT safe)
+    void configure(int nv, int nc, int capacity);
+    void clear();
+    void push(const double* H, const double* g, const double* A, const double* lb, const double* ub, const double* lbA, const double* ubA);
+
+    bool save(const std::string& file) const;
+    bool load(const std::string& file);
+
+    int size() const { return count_; }
+    int numberOfVariables() const { return nv_; }
+    int numberOfConstraints() const { return nc_; }
+    // Problem i, 0 is the oldest
+    const double* H(int i) const { return problem(i); }
+    const double* g(int i) const { return problem(i) + nv_*nv_; }
+    const double* lb(int i) const { return g(i) + nv_; }
+    const double* ub(int i) const { return lb(i) + nv_; }
+    const double* A(int i) const { return ub(i) + nv_; }
+    const double* lbA(int i) const { return A(i) + nc_*nv_; }
+    const double* ubA(int i) const { return lbA(i) + nc_; }
+
+  protected:
+    const double* problem(int i) const { return data_.data() + ((first_ + i) % capacity_) * problem_size_; }
+
+    int nv_, nc_, capacity_, problem_size_, first_, count_;
+    std::vector<double> data_;
+};
+
+#endif // CARTOPTCTRL_QPRECORD_HPP_
@@ -0,0 +1,44 @@
+#ifndef CARTOPTCTRL_SDFDAMPER_HPP_
+#define CARTOPTCTRL_SDFDAMPER_HPP_
+
+#include <cart_opt_ctrl/qp_plugin.hpp>
+#include <cart_opt_ctrl/signed_distance_field.hpp>
+
+namespace cart_opt_ctrl
+{
+  // Keeps the links away from the static environment (signed distance field built by sdf_builder).
+  // The links are covered by capsules sampled into spheres, each sphere gives a velocity damper row
+  //   d_dot >= -max_approach_velocity.(d - safety_distance)/(influence_distance - safety_distance)
+  // reached within the horizon, once its distance d to the environment is under influence_distance.
+  // Parameters (in the plugin namespace) :
+  //   sdf_file : field mapped at configure
+  //   frames : ["..."] one per capsule
+  //   capsules : [ax, ay, az, bx, by, bz, radius, ...] the capsule axis ends in its frame (m)
+  //   samples_per_capsule : spheres per capsule (default 3)
+  //   influence_distance, safety_distance (m), max_approach_velocity (m/s)
+  //   slack_weight : L1 penalty with soft_constraints (default 0, hard)
+  class SDFDamper : public QPPlugin{
+    public:
+      bool configure(const std::string& ns, int dof);
+      bool registerFrames(MultiFrameKinematics& kinematics);
+      int rows() const { return spheres_.size(); }
+      double slackWeight() const { return slack_weight_; }
+      void update(const QPState& state, QPSlice& slice);
+
+    protected:
+      struct Sphere{
+        int frame;
+        Eigen::Vector3d center;
+        double radius;
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+      };
+
+      SignedDistanceField sdf_;
+      std::vector<std::string> frame_names_;
+      std::vector<Sphere, Eigen::aligned_allocator<Sphere> > spheres_;
+      double influence_distance_, safety_distance_, max_approach_velocity_, slack_weight_;
+      Eigen::VectorXd jacobian_row_;
+  };
+}
+
+#endif // CARTOPTCTRL_SDFDAMPER_HPP_
@@ -0,0 +1,76 @@
+#ifndef CARTOPTCTRL_SIGNEDDISTANCEFIELD_HPP_
+#define CARTOPTCTRL_SIGNEDDISTANCEFIELD_HPP_
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Signed distance to the static environment on a regular grid, built offline by sdf_builder
+// and memory-mapped read only, so loading is instantaneous and the pages are shared between processes.
+// Negative inside the obstacles. Beyond the grid the space is considered free (distance grows with the gap).
+// File : "CSDF", int32 nx, ny, nz, double origin x, y, z, resolution, then nx.ny.nz float32 with x the fastest
+class SignedDistanceField{
+  public:
+    SignedDistanceField();
+    ~SignedDistanceField();
+
+    bool load(const std::string& file);
+    void unload();
+    static bool save(const std::string& file, const int size[3], const Eigen::Vector3d& origin, double resolution, const std::vector<float>& data);
+
+    bool isLoaded() const { return data_ != 0; }
+    int size(int axis) const { return size_[axis]; }
+    const Eigen::Vector3d& origin() const { return origin_; }
+    double resolution() const { return resolution_; }
+
+    // Trilinear distance at p (base frame) and its gradient
+    inline double query(const Eigen::Vector3d& p, Eigen::Vector3d& gradient) const{
+      Eigen::Vector3d g = (p - origin_) * inv_resolution_;
+      const Eigen::Vector3d grid = g.cwiseMax(0.0).cwiseMin(upper_);
+      int i[3];
+      double f[3];
+      for(int a=0; a<3; a++){
+        i[a] = std::min(static_cast<int>(grid(a)), size_[a] - 2);
+        f[a] = grid(a) - i[a];
+      }
+      const float* c = data_ + i[0] + stride_y_ * i[1] + stride_z_ * i[2];
+      const double c000 = c[0], c100 = c[1], c010 = c[stride_y_], c110 = c[stride_y_ + 1],
+                   c001 = c[stride_z_], c101 = c[stride_z_ + 1], c011 = c[stride_z_ + stride_y_], c111 = c[stride_z_ + stride_y_ + 1];
+      // Along x, then y, then z
+      const double c00 = c000 + f[0] * (c100 - c000), c10 = c010 + f[0] * (c110 - c010);
+      const double c01 = c001 + f[0] * (c101 - c001), c11 = c011 + f[0] * (c111 - c011);
+      const double c0 = c00 + f[1] * (c10 - c00), c1 = c01 + f[1] * (c11 - c01);
+      double distance = c0 + f[2] * (c1 - c0);
+      const double dx0 = (c100 - c000) + f[1] * ((c110 - c010) - (c100 - c000));
+      const double dx1 = (c101 - c001) + f[1] * ((c111 - c011) - (c101 - c001));
+      gradient(0) = (dx0 + f[2] * (dx1 - dx0)) * inv_resolution_;
+      gradient(1) = ((c10 - c00) + f[2] * ((c11 - c01) - (c10 - c00))) * inv_resolution_;
+      gradient(2) = (c1 - c0) * inv_resolution_;
+
+      // Outside the grid, add the distance to it
+      g -= grid;
+      const double outside = g.squaredNorm();
+      if(outside > 0.0){
+        const double gap = std::sqrt(outside);
+        distance += gap * resolution_;
+        gradient = g / gap;
+      }
+      return distance;
+    }
+
+  protected:
+    SignedDistanceField(const SignedDistanceField&);
+    SignedDistanceField& operator=(const SignedDistanceField&);
+
+    void* mapping_;
+    size_t mapping_size_;
+    const float* data_;
+    int size_[3];
+    int stride_y_, stride_z_;
+    Eigen::Vector3d origin_, upper_;
+    double resolution_, inv_resolution_;
+};
+
+#endif // CARTOPTCTRL_SIGNEDDISTANCEFIELD_HPP_
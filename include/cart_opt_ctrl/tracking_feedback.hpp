@@ -0,0 +1,20 @@
+#ifndef CARTOPTCTRL_TRACKINGFEEDBACK_HPP_
+#define CARTOPTCTRL_TRACKINGFEEDBACK_HPP_
+
+// Layout of the TrackingFeedback vector sent by CartOptCtrl to the trajectory generator.
+// Errors are the norms before saturation, flags are 1.0 when set, 0.0 otherwise.
+namespace TrackingFeedback
+{
+  enum Index {
+    POSITION_ERROR = 0,   // m
+    ORIENTATION_ERROR,    // rad
+    ERROR_SATURATED,      // pose error clipped by position/orientation_saturation
+    TORQUE_LIMITED,       // a torque bound is active
+    JOINT_LIMITED,        // a joint position/velocity constraint is active
+    CARTESIAN_LIMITED,    // a cartesian wall is active
+    ENERGY_LIMITED,       // the kinetic energy constraint is active
+    SIZE
+  };
+}
+
+#endif // CARTOPTCTRL_TRACKINGFEEDBACK_HPP_
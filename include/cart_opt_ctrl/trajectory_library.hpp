@@ -0,0 +1,59 @@
+#ifndef CARTOPTCTRL_TRAJECTORYLIBRARY_HPP_
+#define CARTOPTCTRL_TRAJECTORYLIBRARY_HPP_
+
+#include <kdl/frames.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Named trajectories sampled offline (see trajectory_library_compiler), memory-mapped read only
+// so loading is only a header check and playing one needs no planning.
+// Samples are interpolated linearly (normalized quaternions for the rotation), between 0 and the duration.
+// File : "CTLB", uint32 version, uint32 nb_trajectories, uint32 sample size (19), double period, int64 creation time (unix),
+// then the index sorted by name : char name[64], int64 offset (bytes from the start of the file), int64 nb_samples,
+// then the samples, each [position, quaternion x y z w, velocity (linear, angular), acceleration (linear, angular)]
+class TrajectoryLibrary{
+  public:
+    static const uint32_t VERSION = 1;
+    static const int SAMPLE_SIZE = 19;
+    static const int NAME_SIZE = 64;
+
+    TrajectoryLibrary();
+    ~TrajectoryLibrary();
+
+    bool load(const std::string& file);
+    void unload();
+    // names and samples (nb_samples x SAMPLE_SIZE each) in the same order, names shorter than NAME_SIZE and unique
+    static bool save(const std::string& file, double period, const std::vector<std::string>& names, const std::vector<std::vector<double> >& samples);
+
+    bool isLoaded() const { return index_ != 0; }
+    int size() const { return nb_trajectories_; }
+    double period() const { return period_; }
+    int64_t creationTime() const { return creation_time_; }
+
+    // Index of the trajectory, -1 if unknown (binary search, no allocation)
+    int find(const std::string& name) const;
+    std::string name(int trajectory) const;
+    double duration(int trajectory) const;
+    // State at time along the trajectory, RT safe
+    void sample(int trajectory, double time, KDL::Frame& pos, KDL::Twist& vel, KDL::Twist& acc) const;
+
+  protected:
+    struct IndexEntry{
+      char name[NAME_SIZE];
+      int64_t offset;
+      int64_t nb_samples;
+    };
+
+    TrajectoryLibrary(const TrajectoryLibrary&);
+    TrajectoryLibrary& operator=(const TrajectoryLibrary&);
+
+    void* mapping_;
+    size_t mapping_size_;
+    const IndexEntry* index_;
+    int nb_trajectories_;
+    double period_;
+    int64_t creation_time_;
+};
+
+#endif // CARTOPTCTRL_TRAJECTORYLIBRARY_HPP_
@@ -0,0 +1,73 @@
+#ifndef CARTOPTCTRL_TRAJECTORYPLAN_HPP_
+#define CARTOPTCTRL_TRAJECTORYPLAN_HPP_
+
+#include <kdl/frames.hpp>
+#include <kdl/trajectory.hpp>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// A cartesian trajectory (rounded path through waypoints, then a pause) whose KDL objects live in its own arena.
+// The paths, profiles and segments are placement constructed in blocks owned by the plan, clear() runs their
+// destructors and rewinds the arena : the blocks are kept, so replanning into a retired plan does not touch the heap
+// for them (KDL still allocates the lines and arcs of the rounded path internally, they go with the destructors).
+// Evaluates like KDL::Trajectory_Composite. Not copyable, swap() exchanges two plans without moving the objects.
+class TrajectoryPlan{
+  public:
+    enum Profile { TRAPEZOIDAL = 0, QUINTIC = 1 };
+
+    explicit TrajectoryPlan(size_t block_size = 4096);
+    ~TrajectoryPlan();
+
+    // Replaces the plan by the path through the waypoints timed by the profile, then end_pause at the last one.
+    // Without a path (less than 2 waypoints), stays at the last waypoint. False without waypoints or if the quintic profile
+    // is not rest to rest (KDL without the quintic spline), throws the KDL::Error of the path.
+    bool build(const std::vector<KDL::Frame>& waypoints, double radius, double eqradius, double vel_max, double acc_max,
+               Profile profile, double end_pause);
+    void clear();
+    void swap(TrajectoryPlan& other);
+    bool empty() const { return segments_.empty(); }
+
+    // Same as KDL::Trajectory, the plan must not be empty
+    double Duration() const { return ends_.empty() ? 0.0 : ends_.back(); }
+    KDL::Frame Pos(double time) const;
+    KDL::Twist Vel(double time) const;
+    KDL::Twist Acc(double time) const;
+
+    // Bytes of the arena taken by the current plan, and reserved by the plan for the next ones
+    size_t getMemoryUsed() const { return used_; }
+    size_t getMemoryReserved() const;
+
+  protected:
+    TrajectoryPlan(const TrajectoryPlan&);
+    TrajectoryPlan& operator=(const TrajectoryPlan&);
+
+    struct Block{
+      std::unique_ptr<char[]> data;
+      size_t size;
+    };
+    struct Destructor{
+      void (*destroy)(void*);
+      void* object;
+    };
+    template<class T> static void destroy(void* object){ static_cast<T*>(object)->~T(); }
+
+    void* allocate(size_t size, size_t alignment);
+    template<class T, class... Args> T* create(Args&&... args){
+      T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+      Destructor destructor = {&TrajectoryPlan::destroy<T>, object};
+      destructors_.push_back(destructor);
+      return object;
+    }
+    void add(KDL::Trajectory* segment);
+    const KDL::Trajectory& segmentAt(double& time) const;
+
+    size_t block_size_, block_, offset_, used_;
+    std::vector<Block> blocks_;
+    std::vector<Destructor> destructors_;
+    std::vector<KDL::Trajectory*> segments_;
+    std::vector<double> ends_;
+};
+
+#endif // CARTOPTCTRL_TRAJECTORYPLAN_HPP_
@@ -0,0 +1,57 @@
+#ifndef CARTOPTCTRL_WOODBURYHESSIAN_HPP_
+#define CARTOPTCTRL_WOODBURYHESSIAN_HPP_
+
+#include <Eigen/Core>
+#include <Eigen/Cholesky>
+
+// Inverse of the CartOptCtrl QP hessian from its structure :
+//   H = 2.r.M^-1 + sum_i a_i^T.diag(w_i).a_i   with a_i = J.diag(s_i).M^-1
+//     = M^-1.( 2.r.M + V.V^T ).M^-1             with V = [diag(s_i).J^T.diag(w_i)^1/2 ...]
+// and the Woodbury identity gives
+//   H^-1 = M / (2.r) - V.C^-1.V^T / (4.r^2)     with C = I + V^T.M^-1.V / (2.r)
+// so only the k x k capacitance matrix is factored (k = number of weighted task rows, 6 per task)
+// instead of the dense dof x dof hessian. Zero weights are dropped from V.
+class WoodburyHessian{
+  public:
+    WoodburyHessian();
+
+    // max_tasks tasks of 6 rows at most, allocates the buffers (not RT safe)
+    void configure(int dof, int max_tasks);
+
+    // Starts a new hessian, M and M_inv must stay valid until compute()
+    void reset(const Eigen::MatrixXd& M, const Eigen::MatrixXd& M_inv, double regularisation_weight);
+
+    // Adds a_i^T.diag(weights).a_i with a_i = jacobian.diag(axes).M^-1
+    void addTask(const Eigen::Matrix<double,6,Eigen::Dynamic>& jacobian, const Eigen::VectorXd& axes, const Eigen::Matrix<double,6,1>& weights);
+
+    // Factors C, false if the regularisation is not positive or C is singular
+    bool factorize();
+    // x = H^-1.b after factorize(), without forming H^-1
+    void solve(const Eigen::Ref<const Eigen::VectorXd>& b, Eigen::VectorXd& x);
+    // Factors C and forms H^-1
+    bool compute();
+
+    const Eigen::MatrixXd& inverse() const { return hessian_inverse_; }
+    // Adds the task terms M^-1.V.V^T.M^-1 of H to a dof x dof block holding 2.r.M^-1,
+    // for the solvers that need the dense hessian (the fast path never forms it)
+    template<typename Derived>
+    void addTaskTerms(const Eigen::MatrixBase<Derived>& H){
+      if(!M_inv_ || rank_ == 0)
+        return;
+      const int k = rank_;
+      M_inv_V_.leftCols(k).noalias() = (*M_inv_) * V_.leftCols(k);
+      const_cast<Eigen::MatrixBase<Derived>&>(H).noalias() += M_inv_V_.leftCols(k) * M_inv_V_.leftCols(k).transpose();
+    }
+    int rank() const { return rank_; }
+
+  protected:
+    const Eigen::MatrixXd* M_;
+    const Eigen::MatrixXd* M_inv_;
+    double regularisation_weight_;
+    int rank_;
+    Eigen::MatrixXd V_, M_inv_V_, capacitance_, hessian_inverse_;
+    Eigen::VectorXd Vt_b_;
+    Eigen::LDLT<Eigen::MatrixXd> capacitance_ldlt_;
+};
+
+#endif // CARTOPTCTRL_WOODBURYHESSIAN_HPP_
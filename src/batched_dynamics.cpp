@@ -0,0 +1,603 @@
+#include "cart_opt_ctrl/batched_dynamics.hpp"
+#include <kdl/segment.hpp>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <thread>
+
+const int BatchedDynamics::Lanes;
+const int BatchedDynamics::NB_SEGMENT_PARAMETERS;
+
+namespace{
+  typedef BatchedDynamics::Pack Pack;
+
+  // 3D vector and row major rotation on packs, one configuration per lane
+  struct Vec3{ Pack x, y, z; };
+  struct Mat3{ Pack m[9]; };
+  // Symmetric 3x3 matrix, [xx, xy, xz, yy, yz, zz]
+  struct Sym3{ Pack m[6]; };
+
+  inline Vec3 mul(const Mat3& r, const Vec3& v){
+    Vec3 o;
+    o.x = r.m[0] * v.x + r.m[1] * v.y + r.m[2] * v.z;
+    o.y = r.m[3] * v.x + r.m[4] * v.y + r.m[5] * v.z;
+    o.z = r.m[6] * v.x + r.m[7] * v.y + r.m[8] * v.z;
+    return o;
+  }
+
+  inline Vec3 mul(const Mat3& r, const Eigen::Vector3d& v){
+    Vec3 o;
+    o.x = r.m[0] * v(0) + r.m[1] * v(1) + r.m[2] * v(2);
+    o.y = r.m[3] * v(0) + r.m[4] * v(1) + r.m[5] * v(2);
+    o.z = r.m[6] * v(0) + r.m[7] * v(1) + r.m[8] * v(2);
+    return o;
+  }
+
+  inline Mat3 mul(const Mat3& a, const Mat3& b){
+    Mat3 o;
+    for(int i=0; i<3; i++)
+      for(int j=0; j<3; j++)
+        o.m[3*i+j] = a.m[3*i] * b.m[j] + a.m[3*i+1] * b.m[3+j] + a.m[3*i+2] * b.m[6+j];
+    return o;
+  }
+
+  inline Mat3 mul(const Mat3& a, const Eigen::Matrix3d& b){
+    Mat3 o;
+    for(int i=0; i<3; i++)
+      for(int j=0; j<3; j++)
+        o.m[3*i+j] = a.m[3*i] * b(0,j) + a.m[3*i+1] * b(1,j) + a.m[3*i+2] * b(2,j);
+    return o;
+  }
+
+  inline Vec3 add(const Vec3& a, const Vec3& b){ Vec3 o; o.x = a.x + b.x; o.y = a.y + b.y; o.z = a.z + b.z; return o; }
+  inline Vec3 sub(const Vec3& a, const Vec3& b){ Vec3 o; o.x = a.x - b.x; o.y = a.y - b.y; o.z = a.z - b.z; return o; }
+  inline Vec3 scale(const Pack& s, const Vec3& a){ Vec3 o; o.x = s * a.x; o.y = s * a.y; o.z = s * a.z; return o; }
+  inline Pack dot(const Vec3& a, const Vec3& b){ return a.x * b.x + a.y * b.y + a.z * b.z; }
+  inline Vec3 cross(const Vec3& a, const Vec3& b){
+    Vec3 o;
+    o.x = a.y * b.z - a.z * b.y;
+    o.y = a.z * b.x - a.x * b.z;
+    o.z = a.x * b.y - a.y * b.x;
+    return o;
+  }
+  inline Vec3 mul(const Sym3& s, const Vec3& v){
+    Vec3 o;
+    o.x = s.m[0] * v.x + s.m[1] * v.y + s.m[2] * v.z;
+    o.y = s.m[1] * v.x + s.m[3] * v.y + s.m[4] * v.z;
+    o.z = s.m[2] * v.x + s.m[4] * v.y + s.m[5] * v.z;
+    return o;
+  }
+  inline Vec3 constant(const Eigen::Vector3d& v){
+    Vec3 o;
+    o.x.setConstant(v(0)); o.y.setConstant(v(1)); o.z.setConstant(v(2));
+    return o;
+  }
+
+  // Rotation of angle q around the unit axis a (Rodrigues)
+  inline Mat3 axisAngle(const Eigen::Vector3d& a, const Pack& q){
+    const Pack c = q.cos(), s = q.sin(), t = 1.0 - c;
+    Mat3 r;
+    r.m[0] = c + t * a(0) * a(0);        r.m[1] = t * a(0) * a(1) - s * a(2); r.m[2] = t * a(0) * a(2) + s * a(1);
+    r.m[3] = t * a(1) * a(0) + s * a(2); r.m[4] = c + t * a(1) * a(1);        r.m[5] = t * a(1) * a(2) - s * a(0);
+    r.m[6] = t * a(2) * a(0) - s * a(1); r.m[7] = t * a(2) * a(1) + s * a(0); r.m[8] = c + t * a(2) * a(2);
+    return r;
+  }
+
+  // Inertia of a segment about the base origin from its parameters in the segment frame (rotation r, origin p) :
+  // first moment c = m.p + h and I_O = R.I.R^T + 2(h.p)Id - h.p^T - p.h^T + m(|p|^2.Id - p.p^T) with h = R.first_moment
+  inline void segmentInertia(double mass, const Eigen::Vector3d& first_moment, const Eigen::Matrix3d& rot_inertia,
+                             const Mat3& r, const Vec3& p, Vec3& c, Sym3& inertia){
+    const Vec3 h = mul(r,first_moment);
+    const Mat3 ri = mul(r,rot_inertia);
+    const Pack hp = 2.0 * dot(h,p), pp = mass * dot(p,p);
+    const Pack* pv[3] = {&p.x, &p.y, &p.z};
+    const Pack* hv[3] = {&h.x, &h.y, &h.z};
+    const int idx[6][2] = {{0,0},{0,1},{0,2},{1,1},{1,2},{2,2}};
+    for(int e=0; e<6; e++){
+      const int a = idx[e][0], b = idx[e][1];
+      inertia.m[e] = ri.m[3*a] * r.m[3*b] + ri.m[3*a+1] * r.m[3*b+1] + ri.m[3*a+2] * r.m[3*b+2]
+                   - (*hv[a]) * (*pv[b]) - (*pv[a]) * (*hv[b]) - mass * (*pv[a]) * (*pv[b]);
+      if(a == b)
+        inertia.m[e] += hp + pp;
+    }
+    c = add(scale(Pack::Constant(mass),p),h);
+  }
+
+  // Motion of a joint seen at the base origin, S = (w, v_O)
+  inline void motionSubspace(const BatchedDynamics::SegmentModel& seg, const Vec3& z, const Vec3& o, Vec3& sw, Vec3& sv){
+    if(seg.type == BatchedDynamics::SegmentModel::ROTATIONAL){
+      sw = z;
+      sv = cross(o,z);
+    }
+    else{
+      sw = constant(Eigen::Vector3d::Zero());
+      sv = z;
+    }
+  }
+
+  // Rate of change of the momentum of a body (mass m, first moment c and inertia I about the base origin)
+  // with velocity (w, v) and acceleration (aw, av) at the base origin, i.e. the force (torque, force) it needs
+  inline void bodyForce(double m, const Vec3& c, const Sym3& inertia, const Vec3& w, const Vec3& v, const Vec3& aw, const Vec3& av,
+                        Vec3& f_ang, Vec3& f_lin){
+    const Pack mass = Pack::Constant(m);
+    const Vec3 lin = add(scale(mass,v),cross(w,c));
+    const Vec3 ang = add(mul(inertia,w),cross(c,v));
+    f_lin = add(add(scale(mass,av),cross(aw,c)),cross(w,lin));
+    f_ang = add(add(mul(inertia,aw),cross(c,av)),add(cross(w,ang),cross(v,lin)));
+  }
+
+  // Rows of a (rows x N) matrix to packs, the last incomplete pack repeats its last column
+  void loadRows(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& in, BatchedDynamics::PackVector& out, int col, int valid){
+    for(unsigned int r=0; r<out.size(); r++){
+      if(valid == BatchedDynamics::Lanes)
+        out[r] = Eigen::Map<const Pack>(in.data() + r * in.outerStride() + col);
+      else
+        for(int l=0; l<BatchedDynamics::Lanes; l++)
+          out[r](l) = in(r, col + std::min(l, valid - 1));
+    }
+  }
+
+  void storeRows(const BatchedDynamics::PackVector& in, BatchedDynamicsResult::Matrix& out, int col, int valid){
+    for(unsigned int r=0; r<in.size(); r++){
+      if(valid == BatchedDynamics::Lanes)
+        Eigen::Map<Pack>(&out(r,col)) = in[r];
+      else
+        for(int l=0; l<valid; l++)
+          out(r,col+l) = in[r](l);
+    }
+  }
+}
+
+struct BatchedDynamics::Workspace{
+  PackVector q, qd, qdd;
+  // Joint axes and points on the axes in the base frame
+  std::vector<Vec3, Eigen::aligned_allocator<Vec3> > z, o;
+  // Composite inertia of the subtree moved by each joint, about the base origin
+  PackVector sub_mass;
+  std::vector<Vec3, Eigen::aligned_allocator<Vec3> > sub_first_moment;
+  std::vector<Sym3, Eigen::aligned_allocator<Sym3> > sub_inertia;
+  // Tip frame of every segment
+  std::vector<Mat3, Eigen::aligned_allocator<Mat3> > seg_rot;
+  std::vector<Vec3, Eigen::aligned_allocator<Vec3> > seg_pos;
+  // Force carried by each segment, about the base origin
+  std::vector<Vec3, Eigen::aligned_allocator<Vec3> > f_ang, f_lin;
+  // Outputs
+  PackVector pose, jacobian, gravity, inertia, chol, chol_inv, inertia_inverse, tau, regressor;
+
+  Workspace(int nb_segments, int nb_joints, bool with_regressor = false) :
+    q(nb_joints), qd(nb_joints), qdd(nb_joints), z(nb_joints), o(nb_joints), sub_mass(nb_joints), sub_first_moment(nb_joints), sub_inertia(nb_joints),
+    seg_rot(nb_segments), seg_pos(nb_segments), f_ang(nb_segments), f_lin(nb_segments), pose(12), jacobian(6*nb_joints), gravity(nb_joints),
+    inertia(nb_joints*nb_joints), chol(nb_joints*nb_joints), chol_inv(nb_joints*nb_joints), inertia_inverse(nb_joints*nb_joints),
+    tau(nb_joints), regressor(with_regressor ? nb_joints * nb_segments * NB_SEGMENT_PARAMETERS : 0) {}
+};
+
+BatchedDynamics::BatchedDynamics() : nb_joints_(0), nb_threads_(0)
+{
+  gravity_ << 0.0, 0.0, -9.81;
+  setNbThreads(0);
+}
+
+void BatchedDynamics::setNbThreads(unsigned int nb_threads){
+  nb_threads_ = nb_threads > 0 ? nb_threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool BatchedDynamics::init(const KDL::Chain& chain, const Eigen::Vector3d& gravity){
+  SegmentModels segments;
+  int nb_joints;
+  return extractSegments(chain, segments, nb_joints) && init(segments, nb_joints, gravity);
+}
+
+bool BatchedDynamics::extractSegments(const KDL::Chain& chain, SegmentModels& segments, int& nb_joints){
+  segments.resize(chain.getNrOfSegments());
+  int joint_index = 0;
+  for(unsigned int k=0; k<chain.getNrOfSegments(); k++){
+    const KDL::Segment& segment = chain.getSegment(k);
+    const KDL::Joint& joint = segment.getJoint();
+    SegmentModel& model = segments[k];
+
+    switch(joint.getType()){
+      case KDL::Joint::RotAxis: case KDL::Joint::RotX: case KDL::Joint::RotY: case KDL::Joint::RotZ:
+        model.type = SegmentModel::ROTATIONAL;
+        break;
+      case KDL::Joint::TransAxis: case KDL::Joint::TransX: case KDL::Joint::TransY: case KDL::Joint::TransZ:
+        model.type = SegmentModel::TRANSLATIONAL;
+        break;
+      default:
+        model.type = SegmentModel::FIXED;
+    }
+    model.joint_index = model.type == SegmentModel::FIXED ? -1 : joint_index++;
+    const KDL::Vector axis = joint.JointAxis(), origin = joint.JointOrigin();
+    model.axis << axis.x(), axis.y(), axis.z();
+    model.origin << origin.x(), origin.y(), origin.z();
+
+    // Frame from the joint to the segment tip, independent of q
+    const KDL::Frame tip = joint.pose(0.0).Inverse() * segment.pose(0.0);
+    for(int i=0; i<3; i++){
+      model.tip_pos(i) = tip.p(i);
+      for(int j=0; j<3; j++)
+        model.tip_rot(i,j) = tip.M(i,j);
+    }
+
+    // The joint model assumes no scale nor offset, check it on an arbitrary value
+    const double q_test = 0.37;
+    const KDL::Frame jnt_pose = joint.pose(q_test);
+    Eigen::Matrix3d rot = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d pos = Eigen::Vector3d::Zero();
+    if(model.type == SegmentModel::ROTATIONAL){
+      rot = Eigen::AngleAxisd(q_test, model.axis.normalized()).toRotationMatrix();
+      pos = model.origin - rot * model.origin;
+    }
+    else if(model.type == SegmentModel::TRANSLATIONAL)
+      pos = model.axis * q_test;
+    for(int i=0; i<3; i++){
+      if(std::abs(jnt_pose.p(i) - pos(i)) > 1e-9)
+        return false;
+      for(int j=0; j<3; j++)
+        if(std::abs(jnt_pose.M(i,j) - rot(i,j)) > 1e-9)
+          return false;
+    }
+    model.axis.normalize();
+
+    const KDL::RigidBodyInertia& inertia = segment.getInertia();
+    const KDL::Vector cog = inertia.getCOG();
+    model.mass = inertia.getMass();
+    model.first_moment << model.mass * cog.x(), model.mass * cog.y(), model.mass * cog.z();
+    model.rot_inertia = Eigen::Map<const Eigen::Matrix<double,3,3,Eigen::RowMajor> >(inertia.getRotationalInertia().data);
+  }
+  nb_joints = joint_index;
+  return true;
+}
+
+bool BatchedDynamics::init(const SegmentModels& segments, int nb_joints, const Eigen::Vector3d& gravity){
+  segments_ = segments;
+  nb_joints_ = nb_joints;
+  gravity_ = gravity;
+  joint_segments_.assign(nb_joints, -1);
+  for(unsigned int k=0; k<segments.size(); k++){
+    const int j = segments[k].joint_index;
+    if(segments[k].type != SegmentModel::FIXED && j >= 0 && j < nb_joints)
+      joint_segments_[j] = k;
+  }
+  return nb_joints_ > 0 && std::find(joint_segments_.begin(), joint_segments_.end(), -1) == joint_segments_.end();
+}
+
+void BatchedDynamics::getParameters(const SegmentModel& segment, double* parameters){
+  const Eigen::Matrix3d& I = segment.rot_inertia;
+  parameters[0] = segment.mass;
+  parameters[1] = segment.first_moment(0); parameters[2] = segment.first_moment(1); parameters[3] = segment.first_moment(2);
+  parameters[4] = I(0,0); parameters[5] = I(0,1); parameters[6] = I(0,2);
+  parameters[7] = I(1,1); parameters[8] = I(1,2); parameters[9] = I(2,2);
+}
+
+void BatchedDynamics::setParameters(const double* parameters, SegmentModel& segment){
+  segment.mass = parameters[0];
+  segment.first_moment << parameters[1], parameters[2], parameters[3];
+  segment.rot_inertia << parameters[4], parameters[5], parameters[6],
+                         parameters[5], parameters[7], parameters[8],
+                         parameters[6], parameters[8], parameters[9];
+}
+
+void BatchedDynamics::forEachPackRange(int nb_packs, const std::function<void(int,int)>& range) const{
+  const int nb_threads = std::min<int>(nb_threads_, nb_packs);
+  if(nb_threads <= 1){
+    range(0,nb_packs);
+    return;
+  }
+
+  // Contiguous blocks of packs per thread, each thread writes its own columns
+  std::vector<std::thread> workers;
+  workers.reserve(nb_threads);
+  const int packs_per_thread = (nb_packs + nb_threads - 1) / nb_threads;
+  for(int t=0; t<nb_threads; t++){
+    const int first = t * packs_per_thread;
+    const int last = std::min(nb_packs, first + packs_per_thread);
+    if(first >= last)
+      break;
+    workers.push_back(std::thread(range, first, last));
+  }
+  for(unsigned int t=0; t<workers.size(); t++)
+    workers[t].join();
+}
+
+void BatchedDynamics::compute(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q, BatchedDynamicsResult& result, int outputs) const{
+  const int n = q.cols();
+  const int nj = nb_joints_;
+  if(outputs & POSE) result.pose.resize(12,n);
+  if(outputs & JACOBIAN) result.jacobian.resize(6*nj,n);
+  if(outputs & GRAVITY) result.gravity.resize(nj,n);
+  if(outputs & INERTIA) result.inertia.resize(nj*nj,n);
+  if(outputs & INERTIA_INVERSE) result.inertia_inverse.resize(nj*nj,n);
+
+  forEachPackRange((n + Lanes - 1) / Lanes, [&](int first, int last){ computeRange(q,result,outputs,first,last); });
+}
+
+void BatchedDynamics::computeInverseDynamics(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q,
+                                             const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qd,
+                                             const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qdd,
+                                             BatchedDynamicsResult::Matrix& tau) const{
+  const int n = q.cols();
+  tau.resize(nb_joints_,n);
+  forEachPackRange((n + Lanes - 1) / Lanes, [&](int first, int last){ computeMotionRange(q,qd,qdd,tau,false,first,last); });
+}
+
+void BatchedDynamics::computeRegressor(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q,
+                                       const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qd,
+                                       const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qdd,
+                                       BatchedDynamicsResult::Matrix& regressor) const{
+  const int n = q.cols();
+  regressor.resize(nb_joints_ * getNrOfParameters(),n);
+  forEachPackRange((n + Lanes - 1) / Lanes, [&](int first, int last){ computeMotionRange(q,qd,qdd,regressor,true,first,last); });
+}
+
+void BatchedDynamics::computeMotionRange(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q,
+                                         const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qd,
+                                         const Eigen::Ref<const BatchedDynamicsResult::Matrix>& qdd,
+                                         BatchedDynamicsResult::Matrix& out, bool regressor, int first_pack, int last_pack) const{
+  const int n = q.cols();
+  Workspace ws(segments_.size(), nb_joints_, regressor);
+  for(int pack=first_pack; pack<last_pack; pack++){
+    const int col = pack * Lanes;
+    const int valid = std::min(Lanes, n - col);
+    loadRows(q,ws.q,col,valid);
+    loadRows(qd,ws.qd,col,valid);
+    loadRows(qdd,ws.qdd,col,valid);
+    computePack(ws,0);
+    computeMotionPack(ws,regressor);
+    storeRows(regressor ? ws.regressor : ws.tau,out,col,valid);
+  }
+}
+
+void BatchedDynamics::computeRange(const Eigen::Ref<const BatchedDynamicsResult::Matrix>& q, BatchedDynamicsResult& result,
+                                   int outputs, int first_pack, int last_pack) const{
+  const int n = q.cols();
+  Workspace ws(segments_.size(), nb_joints_);
+
+  for(int pack=first_pack; pack<last_pack; pack++){
+    const int col = pack * Lanes;
+    const int valid = std::min(Lanes, n - col);
+    loadRows(q,ws.q,col,valid);
+
+    computePack(ws,outputs);
+
+    if(outputs & POSE) storeRows(ws.pose,result.pose,col,valid);
+    if(outputs & JACOBIAN) storeRows(ws.jacobian,result.jacobian,col,valid);
+    if(outputs & GRAVITY) storeRows(ws.gravity,result.gravity,col,valid);
+    if(outputs & INERTIA) storeRows(ws.inertia,result.inertia,col,valid);
+    if(outputs & INERTIA_INVERSE) storeRows(ws.inertia_inverse,result.inertia_inverse,col,valid);
+  }
+}
+
+void BatchedDynamics::computePack(Workspace& ws, int outputs) const{
+  const int nj = nb_joints_;
+  const int ns = segments_.size();
+
+  // Forward kinematics, base to tip
+  Mat3 rot;
+  Vec3 pos;
+  for(int i=0; i<9; i++)
+    rot.m[i].setConstant(i % 4 == 0 ? 1.0 : 0.0);
+  pos.x.setZero(); pos.y.setZero(); pos.z.setZero();
+  for(int k=0; k<ns; k++){
+    const SegmentModel& seg = segments_[k];
+    if(seg.type != SegmentModel::FIXED){
+      const int j = seg.joint_index;
+      ws.z[j] = mul(rot,seg.axis);
+      ws.o[j] = add(mul(rot,seg.origin),pos);
+      if(seg.type == SegmentModel::ROTATIONAL){
+        // The joint rotates around the axis going through origin
+        const Mat3 jnt_rot = axisAngle(seg.axis,ws.q[j]);
+        const Vec3 jnt_pos = sub(constant(seg.origin),mul(jnt_rot,seg.origin));
+        pos = add(mul(rot,jnt_pos),pos);
+        rot = mul(rot,jnt_rot);
+      }
+      else
+        pos = add(scale(ws.q[j],ws.z[j]),pos);
+    }
+    pos = add(mul(rot,seg.tip_pos),pos);
+    rot = mul(rot,seg.tip_rot);
+    ws.seg_rot[k] = rot;
+    ws.seg_pos[k] = pos;
+  }
+
+  if(outputs & POSE){
+    ws.pose[0] = pos.x; ws.pose[1] = pos.y; ws.pose[2] = pos.z;
+    for(int i=0; i<9; i++)
+      ws.pose[3+i] = rot.m[i];
+  }
+
+  // Tip jacobian, reference point at the tip
+  if(outputs & JACOBIAN){
+    for(int k=0; k<ns; k++){
+      const SegmentModel& seg = segments_[k];
+      if(seg.type == SegmentModel::FIXED)
+        continue;
+      const int j = seg.joint_index;
+      Vec3 lin, ang;
+      if(seg.type == SegmentModel::ROTATIONAL){
+        lin = cross(ws.z[j],sub(pos,ws.o[j]));
+        ang = ws.z[j];
+      }
+      else{
+        lin = ws.z[j];
+        ang.x.setZero(); ang.y.setZero(); ang.z.setZero();
+      }
+      ws.jacobian[0*nj+j] = lin.x; ws.jacobian[1*nj+j] = lin.y; ws.jacobian[2*nj+j] = lin.z;
+      ws.jacobian[3*nj+j] = ang.x; ws.jacobian[4*nj+j] = ang.y; ws.jacobian[5*nj+j] = ang.z;
+    }
+  }
+
+  if(!(outputs & (GRAVITY | INERTIA | INERTIA_INVERSE)))
+    return;
+
+  // Composite inertias, tip to base, about the base origin
+  Pack mass = Pack::Zero();
+  Vec3 first_moment = constant(Eigen::Vector3d::Zero());
+  Sym3 inertia;
+  for(int i=0; i<6; i++)
+    inertia.m[i].setZero();
+  for(int k=ns-1; k>=0; k--){
+    const SegmentModel& seg = segments_[k];
+    if(seg.mass > 0.0){
+      Vec3 c;
+      Sym3 seg_inertia;
+      segmentInertia(seg.mass,seg.first_moment,seg.rot_inertia,ws.seg_rot[k],ws.seg_pos[k],c,seg_inertia);
+      for(int e=0; e<6; e++)
+        inertia.m[e] += seg_inertia.m[e];
+      mass += seg.mass;
+      first_moment = add(first_moment,c);
+    }
+    if(seg.type != SegmentModel::FIXED){
+      const int j = seg.joint_index;
+      ws.sub_mass[j] = mass;
+      ws.sub_first_moment[j] = first_moment;
+      ws.sub_inertia[j] = inertia;
+    }
+  }
+
+  // Gravity : torque needed to hold the subtree of each joint
+  if(outputs & GRAVITY){
+    const Vec3 g = constant(gravity_);
+    for(int k=0; k<ns; k++){
+      const SegmentModel& seg = segments_[k];
+      if(seg.type == SegmentModel::FIXED)
+        continue;
+      const int j = seg.joint_index;
+      if(seg.type == SegmentModel::ROTATIONAL)
+        ws.gravity[j] = - dot(ws.z[j],cross(sub(ws.sub_first_moment[j],scale(ws.sub_mass[j],ws.o[j])),g));
+      else
+        ws.gravity[j] = - ws.sub_mass[j] * dot(ws.z[j],g);
+    }
+  }
+
+  if(!(outputs & (INERTIA | INERTIA_INVERSE)))
+    return;
+
+  // Composite rigid body algorithm : M(i,j) = S_i^T.Ic_j.S_j for i <= j
+  // with S = (w, v_O) the motion of the joint seen at the base origin
+  Vec3 zero = constant(Eigen::Vector3d::Zero());
+  for(int j=0; j<nj; j++){
+    const bool rot_j = segments_[joint_segments_[j]].type == SegmentModel::ROTATIONAL;
+    const Vec3 w_j = rot_j ? ws.z[j] : zero;
+    const Vec3 v_j = rot_j ? cross(ws.o[j],ws.z[j]) : ws.z[j];
+    // Momentum of the composite body of joint j moving along S_j
+    const Vec3 lin = add(scale(ws.sub_mass[j],v_j),cross(w_j,ws.sub_first_moment[j]));
+    const Vec3 ang = add(mul(ws.sub_inertia[j],w_j),cross(ws.sub_first_moment[j],v_j));
+    for(int k=0, i=0; k<ns && i<=j; k++){
+      const SegmentModel& seg_i = segments_[k];
+      if(seg_i.type == SegmentModel::FIXED)
+        continue;
+      i = seg_i.joint_index;
+      if(i > j)
+        break;
+      Pack m_ij;
+      if(seg_i.type == SegmentModel::ROTATIONAL)
+        m_ij = dot(ws.z[i],ang) + dot(cross(ws.o[i],ws.z[i]),lin);
+      else
+        m_ij = dot(ws.z[i],lin);
+      ws.inertia[i*nj+j] = m_ij;
+      ws.inertia[j*nj+i] = m_ij;
+    }
+  }
+
+  if(!(outputs & INERTIA_INVERSE))
+    return;
+
+  // Cholesky M = L.L^T, then M^-1 = L^-T.L^-1
+  for(int j=0; j<nj; j++){
+    Pack d = ws.inertia[j*nj+j];
+    for(int k=0; k<j; k++)
+      d -= ws.chol[j*nj+k] * ws.chol[j*nj+k];
+    ws.chol[j*nj+j] = d.sqrt();
+    const Pack inv_d = ws.chol[j*nj+j].inverse();
+    for(int i=j+1; i<nj; i++){
+      Pack s = ws.inertia[i*nj+j];
+      for(int k=0; k<j; k++)
+        s -= ws.chol[i*nj+k] * ws.chol[j*nj+k];
+      ws.chol[i*nj+j] = s * inv_d;
+    }
+  }
+  for(int j=0; j<nj; j++){
+    ws.chol_inv[j*nj+j] = ws.chol[j*nj+j].inverse();
+    for(int i=j+1; i<nj; i++){
+      Pack s = Pack::Zero();
+      for(int k=j; k<i; k++)
+        s += ws.chol[i*nj+k] * ws.chol_inv[k*nj+j];
+      ws.chol_inv[i*nj+j] = - s / ws.chol[i*nj+i];
+    }
+  }
+  for(int i=0; i<nj; i++){
+    for(int j=i; j<nj; j++){
+      Pack s = Pack::Zero();
+      for(int k=j; k<nj; k++)
+        s += ws.chol_inv[k*nj+i] * ws.chol_inv[k*nj+j];
+      ws.inertia_inverse[i*nj+j] = s;
+      ws.inertia_inverse[j*nj+i] = s;
+    }
+  }
+}
+
+void BatchedDynamics::computeMotionPack(Workspace& ws, bool regressor) const{
+  const int ns = segments_.size();
+  const int np = getNrOfParameters();
+  if(regressor)
+    std::fill(ws.regressor.begin(), ws.regressor.end(), Pack::Zero());
+
+  // Velocity and acceleration of each segment at the base origin, base to tip.
+  // The gravity enters as an upward acceleration of the base.
+  Vec3 w = constant(Eigen::Vector3d::Zero()), v = w, aw = w, av = constant(- gravity_);
+  int nb_moved = 0;
+  for(int k=0; k<ns; k++){
+    const SegmentModel& seg = segments_[k];
+    if(seg.type != SegmentModel::FIXED){
+      const int j = seg.joint_index;
+      Vec3 sw, sv;
+      motionSubspace(seg,ws.z[j],ws.o[j],sw,sv);
+      // a += S.qdd + v x S.qd
+      const Vec3 sw_qd = scale(ws.qd[j],sw), sv_qd = scale(ws.qd[j],sv);
+      aw = add(aw,add(scale(ws.qdd[j],sw),cross(w,sw_qd)));
+      av = add(av,add(scale(ws.qdd[j],sv),add(cross(w,sv_qd),cross(v,sw_qd))));
+      w = add(w,sw_qd);
+      v = add(v,sv_qd);
+      ++nb_moved;
+    }
+
+    Vec3 c;
+    Sym3 inertia;
+    if(!regressor){
+      segmentInertia(seg.mass,seg.first_moment,seg.rot_inertia,ws.seg_rot[k],ws.seg_pos[k],c,inertia);
+      bodyForce(seg.mass,c,inertia,w,v,aw,av,ws.f_ang[k],ws.f_lin[k]);
+      continue;
+    }
+
+    // Force of each unit parameter of the segment, carried by every joint before it
+    for(int p=0; p<NB_SEGMENT_PARAMETERS; p++){
+      double unit[NB_SEGMENT_PARAMETERS] = {0.0};
+      unit[p] = 1.0;
+      SegmentModel param;
+      setParameters(unit,param);
+      Vec3 f_ang, f_lin;
+      segmentInertia(param.mass,param.first_moment,param.rot_inertia,ws.seg_rot[k],ws.seg_pos[k],c,inertia);
+      bodyForce(param.mass,c,inertia,w,v,aw,av,f_ang,f_lin);
+      for(int j=0; j<nb_moved; j++){
+        Vec3 sw, sv;
+        motionSubspace(segments_[joint_segments_[j]],ws.z[j],ws.o[j],sw,sv);
+        ws.regressor[j*np + k*NB_SEGMENT_PARAMETERS + p] = dot(sw,f_ang) + dot(sv,f_lin);
+      }
+    }
+  }
+  if(regressor)
+    return;
+
+  // Each joint carries the forces of the segments after it, tip to base
+  Vec3 f_ang = constant(Eigen::Vector3d::Zero()), f_lin = f_ang;
+  for(int k=ns-1; k>=0; k--){
+    f_ang = add(f_ang,ws.f_ang[k]);
+    f_lin = add(f_lin,ws.f_lin[k]);
+    const SegmentModel& seg = segments_[k];
+    if(seg.type == SegmentModel::FIXED)
+      continue;
+    const int j = seg.joint_index;
+    Vec3 sw, sv;
+    motionSubspace(seg,ws.z[j],ws.o[j],sw,sv);
+    ws.tau[j] = dot(sw,f_ang) + dot(sv,f_lin);
+  }
+}
@@ -0,0 +1,78 @@
+#include <ros/ros.h>
+#include <rtt_ros_kdl_tools/chain_utils.hpp>
+#include <cart_opt_ctrl/batched_dynamics.hpp>
+#include <chrono>
+
+// Compares BatchedDynamics with the per configuration ChainUtils model
+// on random configurations within the joint limits, for the robot found on the parameter server.
+int main(int argc, char** argv){
+  ros::init(argc, argv, "batched_dynamics_benchmark");
+  ros::NodeHandle nh("~");
+
+  int nb_configs, nb_threads;
+  nh.param("nb_configs", nb_configs, 100000);
+  nh.param("nb_threads", nb_threads, 0);
+
+  rtt_ros_kdl_tools::ChainUtils arm;
+  if(!arm.init()){
+    ROS_ERROR("Could not init chain utils !");
+    return 1;
+  }
+  const int dof = arm.getNrOfJoints();
+
+  BatchedDynamics batch;
+  if(!batch.init(arm.Chain())){
+    ROS_ERROR("The chain has joints with a scale or an offset, not supported by BatchedDynamics");
+    return 1;
+  }
+  batch.setNbThreads(nb_threads);
+
+  // Random configurations
+  const Eigen::VectorXd lower = arm.getJointLowerLimit(), upper = arm.getJointUpperLimit();
+  BatchedDynamicsResult::Matrix q(dof,nb_configs);
+  for(int n=0; n<nb_configs; n++)
+    q.col(n) = lower + (upper - lower).cwiseProduct(Eigen::VectorXd::Random(dof) * 0.5 + Eigen::VectorXd::Constant(dof,0.5));
+
+  BatchedDynamicsResult result;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  batch.compute(q,result);
+  const double batch_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Reference, one configuration at a time
+  const int tip = arm.getNrOfSegments() - 1;
+  const Eigen::VectorXd qd = Eigen::VectorXd::Zero(dof);
+  double max_err_pose = 0.0, max_err_jac = 0.0, max_err_grav = 0.0, max_err_inertia = 0.0, max_err_inertia_inv = 0.0;
+  start = std::chrono::steady_clock::now();
+  for(int n=0; n<nb_configs; n++){
+    arm.setState(q.col(n),qd);
+    arm.updateModel();
+    const KDL::Frame& X = arm.getSegmentPosition(tip);
+    const KDL::Jacobian& J = arm.getSegmentJacobian(tip);
+    const KDL::JntArray& G = arm.getGravityTorque();
+    const KDL::JntSpaceInertiaMatrix& M = arm.getInertiaMatrix();
+    const KDL::JntSpaceInertiaMatrix& M_inv = arm.getInertiaInverseMatrix();
+
+    for(int i=0; i<3; i++){
+      max_err_pose = std::max(max_err_pose, std::abs(X.p(i) - result.pose(i,n)));
+      for(int j=0; j<3; j++)
+        max_err_pose = std::max(max_err_pose, std::abs(X.M(i,j) - result.pose(3+3*i+j,n)));
+    }
+    for(int i=0; i<dof; i++){
+      max_err_grav = std::max(max_err_grav, std::abs(G(i) - result.gravity(i,n)));
+      for(int r=0; r<6; r++)
+        max_err_jac = std::max(max_err_jac, std::abs(J.data(r,i) - result.jacobian(r*dof+i,n)));
+      for(int j=0; j<dof; j++){
+        max_err_inertia = std::max(max_err_inertia, std::abs(M.data(i,j) - result.inertia(i*dof+j,n)));
+        max_err_inertia_inv = std::max(max_err_inertia_inv, std::abs(M_inv.data(i,j) - result.inertia_inverse(i*dof+j,n)));
+      }
+    }
+  }
+  const double ref_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  ROS_INFO("%d configurations, %d joints", nb_configs, dof);
+  ROS_INFO("BatchedDynamics : %.0f configs/s", nb_configs / batch_time);
+  ROS_INFO("ChainUtils      : %.0f configs/s (includes the error computation)", nb_configs / ref_time);
+  ROS_INFO("Max errors : pose %g, jacobian %g, gravity %g, inertia %g, inertia inverse %g",
+           max_err_pose, max_err_jac, max_err_grav, max_err_inertia, max_err_inertia_inv);
+  return 0;
+}
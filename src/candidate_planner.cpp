@@ -0,0 +1,256 @@
+#include "cart_opt_ctrl/candidate_planner.hpp"
+#include <kdl/utilities/error.h>
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+  typedef Eigen::Matrix<double,6,1> Vector6d;
+
+  // Twist bringing a onto b in one second, [linear, angular] in the base frame
+  inline Vector6d poseError(const KDL::Frame& a, const KDL::Frame& b){
+    const KDL::Twist error = KDL::diff(a, b);
+    Vector6d e;
+    for(int i=0; i<6; i++)
+      e(i) = error(i);
+    return e;
+  }
+
+  // Damped least squares : dq = J^T.(J.J^T + l^2.I)^-1.e, fixed size solve
+  inline void dampedLeastSquares(const MultiFrameKinematics::Jacobian& jacobian, const Vector6d& e, Eigen::VectorXd& dq){
+    Eigen::Matrix<double,6,6> a;
+    a.noalias() = jacobian * jacobian.transpose();
+    a.diagonal().array() += 1e-4;
+    const Vector6d x = a.ldlt().solve(e);
+    dq.noalias() = jacobian.transpose() * x;
+  }
+}
+
+CandidatePlanner::CandidatePlanner() : generation_(0), active_(0), stop_(false), use_model_(false), phase_(BUILD), nb_tasks_(0),
+                                       next_task_(0), best_rank_(0), evaluated_(0), feasible_(0), budget_exceeded_(false),
+                                       end_pause_(0.0), waypoints_(0), candidates_(0)
+{
+  limits_.vel = limits_.acc = limits_.rot_vel = limits_.rot_acc = std::numeric_limits<double>::infinity();
+  limits_.check_period = 0.01;
+  limits_.tracking_tolerance = 0.005;
+}
+
+CandidatePlanner::~CandidatePlanner(){
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for(unsigned int t=0; t<workers_.size(); t++)
+    workers_[t].join();
+}
+
+bool CandidatePlanner::init(unsigned int nb_threads, const KDL::Chain* chain, const std::string& tip_segment){
+  if(!workers_.empty())
+    return false;
+  if(nb_threads == 0)
+    nb_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  // Each worker has its own kinematics, they are created before the threads and never move
+  use_model_ = chain != 0;
+  worker_data_.resize(nb_threads);
+  for(unsigned int t=0; t<nb_threads; t++){
+    Worker& worker = worker_data_[t];
+    worker.tip = -1;
+    worker.aborted = false;
+    if(use_model_){
+      if(!worker.kinematics.init(*chain) || (worker.tip = worker.kinematics.addFrame(tip_segment)) < 0)
+        return false;
+      worker.q.setZero(worker.kinematics.getNrOfJoints());
+      worker.qd.setZero(worker.kinematics.getNrOfJoints());
+      worker.dq.setZero(worker.kinematics.getNrOfJoints());
+    }
+  }
+  for(unsigned int t=0; t<nb_threads; t++)
+    workers_.push_back(std::thread(&CandidatePlanner::workerLoop, this, t));
+  return true;
+}
+
+bool CandidatePlanner::plan(const std::vector<KDL::Frame>& waypoints, const std::vector<PlanningCandidate>& candidates, double end_pause,
+                            const Eigen::VectorXd& q_start, double budget, TrajectoryPlan& result, Report& report){
+  const Clock::time_point start = Clock::now();
+  deadline_ = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget));
+  waypoints_ = &waypoints;
+  candidates_ = &candidates;
+  end_pause_ = end_pause;
+  q_start_ = q_start;
+  if(use_model_ && q_start_.size() != worker_data_[0].kinematics.getNrOfJoints())
+    q_start_.resize(0);
+  budget_exceeded_ = false;
+  evaluated_ = 0;
+  feasible_ = 0;
+
+  // Build every candidate into the plans of the previous requests, then check them from the shortest
+  const int nb_candidates = candidates.size();
+  while(plans_.size() < candidates.size())
+    plans_.push_back(std::unique_ptr<TrajectoryPlan>(new TrajectoryPlan()));
+  durations_.assign(nb_candidates, std::numeric_limits<double>::infinity());
+  if(!workers_.empty())
+    dispatch(BUILD, nb_candidates);
+  order_.clear();
+  for(int c=0; c<nb_candidates; c++)
+    if(!plans_[c]->empty())
+      order_.push_back(c);
+  struct ByDuration{
+    const std::vector<double>& durations;
+    bool operator()(int a, int b) const { return durations[a] < durations[b]; }
+  };
+  std::stable_sort(order_.begin(), order_.end(), ByDuration{durations_});
+  best_rank_ = static_cast<int>(order_.size());
+  if(!order_.empty())
+    dispatch(CHECK, order_.size());
+
+  const bool found = best_rank_ < static_cast<int>(order_.size());
+  report.candidates = nb_candidates;
+  report.evaluated = evaluated_;
+  report.feasible = feasible_;
+  report.budget_exceeded = budget_exceeded_;
+  report.duration = found ? durations_[order_[best_rank_]] : 0.0;
+  report.nominal_duration = nb_candidates > 0 && !plans_[0]->empty() ? durations_[0] : 0.0;
+  report.memory = 0;
+  for(unsigned int c=0; c<plans_.size(); c++)
+    report.memory += plans_[c]->getMemoryReserved();
+
+  // The previous content of result is retired with the other candidates
+  if(found)
+    result.swap(*plans_[order_[best_rank_]]);
+  for(int c=0; c<nb_candidates; c++)
+    plans_[c]->clear();
+  report.planning_time = std::chrono::duration<double>(Clock::now() - start).count();
+  return found;
+}
+
+void CandidatePlanner::dispatch(Phase phase, int nb_tasks){
+  std::unique_lock<std::mutex> lock(mutex_);
+  phase_ = phase;
+  nb_tasks_ = nb_tasks;
+  next_task_ = 0;
+  active_ = workers_.size();
+  ++generation_;
+  wake_.notify_all();
+  done_.wait(lock, [this]{ return active_ == 0; });
+}
+
+void CandidatePlanner::workerLoop(unsigned int index){
+  unsigned int generation = 0;
+  while(true){
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this, generation]{ return stop_ || generation_ != generation; });
+      if(stop_)
+        return;
+      generation = generation_;
+    }
+    runTasks(worker_data_[index]);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if(--active_ == 0)
+        done_.notify_one();
+    }
+  }
+}
+
+void CandidatePlanner::runTasks(Worker& worker){
+  for(int i = next_task_++; i < nb_tasks_; i = next_task_++){
+    if(phase_ == BUILD){
+      const PlanningCandidate& candidate = (*candidates_)[i];
+      try{
+        if(plans_[i]->build(*waypoints_, candidate.radius, candidate.eqradius, candidate.vel_max, candidate.acc_max, candidate.profile, end_pause_))
+          durations_[i] = plans_[i]->Duration();
+      } catch(KDL::Error&) {
+        // Blend radius too large for the segments, degenerate path... the plan is left empty
+      }
+      continue;
+    }
+
+    // A shorter candidate is already feasible
+    if(i > best_rank_)
+      continue;
+    if(Clock::now() > deadline_){
+      budget_exceeded_ = true;
+      return;
+    }
+    worker.aborted = false;
+    const bool feasible = isFeasible(worker, *plans_[order_[i]]);
+    if(worker.aborted){
+      budget_exceeded_ = true;
+      return;
+    }
+    ++evaluated_;
+    if(feasible){
+      ++feasible_;
+      int best = best_rank_;
+      while(i < best && !best_rank_.compare_exchange_weak(best, i));
+    }
+  }
+}
+
+bool CandidatePlanner::isFeasible(Worker& worker, const TrajectoryPlan& trajectory){
+  // Cartesian limits, with a small margin for the sampling of the profiles
+  const double duration = trajectory.Duration();
+  const double margin = 1.0 + 1e-6;
+  for(double t=0.0; t<=duration; t+=limits_.check_period){
+    const KDL::Twist vel = trajectory.Vel(t);
+    const KDL::Twist acc = trajectory.Acc(t);
+    if(vel.vel.Norm() > margin * limits_.vel || vel.rot.Norm() > margin * limits_.rot_vel
+       || acc.vel.Norm() > margin * limits_.acc || acc.rot.Norm() > margin * limits_.rot_acc)
+      return false;
+  }
+  if(!use_model_ || q_start_.size() == 0)
+    return true;
+  return followTrajectory(worker, trajectory);
+}
+
+bool CandidatePlanner::followTrajectory(Worker& worker, const TrajectoryPlan& trajectory){
+  MultiFrameKinematics& kinematics = worker.kinematics;
+  const double dt = limits_.check_period;
+  const bool check_velocity = limits_.joint_vel.size() == worker.q.size();
+  const bool check_position = limits_.joint_lower.size() == worker.q.size() && limits_.joint_upper.size() == worker.q.size();
+  worker.q = q_start_;
+  worker.qd.setZero();
+
+  // Reach the start of the trajectory from the start configuration
+  Vector6d error;
+  for(int it=0; ; it++){
+    kinematics.update(worker.q, worker.qd);
+    error = poseError(kinematics.getPose(worker.tip), trajectory.Pos(0.0));
+    if(error.head<3>().norm() < limits_.tracking_tolerance && error.tail<3>().norm() < limits_.tracking_tolerance)
+      break;
+    if(it == 100)
+      return false;
+    dampedLeastSquares(kinematics.getJacobian(worker.tip), error, worker.dq);
+    worker.q += worker.dq;
+  }
+
+  // Then one IK step per sample, the joint velocity is the step over the period
+  const double duration = trajectory.Duration();
+  int step = 0;
+  for(double t=dt; t<=duration; t+=dt, ++step){
+    if((step & 63) == 0 && Clock::now() > deadline_){
+      worker.aborted = true;
+      return false;
+    }
+    const KDL::Frame target = trajectory.Pos(t);
+    error = poseError(kinematics.getPose(worker.tip), target);
+    dampedLeastSquares(kinematics.getJacobian(worker.tip), error, worker.dq);
+    worker.qd = worker.dq / dt;
+    worker.q += worker.dq;
+    if(check_velocity && (worker.qd.cwiseAbs().array() > limits_.joint_vel.array()).any())
+      return false;
+    if(check_position && ((worker.q.array() < limits_.joint_lower.array()).any() || (worker.q.array() > limits_.joint_upper.array()).any()))
+      return false;
+
+    // The tip must have followed the trajectory (out of reach or singular otherwise)
+    kinematics.update(worker.q, worker.qd);
+    error = poseError(kinematics.getPose(worker.tip), target);
+    if(error.head<3>().norm() > limits_.tracking_tolerance || error.tail<3>().norm() > limits_.tracking_tolerance)
+      return false;
+  }
+  return true;
+}
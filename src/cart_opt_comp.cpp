@@ -6,8 +6,10 @@ using namespace KDL;
 CartOptCtrl::CartOptCtrl(const std::string& name):RTT::TaskContext(name)
 {
   // Orocos ports
-  this->addPort("JointPosition",port_joint_position_in_);
+  // Event port, only triggers the cycle with event_triggered (see dataOnPortHook)
+  this->addEventPort("JointPosition",port_joint_position_in_);
   this->addPort("JointVelocity",port_joint_velocity_in_);
+  this->addPort("JointTorque",port_joint_torque_in_);
   this->addPort("JointTorqueCommand",port_joint_torque_out_);
   this->addPort("TrajectoryPointPosIn",port_pnt_pos_in_);
   this->addPort("TrajectoryPointVelIn",port_pnt_vel_in_);
@@ -21,6 +23,14 @@ CartOptCtrl::CartOptCtrl(const std::string& name):RTT::TaskContext(name)
   this->addPort("Ec_lim",port_ec_lim_out_);
   this->addPort("Ec_predicted",port_ec_predicted_out_);
   this->addPort("FTData",port_ftdata_);
+  this->addPort("GainsActive",port_gains_active_out_);
+  this->addPort("PayloadParameters",port_payload_in_);
+  this->addPort("MomentumResidual",port_residual_out_);
+  this->addPort("CollisionDetected",port_collision_out_);
+  this->addPort("TrackingFeedback",port_tracking_feedback_out_);
+  this->addPort("Slack",port_slack_out_);
+  this->addPort("ControlLatency",port_latency_out_);
+  this->addPort("PluginTimings",port_plugin_timings_out_);
 
   // Orocos properties/ROS params
   this->addProperty("frame_of_interest",ee_frame_).doc("The robot frame to track the trajectory");
@@ -47,16 +57,65 @@ CartOptCtrl::CartOptCtrl(const std::string& name):RTT::TaskContext(name)
   this->addProperty("ec_safe",ec_safe_).doc("Min Ec limit");
   this->addProperty("human_min_dist",human_min_dist_).doc("Human minimum distance for ec = ec_safe");
   this->addProperty("human_max_dist",human_max_dist_).doc("Human distance for ec = ec_max");
+  this->addProperty("gain_scheduling",gain_scheduling_).doc("Interpolate the PD gains from the gain schedule tables");
+  this->addProperty("payload_mass",payload_mass_).doc("Mass of the carried payload, used to schedule the gains");
+  this->addProperty("gs_axis_min",gs_axis_min_).doc("Gain schedule grid lower bounds (lambda, payload, speed)");
+  this->addProperty("gs_axis_max",gs_axis_max_).doc("Gain schedule grid upper bounds (lambda, payload, speed)");
+  this->addProperty("gs_axis_samples",gs_axis_samples_).doc("Gain schedule number of samples per axis (lambda, payload, speed)");
+  this->addProperty("gs_p_table",gs_p_table_).doc("Gain schedule proportional gains, 6 per grid point");
+  this->addProperty("gs_d_table",gs_d_table_).doc("Gain schedule derivative gains, 6 per grid point");
+  this->addProperty("impedance_mode",impedance_mode_).doc("Use a cartesian stiffness and a damping computed from Lambda instead of the PD gains");
+  this->addProperty("stiffness",stiffness_).doc("Cartesian stiffness in impedance mode (N/m, N.m/rad)");
+  this->addProperty("damping_ratio",damping_ratio_).doc("Damping ratio for each cartesian axis in impedance mode");
+  this->addProperty("use_payload_model",use_payload_model_).doc("Add the payload inertial parameters to the model");
+  this->addProperty("payload_parameters",payload_params_).doc("Payload [m, m.c, Ixx, Ixy, Ixz, Iyy, Iyz, Izz] in the frame of interest, overwritten by the PayloadParameters port");
+  this->addProperty("collision_detection",collision_detection_).doc("Detect collisions with the generalized momentum observer");
+  this->addProperty("observer_gains",observer_gains_).doc("Momentum observer gains for each joint (1/s)");
+  this->addProperty("collision_thresholds",collision_thresholds_).doc("Residual torque above which a collision is detected, for each joint");
+  this->addProperty("collision_reaction",collision_reaction_).doc("Reaction to a collision, 0 : none, 1 : lower Ec_lim to collision_ec_lim, 2 : compliant (regularisation task only)");
+  this->addProperty("collision_ec_lim",collision_ec_lim_).doc("Ec limit after a collision");
+  this->addProperty("collision_hold_time",collision_hold_time_).doc("Time the reaction is kept once the residuals are back under the thresholds");
+  this->addProperty("soft_constraints",soft_constraints_).doc("Add slack variables with L1 penalties to the constraints so the QP is always feasible");
+  this->addProperty("event_triggered",event_triggered_).doc("Run the cycle when a new JointPosition arrives, the activity should not be periodic");
+  this->addProperty("nominal_period",nominal_period_).doc("Control period used by the model when the activity is not periodic (s)");
+  this->addProperty("watchdog_timeout",watchdog_timeout_).doc("In event_triggered mode, run anyway if no JointPosition arrived during this time (s)");
+  this->addProperty("skip_unchanged_inputs",skip_unchanged_inputs_).doc("Send the previous torque without computing when no input changed since the last cycle");
+  this->addProperty("fast_path",fast_path_).doc("Skip the QP solver when the unconstrained optimum satisfies all the constraints");
+  this->addProperty("woodbury_hessian",woodbury_hessian_).doc("Fast path : invert H from M and the low rank task terms (Woodbury) instead of a dense Cholesky");
+  this->addProperty("qp_record_size",qp_record_size_).doc("Number of QPs given to the solver kept in memory for qp_option_tuner, 0 to disable");
+  this->addProperty("qp_record_file",qp_record_file_).doc("File where the recorded QPs are written on stop");
+  this->addProperty("joint_record_size",joint_record_size_).doc("Number of joint states and torques kept in memory for dynamic_identifier, 0 to disable");
+  this->addProperty("joint_record_file",joint_record_file_).doc("File where the recorded joint states and torques are written on stop");
+  this->addProperty("robot_description",robot_description_).doc("Parameter holding the URDF of the model, read before the others (robot_description_identified for dynamic_identifier's)");
+  this->addProperty("wall_frames",wall_frames_).doc("Frames kept inside the cartesian constraints, separated by spaces, frame_of_interest if empty");
+  this->addProperty("friction_compensation",friction_compensation_).doc("Add the joint friction torque of the identified model to the command");
+  this->addProperty("friction_coulomb",friction_coulomb_).doc("Coulomb friction of each joint (N.m)");
+  this->addProperty("friction_static",friction_static_).doc("Static friction of each joint (N.m)");
+  this->addProperty("friction_stribeck_velocity",friction_stribeck_velocity_).doc("Stribeck velocity of each joint (rad/s)");
+  this->addProperty("friction_viscous",friction_viscous_).doc("Viscous friction of each joint (N.m.s/rad)");
+  this->addProperty("friction_velocity_deadband",friction_deadband_).doc("Velocity under which the friction compensation ramps to 0 (rad/s)");
+  this->addProperty("slack_weights",slack_weights_).doc("L1 penalty of the slacks for [joint, cartesian, energy] constraints, the highest is violated last, <= 0 keeps the class hard");
 
   select_components_.resize(6);
   select_axes_.resize(select_components_.size());
+  task_frames_.resize(select_components_.size());
   for(int i = 0; i<select_components_.size() ; i++){
     std::string name = "select_components_"+ std::to_string(i);
     this->addProperty(name,select_components_[i]).doc("Selection of cartesian components for the task");
     name = "select_axes_"+ std::to_string(i);
     this->addProperty(name,select_axes_[i]).doc("Selection of the axis to use for the task");
+    name = "task_frame_"+ std::to_string(i);
+    this->addProperty(name,task_frames_[i]).doc("Frame of the task, frame_of_interest if empty, other frames hold their pose at the first command");
   }
 
+  this->addAttribute("skipped_cycles",skipped_cycles_);
+  this->addAttribute("computed_cycles",computed_cycles_);
+  this->addAttribute("fast_path_hits",fast_path_hits_);
+  this->addAttribute("qp_calls",qp_calls_);
+  this->addAttribute("fast_path_hit_rate",fast_path_hit_rate_);
+
+  robot_description_ = "robot_description";
+
   // Service to get current cartesian pose
   this->addOperation("getCurrentPose",&CartOptCtrl::getCurrentPose,this,RTT::ClientThread);
 }
@@ -69,13 +128,14 @@ bool CartOptCtrl::getCurrentPose(cart_opt_ctrl::GetCurrentPose::Request& req, ca
 
 bool CartOptCtrl::configureHook(){
   // Initialise the model, the internal solvers etc
-  if( ! arm_.init() ){
+  // The URDF parameter is needed before the model, the other properties after
+  ros::param::get(this->getName() + "/robot_description", robot_description_);
+  if( ! arm_.init(robot_description_) ){
     log(RTT::Error) << "Could not init chain utils !" << endlog();
     return false;
   }
   // The number of joints
   const int dof = arm_.getNrOfJoints();
-  number_of_constraints_ = dof + 3 + 1;
 
   // Resize the vectors and matrices
   p_gains_.resize(6);
@@ -93,47 +153,52 @@ bool CartOptCtrl::configureHook(){
   joint_torque_out_.resize(dof);
   joint_position_in_.resize(dof);
   joint_velocity_in_.resize(dof);
-  H_.resize(dof,dof);
-  g_.resize(dof);
   a_.resize(6,dof);
-  lb_.resize(dof);
-  ub_.resize(dof);
-  A_.resize(number_of_constraints_,dof);
-  lbA_.resize(number_of_constraints_);
-  ubA_.resize(number_of_constraints_);
   qd_min_.resize(dof);
   qd_max_.resize(dof);
   J_.resize(dof);
   M_inv_.resize(dof);
   coriolis_.resize(dof);
   gravity_.resize(dof);
+  dyn_param_.reset(new KDL::ChainDynParam(arm_.Chain(), KDL::Vector(gravity_vector_(0),gravity_vector_(1),gravity_vector_(2))));
+  q_kdl_.resize(dof);
+  qd_kdl_.resize(dof);
+  arm_gravity_.resize(dof);
+  arm_inertia_.resize(dof);
+  arm_inertia_llt_ = Eigen::LLT<Eigen::MatrixXd>(dof);
   nonLinearTerms_.resize(dof);
-  x_max_.resize(6);
-  x_min_.resize(6);
   joint_pos_vel_.positions.resize(dof);
   joint_pos_vel_.velocities.resize(dof);
   viscous_coeffs_.resize(6);
+  p_gains_active_.resize(6);
+  d_gains_active_.resize(6);
+  gains_active_.resize(12);
+  stiffness_.resize(6);
+  damping_ratio_.resize(6);
+  payload_params_.resize(PayloadEstimator::NB_PARAMS);
+  payload_in_.resize(PayloadEstimator::NB_PARAMS);
+  mass_matrix_.resize(dof,dof);
+  observer_gains_.resize(dof);
+  collision_thresholds_.resize(dof);
+  applied_torque_.resize(dof);
+  joint_torque_in_.resize(dof);
+  slack_weights_.resize(3);
 
   // Matices init
-  H_.setZero(dof, dof);
-  g_.setZero(dof);
   a_.setZero(6,dof);
-  lb_.setZero(dof);
-  ub_.setZero(dof);
-  A_.setZero(number_of_constraints_,dof);
-  lbA_.setZero(number_of_constraints_);
-  ubA_.setZero(number_of_constraints_);
   qd_min_.setZero(dof);
   qd_max_.setZero(dof);
   nonLinearTerms_.setZero(dof);
-  x_max_.setZero(6);
-  x_min_.setZero(6);
   joint_torque_out_.setZero(dof);
   joint_position_in_.setZero(dof);
   joint_velocity_in_.setZero(dof);
   KDL::SetToZero(integral_error_);
   viscous_coeffs_.setZero(6);
   xd_curr_filtered_.setZero();
+  p_gains_active_.setZero(6);
+  d_gains_active_.setZero(6);
+  gains_active_.setZero(12);
+  applied_torque_.setZero(dof);
 
   // Default params
   ee_frame_ = arm_.getSegmentName( arm_.getNrOfSegments() - 1 );
@@ -159,6 +224,9 @@ bool CartOptCtrl::configureHook(){
   }
   select_components_[0].setOnes(6);
   select_axes_[0].setOnes(dof);
+  for(unsigned int i = 0; i<task_frames_.size() ; i++)
+    task_frames_[i] = "";
+  wall_frames_ = "";
   // TODO: get this from URDF
   torque_max_ << 175,175,99,99,99,37,37 ;
   jnt_vel_max_ << 1.0,1.0,1.0,1.0,1.0,1.0,1.0;
@@ -167,6 +235,37 @@ bool CartOptCtrl::configureHook(){
   human_min_dist_ = 0.15;
   human_max_dist_ = 4;
   distance_to_contact_ = 1000;
+  gain_scheduling_ = false;
+  payload_mass_ = 0.0;
+  impedance_mode_ = false;
+  stiffness_ << 3000,3000,3000,300,300,300;
+  damping_ratio_ << 1.0,1.0,1.0,1.0,1.0,1.0;
+  use_payload_model_ = false;
+  payload_params_.setZero(PayloadEstimator::NB_PARAMS);
+  collision_detection_ = false;
+  observer_gains_.setConstant(dof, 50.0);
+  collision_thresholds_ << 20,20,12,12,8,4,4;
+  collision_reaction_ = 1;
+  collision_ec_lim_ = 0.01;
+  collision_hold_time_ = 1.0;
+  soft_constraints_ = false;
+  slack_weights_ << 1.0e5, 1.0e4, 1.0e3;
+  event_triggered_ = false;
+  nominal_period_ = 0.001;
+  watchdog_timeout_ = 0.002;
+  skip_unchanged_inputs_ = false;
+  fast_path_ = false;
+  woodbury_hessian_ = false;
+  qp_record_size_ = 0;
+  qp_record_file_ = "";
+  joint_record_size_ = 0;
+  joint_record_file_ = "";
+  friction_compensation_ = false;
+  friction_coulomb_.setZero(dof);
+  friction_static_.setZero(dof);
+  friction_stribeck_velocity_.setConstant(dof, 0.05);
+  friction_viscous_.setZero(dof);
+  friction_deadband_ = 0.005;
 
   // Match all properties (defined in the constructor)
   // with the rosparams in the namespace :
@@ -174,22 +273,143 @@ bool CartOptCtrl::configureHook(){
   // Equivalent to ros::param::get("CartOptCtrl/p_gains_");
   rtt_ros_kdl_tools::getAllPropertiesFromROSParam(this);
 
-  // QPOases init
-  int number_of_variables = dof;
-  number_of_constraints_ = dof + 3 + 1;
-  qpoases_solver_.reset(new qpOASES::SQProblem(number_of_variables,number_of_constraints_,qpOASES::HST_POSDEF));
+  // Frame handles, nothing is looked up by name in the loop
+  if(!resolveFrames())
+    return false;
 
-  // QPOases options
+  // Event triggered mode, the model still needs a period
+  period_ = this->getPeriod() > 0.0 ? this->getPeriod() : nominal_period_;
+  if(event_triggered_){
+    if(this->getPeriod() > 0.0)
+      log(RTT::Warning) << "event_triggered with a periodic activity, the cycle runs on both" << endlog();
+    if(watchdog_timeout_ <= 0.0){
+      log(RTT::Error) << "watchdog_timeout must be positive" << endlog();
+      return false;
+    }
+    watchdog_.reset(new Watchdog(this));
+  }
+  else
+    watchdog_.reset();
+  joint_state_time_ = 0;
+  latency_msg_.data = 0.0;
+  port_latency_out_.setDataSample(latency_msg_);
+
+  // Gain schedule tables
+  if(gain_scheduling_ && !gain_scheduler_.configure(gs_axis_min_,gs_axis_max_,gs_axis_samples_,gs_p_table_,gs_d_table_)){
+    log(RTT::Error) << "Invalid gain schedule tables !" << endlog();
+    return false;
+  }
+  port_gains_active_out_.setDataSample(gains_active_);
+  if(impedance_mode_ && gain_scheduling_)
+    log(RTT::Warning) << "Impedance mode enabled, the gain schedule will be ignored" << endlog();
+
+  // Payload model
+  if(payload_params_.size() != PayloadEstimator::NB_PARAMS){
+    log(RTT::Error) << "payload_parameters must have " << PayloadEstimator::NB_PARAMS << " elements" << endlog();
+    return false;
+  }
+  if(!PayloadEstimator::isPhysical(payload_params_.data())){
+    log(RTT::Error) << "payload_parameters are not physically consistent (mass, inertia about the center of mass)" << endlog();
+    return false;
+  }
+  payload_in_ = payload_params_;
+  mass_matrix_ldlt_ = Eigen::LDLT<Eigen::MatrixXd>(dof);
+
+  // Collision detection
+  if(collision_detection_ && (collision_thresholds_.size() != dof || !momentum_observer_.configure(dof,observer_gains_))){
+    log(RTT::Error) << "Invalid collision detection parameters, observer_gains and collision_thresholds need "
+                    << dof << " elements" << endlog();
+    return false;
+  }
+  port_residual_out_.setDataSample(momentum_observer_.getResidual());
+
+  // Friction tables over the joint velocity limits
+  friction_torque_.setZero(dof);
+  if(friction_compensation_){
+    std::vector<FrictionModel::Parameters> friction(dof);
+    const bool sizes = friction_coulomb_.size() == dof && friction_static_.size() == dof
+                       && friction_stribeck_velocity_.size() == dof && friction_viscous_.size() == dof;
+    for(int i=0; sizes && i<dof; i++){
+      friction[i].coulomb = friction_coulomb_(i);
+      friction[i].stat = friction_static_(i);
+      friction[i].stribeck_velocity = friction_stribeck_velocity_(i);
+      friction[i].viscous = friction_viscous_(i);
+    }
+    if(!sizes || (friction_stribeck_velocity_.array() <= 0.0).any() || !friction_table_.configure(friction,jnt_vel_max_,friction_deadband_)){
+      log(RTT::Error) << "Invalid friction parameters, " << dof << " elements each, positive stribeck velocities and joint_vel_max, "
+                      << "and a friction_velocity_deadband over " << 4.0 * jnt_vel_max_.maxCoeff() / (FrictionTable::MAX_SIZE - 1) << " rad/s" << endlog();
+      return false;
+    }
+  }
+
+  // QP variables [tau, s+, s-], the slacks are only there with soft constraints
+  // Constraints [joint position/velocity (dof), cartesian walls (3 per wall frame), Ec (1), plugins rows]
+  if(soft_constraints_ && slack_weights_.size() != 3){
+    log(RTT::Error) << "slack_weights needs 3 elements [joint, cartesian, energy]" << endlog();
+    return false;
+  }
+  if(!loadPlugins(dof))
+    return false;
+  const int nb_wall_rows = 3 * wall_handles_.size();
+  number_of_constraints_ = dof + nb_wall_rows + 1;
+  plugin_row_offsets_.clear();
+  for(unsigned int i=0; i<plugins_.size(); i++){
+    plugin_row_offsets_.push_back(number_of_constraints_);
+    number_of_constraints_ += plugins_[i]->rows();
+  }
+  slack_row_weights_.setZero(number_of_constraints_);
+  if(soft_constraints_){
+    slack_row_weights_.head(dof).setConstant(slack_weights_(0));
+    slack_row_weights_.segment(dof,nb_wall_rows).setConstant(slack_weights_(1));
+    slack_row_weights_(dof+nb_wall_rows) = slack_weights_(2);
+    for(unsigned int i=0; i<plugins_.size(); i++)
+      slack_row_weights_.segment(plugin_row_offsets_[i],plugins_[i]->rows()).setConstant(plugins_[i]->slackWeight());
+  }
+  number_of_variables_ = soft_constraints_ ? dof + 2 * number_of_constraints_ : dof;
+  H_.setZero(number_of_variables_, number_of_variables_);
+  g_.setZero(number_of_variables_);
+  lb_.setZero(number_of_variables_);
+  ub_.setZero(number_of_variables_);
+  A_.setZero(number_of_constraints_, number_of_variables_);
+  lbA_.setZero(number_of_constraints_);
+  ubA_.setZero(number_of_constraints_);
+  primal_solution_.setZero(number_of_variables_);
+  hessian_llt_ = Eigen::LLT<Eigen::MatrixXd>(dof);
+  woodbury_.configure(dof, select_components_.size());
+  unconstrained_tau_.setZero(dof);
+  constraint_rows_.setZero(number_of_constraints_);
+  fast_path_hit_ = false;
+  // The low rank hessian only knows the cartesian tasks
+  if(woodbury_hessian_ && !plugins_.empty()){
+    log(RTT::Warning) << "woodbury_hessian ignores the plugin tasks, using the dense Cholesky" << endlog();
+    woodbury_hessian_ = false;
+  }
+  slack_out_.setZero(soft_constraints_ ? number_of_constraints_ : 0);
+  port_slack_out_.setDataSample(slack_out_);
+
+  // QPOases init
+  qpoases_solver_.reset(new qpOASES::SQProblem(number_of_variables_,number_of_constraints_,qpOASES::HST_POSDEF));
+  dual_solution_.setZero(number_of_variables_ + number_of_constraints_);
+  tracking_feedback_.setZero(TrackingFeedback::SIZE);
+  port_tracking_feedback_out_.setDataSample(tracking_feedback_);
+
+  // QPOases options, setToMPC() without regularisation by default,
+  // config/qp_options.yaml (written by qp_option_tuner) is loaded in CartOptCtrl/qp_options
+  qp_options_ = QPSolverOptions();
+  qp_options_.getFromROSParam(this->getName() + "/qp_options");
   qpOASES::Options options;
-  // This options enables regularisation (required) and disable
-  // some checks to be very fast !
-  // options.setToDefault();
-  options.setToMPC(); // setToReliable() // setToDefault()
-  options.enableRegularisation = qpOASES::BT_FALSE; // since we specify the type of Hessian matrix, we do not need automatic regularisation
-  options.enableEqualities = qpOASES::BT_TRUE; // Specifies whether equalities shall be  always treated as active constraints.
+  if(!qp_options_.toOptions(options)){
+    log(RTT::Error) << "Unknown qp_options/preset " << qp_options_.preset << ", use MPC, Default or Reliable" << endlog();
+    return false;
+  }
+  log(RTT::Info) << "qpOASES options : " << qp_options_.toString() << endlog();
   qpoases_solver_->setOptions( options );
   qpoases_solver_->setPrintLevel(qpOASES::PL_NONE); // PL_HIGH for full output, PL_NONE for... none
 
+  // Record buffer, allocated once
+  qp_record_.configure(number_of_variables_, number_of_constraints_, qp_record_size_);
+  joint_record_.configure(dof, joint_record_size_, port_joint_torque_in_.connected() ? JointRecord::MEASURED_TORQUE : 0);
+
   return true;
 }
 
@@ -198,11 +418,37 @@ bool CartOptCtrl::startHook(){
   has_first_command_ = false;
   button_pressed_ = false;
   transition_gain_ = 1.0;
+  collision_detected_ = false;
+  collision_time_left_ = 0.0;
+  applied_torque_.setZero();
+  momentum_observer_.reset();
+  cycle_time_ = 0;
+  cycle_dt_ = period_;
+  skipped_cycles_ = 0;
+  computed_cycles_ = 0;
+  fast_path_hits_ = 0;
+  qp_calls_ = 0;
+  fast_path_hit_rate_ = 0.0;
+  if(watchdog_)
+    watchdog_->arm(0, watchdog_timeout_);
   return true;
 }
 
+bool CartOptCtrl::dataOnPortHook(RTT::base::PortInterface* port){
+  // Stamp the wake up on a new joint state for the latency, cycle only in event mode
+  if(port == &port_joint_position_in_){
+    joint_state_time_ = RTT::os::TimeService::Instance()->getNSecs();
+    return event_triggered_;
+  }
+  return false;
+}
+
 void CartOptCtrl::updateHook(){
   const int dof = arm_.getNrOfJoints();
+  // Falls back to a cycle every watchdog_timeout if the driver stops sending
+  if(watchdog_)
+    watchdog_->arm(0, watchdog_timeout_);
+
   // Read the current state of the robot
   RTT::FlowStatus fp = this->port_joint_position_in_.read(this->joint_position_in_);
   RTT::FlowStatus fv = this->port_joint_velocity_in_.read(this->joint_velocity_in_);
@@ -213,21 +459,58 @@ void CartOptCtrl::updateHook(){
     return;
   }
 
-  // Feed the internal model
+  // Read button press port
+  const bool button_was_pressed = button_pressed_;
+  this->port_button_pressed_in_.read(button_pressed_);
+
+  // Read the trajectory point, the ports keep the last sample
+  RTT::FlowStatus fpos = port_pnt_pos_in_.read(pt_pos_in_);
+  RTT::FlowStatus fvel = port_pnt_vel_in_.read(pt_vel_in_);
+  RTT::FlowStatus facc = port_pnt_acc_in_.read(pt_acc_in_);
+
+  // Nothing changed since the last cycle, the previous torque is still the solution.
+  // The other inputs (human pose, payload, FT) are used at the next computed cycle.
+  // The torque is held meanwhile, the next cycle integrates the observer, the integral term
+  // and the collision hold time over the whole interval (cycle_dt_)
+  if(skip_unchanged_inputs_ && has_first_command_ && fp == RTT::OldData && fv == RTT::OldData
+     && fpos != RTT::NewData && fvel != RTT::NewData && facc != RTT::NewData && button_pressed_ == button_was_pressed){
+    port_joint_torque_out_.write(joint_torque_out_);
+    ++skipped_cycles_;
+    return;
+  }
+  ++computed_cycles_;
+
+  // The event triggered cycles are not evenly spaced and cycles may be skipped, integrate over the measured interval
+  const RTT::os::TimeService::nsecs now = RTT::os::TimeService::Instance()->getNSecs();
+  cycle_dt_ = cycle_time_ > 0 && now > cycle_time_ ? RTT::os::TimeService::nsecs2Seconds(now - cycle_time_) : period_;
+  cycle_time_ = now;
+
+  // Feed the internal model, used for the external wrench torque
   arm_.setState(this->joint_position_in_,this->joint_velocity_in_);
-  // Make some calculations
-  arm_.updateModel();
+
+  // Dynamics of the arm, the jacobians and Jdot.qdot are only computed by kinematics_
+  q_kdl_.data = joint_position_in_;
+  qd_kdl_.data = joint_velocity_in_;
+  dyn_param_->JntToMass(q_kdl_,arm_inertia_);
+  dyn_param_->JntToCoriolis(q_kdl_,qd_kdl_,coriolis_);
+  dyn_param_->JntToGravity(q_kdl_,arm_gravity_);
+  arm_inertia_llt_.compute(arm_inertia_.data);
+  M_inv_.data.setIdentity();
+  arm_inertia_llt_.solveInPlace(M_inv_.data);
+
+  // Kinematics of every frame in one sweep
+  kinematics_.update(joint_position_in_, joint_velocity_in_);
 
   // Get Current end effector Pose
-  X_curr_ = arm_.getSegmentPosition(ee_frame_);
-  Xd_curr_ = arm_.getSegmentVelocity(ee_frame_);
+  X_curr_ = kinematics_.getPose(ee_handle_);
+  tf::twistEigenToKDL(kinematics_.getTwist(ee_handle_), Xd_curr_);
 
   // Initialize the desired velocity and acceleration to zero
   KDL::SetToZero(Xd_traj_);
   KDL::SetToZero(Xdd_traj_);
 
   // If we get a new trajectory point to track
-  if((port_pnt_pos_in_.read(pt_pos_in_) != RTT::NoData) && (port_pnt_vel_in_.read(pt_vel_in_) != RTT::NoData) && (port_pnt_acc_in_.read(pt_acc_in_) != RTT::NoData)){
+  if((fpos != RTT::NoData) && (fvel != RTT::NoData) && (facc != RTT::NoData)){
     // Then overwrite the desired
     X_traj_ = pt_pos_in_;
     Xd_traj_ = pt_vel_in_;
@@ -262,6 +545,13 @@ void CartOptCtrl::updateHook(){
   port_error_out_.write(error_twist_ros_);
 
   // Saturate the pose error
+  tracking_feedback_(TrackingFeedback::POSITION_ERROR) = X_err_.vel.Norm();
+  tracking_feedback_(TrackingFeedback::ORIENTATION_ERROR) = X_err_.rot.Norm();
+  error_saturated_ = false;
+  for(unsigned int i=0; i<3; ++i )
+    error_saturated_ |= std::abs(X_err_(i)) > position_saturation_;
+  for(unsigned int i=3; i<6; ++i )
+    error_saturated_ |= std::abs(X_err_(i)) > orientation_saturation_;
   for(unsigned int i=0; i<3; ++i ){
     if(X_err_(i) >0)
       X_err_(i) = std::min(position_saturation_, X_err_(i));
@@ -278,7 +568,7 @@ void CartOptCtrl::updateHook(){
   // Saturate the integral term
   for(unsigned int i=0; i<3; ++i ){
     if (i_gains_(i) > 0){
-      integral_error_(i) += X_err_(i) * this->getPeriod();
+      integral_error_(i) += X_err_(i) * cycle_dt_;
       if(integral_error_(i) >0)
         integral_error_(i) = std::min(integral_pos_saturation_ / i_gains_(i), integral_error_(i));
       else
@@ -289,7 +579,7 @@ void CartOptCtrl::updateHook(){
   }
   for(unsigned int i=3; i<6; ++i ){
     if (i_gains_(i) > 0){
-      integral_error_(i) += X_err_(i) * this->getPeriod();
+      integral_error_(i) += X_err_(i) * cycle_dt_;
       if(integral_error_(i) >0)
         integral_error_(i) = std::min(integral_rot_saturation_ / i_gains_(i), integral_error_(i));
       else
@@ -299,23 +589,78 @@ void CartOptCtrl::updateHook(){
       integral_error_(i) = 0;
   }
 
-  // Apply PD
-  for( unsigned int i=0; i<6; ++i )
-    Xdd_des_(i) = Xdd_traj_(i) + p_gains_(i) * ( X_err_(i) ) + i_gains_(i) * integral_error_(i) - d_gains_(i) * ( Xd_curr_(i) );
-  tf::twistKDLToEigen(Xdd_des_,xdd_des_);
-
   // Update current Matrices and vectors
-  J_ = arm_.getSegmentJacobian(ee_frame_);
-  M_inv_ = arm_.getInertiaInverseMatrix();
-  coriolis_ = arm_.getCoriolisTorque();
-  gravity_ = arm_.getGravityTorque();
-  Jdotqdot_ = arm_.getSegmentJdotQdot(ee_frame_);
-  tf::twistKDLToEigen(Jdotqdot_,jdot_qdot_);
+  J_.data = kinematics_.getJacobian(ee_handle_);
+  gravity_ = arm_gravity_;
+  jdot_qdot_ = kinematics_.getJdotQdot(ee_handle_);
+
+  // Add the payload to the model, the FT compensation already accounts for it when hand guiding
+  if(use_payload_model_ && !button_pressed_)
+    addPayloadToModel();
+
+  // Collision detection, reuses the model computed above
+  if(collision_detection_)
+    detectCollision();
+
   nonLinearTerms_ = M_inv_.data * ( coriolis_.data + gravity_.data );
   tf::twistKDLToEigen(Xd_curr_, xd_curr_);
   tf::vectorKDLToEigen(X_curr_.p, x_curr_lin_);
   x_curr_.block(0,0,3,1) = x_curr_lin_;
 
+  // Operational space inertia, used by the gain schedule and the Ec constraint
+  lambda_inv_.noalias() = J_.data * M_inv_.data * J_.data.transpose();
+  if(impedance_mode_){
+    // One eigen decomposition of Lambda^-1 = V.S.V^T gives both Lambda and its square root
+    lambda_inv_eig_.compute(lambda_inv_);
+    lambda_eigenvalues_ = lambda_inv_eig_.eigenvalues().cwiseInverse();
+    Lambda_.noalias() = lambda_inv_eig_.eigenvectors() * lambda_eigenvalues_.asDiagonal() * lambda_inv_eig_.eigenvectors().transpose();
+    lambda_eigenvalues_ = lambda_eigenvalues_.cwiseSqrt();
+    lambda_sqrt_.noalias() = lambda_inv_eig_.eigenvectors() * lambda_eigenvalues_.asDiagonal() * lambda_inv_eig_.eigenvectors().transpose();
+  }
+  else
+    Lambda_ = lambda_inv_.inverse();
+
+  // Select the PD gains for this cycle
+  if(impedance_mode_){
+    // Damping D = Lambda^1/2.Z.K^1/2 + K^1/2.Z.Lambda^1/2, critically damped for Z = 1
+    damping_half_.noalias() = lambda_sqrt_ * (stiffness_.cwiseSqrt().cwiseProduct(damping_ratio_)).asDiagonal();
+    damping_matrix_ = damping_half_ + damping_half_.transpose();
+    p_gains_active_ = stiffness_;
+    d_gains_active_ = damping_matrix_.diagonal();
+  }
+  else if(gain_scheduling_){
+    // The schedule is indexed by the highest effective translational mass
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> lambda_eig;
+    lambda_eig.computeDirect(Lambda_.topLeftCorner<3,3>(), Eigen::EigenvaluesOnly);
+    if(!gain_scheduler_.interpolate(lambda_eig.eigenvalues()(2), payload_mass_, xd_curr_.head<3>().norm(), p_gains_active_, d_gains_active_)){
+      // Non finite state, fixed gains
+      p_gains_active_ = p_gains_;
+      d_gains_active_ = d_gains_;
+    }
+  }
+  else{
+    p_gains_active_ = p_gains_;
+    d_gains_active_ = d_gains_;
+  }
+  gains_active_ << p_gains_active_, d_gains_active_;
+  port_gains_active_out_.write(gains_active_);
+
+  // Apply PD
+  if(impedance_mode_){
+    // Xdd_des = Xdd_traj + Lambda^-1.( K.X_err - D.Xd_curr ) + Ki.integral_error
+    tf::twistKDLToEigen(X_err_,x_err_);
+    tf::twistKDLToEigen(Xdd_traj_,xdd_traj_);
+    tf::twistKDLToEigen(integral_error_,integral_err_);
+    impedance_wrench_.noalias() = stiffness_.asDiagonal() * x_err_ - damping_matrix_ * xd_curr_;
+    xdd_des_.noalias() = xdd_traj_ + lambda_inv_ * impedance_wrench_ + i_gains_.asDiagonal() * integral_err_;
+    tf::twistEigenToKDL(xdd_des_,Xdd_des_);
+  }
+  else{
+    for( unsigned int i=0; i<6; ++i )
+      Xdd_des_(i) = Xdd_traj_(i) + p_gains_active_(i) * ( X_err_(i) ) + i_gains_(i) * integral_error_(i) - d_gains_active_(i) * ( Xd_curr_(i) );
+    tf::twistKDLToEigen(Xdd_des_,xdd_des_);
+  }
+
   // We put it in the form ax + b
   // M(q).qdd + B(qd) + G(q) = T
   // --> qdd = Minv.( T - B - G)
@@ -331,40 +676,64 @@ void CartOptCtrl::updateHook(){
 
   // Regularisation task
   // Can be tau, tau-g or tau-g-b*qdot
-  H_ = 2.0 * regularisation_weight_ * M_inv_.data;
+  H_.topLeftCorner(dof,dof) = 2.0 * regularisation_weight_ * M_inv_.data;
   if (compensate_gravity_)
-    g_ = - 2.0* (regularisation_weight_ * M_inv_.data * (gravity_.data - damping_weight_.asDiagonal() * joint_velocity_in_));
-
-  // Read button press port
-  this->port_button_pressed_in_.read(button_pressed_);
+    g_.head(dof) = - 2.0* (regularisation_weight_ * M_inv_.data * (gravity_.data - damping_weight_.asDiagonal() * joint_velocity_in_));
 
-  // If button is pressed leave only the regularisation task
+  // If button is pressed (or in compliant collision reaction) leave only the regularisation task
   // Then progressively introduce the cartesian task
-  if (button_pressed_)
+  if (button_pressed_ || (collision_detected_ && collision_reaction_ == 2))
     transition_gain_ = 0.0;
   else
     transition_gain_ = std::min(1.0,transition_gain_ + 0.001 * regularisation_weight_);
 
+  // Same hessian, kept as M and low rank terms for the fast path, the dense task terms are only added if the QP runs
+  const bool use_woodbury = fast_path_ && woodbury_hessian_;
+  if(use_woodbury){
+    if(!use_payload_model_ || button_pressed_)
+      mass_matrix_ = arm_inertia_.data;
+    woodbury_.reset(mass_matrix_, M_inv_.data, regularisation_weight_);
+  }
+
   // Write cartesian tasks
   // The cartesian tasks can be decoupling by axes
+  // and target any frame, the frame_of_interest follows the trajectory
   for(int i=0; i<select_components_.size();i++){
-    a_.noalias() =  J_.data * select_axes_[i].asDiagonal() * M_inv_.data;
-    b_.noalias() = (- a_ * ( coriolis_.data + gravity_.data ) + jdot_qdot_ - xdd_des_);
+    const int frame = task_handles_[i];
+    if(frame != ee_handle_)
+      computeFrameTask(i);
+    const MultiFrameKinematics::Jacobian& task_jacobian = frame == ee_handle_ ? J_.data : kinematics_.getJacobian(frame);
+    if(use_woodbury)
+      woodbury_.addTask(task_jacobian, select_axes_[i], transition_gain_ * 2.0 * select_components_[i]);
+    a_.noalias() =  task_jacobian * select_axes_[i].asDiagonal() * M_inv_.data;
+    if(frame == ee_handle_)
+      b_.noalias() = (- a_ * ( coriolis_.data + gravity_.data ) + jdot_qdot_ - xdd_des_);
+    else
+      b_.noalias() = (- a_ * ( coriolis_.data + gravity_.data ) + kinematics_.getJdotQdot(frame) - frame_xdd_des_);
 
-    H_ += transition_gain_ * 2.0 * a_.transpose() * select_components_[i].asDiagonal() * a_;
-    g_ += transition_gain_ * 2.0 * a_.transpose() * select_components_[i].asDiagonal() * b_;
+    if(!use_woodbury)
+      H_.topLeftCorner(dof,dof) += transition_gain_ * 2.0 * a_.transpose() * select_components_[i].asDiagonal() * a_;
+    g_.head(dof) += transition_gain_ * 2.0 * a_.transpose() * select_components_[i].asDiagonal() * b_;
   }
 
   // Torque bounds update
-  lb_ = -torque_max_;
-  ub_ = torque_max_;
+  lb_.head(dof) = -torque_max_;
+  ub_.head(dof) = torque_max_;
+  // Friction is not in the model of the QP, its compensation is added to the solution
+  // so the bounds leave room for it and the command stays within torque_max
+  if(friction_compensation_){
+    friction_table_.compute(joint_velocity_in_,friction_torque_);
+    friction_torque_ = friction_torque_.cwiseMax(-torque_max_).cwiseMin(torque_max_);
+    lb_.head(dof) -= friction_torque_;
+    ub_.head(dof) -= friction_torque_;
+  }
 
   // Joint velocity bounds update
   qd_max_ = jnt_vel_max_;
   qd_min_ = -jnt_vel_max_;
 
   // Update horizon
-  double horizon_dt = horizon_steps_* this->getPeriod();
+  double horizon_dt = horizon_steps_* period_;
 
   // Joint position and velocity constraints
   A_.block(0,0,dof,dof) = M_inv_.data;
@@ -395,12 +764,16 @@ void CartOptCtrl::updateHook(){
   ubA_.block(0,0,dof,1) = (( qd_max_ - joint_velocity_in_ ) / horizon_dt + nonLinearTerms_).cwiseMin(
       2*(arm_.getJointUpperLimit() - joint_position_in_ - joint_velocity_in_ * horizon_dt)/ (horizon_dt*horizon_dt) + nonLinearTerms_ );
 
-  // Cartesian position constraints
-  A_.block(dof,0,3,dof) = (J_.data*M_inv_.data).block(0,0,3,dof);
-  x_max_.block(0,0,3,1) = cart_max_constraints_;
-  x_min_.block(0,0,3,1) = cart_min_constraints_;
-  ubA_.block(dof,0,3,1) = (2*(x_max_ - x_curr_ - horizon_dt * J_.data * joint_velocity_in_)/(horizon_dt*horizon_dt) - jdot_qdot_ + J_.data * nonLinearTerms_).block(0,0,3,1);
-  lbA_.block(dof,0,3,1) = (2*(x_min_ - x_curr_ - horizon_dt * J_.data * joint_velocity_in_)/(horizon_dt*horizon_dt) - jdot_qdot_ + J_.data * nonLinearTerms_).block(0,0,3,1);
+  // Cartesian position constraints, 3 rows per wall frame
+  for(unsigned int w=0; w<wall_handles_.size(); w++){
+    const int frame = wall_handles_[w], row = dof + 3 * w;
+    const MultiFrameKinematics::Jacobian& wall_jacobian = kinematics_.getJacobian(frame);
+    A_.block(row,0,3,dof).noalias() = wall_jacobian.topRows<3>() * M_inv_.data;
+    ubA_.segment<3>(row) = 2*(cart_max_constraints_ - kinematics_.getPosition(frame) - horizon_dt * kinematics_.getTwist(frame).head<3>())/(horizon_dt*horizon_dt)
+                           - kinematics_.getJdotQdot(frame).head<3>() + wall_jacobian.topRows<3>() * nonLinearTerms_;
+    lbA_.segment<3>(row) = 2*(cart_min_constraints_ - kinematics_.getPosition(frame) - horizon_dt * kinematics_.getTwist(frame).head<3>())/(horizon_dt*horizon_dt)
+                           - kinematics_.getJdotQdot(frame).head<3>() + wall_jacobian.topRows<3>() * nonLinearTerms_;
+  }
 
   // Filter current speed for kinetic energy computation
   if (!has_first_command_)
@@ -411,7 +784,6 @@ void CartOptCtrl::updateHook(){
   }
 
   // Ec current and Ec next
-  Lambda_ = (J_.data * M_inv_.data * J_.data.transpose()).inverse();
   delta_x_ = xd_curr_filtered_ * horizon_dt + 0.5 * xdd_des_ * horizon_dt * horizon_dt;
   double ec_curr = 0.5 * xd_curr_filtered_.transpose() * Lambda_ * xd_curr_filtered_;
   double ec_next = ec_curr + delta_x_.transpose() * Lambda_ * (jdot_qdot_ - J_.data * nonLinearTerms_);
@@ -432,11 +804,14 @@ void CartOptCtrl::updateHook(){
   }
   else
     ec_lim_ = 1;
+  if(collision_detected_ && collision_reaction_ == 1)
+    ec_lim_ = std::min(ec_lim_, collision_ec_lim_);
 
   // Ec constraint
-  A_.block(dof + 3 ,0,1,dof) = delta_x_.transpose() * Lambda_ * J_.data * M_inv_.data;
-  ubA_(dof + 3) = ec_lim_ - ec_next;
-  lbA_(dof + 3) = -100000000.0 - ec_next;
+  const int ec_row = dof + 3 * wall_handles_.size();
+  A_.block(ec_row,0,1,dof) = delta_x_.transpose() * Lambda_ * J_.data * M_inv_.data;
+  ubA_(ec_row) = ec_lim_ - ec_next;
+  lbA_(ec_row) = -100000000.0 - ec_next;
 
   // Ec limit stream to ROS
   std_msgs::Float32 ec_msg;
@@ -452,9 +827,16 @@ void CartOptCtrl::updateHook(){
       else
         viscous_coeffs_(i) = max_viscous_coeff_*(1-1/(1+std::exp(((x_curr_(i)-viscous_walls_thickness_-cart_min_constraints_(i))*(2/-viscous_walls_thickness_)-1)*6)));
     }
-    g_ +=  2.0 * regularisation_weight_ * M_inv_.data *J_.data.transpose() * viscous_coeffs_.asDiagonal() * xd_curr_;
+    g_.head(dof) +=  2.0 * regularisation_weight_ * M_inv_.data *J_.data.transpose() * viscous_coeffs_.asDiagonal() * xd_curr_;
   }
 
+  // Tasks and constraints from the plugins, written in place
+  if(!plugins_.empty())
+    updatePlugins();
+
+  if(soft_constraints_)
+    addSlackVariables();
+
   // number of allowed compute steps
   int nWSR = 1e6;
 
@@ -462,7 +844,18 @@ void CartOptCtrl::updateHook(){
   qpOASES::returnValue ret;
   static bool qpoases_initialized = false;
 
-  if(!qpoases_initialized){
+  // The solver keeps its working set from the last call, the hotstart stays valid after fast path cycles
+  fast_path_hit_ = fast_path_ && solveUnconstrained();
+  if(!fast_path_hit_ && use_woodbury)
+    woodbury_.addTaskTerms(H_.topLeftCorner(dof,dof));
+  // Keep the problems given to the solver for qp_option_tuner
+  if(!fast_path_hit_)
+    qp_record_.push(H_.data(),g_.data(),A_.data(),lb_.data(),ub_.data(),lbA_.data(),ubA_.data());
+  if(fast_path_hit_){
+    ret = qpOASES::SUCCESSFUL_RETURN;
+    ++fast_path_hits_;
+  }
+  else if(!qpoases_initialized){
     // Initialise the problem, once it has found a solution, we can hotstart
     ret = qpoases_solver_->init(H_.data(),g_.data(),A_.data(),lb_.data(),ub_.data(),lbA_.data(),ubA_.data(),nWSR);
 
@@ -477,6 +870,9 @@ void CartOptCtrl::updateHook(){
     if(ret != qpOASES::SUCCESSFUL_RETURN)
       qpoases_initialized = false;
   }
+  if(!fast_path_hit_)
+    ++qp_calls_;
+  fast_path_hit_rate_ = fast_path_hits_ / std::max(1.0, double(fast_path_hits_ + qp_calls_));
 
   // Zero grav if no solution found
   // TODO: find a better alternative
@@ -484,7 +880,15 @@ void CartOptCtrl::updateHook(){
 
   if(ret == qpOASES::SUCCESSFUL_RETURN){
     // Get the solution
-    qpoases_solver_->getPrimalSolution(joint_torque_out_.data());
+    if(!fast_path_hit_)
+      qpoases_solver_->getPrimalSolution(primal_solution_.data());
+    joint_torque_out_ = primal_solution_.head(dof);
+
+    // Stream the slack magnitudes |s+ - s-| per constraint
+    if(soft_constraints_){
+      slack_out_ = (primal_solution_.segment(dof,number_of_constraints_) - primal_solution_.tail(number_of_constraints_)).cwiseAbs();
+      port_slack_out_.write(slack_out_);
+    }
 
     // Stream Ec_predicted
     double ec_predicted = delta_x_.transpose() * Lambda_ * J_.data * M_inv_.data* joint_torque_out_ + ec_next;
@@ -493,10 +897,15 @@ void CartOptCtrl::updateHook(){
     port_ec_predicted_out_.write(ec_predicted_msg);
 
     // Remove gravity because Kuka already adds it
-    joint_torque_out_ -= arm_.getGravityTorque().data;
+    joint_torque_out_ -= arm_gravity_.data;
+
+    // The friction compensation only goes with a solution, the bounds already account for it
+    if(friction_compensation_)
+      joint_torque_out_ += friction_torque_;
   }
   else
     log(RTT::Error) << "QPOases failed!" << endlog();
+  updateTrackingFeedback(ret == qpOASES::SUCCESSFUL_RETURN);
 
   // Compensate for an added load
   if (button_pressed_){
@@ -509,7 +918,7 @@ void CartOptCtrl::updateHook(){
     KDL::Wrench wrench_kdl;
     tf::wrenchMsgToKDL(ft_msg_.wrench,wrench_kdl);
 
-    arm_.setExternalMeasuredWrench(wrench_kdl,arm_.getSegmentIndex(ee_frame_));
+    arm_.setExternalMeasuredWrench(wrench_kdl,ee_segment_index_);
 
     arm_.computeExternalWrenchTorque(joint_position_in_,true);
 
@@ -520,11 +929,306 @@ void CartOptCtrl::updateHook(){
     joint_torque_out_ += ext_t.data;
   }
 
-  // Send torques to the robot
+  // Send torques to the robot, the Kuka adds the gravity to get the torque applied on the joints
   port_joint_torque_out_.write(joint_torque_out_);
+
+  // Sensor to torque latency, from the wake up on the joint state read by this cycle.
+  // Watchdog and periodic cycles on an old sample would report the time since that sample instead
+  const RTT::os::TimeService::nsecs joint_state_time = joint_state_time_;
+  if(fp == RTT::NewData && joint_state_time > 0){
+    latency_msg_.data = RTT::os::TimeService::nsecs2Seconds(RTT::os::TimeService::Instance()->getNSecs() - joint_state_time);
+    port_latency_out_.write(latency_msg_);
+  }
+  applied_torque_ = joint_torque_out_ + arm_gravity_.data;
   has_first_command_ = true;
+
+  if(joint_record_size_ > 0){
+    if(!(joint_record_.flags() & JointRecord::MEASURED_TORQUE) || port_joint_torque_in_.read(joint_torque_in_) == RTT::NoData
+       || joint_torque_in_.size() != dof)
+      joint_torque_in_ = applied_torque_;
+    joint_record_.push(RTT::os::TimeService::nsecs2Seconds(RTT::os::TimeService::Instance()->getNSecs()),
+                       joint_position_in_,joint_velocity_in_,joint_torque_in_,applied_torque_);
+  }
+}
+
+void CartOptCtrl::addPayloadToModel(){
+  // Swap in the latest estimate, the data connection makes the update atomic
+  // and the vector keeps its size so nothing is allocated
+  if(port_payload_in_.read(payload_in_) == RTT::NewData && payload_in_.size() == PayloadEstimator::NB_PARAMS && payload_in_.allFinite()){
+    // An inconsistent inertia could make M + J^T.I.J indefinite, take the nearest consistent one
+    if(!PayloadEstimator::isPhysical(payload_in_.data()))
+      PayloadEstimator::projectPhysical(payload_in_.data(), 1e-6);
+    payload_params_ = payload_in_;
+  }
+
+  // Payload parameters in the base frame, about the frame of interest origin
+  for(int i=0; i<3; i++)
+    for(int j=0; j<3; j++)
+      payload_rot_(i,j) = X_curr_.M(i,j);
+  const double mass = std::max(0.0, payload_params_(0));
+  payload_mass_ = mass;
+  payload_first_moment_.noalias() = payload_rot_ * payload_params_.segment<3>(1);
+  payload_inertia_ << payload_params_(4), payload_params_(5), payload_params_(6),
+                      payload_params_(5), payload_params_(7), payload_params_(8),
+                      payload_params_(6), payload_params_(8), payload_params_(9);
+  payload_spatial_inertia_.setZero();
+  payload_spatial_inertia_.topLeftCorner<3,3>().diagonal().setConstant(mass);
+  payload_spatial_inertia_.bottomRightCorner<3,3>().noalias() = payload_rot_ * payload_inertia_ * payload_rot_.transpose();
+  payload_spatial_inertia_.bottomLeftCorner<3,3>() << 0, -payload_first_moment_(2), payload_first_moment_(1),
+                                                      payload_first_moment_(2), 0, -payload_first_moment_(0),
+                                                      -payload_first_moment_(1), payload_first_moment_(0), 0;
+  payload_spatial_inertia_.topRightCorner<3,3>() = payload_spatial_inertia_.bottomLeftCorner<3,3>().transpose();
+
+  // Gravity : the robot has to apply -(m.g, c x m.g) on the payload
+  payload_wrench_.head<3>() = - mass * gravity_vector_;
+  payload_wrench_.tail<3>() = - payload_first_moment_.cross(gravity_vector_);
+  gravity_.data.noalias() += J_.data.transpose() * payload_wrench_;
+
+  // Inertia : M + J^T.I_payload.J, the coriolis terms of the payload are neglected
+  mass_matrix_ = arm_inertia_.data;
+  mass_matrix_.noalias() += J_.data.transpose() * payload_spatial_inertia_ * J_.data;
+  mass_matrix_ldlt_.compute(mass_matrix_);
+  if(mass_matrix_ldlt_.info() != Eigen::Success || !mass_matrix_ldlt_.isPositive() || mass_matrix_ldlt_.vectorD().minCoeff() <= 0.0){
+    // Keep the nominal model (M_inv_ is still the one of the arm)
+    mass_matrix_ = arm_inertia_.data;
+    gravity_ = arm_gravity_;
+    return;
+  }
+  M_inv_.data.setIdentity();
+  mass_matrix_ldlt_.solveInPlace(M_inv_.data);
+}
+
+void CartOptCtrl::detectCollision(){
+  // Inertia matrix matching gravity_, with the payload if it was added
+  if(!use_payload_model_ || button_pressed_)
+    mass_matrix_ = arm_inertia_.data;
+  momentum_observer_.update(mass_matrix_,coriolis_.data,gravity_.data,joint_velocity_in_,applied_torque_,cycle_dt_);
+  port_residual_out_.write(momentum_observer_.getResidual());
+
+  // Contacts are expected while hand guiding
+  if(button_pressed_){
+    collision_detected_ = false;
+    collision_time_left_ = 0.0;
+  }
+  else if(momentum_observer_.exceeds(collision_thresholds_)){
+    if(!collision_detected_)
+      log(RTT::Warning) << "Collision detected, residual : " << momentum_observer_.getResidual().transpose() << endlog();
+    collision_detected_ = true;
+    collision_time_left_ = collision_hold_time_;
+  }
+  else if(collision_detected_){
+    collision_time_left_ -= cycle_dt_;
+    collision_detected_ = collision_time_left_ > 0.0;
+  }
+
+  collision_msg_.data = collision_detected_;
+  port_collision_out_.write(collision_msg_);
+}
+
+void CartOptCtrl::updateTrackingFeedback(bool qp_solved){
+  // Non zero multipliers are the active bounds and constraints,
+  // ordered as [torque bounds, slack bounds, joint constraints, cartesian constraints, Ec constraint, plugins]
+  // A softened constraint that is violated keeps a multiplier equal to its slack weight
+  const int dof = arm_.getNrOfJoints();
+  const int nv = number_of_variables_;
+  const int nb_wall_rows = 3 * wall_handles_.size();
+  if(fast_path_hit_)
+    dual_solution_.setZero();
+  else if(qp_solved)
+    qpoases_solver_->getDualSolution(dual_solution_.data());
+  else
+    dual_solution_.setOnes();
+  tracking_feedback_(TrackingFeedback::ERROR_SATURATED) = error_saturated_ ? 1.0 : 0.0;
+  tracking_feedback_(TrackingFeedback::TORQUE_LIMITED) = dual_solution_.head(dof).isZero(0.0) ? 0.0 : 1.0;
+  tracking_feedback_(TrackingFeedback::JOINT_LIMITED) = dual_solution_.segment(nv,dof).isZero(0.0) ? 0.0 : 1.0;
+  tracking_feedback_(TrackingFeedback::CARTESIAN_LIMITED) = dual_solution_.segment(nv+dof,nb_wall_rows).isZero(0.0) ? 0.0 : 1.0;
+  tracking_feedback_(TrackingFeedback::ENERGY_LIMITED) = dual_solution_(nv+dof+nb_wall_rows) == 0.0 ? 0.0 : 1.0;
+  port_tracking_feedback_out_.write(tracking_feedback_);
+}
+
+void CartOptCtrl::addSlackVariables(){
+  // Elastic constraints : lbA <= A.tau + s+ - s- <= ubA with s+, s- >= 0 and the cost w.(s+ + s-).
+  // The L1 penalty is exact, the slacks stay at zero as long as the hard problem is feasible
+  // and the weight is above the constraint multiplier, so the classes are violated by increasing weight.
+  const int dof = arm_.getNrOfJoints();
+  const int nc = number_of_constraints_;
+  A_.block(0,dof,nc,nc).setIdentity();
+  A_.block(0,dof+nc,nc,nc) = -Eigen::MatrixXd::Identity(nc,nc);
+
+  // Small quadratic term so the hessian stays positive definite
+  H_.bottomRightCorner(2*nc,2*nc).diagonal().setConstant(2.0 * regularisation_weight_);
+
+  for(int i=0; i<nc; i++){
+    const double w = slack_row_weights_(i);
+    g_(dof+i) = g_(dof+nc+i) = w;
+    lb_(dof+i) = lb_(dof+nc+i) = 0.0;
+    ub_(dof+i) = ub_(dof+nc+i) = w > 0.0 ? qpOASES::INFTY : 0.0;
+
+    // The joint position and velocity bounds can cross, aim between them
+    if(w > 0.0 && lbA_(i) > ubA_(i))
+      lbA_(i) = ubA_(i) = 0.5 * (lbA_(i) + ubA_(i));
+  }
+}
+
+bool CartOptCtrl::solveUnconstrained(){
+  // Minimum of 0.5.tau^T.H.tau + g^T.tau, the slacks if any stay at zero
+  const int dof = arm_.getNrOfJoints();
+  if(woodbury_hessian_){
+    if(!woodbury_.factorize())
+      return false;
+    woodbury_.solve(g_.head(dof), unconstrained_tau_);
+    unconstrained_tau_ = -unconstrained_tau_;
+  }
+  else{
+    hessian_llt_.compute(H_.topLeftCorner(dof,dof));
+    if(hessian_llt_.info() != Eigen::Success)
+      return false;
+    unconstrained_tau_ = -g_.head(dof);
+    hessian_llt_.solveInPlace(unconstrained_tau_);
+  }
+
+  // One pass over the torque bounds and the constraint rows
+  constraint_rows_.noalias() = A_.leftCols(dof) * unconstrained_tau_;
+  if((unconstrained_tau_.array() < lb_.head(dof).array()).any() || (unconstrained_tau_.array() > ub_.head(dof).array()).any()
+     || (constraint_rows_.array() < lbA_.array()).any() || (constraint_rows_.array() > ubA_.array()).any())
+    return false;
+
+  primal_solution_.setZero();
+  primal_solution_.head(dof) = unconstrained_tau_;
+  return true;
+}
+
+bool CartOptCtrl::resolveFrames(){
+  if(!kinematics_.init(arm_.Chain())){
+    log(RTT::Error) << "Could not build the kinematics of the chain" << endlog();
+    return false;
+  }
+  ee_handle_ = kinematics_.addFrame(ee_frame_);
+  if(ee_handle_ < 0){
+    log(RTT::Error) << "Unknown frame_of_interest " << ee_frame_ << endlog();
+    return false;
+  }
+  ee_segment_index_ = arm_.getSegmentIndex(ee_frame_);
+
+  task_handles_.resize(task_frames_.size());
+  task_hold_poses_.resize(task_frames_.size());
+  for(unsigned int i=0; i<task_frames_.size(); i++){
+    task_handles_[i] = task_frames_[i].empty() ? ee_handle_ : kinematics_.addFrame(task_frames_[i]);
+    if(task_handles_[i] < 0){
+      log(RTT::Error) << "Unknown task_frame_" << i << " " << task_frames_[i] << endlog();
+      return false;
+    }
+  }
+
+  wall_handles_.clear();
+  std::istringstream wall_frames(wall_frames_);
+  std::string frame;
+  while(wall_frames >> frame){
+    wall_handles_.push_back(kinematics_.addFrame(frame));
+    if(wall_handles_.back() < 0){
+      log(RTT::Error) << "Unknown wall frame " << frame << endlog();
+      return false;
+    }
+  }
+  if(wall_handles_.empty())
+    wall_handles_.push_back(ee_handle_);
+  return true;
+}
+
+void CartOptCtrl::computeFrameTask(int task){
+  // PD toward the pose held since the first command, with the same gains and saturations as the trajectory.
+  // In impedance mode the active gains are a stiffness and a damping, not accelerations : use the PD gains
+  const int frame = task_handles_[task];
+  const Eigen::VectorXd& p_gains = impedance_mode_ ? p_gains_ : p_gains_active_;
+  const Eigen::VectorXd& d_gains = impedance_mode_ ? d_gains_ : d_gains_active_;
+  if(!has_first_command_)
+    task_hold_poses_[task] = kinematics_.getPose(frame);
+  frame_err_ = diff( kinematics_.getPose(frame) , task_hold_poses_[task] );
+  for(unsigned int i=0; i<6; ++i ){
+    const double saturation = i < 3 ? position_saturation_ : orientation_saturation_;
+    frame_xdd_des_(i) = p_gains(i) * std::max(-saturation, std::min(saturation, frame_err_(i)))
+                        - d_gains(i) * kinematics_.getTwist(frame)(i);
+  }
+}
+
+bool CartOptCtrl::loadPlugins(int dof){
+  // Types from the rosparam CartOptCtrl/qp_plugins, e.g. ["cart_opt_ctrl/JointAccelerationLimit"],
+  // each plugin reads its parameters in CartOptCtrl/<ClassName>
+  plugins_.clear();
+  qp_plugin_types_.clear();
+  ros::param::get(this->getName() + "/qp_plugins", qp_plugin_types_);
+  if(!plugin_loader_)
+    plugin_loader_.reset(new pluginlib::ClassLoader<cart_opt_ctrl::QPPlugin>("cart_opt_ctrl","cart_opt_ctrl::QPPlugin"));
+
+  for(unsigned int i=0; i<qp_plugin_types_.size(); i++){
+    boost::shared_ptr<cart_opt_ctrl::QPPlugin> plugin;
+    try{
+      plugin = plugin_loader_->createInstance(qp_plugin_types_[i]);
+    }
+    catch(pluginlib::PluginlibException& ex){
+      log(RTT::Error) << "Could not load the QP plugin " << qp_plugin_types_[i] << " : " << ex.what() << endlog();
+      return false;
+    }
+    const std::string ns = this->getName() + "/" + qp_plugin_types_[i].substr(qp_plugin_types_[i].find('/') + 1);
+    if(!plugin->configure(ns, dof) || !plugin->registerFrames(kinematics_) || plugin->rows() < 0){
+      log(RTT::Error) << "Could not configure the QP plugin " << qp_plugin_types_[i] << " in " << ns << endlog();
+      return false;
+    }
+    plugins_.push_back(plugin);
+    log(RTT::Info) << "QP plugin " << qp_plugin_types_[i] << " loaded with " << plugin->rows() << " rows" << endlog();
+  }
+
+  log(RTT::Info) << kinematics_.getNrOfFrames() << " frames computed per cycle" << endlog();
+  plugin_timings_.setZero(plugins_.size());
+  port_plugin_timings_out_.setDataSample(plugin_timings_);
+  qp_state_.dof = dof;
+  qp_state_.joint_position = &joint_position_in_;
+  qp_state_.joint_velocity = &joint_velocity_in_;
+  qp_state_.inertia_inverse = &M_inv_.data;
+  qp_state_.nonlinear_terms = &nonLinearTerms_;
+  qp_state_.jacobian = &J_.data;
+  qp_state_.jdot_qdot = &jdot_qdot_;
+  qp_state_.pose = &X_curr_;
+  qp_state_.velocity = &xd_curr_;
+  qp_state_.arm = &arm_;
+  qp_state_.kinematics = &kinematics_;
+  return true;
+}
+
+void CartOptCtrl::updatePlugins(){
+  // Each plugin gets views on the torque block of the cost and on its own rows, in a fixed order
+  const int dof = arm_.getNrOfJoints();
+  qp_state_.period = period_;
+  qp_state_.horizon_dt = horizon_steps_ * period_;
+  for(unsigned int i=0; i<plugins_.size(); i++){
+    const int row = plugin_row_offsets_[i], rows = plugins_[i]->rows();
+    const RTT::os::TimeService::nsecs start = RTT::os::TimeService::Instance()->getNSecs();
+    cart_opt_ctrl::QPSlice slice(H_.topLeftCorner(dof,dof), g_.head(dof),
+                                 A_.block(row,0,rows,dof), lbA_.segment(row,rows), ubA_.segment(row,rows));
+    plugins_[i]->update(qp_state_, slice);
+    plugin_timings_(i) = RTT::os::TimeService::nsecs2Seconds(RTT::os::TimeService::Instance()->getNSecs() - start);
+  }
+  port_plugin_timings_out_.write(plugin_timings_);
 }
 
 void CartOptCtrl::stopHook(){
+  if(watchdog_)
+    watchdog_->killTimer(0);
   has_first_command_ = false;
+
+  // Writes the recorded QPs, outside of the loop
+  if(qp_record_.size() > 0 && !qp_record_file_.empty()){
+    if(qp_record_.save(qp_record_file_))
+      log(RTT::Info) << qp_record_.size() << " QPs written to " << qp_record_file_ << endlog();
+    else
+      log(RTT::Error) << "Could not write the QPs to " << qp_record_file_ << endlog();
+    qp_record_.clear();
+  }
+  if(joint_record_.size() > 0 && !joint_record_file_.empty()){
+    if(joint_record_.save(joint_record_file_))
+      log(RTT::Info) << joint_record_.size() << " joint samples written to " << joint_record_file_ << endlog();
+    else
+      log(RTT::Error) << "Could not write the joint samples to " << joint_record_file_ << endlog();
+    joint_record_.clear();
+  }
 }
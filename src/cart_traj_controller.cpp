@@ -0,0 +1,224 @@
+#include <cart_opt_ctrl/cart_traj_controller.hpp>
+#include <pluginlib/class_list_macros.h>
+
+namespace cart_opt_controllers
+{
+  // Reads an array parameter if it exists, keeps the default otherwise
+  static bool getVectorParam(const ros::NodeHandle& nh, const std::string& name, Eigen::VectorXd& value){
+    std::vector<double> param;
+    if(!nh.getParam(name, param))
+      return true;
+    if(param.size() != static_cast<size_t>(value.size())){
+      ROS_ERROR_STREAM("The " << name << " parameter does not have the right size, " << value.size() << " (namespace: " << nh.getNamespace() << ").");
+      return false;
+    }
+    for(unsigned int i=0; i<param.size(); ++i)
+      value(i) = param[i];
+    return true;
+  }
+
+  CartesianTrajectoryController::CartesianTrajectoryController() : segment_index_(0) {}
+
+  bool CartesianTrajectoryController::init(hardware_interface::CartOptEffortJointInterface* hw, ros::NodeHandle& /*root_nh*/, ros::NodeHandle& controller_nh){
+    // Init chain utils
+    if( !arm_.init() ){
+      ROS_ERROR("Could not init chain utils !");
+      return false;
+    }
+    const int dof = arm_.getNrOfJoints();
+    ee_frame_ = arm_.getSegmentName( arm_.getNrOfSegments() - 1 );
+
+    // Joint handles
+    std::vector<std::string> joint_names;
+    if(!controller_nh.getParam("joints", joint_names) || joint_names.size() != static_cast<size_t>(dof)){
+      ROS_ERROR_STREAM("The joints parameter must list the " << dof << " joints of the chain (namespace: " << controller_nh.getNamespace() << ").");
+      return false;
+    }
+    joint_handles_.clear();
+    for(unsigned int i=0; i<joint_names.size(); ++i)
+      joint_handles_.push_back(hw->getHandle(joint_names[i]));
+
+    // Default params
+    p_gains_.resize(6);
+    d_gains_.resize(6);
+    damping_weight_.setOnes(dof);
+    torque_max_.resize(dof);
+    jnt_vel_max_.setOnes(dof);
+    p_gains_ << 800, 800, 800, 350, 350, 350;
+    d_gains_ << 22, 22, 22, 10, 10, 10;
+    // TODO: get this from URDF
+    torque_max_ << 200,200,100,100,100,30,30;
+    regularisation_weight_ = 1e-05;
+    horizon_steps_ = 15.0;
+    position_saturation_ = 0.01;
+    orientation_saturation_ = M_PI/100;
+
+    // Read params
+    if(!getVectorParam(controller_nh, "cartesian_gains/p_gains", p_gains_) ||
+       !getVectorParam(controller_nh, "cartesian_gains/d_gains", d_gains_) ||
+       !getVectorParam(controller_nh, "damping_weight", damping_weight_) ||
+       !getVectorParam(controller_nh, "torque_max", torque_max_) ||
+       !getVectorParam(controller_nh, "joint_vel_max", jnt_vel_max_))
+      return false;
+    controller_nh.getParam("regularisation_weights/tau", regularisation_weight_);
+    controller_nh.getParam("horizon_steps", horizon_steps_);
+    controller_nh.getParam("position_saturation", position_saturation_);
+    controller_nh.getParam("orientation_saturation", orientation_saturation_);
+
+    // Resize everything used in the update
+    joint_torque_out_.setZero(dof);
+    joint_position_in_.setZero(dof);
+    joint_velocity_in_.setZero(dof);
+    qp_.init(dof);
+
+    trajectory_command_sub_ = controller_nh.subscribe("command", 1, &CartesianTrajectoryController::commandCB, this);
+    return true;
+  }
+
+  void CartesianTrajectoryController::commandCB(const cart_opt_ctrl::CartesianTrajectoryConstPtr& msg){
+    // Not RT, all the coefficients are computed here
+    if(msg->points.empty()){
+      ROS_WARN("Received an empty cartesian trajectory, ignoring it");
+      return;
+    }
+    for(unsigned int i=1; i<msg->points.size(); ++i){
+      if(msg->points[i].time_from_start <= msg->points[i-1].time_from_start){
+        ROS_ERROR("Cartesian trajectory points must have increasing time_from_start, ignoring it");
+        return;
+      }
+    }
+
+    boost::shared_ptr<Trajectory> trajectory(new Trajectory);
+    trajectory->start_time = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
+    trajectory->segments.resize(msg->points.size() - 1);
+
+    KDL::Frame pose, next_pose;
+    KDL::Twist vel, acc, next_vel, next_acc;
+    tf::poseMsgToKDL(msg->points[0].pose, pose);
+    tf::twistMsgToKDL(msg->points[0].twist, vel);
+    tf::twistMsgToKDL(msg->points[0].acceleration, acc);
+    trajectory->first_time = msg->points[0].time_from_start.toSec();
+    trajectory->first_pose = pose;
+    trajectory->first_vel = vel;
+    trajectory->first_acc = acc;
+    for(unsigned int i=1; i<msg->points.size(); ++i){
+      tf::poseMsgToKDL(msg->points[i].pose, next_pose);
+      tf::twistMsgToKDL(msg->points[i].twist, next_vel);
+      tf::twistMsgToKDL(msg->points[i].acceleration, next_acc);
+      const double t0 = msg->points[i-1].time_from_start.toSec();
+      trajectory->segments[i-1].init(t0, msg->points[i].time_from_start.toSec() - t0, pose, vel, acc, next_pose, next_vel, next_acc);
+      pose = next_pose;
+      vel = next_vel;
+      acc = next_acc;
+    }
+
+    trajectory_buffer_.writeFromNonRT(trajectory);
+  }
+
+  void CartesianTrajectoryController::starting(const ros::Time& /*time*/){
+    for(unsigned int i=0; i<joint_handles_.size(); ++i){
+      joint_position_in_(i) = joint_handles_[i].getPosition();
+      joint_velocity_in_(i) = joint_handles_[i].getVelocity();
+      joint_handles_[i].setCommand(0.0);
+    }
+
+    // Hold the current pose
+    joint_velocity_in_.setZero();
+    arm_.setState(joint_position_in_,joint_velocity_in_);
+    arm_.updateModel();
+    X_traj_ = arm_.getSegmentPosition(ee_frame_);
+    KDL::SetToZero(Xd_traj_);
+    KDL::SetToZero(Xdd_traj_);
+    trajectory_buffer_.writeFromNonRT(TrajectoryPtr());
+    trajectory_.reset();
+    qp_.reset();
+  }
+
+  void CartesianTrajectoryController::stopping(const ros::Time& /*time*/){}
+
+  void CartesianTrajectoryController::sampleTrajectory(const ros::Time& time){
+    // Switch to the latest trajectory, joining its first point from the current reference
+    const TrajectoryPtr& latest = *trajectory_buffer_.readFromRT();
+    if(latest != trajectory_){
+      trajectory_ = latest;
+      if(!trajectory_)
+        return;
+      const double now = (time - trajectory_->start_time).toSec();
+      entry_segment_.init(now, trajectory_->first_time - now, X_traj_, Xd_traj_, Xdd_traj_,
+                          trajectory_->first_pose, trajectory_->first_vel, trajectory_->first_acc);
+      segment_index_ = 0;
+    }
+    if(!trajectory_)
+      return;
+
+    const double t = (time - trajectory_->start_time).toSec();
+    if(trajectory_->segments.empty() || t < entry_segment_.endTime())
+      entry_segment_.sample(t, X_traj_, Xd_traj_, Xdd_traj_);
+    else{
+      while(segment_index_ + 1 < trajectory_->segments.size() && t >= trajectory_->segments[segment_index_].endTime())
+        ++segment_index_;
+      trajectory_->segments[segment_index_].sample(t, X_traj_, Xd_traj_, Xdd_traj_);
+    }
+
+    // Hold the last point once finished
+    const double end_time = trajectory_->segments.empty() ? entry_segment_.endTime() : trajectory_->segments.back().endTime();
+    if(t >= end_time){
+      KDL::SetToZero(Xd_traj_);
+      KDL::SetToZero(Xdd_traj_);
+    }
+  }
+
+  void CartesianTrajectoryController::update(const ros::Time& time, const ros::Duration& period){
+    const int dof = joint_handles_.size();
+
+    // Get current state from the joint handles
+    for(int i=0; i<dof; ++i){
+      joint_position_in_(i) = joint_handles_[i].getPosition();
+      joint_velocity_in_(i) = joint_handles_[i].getVelocity();
+    }
+
+    // Feed the internal model
+    arm_.setState(joint_position_in_,joint_velocity_in_);
+    arm_.updateModel();
+    X_curr_ = arm_.getSegmentPosition(ee_frame_);
+    Xd_curr_ = arm_.getSegmentVelocity(ee_frame_);
+
+    // Reference from the precomputed segments
+    sampleTrajectory(time);
+
+    // Compute and saturate the cartesian errors
+    X_err_ = diff( X_curr_ , X_traj_ );
+    Xd_err_ = diff( Xd_curr_ , Xd_traj_ );
+    for(unsigned int i=0; i<3; ++i )
+      X_err_(i) = std::max(-position_saturation_, std::min(position_saturation_, X_err_(i)));
+    for(unsigned int i=3; i<6; ++i )
+      X_err_(i) = std::max(-orientation_saturation_, std::min(orientation_saturation_, X_err_(i)));
+
+    // Apply PD
+    for(unsigned int i=0; i<6; ++i )
+      Xdd_des_(i) = Xdd_traj_(i) + p_gains_(i) * X_err_(i) + d_gains_(i) * Xd_err_(i);
+    tf::twistKDLToEigen(Xdd_des_,xdd_des_);
+
+    const KDL::Jacobian& J = arm_.getSegmentJacobian(ee_frame_);
+    const KDL::JntSpaceInertiaMatrix& M_inv = arm_.getInertiaInverseMatrix();
+    const KDL::JntArray& coriolis = arm_.getCoriolisTorque();
+    const KDL::JntArray& gravity = arm_.getGravityTorque();
+    tf::twistKDLToEigen(arm_.getSegmentJdotQdot(ee_frame_),jdot_qdot_);
+
+    // Cartesian task, regularisation on tau - g + damping.qd
+    qp_.setCartesianTask(J.data, M_inv.data, coriolis.data, gravity.data, jdot_qdot_, xdd_des_);
+    qp_.H += 2.0 * regularisation_weight_ * M_inv.data;
+    qp_.g.noalias() -= 2.0 * regularisation_weight_ * M_inv.data * (gravity.data - damping_weight_.cwiseProduct(joint_velocity_in_));
+
+    // Torque bounds, joint position and velocity constraints
+    qp_.setLimits(M_inv.data, joint_position_in_, joint_velocity_in_, arm_.getJointLowerLimit(), arm_.getJointUpperLimit(),
+                  jnt_vel_max_, torque_max_, horizon_steps_ * period.toSec());
+    qp_.solve(gravity.data, joint_torque_out_);
+
+    // Send commands
+    for(int i=0; i<dof; ++i)
+      joint_handles_[i].setCommand(joint_torque_out_(i));
+  }
+}
+
+PLUGINLIB_EXPORT_CLASS(cart_opt_controllers::CartesianTrajectoryController, controller_interface::ControllerBase)
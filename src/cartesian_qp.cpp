@@ -0,0 +1,73 @@
+#include "cart_opt_ctrl/cartesian_qp.hpp"
+
+namespace cart_opt_controllers
+{
+  CartesianQP::CartesianQP() : initialized_(false) {}
+
+  void CartesianQP::init(int dof){
+    H.setZero(dof,dof);
+    A.setZero(dof,dof);
+    g.setZero(dof);
+    lb.setZero(dof);
+    ub.setZero(dof);
+    lbA.setZero(dof);
+    ubA.setZero(dof);
+    nonlinear_terms.setZero(dof);
+    a_.setZero(6,dof);
+    b_.setZero();
+
+    // Joint position and velocity constraints only
+    solver_.reset(new qpOASES::SQProblem(dof,dof,qpOASES::HST_POSDEF));
+    qpOASES::Options options;
+    options.setToMPC();
+    options.enableRegularisation = qpOASES::BT_FALSE; // since we specify the type of Hessian matrix, we do not need automatic regularisation
+    options.enableEqualities = qpOASES::BT_TRUE;
+    solver_->setOptions( options );
+    solver_->setPrintLevel(qpOASES::PL_NONE);
+    initialized_ = false;
+  }
+
+  void CartesianQP::setCartesianTask(const Eigen::Ref<const Eigen::MatrixXd>& jacobian, const Eigen::MatrixXd& mass_inv,
+                                     const Eigen::VectorXd& coriolis, const Eigen::VectorXd& gravity,
+                                     const Eigen::Matrix<double,6,1>& jdot_qdot, const Eigen::Matrix<double,6,1>& xdd_des){
+    // Xdd = Jdot.qdot + J.Minv.( T - B - G )
+    nonlinear_terms.noalias() = mass_inv * ( coriolis + gravity );
+    a_.noalias() = jacobian * mass_inv;
+    b_.noalias() = - jacobian * nonlinear_terms;
+    b_ += jdot_qdot - xdd_des;
+    H.noalias() = 2.0 * a_.transpose() * a_;
+    g.noalias() = 2.0 * a_.transpose() * b_;
+  }
+
+  void CartesianQP::setLimits(const Eigen::MatrixXd& mass_inv, const Eigen::VectorXd& q, const Eigen::VectorXd& qd,
+                              const Eigen::VectorXd& q_min, const Eigen::VectorXd& q_max, const Eigen::VectorXd& qd_max,
+                              const Eigen::VectorXd& torque_max, double horizon_dt){
+    lb = -torque_max;
+    ub = torque_max;
+    A = mass_inv;
+    lbA = (( -qd_max - qd ) / horizon_dt + nonlinear_terms).cwiseMax(
+        2*(q_min - q - qd * horizon_dt)/ (horizon_dt*horizon_dt) + nonlinear_terms );
+    ubA = (( qd_max - qd ) / horizon_dt + nonlinear_terms).cwiseMin(
+        2*(q_max - q - qd * horizon_dt)/ (horizon_dt*horizon_dt) + nonlinear_terms );
+  }
+
+  bool CartesianQP::solve(const Eigen::VectorXd& gravity, Eigen::VectorXd& torque){
+    // number of allowed compute steps
+    int nWSR = 1e6;
+    qpOASES::returnValue ret;
+    if(!initialized_)
+      ret = solver_->init(H.data(),g.data(),A.data(),lb.data(),ub.data(),lbA.data(),ubA.data(),nWSR);
+    else
+      ret = solver_->hotstart(H.data(),g.data(),A.data(),lb.data(),ub.data(),lbA.data(),ubA.data(),nWSR);
+    initialized_ = (ret == qpOASES::SUCCESSFUL_RETURN);
+
+    // Zero grav if not found
+    torque.setZero();
+    if(!initialized_)
+      return false;
+    solver_->getPrimalSolution(torque.data());
+    // Remove gravity because Kuka already adds it
+    torque -= gravity;
+    return true;
+  }
+}
@@ -0,0 +1,107 @@
+#include "cart_opt_ctrl/cartesian_segment.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace{
+  inline Eigen::Matrix3d skew(const Eigen::Vector3d& v){
+    Eigen::Matrix3d m;
+    m << 0.0, -v(2), v(1),
+         v(2), 0.0, -v(0),
+         -v(1), v(0), 0.0;
+    return m;
+  }
+
+  // Left jacobian of SO(3), d/dt(Exp(theta)).Exp(theta)^T = [Jl(theta).dtheta/dt]x
+  Eigen::Matrix3d leftJacobian(const Eigen::Vector3d& theta){
+    const double a = theta.norm(), a2 = a * a;
+    const Eigen::Matrix3d k = skew(theta);
+    // Series below 1e-4 rad, the closed forms lose all their digits
+    const double c1 = a < 1e-4 ? 0.5 - a2 / 24.0 : (1.0 - std::cos(a)) / a2;
+    const double c2 = a < 1e-4 ? 1.0 / 6.0 - a2 / 120.0 : (a - std::sin(a)) / (a2 * a);
+    return Eigen::Matrix3d::Identity() + c1 * k + c2 * k * k;
+  }
+
+  // Inverse of Jl, theta is a rotation vector (norm under pi)
+  Eigen::Matrix3d leftJacobianInverse(const Eigen::Vector3d& theta){
+    const double a = theta.norm(), a2 = a * a;
+    const Eigen::Matrix3d k = skew(theta);
+    const double c = a < 1e-4 ? 1.0 / 12.0 + a2 / 720.0 : 1.0 / a2 - (1.0 + std::cos(a)) / (2.0 * a * std::sin(a));
+    return Eigen::Matrix3d::Identity() - 0.5 * k + c * k * k;
+  }
+
+  // d/dt(Jl(theta)).dtheta/dt, central differences along dtheta
+  Eigen::Vector3d leftJacobianRate(const Eigen::Vector3d& theta, const Eigen::Vector3d& dtheta){
+    const double h = 1e-5 / std::max(1.0, dtheta.norm());
+    return (leftJacobian(theta + h * dtheta) - leftJacobian(theta - h * dtheta)) * dtheta / (2.0 * h);
+  }
+}
+
+CartesianSegment::CartesianSegment() : start_time_(0.0), duration_(0.0)
+{
+  coeffs_.setZero();
+}
+
+void CartesianSegment::init(double start_time, double duration,
+                            const KDL::Frame& start_pose, const KDL::Twist& start_vel, const KDL::Twist& start_acc,
+                            const KDL::Frame& end_pose, const KDL::Twist& end_vel, const KDL::Twist& end_acc){
+  start_time_ = start_time;
+  duration_ = std::max(0.0, duration);
+  start_rot_ = start_pose.M;
+
+  // Boundary conditions, the angular part in the start frame. Jl is the identity at the start
+  // (and its rate is zero there), at the end dtheta = Jl^-1.w and ddtheta = Jl^-1.(dw - dJl.dtheta)
+  Eigen::Matrix<double,6,1> p0, v0, a0, p1, v1, a1;
+  const KDL::Rotation inv_rot = start_rot_.Inverse();
+  const KDL::Vector theta = (inv_rot * end_pose.M).GetRot();
+  const KDL::Vector w0 = inv_rot * start_vel.rot, w1 = inv_rot * end_vel.rot;
+  const KDL::Vector dw0 = inv_rot * start_acc.rot, dw1 = inv_rot * end_acc.rot;
+  for(int i=0; i<3; i++){
+    p0(i) = start_pose.p(i);  p0(i+3) = 0.0;
+    v0(i) = start_vel.vel(i); v0(i+3) = w0(i);
+    a0(i) = start_acc.vel(i); a0(i+3) = dw0(i);
+    p1(i) = end_pose.p(i);    p1(i+3) = theta(i);
+    v1(i) = end_vel.vel(i);   v1(i+3) = w1(i);
+    a1(i) = end_acc.vel(i);   a1(i+3) = dw1(i);
+  }
+  const Eigen::Matrix3d jl_inv = leftJacobianInverse(p1.tail<3>());
+  v1.tail<3>() = jl_inv * v1.tail<3>();
+  a1.tail<3>() = jl_inv * (a1.tail<3>() - leftJacobianRate(p1.tail<3>(), v1.tail<3>()));
+
+  coeffs_.setZero();
+  coeffs_.col(0) = p0;
+  if(duration_ <= 0.0){
+    // Jump to the end state
+    coeffs_.col(0) = p1;
+    coeffs_.col(1) = v1;
+    coeffs_.col(2) = 0.5 * a1;
+    return;
+  }
+  const double T = duration_, T2 = T*T, T3 = T2*T, T4 = T3*T, T5 = T4*T;
+  coeffs_.col(1) = v0;
+  coeffs_.col(2) = 0.5 * a0;
+  coeffs_.col(3) = (20.0 * (p1 - p0) - (8.0 * v1 + 12.0 * v0) * T - (3.0 * a0 - a1) * T2) / (2.0 * T3);
+  coeffs_.col(4) = (30.0 * (p0 - p1) + (14.0 * v1 + 16.0 * v0) * T + (3.0 * a0 - 2.0 * a1) * T2) / (2.0 * T4);
+  coeffs_.col(5) = (12.0 * (p1 - p0) - 6.0 * (v1 + v0) * T - (a0 - a1) * T2) / (2.0 * T5);
+}
+
+void CartesianSegment::sample(double t, KDL::Frame& pose, KDL::Twist& vel, KDL::Twist& acc) const{
+  const double s = std::min(std::max(t - start_time_, 0.0), duration_);
+  const double s2 = s*s, s3 = s2*s, s4 = s3*s, s5 = s4*s;
+  const Eigen::Matrix<double,6,1> p = coeffs_ * (Eigen::Matrix<double,6,1>() << 1.0, s, s2, s3, s4, s5).finished();
+  const Eigen::Matrix<double,6,1> v = coeffs_.rightCols<5>() * (Eigen::Matrix<double,5,1>() << 1.0, 2.0*s, 3.0*s2, 4.0*s3, 5.0*s4).finished();
+  const Eigen::Matrix<double,6,1> a = coeffs_.rightCols<4>() * (Eigen::Matrix<double,4,1>() << 2.0, 6.0*s, 12.0*s2, 20.0*s3).finished();
+
+  const KDL::Vector theta(p(3),p(4),p(5));
+  const double angle = theta.Norm();
+  pose.p = KDL::Vector(p(0),p(1),p(2));
+  pose.M = angle > 1e-12 ? start_rot_ * KDL::Rotation::Rot2(theta / angle, angle) : start_rot_;
+
+  // Angular velocity and acceleration in the start frame, then in the base frame
+  const Eigen::Matrix3d jl = leftJacobian(p.tail<3>());
+  const Eigen::Vector3d w = jl * v.tail<3>();
+  const Eigen::Vector3d dw = jl * a.tail<3>() + leftJacobianRate(p.tail<3>(), v.tail<3>());
+  vel.vel = KDL::Vector(v(0),v(1),v(2));
+  vel.rot = start_rot_ * KDL::Vector(w(0),w(1),w(2));
+  acc.vel = KDL::Vector(a(0),a(1),a(2));
+  acc.rot = start_rot_ * KDL::Vector(dw(0),dw(1),dw(2));
+}
@@ -2,6 +2,15 @@
 
 using namespace RTT;
 
+namespace{
+  // Played and requested sources in one word, offset so that they are positive
+  inline int64_t packHandover(int played, int requested){
+    return (static_cast<int64_t>(played + 2) << 32) | static_cast<int64_t>(requested + 2);
+  }
+  inline int playedSource(int64_t handover){ return static_cast<int>(handover >> 32) - 2; }
+  inline int requestedSource(int64_t handover){ return static_cast<int>(handover & 0xffffffff) - 2; }
+}
+
 KDLTrajCompute::KDLTrajCompute(const std::string& name) : RTT::TaskContext(name)
 { 
   this->addPort("TrajectoryPointPosOut",port_pnt_pos_out_);
@@ -10,13 +19,41 @@ KDLTrajCompute::KDLTrajCompute(const std::string& name) : RTT::TaskContext(name)
   this->addPort("PathROSOut",port_path_out_);
   this->addPort("PathPosesROSOut",port_pose_array_out_);
   this->addPort("ButtonPressed",port_button_pressed_in_);
+  this->addPort("SpeedScale",port_speed_scale_in_);
+  this->addPort("Ec_lim",port_ec_lim_in_);
+  this->addPort("SpeedScaleOut",port_speed_scale_out_);
+  this->addPort("TrackingFeedback",port_tracking_feedback_in_);
+  this->addPort("JointPosition",port_joint_position_in_);
+  this->addPort("PlanningStats",port_planning_stats_out_);
   this->addOperation("updateWaypoints",&KDLTrajCompute::updateWaypoints,this,RTT::ClientThread);
+  this->addOperation("playTrajectory",&KDLTrajCompute::playTrajectory,this,RTT::ClientThread);
   
   this->addProperty("base_frame",base_frame_).doc("Max cartesian velocity");
   this->addProperty("vel_max",vel_max_).doc("Max cartesian velocity");
   this->addProperty("acc_max",acc_max_).doc("Max cartesian acceleration");
   this->addProperty("radius",radius_).doc("Radius for path roundness");
   this->addProperty("eqradius",eqradius_).doc("Equivalent radius for path roundness");
+  this->addProperty("max_scale_rate",max_scale_rate_).doc("Max rate of change of the speed scale (1/s)");
+  this->addProperty("speed_scaling_policy",speed_scaling_policy_).doc("Also scale the speed so that the kinetic energy at vel_max stays under Ec_lim");
+  this->addProperty("reference_mass",reference_mass_).doc("Effective mass used by the speed scaling policy (kg)");
+  this->addProperty("tracking_feedback",tracking_feedback_enabled_).doc("Slow down or pause the trajectory from the controller TrackingFeedback");
+  this->addProperty("slowdown_error",slowdown_error_).doc("Position error from which the trajectory slows down (m)");
+  this->addProperty("pause_error",pause_error_).doc("Position error at which the trajectory is paused (m)");
+  this->addProperty("limited_speed_scale",limited_speed_scale_).doc("Max speed scale while the controller error is saturated or a constraint is active");
+  this->addProperty("candidate_planning",candidate_planning_).doc("Plan many timings of the waypoints in parallel and keep the shortest feasible one");
+  this->addProperty("planning_threads",planning_threads_).doc("Candidate planning threads, 0 for one per hardware thread");
+  this->addProperty("planning_budget",planning_budget_).doc("Candidate planning latency budget (s) when the request does not give one");
+  this->addProperty("blend_scales",blend_scales_).doc("Candidate factors on radius and eqradius");
+  this->addProperty("vel_scales",vel_scales_).doc("Candidate factors on vel_max");
+  this->addProperty("acc_scales",acc_scales_).doc("Candidate factors on acc_max");
+  this->addProperty("vel_limit",vel_limit_).doc("Max cartesian velocity of a candidate (m/s)");
+  this->addProperty("acc_limit",acc_limit_).doc("Max cartesian acceleration of a candidate, blends included (m/s^2)");
+  this->addProperty("rot_vel_limit",rot_vel_limit_).doc("Max angular velocity of a candidate (rad/s)");
+  this->addProperty("rot_acc_limit",rot_acc_limit_).doc("Max angular acceleration of a candidate (rad/s^2)");
+  this->addProperty("joint_vel_max",joint_vel_max_).doc("Max velocity for each joint along a candidate, empty to skip");
+  this->addProperty("check_period",check_period_).doc("Sampling period of the candidate check (s)");
+  this->addProperty("tracking_tolerance",tracking_tolerance_).doc("Max IK tracking error along a candidate (m, rad)");
+  this->addProperty("trajectory_library",trajectory_library_file_).doc("Trajectory library mapped at configure for playTrajectory, empty for none");
   
   // Default params
   base_frame_ = "base_link";
@@ -24,6 +61,29 @@ KDLTrajCompute::KDLTrajCompute(const std::string& name) : RTT::TaskContext(name)
   acc_max_ = 2.0;
   radius_ = 0.01;
   eqradius_ = 0.05;
+  max_scale_rate_ = 2.0;
+  speed_scaling_policy_ = false;
+  reference_mass_ = 10.0;
+  tracking_feedback_enabled_ = false;
+  slowdown_error_ = 0.005;
+  pause_error_ = 0.02;
+  limited_speed_scale_ = 0.5;
+  candidate_planning_ = false;
+  planning_threads_ = 0;
+  planning_budget_ = 0.05;
+  blend_scales_.resize(4);
+  blend_scales_ << 0.5, 1.0, 2.0, 4.0;
+  vel_scales_.resize(3);
+  vel_scales_ << 1.0, 1.5, 2.0;
+  acc_scales_.resize(2);
+  acc_scales_ << 1.0, 2.0;
+  vel_limit_ = 1.0;
+  acc_limit_ = 3.0;
+  rot_vel_limit_ = 2.0;
+  rot_acc_limit_ = 10.0;
+  check_period_ = 0.01;
+  tracking_tolerance_ = 0.005;
+  trajectory_library_file_ = "";
   
   // Match all properties (defined in the constructor) 
   // with the rosparams in the namespace : 
@@ -31,8 +91,10 @@ KDLTrajCompute::KDLTrajCompute(const std::string& name) : RTT::TaskContext(name)
   // Equivalent to ros::param::get("CartOptCtrl/p_gains_");
   rtt_ros_kdl_tools::getAllPropertiesFromROSParam(this);
   
-  interpolator_ = new KDL::RotationalInterpolation_SingleAxis();
   tf_ = new tf::TransformListener();
+  handover_ = packHandover(NO_TRAJECTORY, NO_REQUEST);
+  source_ = NO_TRAJECTORY;
+  traj_computed_ = false;
   
   button_pressed_ = false;
 }
@@ -57,25 +119,67 @@ bool KDLTrajCompute::updateWaypoints(cart_opt_ctrl::UpdateWaypoints::Request& re
   }
   waypoints_in_.header.frame_id = base_frame_;
   
-  bool success = computeTrajectory();
-  current_traj_time_ = 0.0;
-  traj_computed_ = success;
+  bool success;
+  {
+    std::lock_guard<std::mutex> lock(service_mutex_);
+    // Withdraw a request not taken yet, the plan that is not played is then free
+    const int plan = requestTrajectory(NO_REQUEST) == 0 ? 1 : 0;
+    success = computeTrajectory(plan, req.planning_budget);
+    requestTrajectory(success ? plan : NO_TRAJECTORY);
+  }
   resp.success = success;
   
+  if(!waitForTrajectory()){
+    resp.success = false;
+    return false;
+  }
+  return true;
+}
+
+bool KDLTrajCompute::playTrajectory(cart_opt_ctrl::PlayTrajectory::Request& req, cart_opt_ctrl::PlayTrajectory::Response& resp){
+  // Already sampled, starts at the next period
+  const int trajectory = library_.isLoaded() ? library_.find(req.name) : -1;
+  if(trajectory < 0){
+    log(RTT::Error) << "No trajectory " << req.name << " in the library" << endlog();
+    resp.success = false;
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(service_mutex_);
+    requestTrajectory(LIBRARY + trajectory);
+  }
+  resp.success = true;
+  publishTrajectory(LIBRARY + trajectory);
+
+  if(!waitForTrajectory()){
+    resp.success = false;
+    return false;
+  }
+  return true;
+}
+
+int KDLTrajCompute::requestTrajectory(int source){
+  int64_t handover = handover_.load();
+  while(!handover_.compare_exchange_weak(handover, packHandover(playedSource(handover), source))){}
+  return playedSource(handover);
+}
+
+bool KDLTrajCompute::waitForTrajectory(){
+  // Taken at the next cycle, or at start
+  while(requestedSource(handover_.load()) != NO_REQUEST && this->isRunning())
+    usleep(1000);
   while(traj_computed_){
     // Read button press port
     if(this->port_button_pressed_in_.read(button_pressed_) != RTT::NoData){
       // If gravity compensation activated, return failure on service
       if (button_pressed_){
-        current_traj_time_ = 0.0;
-        traj_computed_ = false;
-        resp.success = false;
+        std::lock_guard<std::mutex> lock(service_mutex_);
+        requestTrajectory(NO_TRAJECTORY);
         return false;
       }
     }
     usleep(1e05);
   }
-
   return true;
 }
 
@@ -83,20 +187,115 @@ bool KDLTrajCompute::updateWaypoints(cart_opt_ctrl::UpdateWaypoints::Request& re
 bool KDLTrajCompute::configureHook(){ 
   current_traj_time_ = 0.0;
   traj_computed_ = false;
+
+  if(!trajectory_library_file_.empty()){
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(!library_.load(trajectory_library_file_)){
+      log(RTT::Error) << "Could not map the trajectory library " << trajectory_library_file_ << endlog();
+      return false;
+    }
+    log(RTT::Info) << "Trajectory library with " << library_.size() << " trajectories mapped in "
+                   << 1e6 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " us" << endlog();
+    if(std::abs(library_.period() - this->getPeriod()) > 1e-9)
+      log(RTT::Warning) << "The library is sampled every " << library_.period() << " s, the samples will be interpolated" << endlog();
+  }
+
+  planning_stats_.setZero(PlanningStats::SIZE);
+  if(candidate_planning_){
+    if(check_period_ <= 0.0 || vel_limit_ <= 0.0 || acc_limit_ <= 0.0 || rot_vel_limit_ <= 0.0 || rot_acc_limit_ <= 0.0){
+      log(RTT::Error) << "check_period and the candidate limits must be positive" << endlog();
+      return false;
+    }
+    PlanningLimits limits;
+    limits.vel = vel_limit_;
+    limits.acc = acc_limit_;
+    limits.rot_vel = rot_vel_limit_;
+    limits.rot_acc = rot_acc_limit_;
+    limits.joint_vel = joint_vel_max_;
+    limits.check_period = check_period_;
+    limits.tracking_tolerance = tracking_tolerance_;
+
+    // The threads are started once, the limits follow every configuration
+    if(planner_.getNrOfThreads() == 0){
+      // The joint check needs the model, the candidates are only checked in cartesian space without it
+      bool planner_ready;
+      if(arm_.init())
+        planner_ready = planner_.init(planning_threads_, &arm_.Chain(), arm_.getSegmentName(arm_.getNrOfSegments() - 1));
+      else{
+        log(RTT::Warning) << "Could not init chain utils, the candidates will not be checked against the joint limits" << endlog();
+        planner_ready = planner_.init(planning_threads_);
+      }
+      if(!planner_ready){
+        log(RTT::Error) << "Could not start the candidate planner" << endlog();
+        return false;
+      }
+      log(RTT::Info) << "Candidate planning on " << planner_.getNrOfThreads() << " threads" << endlog();
+    }
+    if(planner_.usesModel()){
+      limits.joint_lower = arm_.getJointLowerLimit();
+      limits.joint_upper = arm_.getJointUpperLimit();
+    }
+    planner_.setLimits(limits);
+  }
   return true;
 }
 
 bool KDLTrajCompute::startHook(){ 
+  speed_scale_ = 1.0;
+  speed_scale_rate_ = 0.0;
+  speed_scale_in_ = 1.0;
+  ec_lim_in_.data = -1.0;
+  tracking_feedback_in_.setZero(TrackingFeedback::SIZE);
   return true;
 }
 
+void KDLTrajCompute::updateSpeedScale(){
+  // Requested scale, full speed until someone writes on the port
+  port_speed_scale_in_.read(speed_scale_in_);
+  double target = std::min(1.0, std::max(0.0, speed_scale_in_));
+
+  // Policy : 0.5.m.(s.vel_max)^2 <= Ec_lim
+  port_ec_lim_in_.read(ec_lim_in_);
+  if(speed_scaling_policy_ && ec_lim_in_.data >= 0.0 && vel_max_ > 0.0)
+    target = std::min(target, std::sqrt(2.0 * ec_lim_in_.data / reference_mass_) / vel_max_);
+
+  // Path following : the reference waits for the robot instead of running away
+  if(tracking_feedback_enabled_ && port_tracking_feedback_in_.read(tracking_feedback_in_) != RTT::NoData
+     && tracking_feedback_in_.size() == TrackingFeedback::SIZE){
+    const double error = tracking_feedback_in_(TrackingFeedback::POSITION_ERROR);
+    if(pause_error_ > slowdown_error_)
+      target = std::min(target, std::min(1.0, std::max(0.0, (pause_error_ - error) / (pause_error_ - slowdown_error_))));
+    if(tracking_feedback_in_.segment(TrackingFeedback::ERROR_SATURATED, TrackingFeedback::SIZE - TrackingFeedback::ERROR_SATURATED).any())
+      target = std::min(target, limited_speed_scale_);
+  }
+
+  // Bounded derivative so that the scaled velocities and accelerations stay consistent
+  const double max_step = max_scale_rate_ * this->getPeriod();
+  const double step = std::min(max_step, std::max(-max_step, target - speed_scale_));
+  speed_scale_rate_ = step / this->getPeriod();
+  speed_scale_ += step;
+  port_speed_scale_out_.write(speed_scale_);
+}
+
 void KDLTrajCompute::updateHook(){ 
+  updateSpeedScale();
+
+  // Switch to the requested trajectory from its first sample, the services see the switch as done once the request is cleared
+  int64_t handover = handover_.load();
+  const int requested = requestedSource(handover);
+  if(requested != NO_REQUEST && handover_.compare_exchange_strong(handover, packHandover(requested, NO_REQUEST))){
+    source_ = requested;
+    current_traj_time_ = 0.0;
+    traj_computed_ = source_ != NO_TRAJECTORY;
+  }
+
   if (traj_computed_){
-    if (current_traj_time_ < ctraject_->Duration()){
-      // Get trajectory point
-      current_pos_ = ctraject_->Pos(current_traj_time_);
-      current_vel_ = ctraject_->Vel(current_traj_time_);
-      current_acc_ = ctraject_->Acc(current_traj_time_);
+    if (current_traj_time_ < trajectoryDuration(source_)){
+      // Get trajectory point, with tau(t) the scaled time :
+      // Xd = s.Vel(tau), Xdd = s^2.Acc(tau) + ds/dt.Vel(tau)
+      trajectoryPoint(source_, current_traj_time_, current_pos_, current_vel_, current_acc_);
+      current_acc_ = current_acc_ * (speed_scale_ * speed_scale_) + current_vel_ * speed_scale_rate_;
+      current_vel_ = current_vel_ * speed_scale_;
       
       // Send point via ports
       port_pnt_pos_out_.write(current_pos_);
@@ -104,7 +303,7 @@ void KDLTrajCompute::updateHook(){
       port_pnt_acc_out_.write(current_acc_);
       
       // Increase timer
-      current_traj_time_ += this->getPeriod();
+      current_traj_time_ += speed_scale_ * this->getPeriod();
     }
     else{
       traj_computed_ = false;
@@ -113,52 +312,112 @@ void KDLTrajCompute::updateHook(){
   }
 }
 
-bool KDLTrajCompute::computeTrajectory(){  
-  try {
-    // Initialize path with roundness between waypoints
-    path_ = new KDL::Path_RoundedComposite(radius_,eqradius_,interpolator_);
+double KDLTrajCompute::trajectoryDuration(int source) const{
+  if(source >= LIBRARY)
+    return library_.duration(source - LIBRARY);
+  return source >= 0 && !plans_[source].empty() ? plans_[source].Duration() : 0.0;
+}
 
-    // Add all the waypoints to the path
-    KDL::Frame frame, previous_frame;
-    std::vector<KDL::Frame> waypoints;
-    for(int i=0; i<waypoints_in_.poses.size(); i++){
-      tf::poseMsgToKDL(waypoints_in_.poses[i], frame);
-      // If the previous points is too similar dont add it
-      if(i>0){
-        KDL::Twist err =  diff(frame, previous_frame);
-        if((std::abs(err(0))<0.01) && (std::abs(err(1))<0.01) && (std::abs(err(2))<0.01)){
-          ROS_WARN_STREAM("Skipping point #"<<i<<" of the path");
-          continue;
-        }
+void KDLTrajCompute::trajectoryPoint(int source, double time, KDL::Frame& pos, KDL::Twist& vel, KDL::Twist& acc) const{
+  if(source >= LIBRARY){
+    library_.sample(source - LIBRARY, time, pos, vel, acc);
+    return;
+  }
+  pos = plans_[source].Pos(time);
+  vel = plans_[source].Vel(time);
+  acc = plans_[source].Acc(time);
+}
+
+void KDLTrajCompute::extractWaypoints(std::vector<KDL::Frame>& waypoints){
+  KDL::Frame frame, previous_frame;
+  waypoints.clear();
+  for(unsigned int i=0; i<waypoints_in_.poses.size(); i++){
+    tf::poseMsgToKDL(waypoints_in_.poses[i], frame);
+    // If the previous points is too similar dont add it
+    if(i>0){
+      KDL::Twist err =  diff(frame, previous_frame);
+      if((std::abs(err(0))<0.01) && (std::abs(err(1))<0.01) && (std::abs(err(2))<0.01)){
+        ROS_WARN_STREAM("Skipping point #"<<i<<" of the path");
+        continue;
       }
-      waypoints.push_back(frame);
-      previous_frame = frame;
     }
+    waypoints.push_back(frame);
+    previous_frame = frame;
+  }
+}
 
-    ctraject_ = new KDL::Trajectory_Composite();
-    // Add a path only if there is at least 2 points
-    if(waypoints.size() > 1){
-      for(int i=0; i< waypoints.size(); i++)
-        path_->Add(waypoints[i]);
-      path_->Finish();
-      
-      // Set velocity profile of the trajectory
-      vel_profile_ = new KDL::VelocityProfile_Trap(vel_max_,acc_max_);
-      vel_profile_->SetProfile(0,path_->PathLength());
-      
-      traject_ = new KDL::Trajectory_Segment(path_, vel_profile_);
-      ctraject_->Add(traject_);
+void KDLTrajCompute::makeCandidates(){
+  // The nominal timing first, then every combination of the scales and of the profiles
+  const PlanningCandidate nominal = {radius_, eqradius_, vel_max_, acc_max_, TrajectoryPlan::TRAPEZOIDAL};
+  candidates_.clear();
+  candidates_.push_back(nominal);
+  for(int b=0; b<blend_scales_.size(); b++)
+    for(int v=0; v<vel_scales_.size(); v++)
+      for(int a=0; a<acc_scales_.size(); a++)
+        for(int p=TrajectoryPlan::TRAPEZOIDAL; p<=TrajectoryPlan::QUINTIC; p++){
+          if(blend_scales_(b) == 1.0 && vel_scales_(v) == 1.0 && acc_scales_(a) == 1.0 && p == TrajectoryPlan::TRAPEZOIDAL)
+            continue;
+          const PlanningCandidate candidate = {radius_ * blend_scales_(b), eqradius_ * blend_scales_(b),
+                                               vel_max_ * vel_scales_(v), acc_max_ * acc_scales_(a), static_cast<TrajectoryPlan::Profile>(p)};
+          candidates_.push_back(candidate);
+        }
+}
+
+void KDLTrajCompute::updatePlanningStats(const CandidatePlanner::Report& report){
+  const double nb_plans = planning_stats_(PlanningStats::NB_PLANS) + 1.0;
+  planning_stats_(PlanningStats::PLANNING_TIME) = report.planning_time;
+  planning_stats_(PlanningStats::CANDIDATES) = report.candidates;
+  planning_stats_(PlanningStats::EVALUATED) = report.evaluated;
+  planning_stats_(PlanningStats::FEASIBLE) = report.feasible;
+  planning_stats_(PlanningStats::BUDGET_EXCEEDED) = report.budget_exceeded ? 1.0 : 0.0;
+  planning_stats_(PlanningStats::DURATION) = report.duration;
+  planning_stats_(PlanningStats::NOMINAL_DURATION) = report.nominal_duration;
+  planning_stats_(PlanningStats::NB_PLANS) = nb_plans;
+  planning_stats_(PlanningStats::MEAN_PLANNING_TIME) += (report.planning_time - planning_stats_(PlanningStats::MEAN_PLANNING_TIME)) / nb_plans;
+  planning_stats_(PlanningStats::MAX_PLANNING_TIME) = std::max(planning_stats_(PlanningStats::MAX_PLANNING_TIME), report.planning_time);
+  planning_stats_(PlanningStats::MEAN_DURATION) += (report.duration - planning_stats_(PlanningStats::MEAN_DURATION)) / nb_plans;
+  planning_stats_(PlanningStats::MEMORY) = report.memory;
+  port_planning_stats_out_.write(planning_stats_);
+
+  log(RTT::Info) << "Planned in " << 1e3 * report.planning_time << " ms, " << report.evaluated << "/" << report.candidates
+                 << " candidates checked" << (report.budget_exceeded ? " (budget exceeded)" : "")
+                 << ", cycle time " << report.duration << " s (nominal " << report.nominal_duration << " s), "
+                 << report.memory << " bytes in the candidate arenas" << endlog();
+}
+
+bool KDLTrajCompute::computeTrajectory(int plan_index, double planning_budget){  
+  // Neither played nor requested (see handover_)
+  TrajectoryPlan& plan = plans_[plan_index];
+  try {
+    std::vector<KDL::Frame> waypoints;
+    extractWaypoints(waypoints);
+
+    if(candidate_planning_){
+      // Start configuration for the joint check, none until the robot publishes it
+      if(port_joint_position_in_.read(joint_position_in_) == RTT::NoData)
+        joint_position_in_.resize(0);
+      makeCandidates();
+      CandidatePlanner::Report report;
+      const bool found = planner_.plan(waypoints, candidates_, 0.5, joint_position_in_,
+                                       planning_budget > 0.0 ? planning_budget : planning_budget_, plan, report);
+      updatePlanningStats(report);
+      if(!found){
+        log(RTT::Error) << "No feasible candidate for the " << waypoints.size() << " waypoints" << endlog();
+        return false;
+      }
     }
     else{
-      vel_profile_ = new KDL::VelocityProfile_Trap(vel_max_,acc_max_);
-      ctraject_->Add(new KDL::Trajectory_Segment(new KDL::Path_Point(frame), vel_profile_));
+      // Single plan with the nominal parameters, wait 0.5s at the end of the trajectory
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      if(!plan.build(waypoints, radius_, eqradius_, vel_max_, acc_max_, TrajectoryPlan::TRAPEZOIDAL, 0.5)){
+        log(RTT::Error) << "No waypoints to plan" << endlog();
+        return false;
+      }
+      log(RTT::Info) << "Planned in " << 1e3 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " ms, "
+                     << plan.getMemoryUsed() << " bytes in its arena (" << plan.getMemoryReserved() << " reserved)" << endlog();
     }
-    
-    // Wait 0.5s at the end of the trajectory
-    ctraject_->Add(new KDL::Trajectory_Stationary(0.5,frame));
-    
     // Publish a displayable path to ROS
-    publishTrajectory();
+    publishTrajectory(plan_index);
   
     } catch(KDL::Error& error) {
       std::cout <<"Tried planning with the following waypoints : \n" << waypoints_in_ << endlog();
@@ -169,9 +428,9 @@ bool KDLTrajCompute::computeTrajectory(){
   return true;
 }
 
-void KDLTrajCompute::publishTrajectory(){
+void KDLTrajCompute::publishTrajectory(int source){
   nav_msgs::Path path_ros;
-  path_ros.header.frame_id = waypoints_in_.header.frame_id;
+  path_ros.header.frame_id = base_frame_;
   path_ros.header.stamp = ros::Time::now();
 
   geometry_msgs::PoseArray pose_array;
@@ -182,10 +441,8 @@ void KDLTrajCompute::publishTrajectory(){
   geometry_msgs::Pose pose;
   geometry_msgs::PoseStamped pose_st;
   pose_st.header = path_ros.header;
-  for (double t=0.0; t <= ctraject_->Duration(); t+= 0.1) {    
-    current_pose = ctraject_->Pos(t);
-    current_vel = ctraject_->Vel(t);
-    current_acc = ctraject_->Acc(t);
+  for (double t=0.0; t <= trajectoryDuration(source); t+= 0.1) {    
+    trajectoryPoint(source, t, current_pose, current_vel, current_acc);
                 
     tf::poseKDLToMsg(current_pose,pose);
     pose_array.poses.push_back(pose);
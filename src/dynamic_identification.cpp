@@ -0,0 +1,310 @@
+#include "cart_opt_ctrl/dynamic_identification.hpp"
+#include "cart_opt_ctrl/payload_estimator.hpp"
+#include <Eigen/QR>
+#include <Eigen/SVD>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+static_assert(BatchedDynamics::NB_SEGMENT_PARAMETERS == PayloadEstimator::NB_PARAMS, "the physical consistency helpers take the payload parameters layout");
+
+FourierExcitation::FourierExcitation() : omega_(2.0 * M_PI)
+{
+}
+
+void FourierExcitation::init(const Eigen::VectorXd& start, int nb_harmonics, double base_frequency){
+  start_ = start;
+  sine_.setZero(start.size(), std::max(1, nb_harmonics));
+  cosine_.setZero(start.size(), std::max(1, nb_harmonics));
+  omega_ = 2.0 * M_PI * base_frequency;
+}
+
+void FourierExcitation::project(){
+  const int nh = sine_.cols();
+  const Eigen::VectorXd l = Eigen::VectorXd::LinSpaced(nh, 1.0, nh);
+  for(int j=0; j<sine_.rows(); j++){
+    sine_.row(j).array() -= sine_.row(j).mean();
+    cosine_.row(j) -= (cosine_.row(j).dot(l) / l.squaredNorm()) * l.transpose();
+  }
+}
+
+void FourierExcitation::sample(double t, Eigen::VectorXd& q, Eigen::VectorXd& qd, Eigen::VectorXd& qdd) const{
+  q = start_;
+  qd.setZero();
+  qdd.setZero();
+  for(int l=1; l<=sine_.cols(); l++){
+    const double w = omega_ * l, s = std::sin(w * t), c = std::cos(w * t);
+    for(int j=0; j<start_.size(); j++){
+      const double a = sine_(j,l-1), b = cosine_(j,l-1);
+      // The offset b / w puts q(0) at the start
+      q[j] += (a * s - b * c + b) / w;
+      qd[j] += a * c + b * s;
+      qdd[j] += w * (b * c - a * s);
+    }
+  }
+}
+
+void FourierExcitation::sample(double first, double step, int nb_samples, Matrix& q, Matrix& qd, Matrix& qdd) const{
+  const int nj = start_.size();
+  q.resize(nj, nb_samples);
+  qd.resize(nj, nb_samples);
+  qdd.resize(nj, nb_samples);
+  Eigen::VectorXd qk(nj), qdk(nj), qddk(nj);
+  for(int k=0; k<nb_samples; k++){
+    sample(first + k * step, qk, qdk, qddk);
+    q.col(k) = qk;
+    qd.col(k) = qdk;
+    qdd.col(k) = qddk;
+  }
+}
+
+double FourierExcitation::scaleToLimits(const Eigen::VectorXd& lower, const Eigen::VectorXd& upper, const Eigen::VectorXd& qd_max,
+                                        const Eigen::VectorXd& qdd_max, int nb_samples){
+  // q - start, qd and qdd are linear in the coefficients
+  Matrix q, qd, qdd;
+  sample(0.0, period() / nb_samples, nb_samples, q, qd, qdd);
+  double scale = std::numeric_limits<double>::infinity();
+  for(int j=0; j<start_.size(); j++){
+    const double d_max = q.row(j).maxCoeff() - start_[j], d_min = q.row(j).minCoeff() - start_[j];
+    if(d_max > 0.0)
+      scale = std::min(scale, (upper[j] - start_[j]) / d_max);
+    if(d_min < 0.0)
+      scale = std::min(scale, (lower[j] - start_[j]) / d_min);
+    const double v = qd.row(j).cwiseAbs().maxCoeff(), a = qdd.row(j).cwiseAbs().maxCoeff();
+    if(v > 0.0)
+      scale = std::min(scale, qd_max[j] / v);
+    if(a > 0.0)
+      scale = std::min(scale, qdd_max[j] / a);
+  }
+  scale = std::isfinite(scale) ? std::max(0.0, scale) : 0.0;
+  sine_ *= scale;
+  cosine_ *= scale;
+  return scale;
+}
+
+DynamicIdentification::DynamicIdentification() : friction_(false), friction_deadband_(0.01), nb_samples_(0)
+{
+}
+
+bool DynamicIdentification::init(const BatchedDynamics& dynamics, bool friction, double friction_deadband){
+  dynamics_ = dynamics;
+  friction_ = friction;
+  friction_deadband_ = friction_deadband;
+  const int nj = dynamics.getNrOfJoints(), np = dynamics.getNrOfParameters();
+  if(nj <= 0)
+    return false;
+  prior_.setZero(np + (friction ? 2 * nj : 0));
+  scales_.setOnes(prior_.size());
+  const BatchedDynamics::SegmentModels& segments = dynamics.getSegments();
+  double mean_mass = 0.0;
+  for(unsigned int k=0; k<segments.size(); k++)
+    mean_mass += segments[k].mass / segments.size();
+  for(unsigned int k=0; k<segments.size(); k++){
+    double* p = prior_.data() + k * BatchedDynamics::NB_SEGMENT_PARAMETERS;
+    double* s = scales_.data() + k * BatchedDynamics::NB_SEGMENT_PARAMETERS;
+    BatchedDynamics::getParameters(segments[k], p);
+    // Massless segments (frames) may still take a fraction of the mean mass
+    const double mass = std::max(segments[k].mass, 0.1 * mean_mass), length = std::max(segments[k].tip_pos.norm(), 0.05);
+    s[0] = mass;
+    for(int i=1; i<4; i++)
+      s[i] = mass * length;
+    for(int i=4; i<BatchedDynamics::NB_SEGMENT_PARAMETERS; i++)
+      s[i] = mass * length * length;
+  }
+  clear();
+  return true;
+}
+
+void DynamicIdentification::clear(){
+  const int c = prior_.size() + 1;
+  r_.assign(dynamics_.getNrOfJoints(), Eigen::MatrixXd::Zero(c,c));
+  nb_samples_ = 0;
+}
+
+void DynamicIdentification::reduce(Eigen::MatrixXd& r, const Eigen::MatrixXd& block){
+  const int c = r.cols();
+  Eigen::MatrixXd stacked(c + block.rows(), c);
+  stacked << r, block;
+  const Eigen::HouseholderQR<Eigen::MatrixXd> qr(stacked);
+  r = qr.matrixQR().topRows(c).triangularView<Eigen::Upper>();
+}
+
+void DynamicIdentification::reduceBatch(const BatchedDynamics& dynamics, const BatchedDynamicsResult::Matrix& q,
+                                        const BatchedDynamicsResult::Matrix& qd, const BatchedDynamicsResult::Matrix& qdd,
+                                        const BatchedDynamicsResult::Matrix& tau, int first, int last, std::vector<Eigen::MatrixXd>& r) const{
+  const int n = last - first, nj = dynamics.getNrOfJoints(), np = dynamics.getNrOfParameters();
+  const int c = prior_.size() + 1;
+  BatchedDynamicsResult::Matrix y;
+  dynamics.computeRegressor(q.middleCols(first,n), qd.middleCols(first,n), qdd.middleCols(first,n), y);
+  Eigen::MatrixXd block(n, c);
+  for(int j=0; j<nj; j++){
+    block.leftCols(np) = y.middleRows(j*np,np).transpose();
+    if(friction_){
+      block.middleCols(np, 2*nj).setZero();
+      for(int k=0; k<n; k++){
+        const double v = qd(j,first+k);
+        block(k,np+j) = std::abs(v) < friction_deadband_ ? 0.0 : (v > 0.0 ? 1.0 : -1.0);
+        block(k,np+nj+j) = v;
+      }
+    }
+    block.col(c-1) = tau.row(j).segment(first,n).transpose();
+    reduce(r[j], block);
+  }
+}
+
+void DynamicIdentification::addSamples(const BatchedDynamicsResult::Matrix& q, const BatchedDynamicsResult::Matrix& qd,
+                                       const BatchedDynamicsResult::Matrix& qdd, const BatchedDynamicsResult::Matrix& tau,
+                                       unsigned int nb_threads, int batch_size){
+  const int n = q.cols(), nj = dynamics_.getNrOfJoints();
+  batch_size = std::max(BatchedDynamics::Lanes, batch_size);
+  const int nb_batches = (n + batch_size - 1) / batch_size;
+  if(nb_batches == 0)
+    return;
+  if(nb_threads == 0)
+    nb_threads = std::max(1u, std::thread::hardware_concurrency());
+  nb_threads = std::min<unsigned int>(nb_threads, nb_batches);
+
+  // Each thread takes the next batch and keeps its own factors, merged at the end
+  std::atomic<int> next_batch(0);
+  const Eigen::MatrixXd zero = Eigen::MatrixXd::Zero(prior_.size() + 1, prior_.size() + 1);
+  std::vector<std::vector<Eigen::MatrixXd> > partial(nb_threads, std::vector<Eigen::MatrixXd>(nj, zero));
+  std::vector<std::thread> workers;
+  for(unsigned int t=0; t<nb_threads; t++){
+    workers.push_back(std::thread([&, t](){
+      BatchedDynamics dynamics = dynamics_;
+      dynamics.setNbThreads(1);
+      for(int b=next_batch++; b<nb_batches; b=next_batch++)
+        reduceBatch(dynamics, q, qd, qdd, tau, b * batch_size, std::min(n, (b + 1) * batch_size), partial[t]);
+    }));
+  }
+  for(unsigned int t=0; t<workers.size(); t++)
+    workers[t].join();
+  for(unsigned int t=0; t<nb_threads; t++)
+    for(int j=0; j<nj; j++)
+      reduce(r_[j], partial[t][j]);
+  nb_samples_ += n;
+}
+
+double DynamicIdentification::residual(int joint, const Eigen::VectorXd& parameters) const{
+  const int np = prior_.size();
+  return (r_[joint].leftCols(np) * parameters - r_[joint].col(np)).squaredNorm();
+}
+
+void DynamicIdentification::solveWeighted(const Eigen::VectorXd& weights, const std::vector<bool>& fixed, double rank_threshold,
+                                          Eigen::VectorXd& parameters, int& rank, double& condition_number, Eigen::MatrixXd* null_space) const{
+  const int nj = r_.size(), np = prior_.size(), c = np + 1;
+  Eigen::MatrixXd a(nj * c, np);
+  Eigen::VectorXd b(nj * c);
+  for(int j=0; j<nj; j++){
+    a.middleRows(j*c,c) = weights[j] * r_[j].leftCols(np);
+    b.segment(j*c,c) = weights[j] * r_[j].col(np);
+  }
+  // Change from the prior on the columns of the free segments, in the units of the segments
+  b -= a * prior_;
+  const Eigen::VectorXd norms = a.colwise().norm();
+  const double max_norm = norms.maxCoeff();
+  std::vector<int> columns;
+  for(int k=0; k<np; k++){
+    const int segment = k < dynamics_.getNrOfParameters() ? k / BatchedDynamics::NB_SEGMENT_PARAMETERS : -1;
+    if((segment < 0 || !fixed[segment]) && norms[k] > 1e-12 * max_norm)
+      columns.push_back(k);
+  }
+  parameters = prior_;
+  rank = 0;
+  condition_number = 0.0;
+  if(null_space)
+    null_space->setZero(np, 0);
+  if(columns.empty())
+    return;
+  Eigen::MatrixXd scaled(a.rows(), columns.size()), normalized(a.rows(), columns.size());
+  for(unsigned int i=0; i<columns.size(); i++){
+    scaled.col(i) = a.col(columns[i]) * scales_[columns[i]];
+    normalized.col(i) = a.col(columns[i]) / norms[columns[i]];
+  }
+
+  // Minimum norm solution : the directions the data does not see keep the prior
+  const int n = columns.size();
+  const Eigen::JacobiSVD<Eigen::MatrixXd> svd(scaled, Eigen::ComputeThinU | Eigen::ComputeFullV);
+  const Eigen::VectorXd& sv = svd.singularValues();
+  while(rank < n && sv[rank] > rank_threshold * sv[0])
+    ++rank;
+  const Eigen::VectorXd delta = svd.matrixV().leftCols(rank) * (svd.matrixU().leftCols(rank).transpose() * b).cwiseQuotient(sv.head(rank));
+  for(int i=0; i<n; i++)
+    parameters[columns[i]] += delta[i] * scales_[columns[i]];
+  if(null_space){
+    null_space->setZero(np, n - rank);
+    for(int i=0; i<n; i++)
+      null_space->row(columns[i]) = svd.matrixV().row(i).tail(n - rank) * scales_[columns[i]];
+  }
+
+  // Independent of the units
+  const Eigen::VectorXd singular_values = Eigen::JacobiSVD<Eigen::MatrixXd>(normalized).singularValues();
+  condition_number = rank > 0 ? singular_values[0] / singular_values[rank-1] : 0.0;
+}
+
+bool DynamicIdentification::solve(Result& result, double rank_threshold) const{
+  const int nj = r_.size(), ns = dynamics_.getNrOfSegments();
+  if(nb_samples_ == 0 || nj == 0)
+    return false;
+
+  // Ordinary least squares for the noise of each joint
+  std::vector<bool> fixed(ns, false);
+  Eigen::VectorXd ols;
+  solveWeighted(Eigen::VectorXd::Ones(nj), fixed, rank_threshold, ols, result.rank, result.condition_number);
+  const double dof = std::max(1.0, double(nb_samples_) - result.rank);
+  result.sigma.resize(nj);
+  Eigen::VectorXd weights(nj);
+  for(int j=0; j<nj; j++){
+    result.sigma[j] = std::sqrt(residual(j, ols) / dof);
+    weights[j] = result.sigma[j] > 0.0 ? 1.0 / result.sigma[j] : 1.0;
+  }
+
+  // Weighted, again without the segments that are not physically consistent
+  result.prior_segments.clear();
+  bool changed = true;
+  Eigen::MatrixXd null_space;
+  while(changed){
+    solveWeighted(weights, fixed, rank_threshold, result.parameters, result.rank, result.condition_number, &null_space);
+    makePhysical(fixed, null_space, result.parameters);
+    changed = false;
+    for(int k=0; k<ns; k++){
+      if(!fixed[k] && !PayloadEstimator::isPhysical(result.parameters.data() + k * BatchedDynamics::NB_SEGMENT_PARAMETERS)){
+        fixed[k] = true;
+        result.prior_segments.push_back(k);
+        changed = true;
+      }
+    }
+  }
+
+  result.prior_rms.resize(nj);
+  result.rms.resize(nj);
+  for(int j=0; j<nj; j++){
+    result.prior_rms[j] = std::sqrt(residual(j, prior_) / nb_samples_);
+    result.rms[j] = std::sqrt(residual(j, result.parameters) / nb_samples_);
+  }
+  return true;
+}
+
+bool DynamicIdentification::makePhysical(const std::vector<bool>& fixed, const Eigen::MatrixXd& null_space, Eigen::VectorXd& parameters) const{
+  const int ns = dynamics_.getNrOfSegments(), ps = BatchedDynamics::NB_SEGMENT_PARAMETERS;
+  const Eigen::VectorXd fit = parameters;
+  // Orthonormal in the units of the segments
+  const Eigen::MatrixXd basis = scales_.cwiseInverse().asDiagonal() * null_space;
+  const int max_iterations = 1000;
+  for(int it=0; it<max_iterations; it++){
+    bool physical = true;
+    for(int k=0; k<ns; k++)
+      physical = physical && (fixed[k] || PayloadEstimator::isPhysical(parameters.data() + k * ps));
+    if(physical)
+      return true;
+    if(null_space.cols() == 0)
+      return false;
+    for(int k=0; k<ns; k++)
+      if(!fixed[k])
+        PayloadEstimator::projectPhysical(parameters.data() + k * ps, 1e-6 * scales_[k * ps + 4]);
+    // Back on the parameters fitting as well, smallest change in the units of the segments
+    parameters = fit + null_space * (basis.transpose() * (parameters - fit).cwiseQuotient(scales_));
+  }
+  return false;
+}
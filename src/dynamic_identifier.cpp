@@ -0,0 +1,242 @@
+#include <ros/ros.h>
+#include <rtt_ros_kdl_tools/chain_utils.hpp>
+#include <cart_opt_ctrl/batched_dynamics.hpp>
+#include <cart_opt_ctrl/dynamic_identification.hpp>
+#include <cart_opt_ctrl/joint_record.hpp>
+#include <urdf/model.h>
+#include <urdf_parser/urdf_parser.h>
+#include <tinyxml.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+// Identification of the inertial parameters (and optionally the joint friction) of the robot found on the parameter
+// server, from the joint samples recorded by CartOptCtrl (joint_record_size, joint_record_file), e.g. while it plays
+// the trajectory of excitation_generator. See DynamicIdentification for the solver.
+// The records are low pass filtered forward and backward (no delay), the accelerations are the central differences
+// of the filtered velocities, the filter transients are dropped and the samples decimated.
+// With torque:=command, the commanded torques hold the gravity of the model : only use it without a torque sensor.
+// The identified inertials are written to output_urdf, the robot_description with the links of the chain updated
+// (URDF elements unknown to urdfdom such as gazebo tags are dropped, the model is for the controllers only) :
+// roslaunch cart_opt_ctrl run.launch identified_model:=<output_urdf>. The friction goes to friction_file,
+// in the format of FrictionIdentComp.
+// Usage : rosrun cart_opt_ctrl dynamic_identifier _records:="[/tmp/cart_opt_ctrl_joints.bin]"
+namespace{
+  // Second order Butterworth low pass run forward then backward (zero phase)
+  void filtfilt(double* x, int n, double cutoff_frequency, double period){
+    const double k = std::tan(M_PI * cutoff_frequency * period);
+    const double norm = 1.0 / (1.0 + std::sqrt(2.0) * k + k * k);
+    const double b0 = k * k * norm, b1 = 2.0 * b0, b2 = b0;
+    const double a1 = 2.0 * (k * k - 1.0) * norm, a2 = (1.0 - std::sqrt(2.0) * k + k * k) * norm;
+    for(int pass=0; pass<2; pass++){
+      const int step = pass == 0 ? 1 : -1;
+      double* p = pass == 0 ? x : x + n - 1;
+      // Starts at steady state on the first value
+      double x1 = *p, x2 = *p, y1 = *p, y2 = *p;
+      for(int i=0; i<n; i++, p+=step){
+        const double y = b0 * *p + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+        x2 = x1; x1 = *p;
+        y2 = y1; y1 = y;
+        *p = y;
+      }
+    }
+  }
+
+  bool writeFriction(const std::string& file, const Eigen::VectorXd& coulomb, const Eigen::VectorXd& viscous, double deadband){
+    FILE* f = std::fopen(file.c_str(), "w");
+    if(!f)
+      return false;
+    const char* names[4] = {"friction_coulomb", "friction_static", "friction_stribeck_velocity", "friction_viscous"};
+    std::fprintf(f, "# Identified by dynamic_identifier, CartOptCtrl parameters\n");
+    for(int n=0; n<4; n++){
+      std::fprintf(f, "%s : [", names[n]);
+      for(int j=0; j<coulomb.size(); j++){
+        // No Stribeck effect from this identification
+        const double values[4] = {coulomb[j], coulomb[j], 0.05, viscous[j]};
+        std::fprintf(f, "%s%g", j > 0 ? ", " : "", values[n]);
+      }
+      std::fprintf(f, "]\n");
+    }
+    std::fprintf(f, "friction_velocity_deadband : %g\n", deadband);
+    return std::fclose(f) == 0;
+  }
+
+  std::string toString(const Eigen::VectorXd& v){
+    std::ostringstream s;
+    s << v.transpose();
+    return s.str();
+  }
+}
+
+int main(int argc, char** argv){
+  ros::init(argc, argv, "dynamic_identifier");
+  ros::NodeHandle nh("~");
+
+  std::vector<std::string> records;
+  std::string torque, output_urdf, friction_file, robot_description;
+  int decimation, nb_threads, batch_size;
+  double cutoff_frequency, friction_deadband, rank_threshold;
+  bool friction;
+  nh.getParam("records", records);
+  nh.param<std::string>("torque", torque, "measured");
+  nh.param("cutoff_frequency", cutoff_frequency, 10.0);
+  nh.param("decimation", decimation, 10);
+  nh.param("friction", friction, true);
+  nh.param("friction_deadband", friction_deadband, 0.01);
+  nh.param("nb_threads", nb_threads, 0);
+  nh.param("batch_size", batch_size, 2048);
+  nh.param("rank_threshold", rank_threshold, 1e-6);
+  nh.param<std::string>("output_urdf", output_urdf, "/tmp/robot_description_identified.urdf");
+  nh.param<std::string>("friction_file", friction_file, "");
+  nh.param<std::string>("robot_description", robot_description, "robot_description");
+  if(records.empty()){
+    ROS_ERROR("No records given, set ~records to the files written by CartOptCtrl (joint_record_file)");
+    return 1;
+  }
+  if(torque != "measured" && torque != "command"){
+    ROS_ERROR("torque is either measured or command, not %s", torque.c_str());
+    return 1;
+  }
+  decimation = std::max(1, decimation);
+
+  rtt_ros_kdl_tools::ChainUtils arm;
+  if(!arm.init(robot_description)){
+    ROS_ERROR("Could not init chain utils !");
+    return 1;
+  }
+  const int dof = arm.getNrOfJoints();
+  BatchedDynamics dynamics;
+  DynamicIdentification identification;
+  if(!dynamics.init(arm.Chain()) || !identification.init(dynamics, friction, friction_deadband)){
+    ROS_ERROR("The chain has joints with a scale or an offset, not supported by BatchedDynamics");
+    return 1;
+  }
+
+  for(unsigned int f=0; f<records.size(); f++){
+    JointRecord record;
+    if(!record.load(records[f])){
+      ROS_ERROR("Could not read %s", records[f].c_str());
+      return 1;
+    }
+    if(record.getNrOfJoints() != dof){
+      ROS_ERROR("%s has %d joints, the chain %d", records[f].c_str(), record.getNrOfJoints(), dof);
+      return 1;
+    }
+    const bool measured = torque == "measured";
+    if(measured && !(record.flags() & JointRecord::MEASURED_TORQUE))
+      ROS_WARN("%s was recorded without a torque sensor, its measured torques are the commands", records[f].c_str());
+
+    const int n = record.size();
+    const double period = n > 1 ? (record.time(n-1) - record.time(0)) / (n - 1) : 0.0;
+    // Transients of the filter at both ends
+    const int edge = period > 0.0 ? static_cast<int>(std::ceil(2.0 / (cutoff_frequency * period))) + 1 : 0;
+    if(n < 2 * edge + decimation || period <= 0.0){
+      ROS_WARN("%s is too short (%d samples), skipped", records[f].c_str(), n);
+      continue;
+    }
+    double max_gap = 0.0;
+    for(int i=1; i<n; i++)
+      max_gap = std::max(max_gap, record.time(i) - record.time(i-1));
+    if(max_gap > 2.0 * period)
+      ROS_WARN("%s has gaps up to %g s for a period of %g s, the accelerations around them are wrong", records[f].c_str(), max_gap, period);
+
+    // One row per signal so the filter runs on contiguous samples
+    BatchedDynamicsResult::Matrix data(3 * dof, n);
+    for(int i=0; i<n; i++){
+      const double* tau = measured ? record.tauMeasured(i) : record.tauCommand(i);
+      for(int j=0; j<dof; j++){
+        data(j,i) = record.q(i)[j];
+        data(dof+j,i) = record.qd(i)[j];
+        data(2*dof+j,i) = tau[j];
+      }
+    }
+    for(int r=0; r<data.rows(); r++)
+      filtfilt(data.row(r).data(), n, cutoff_frequency, period);
+
+    const int m = (n - 2 * edge - 1) / decimation + 1;
+    BatchedDynamicsResult::Matrix q(dof, m), qd(dof, m), qdd(dof, m), tau(dof, m);
+    for(int k=0; k<m; k++){
+      const int i = edge + k * decimation;
+      q.col(k) = data.block(0, i, dof, 1);
+      qd.col(k) = data.block(dof, i, dof, 1);
+      tau.col(k) = data.block(2*dof, i, dof, 1);
+      qdd.col(k) = (data.block(dof, i+1, dof, 1) - data.block(dof, i-1, dof, 1)) / (record.time(i+1) - record.time(i-1));
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    identification.addSamples(q, qd, qdd, tau, nb_threads, batch_size);
+    ROS_INFO("%s : %d samples of %.1f s reduced in %.2f s", records[f].c_str(), m, record.time(n-1) - record.time(0),
+             std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  if(identification.getNrOfSamples() == 0){
+    ROS_ERROR("No samples to identify from");
+    return 1;
+  }
+
+  DynamicIdentification::Result result;
+  if(!identification.solve(result, rank_threshold)){
+    ROS_ERROR("Identification failed, not enough samples for the %d parameters ?", identification.getNrOfParameters());
+    return 1;
+  }
+  ROS_INFO("Rank %d of %d parameters, condition number %g", result.rank, identification.getNrOfParameters(), result.condition_number);
+  ROS_INFO("Noise per joint (N.m) : %s", toString(result.sigma).c_str());
+  ROS_INFO("RMS error per joint (N.m), URDF : %s", toString(result.prior_rms).c_str());
+  ROS_INFO("RMS error per joint (N.m), identified : %s", toString(result.rms).c_str());
+
+  // Inertials of the links of the chain, the segment frames are the link frames (kdl_parser)
+  std::string xml;
+  urdf::Model model;
+  if(!ros::param::get(robot_description, xml) || !model.initString(xml)){
+    ROS_ERROR("Could not parse %s", robot_description.c_str());
+    return 1;
+  }
+  const int nb_segments = dynamics.getNrOfSegments();
+  for(int k=0; k<nb_segments; k++){
+    const std::string& name = arm.Chain().getSegment(k).getName();
+    if(std::find(result.prior_segments.begin(), result.prior_segments.end(), k) != result.prior_segments.end())
+      ROS_WARN("No physically consistent inertial for %s, kept from the URDF", name.c_str());
+    const double* p = result.parameters.data() + k * BatchedDynamics::NB_SEGMENT_PARAMETERS;
+    std::map<std::string, urdf::LinkSharedPtr>::iterator link = model.links_.find(name);
+    if(link == model.links_.end() || p[0] <= 0.0)
+      continue;
+    // Inertia about the center of mass
+    const Eigen::Vector3d c = Eigen::Vector3d(p[1], p[2], p[3]) / p[0];
+    Eigen::Matrix3d inertia;
+    inertia << p[4], p[5], p[6],
+               p[5], p[7], p[8],
+               p[6], p[8], p[9];
+    inertia -= p[0] * (c.squaredNorm() * Eigen::Matrix3d::Identity() - c * c.transpose());
+    if(!link->second->inertial)
+      link->second->inertial.reset(new urdf::Inertial());
+    urdf::Inertial& inertial = *link->second->inertial;
+    inertial.mass = p[0];
+    inertial.origin.position = urdf::Vector3(c[0], c[1], c[2]);
+    inertial.origin.rotation = urdf::Rotation();
+    inertial.ixx = inertia(0,0); inertial.ixy = inertia(0,1); inertial.ixz = inertia(0,2);
+    inertial.iyy = inertia(1,1); inertial.iyz = inertia(1,2); inertial.izz = inertia(2,2);
+    ROS_INFO("%s : mass %g kg, center of mass %g %g %g", name.c_str(), p[0], c[0], c[1], c[2]);
+  }
+  TiXmlDocument* doc = urdf::exportURDF(model);
+  const bool written = doc && doc->SaveFile(output_urdf.c_str());
+  delete doc;
+  if(!written){
+    ROS_ERROR("Could not write %s", output_urdf.c_str());
+    return 1;
+  }
+  ROS_INFO("Identified model written to %s", output_urdf.c_str());
+
+  if(friction){
+    const int first = nb_segments * BatchedDynamics::NB_SEGMENT_PARAMETERS;
+    const Eigen::VectorXd coulomb = result.parameters.segment(first, dof), viscous = result.parameters.segment(first + dof, dof);
+    ROS_INFO("Coulomb friction (N.m) : %s", toString(coulomb).c_str());
+    ROS_INFO("Viscous friction (N.m.s/rad) : %s", toString(viscous).c_str());
+    if(!friction_file.empty()){
+      if(writeFriction(friction_file, coulomb, viscous, friction_deadband))
+        ROS_INFO("Friction parameters written to %s", friction_file.c_str());
+      else
+        ROS_ERROR("Could not write the friction parameters to %s", friction_file.c_str());
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,266 @@
+#include <ros/ros.h>
+#include <rtt_ros_kdl_tools/chain_utils.hpp>
+#include <cart_opt_ctrl/batched_dynamics.hpp>
+#include <cart_opt_ctrl/dynamic_identification.hpp>
+#include <cart_opt_ctrl/trajectory_library.hpp>
+#include <Eigen/QR>
+#include <Eigen/SVD>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+// Excitation trajectory for dynamic_identifier, for the robot found on the parameter server : a periodic joint
+// trajectory (see FourierExcitation) within the joint limits, velocities and accelerations, with the tip inside
+// the cartesian walls of CartOptCtrl, minimizing the condition number of the regressor of the identifiable parameters.
+// Random starts are improved by a (1+1) evolution strategy, spread over nb_threads.
+// The trajectory is written as a trajectory library for KDLTrajCompute (playTrajectory) : the tip follows the joint
+// trajectory, CartOptCtrl may move the redundant joints differently so the identification uses the recorded joints.
+// It starts and ends at rest at start_configuration, the pose to reach before playing it is printed.
+namespace{
+  struct Settings{
+    Eigen::VectorXd lower, upper, qd_max, qdd_max;
+    Eigen::Vector3d cart_min, cart_max;
+    int nb_samples;
+    std::vector<int> base_columns;
+  };
+
+  // Fits the excitation in the limits and returns the condition number of its normalized base regressor,
+  // infinite if the tip cannot stay inside the walls
+  double evaluate(const BatchedDynamics& dynamics, const Settings& settings, FourierExcitation& excitation){
+    excitation.project();
+    if(excitation.scaleToLimits(settings.lower, settings.upper, settings.qd_max, settings.qdd_max, settings.nb_samples) <= 0.0)
+      return std::numeric_limits<double>::infinity();
+    FourierExcitation::Matrix q, qd, qdd;
+    BatchedDynamicsResult result;
+    // Smaller motions until the tip stays inside the walls
+    bool inside = false;
+    for(int shrink=0; shrink<20 && !inside; shrink++){
+      excitation.sample(0.0, excitation.period() / settings.nb_samples, settings.nb_samples, q, qd, qdd);
+      dynamics.compute(q, result, BatchedDynamics::POSE);
+      inside = true;
+      for(int i=0; i<3 && inside; i++)
+        inside = result.pose.row(i).minCoeff() >= settings.cart_min[i] && result.pose.row(i).maxCoeff() <= settings.cart_max[i];
+      if(!inside){
+        excitation.sineCoefficients() *= 0.8;
+        excitation.cosineCoefficients() *= 0.8;
+      }
+    }
+    if(!inside)
+      return std::numeric_limits<double>::infinity();
+
+    BatchedDynamicsResult::Matrix y;
+    dynamics.computeRegressor(q, qd, qdd, y);
+    const int nj = dynamics.getNrOfJoints(), np = dynamics.getNrOfParameters(), ns = settings.nb_samples;
+    Eigen::MatrixXd w(nj * ns, settings.base_columns.size());
+    for(unsigned int i=0; i<settings.base_columns.size(); i++){
+      for(int j=0; j<nj; j++)
+        w.col(i).segment(j*ns, ns) = y.row(j*np + settings.base_columns[i]).transpose();
+      w.col(i).normalize();
+    }
+    const Eigen::VectorXd sv = Eigen::JacobiSVD<Eigen::MatrixXd>(w).singularValues();
+    return sv[sv.size()-1] > 0.0 ? sv[0] / sv[sv.size()-1] : std::numeric_limits<double>::infinity();
+  }
+
+  template<class T> void getVector(ros::NodeHandle& nh, const std::string& name, T& value, int size, double fallback){
+    std::vector<double> v;
+    if(nh.getParam(name, v) && static_cast<int>(v.size()) == size)
+      value = Eigen::Map<const Eigen::VectorXd>(v.data(), size);
+    else
+      value.setConstant(size, fallback);
+  }
+}
+
+int main(int argc, char** argv){
+  ros::init(argc, argv, "excitation_generator");
+  ros::NodeHandle nh("~");
+
+  std::string output, name;
+  int nb_harmonics, nb_periods, nb_starts, nb_iterations, nb_threads, seed;
+  double base_frequency, period, limit_margin;
+  Settings settings;
+  nh.param<std::string>("output", output, "/tmp/excitation.ctl");
+  nh.param<std::string>("name", name, "excitation");
+  nh.param("nb_harmonics", nb_harmonics, 5);
+  nh.param("base_frequency", base_frequency, 0.1);
+  nh.param("nb_periods", nb_periods, 3);
+  nh.param("period", period, 0.001);
+  nh.param("limit_margin", limit_margin, 0.1);
+  nh.param("nb_samples", settings.nb_samples, 100);
+  nh.param("nb_starts", nb_starts, 16);
+  nh.param("nb_iterations", nb_iterations, 300);
+  nh.param("nb_threads", nb_threads, 0);
+  nh.param("seed", seed, 0);
+
+  rtt_ros_kdl_tools::ChainUtils arm;
+  if(!arm.init()){
+    ROS_ERROR("Could not init chain utils !");
+    return 1;
+  }
+  const int dof = arm.getNrOfJoints();
+  BatchedDynamics dynamics;
+  if(!dynamics.init(arm.Chain())){
+    ROS_ERROR("The chain has joints with a scale or an offset, not supported by BatchedDynamics");
+    return 1;
+  }
+  dynamics.setNbThreads(1);
+
+  // Defaults from CartOptCtrl's run.launch
+  settings.lower = arm.getJointLowerLimit().array() + limit_margin;
+  settings.upper = arm.getJointUpperLimit().array() - limit_margin;
+  getVector(nh, "joint_vel_max", settings.qd_max, dof, 1.0);
+  getVector(nh, "joint_acc_max", settings.qdd_max, dof, 2.0);
+  Eigen::VectorXd cart_min, cart_max, start;
+  getVector(nh, "cart_min", cart_min, 3, 0.0);
+  getVector(nh, "cart_max", cart_max, 3, 0.0);
+  if(!nh.hasParam("cart_min") || !nh.hasParam("cart_max")){
+    cart_min = Eigen::Vector3d(-0.6, -0.25, 0.15);
+    cart_max = Eigen::Vector3d(0.9, 0.5, 0.8);
+  }
+  settings.cart_min = cart_min;
+  settings.cart_max = cart_max;
+  getVector(nh, "start_configuration", start, dof, 0.0);
+  if(!nh.hasParam("start_configuration"))
+    start = 0.5 * (settings.lower + settings.upper);
+  if((start.array() < settings.lower.array()).any() || (start.array() > settings.upper.array()).any()){
+    ROS_ERROR("start_configuration is not within the joint limits (minus limit_margin)");
+    return 1;
+  }
+
+  // Identifiable columns, from random states
+  {
+    const int nb_random = 500;
+    BatchedDynamicsResult::Matrix q(dof, nb_random), qd, qdd, y;
+    for(int n=0; n<nb_random; n++)
+      q.col(n) = settings.lower + (settings.upper - settings.lower).cwiseProduct(Eigen::VectorXd::Random(dof) * 0.5 + Eigen::VectorXd::Constant(dof, 0.5));
+    qd = settings.qd_max.asDiagonal() * BatchedDynamicsResult::Matrix::Random(dof, nb_random);
+    qdd = settings.qdd_max.asDiagonal() * BatchedDynamicsResult::Matrix::Random(dof, nb_random);
+    dynamics.computeRegressor(q, qd, qdd, y);
+    const int np = dynamics.getNrOfParameters();
+    Eigen::MatrixXd w(dof * nb_random, np);
+    for(int p=0; p<np; p++){
+      for(int j=0; j<dof; j++)
+        w.col(p).segment(j*nb_random, nb_random) = y.row(j*np + p).transpose();
+      const double norm = w.col(p).norm();
+      if(norm > 0.0)
+        w.col(p) /= norm;
+    }
+    Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(w);
+    qr.setThreshold(1e-8);
+    for(int i=0; i<qr.rank(); i++)
+      settings.base_columns.push_back(qr.colsPermutation().indices()[i]);
+    ROS_INFO("%d identifiable combinations of the %d inertial parameters", static_cast<int>(qr.rank()), np);
+  }
+
+  // Random starts, each improved by a (1+1) evolution strategy with the 1/5th success rule
+  if(nb_threads <= 0)
+    nb_threads = std::max(1u, std::thread::hardware_concurrency());
+  FourierExcitation best;
+  double best_cost = std::numeric_limits<double>::infinity();
+  std::mutex best_mutex;
+  std::atomic<int> next_start(0);
+  std::vector<std::thread> workers;
+  for(int t=0; t<nb_threads; t++){
+    workers.push_back(std::thread([&](){
+      for(int s=next_start++; s<nb_starts; s=next_start++){
+        std::mt19937 rng(seed + s);
+        std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+        std::normal_distribution<double> normal(0.0, 1.0);
+        FourierExcitation current;
+        current.init(start, nb_harmonics, base_frequency);
+        for(int j=0; j<dof; j++){
+          for(int l=0; l<current.getNrOfHarmonics(); l++){
+            current.sineCoefficients()(j,l) = uniform(rng);
+            current.cosineCoefficients()(j,l) = uniform(rng);
+          }
+        }
+        double cost = evaluate(dynamics, settings, current);
+        double step = 0.3;
+        for(int it=0; it<nb_iterations; it++){
+          FourierExcitation candidate = current;
+          const double size = std::sqrt((current.sineCoefficients().squaredNorm() + current.cosineCoefficients().squaredNorm())
+                                        / (2.0 * current.sineCoefficients().size())) + 1e-9;
+          for(int j=0; j<dof; j++){
+            for(int l=0; l<current.getNrOfHarmonics(); l++){
+              candidate.sineCoefficients()(j,l) += step * size * normal(rng);
+              candidate.cosineCoefficients()(j,l) += step * size * normal(rng);
+            }
+          }
+          const double candidate_cost = evaluate(dynamics, settings, candidate);
+          if(candidate_cost < cost){
+            current = candidate;
+            cost = candidate_cost;
+            step *= 1.5;
+          }
+          else
+            step *= 0.9;
+          step = std::min(std::max(step, 1e-3), 1.0);
+        }
+        std::lock_guard<std::mutex> lock(best_mutex);
+        ROS_INFO("Start %d : condition number %g", s, cost);
+        if(cost < best_cost){
+          best_cost = cost;
+          best = current;
+        }
+      }
+    }));
+  }
+  for(unsigned int t=0; t<workers.size(); t++)
+    workers[t].join();
+  if(!std::isfinite(best_cost)){
+    ROS_ERROR("No excitation within the limits, check start_configuration and the walls");
+    return 1;
+  }
+
+  // Tip trajectory, the acceleration is J.qdd + dJ/dt.qd with dJ/dt from the jacobians at q -/+ h.qd
+  const int nb_points = static_cast<int>(std::round(nb_periods * best.period() / period)) + 1;
+  FourierExcitation::Matrix q, qd, qdd;
+  best.sample(0.0, period, nb_points, q, qd, qdd);
+  const double h = 1e-6;
+  BatchedDynamicsResult result, before, after;
+  dynamics.setNbThreads(nb_threads);
+  dynamics.compute(q, result, BatchedDynamics::POSE | BatchedDynamics::JACOBIAN);
+  dynamics.compute(q - h * qd, before, BatchedDynamics::JACOBIAN);
+  dynamics.compute(q + h * qd, after, BatchedDynamics::JACOBIAN);
+  std::vector<double> samples(nb_points * TrajectoryLibrary::SAMPLE_SIZE);
+  double previous[4] = {0.0, 0.0, 0.0, 1.0};
+  for(int k=0; k<nb_points; k++){
+    double* s = &samples[k * TrajectoryLibrary::SAMPLE_SIZE];
+    const KDL::Rotation rot(result.pose(3,k), result.pose(4,k), result.pose(5,k),
+                            result.pose(6,k), result.pose(7,k), result.pose(8,k),
+                            result.pose(9,k), result.pose(10,k), result.pose(11,k));
+    double quat[4];
+    rot.GetQuaternion(quat[0], quat[1], quat[2], quat[3]);
+    const double sign = quat[0]*previous[0] + quat[1]*previous[1] + quat[2]*previous[2] + quat[3]*previous[3] < 0.0 ? -1.0 : 1.0;
+    for(int i=0; i<4; i++)
+      s[3+i] = previous[i] = sign * quat[i];
+    for(int r=0; r<6; r++){
+      double vel = 0.0, acc = 0.0;
+      for(int j=0; j<dof; j++){
+        const double jac = result.jacobian(r*dof+j,k);
+        const double jac_dot = (after.jacobian(r*dof+j,k) - before.jacobian(r*dof+j,k)) / (2.0 * h);
+        vel += jac * qd(j,k);
+        acc += jac * qdd(j,k) + jac_dot * qd(j,k);
+      }
+      s[7+r] = vel;
+      s[13+r] = acc;
+    }
+    for(int i=0; i<3; i++)
+      s[i] = result.pose(i,k);
+  }
+  if(!TrajectoryLibrary::save(output, period, std::vector<std::string>(1, name), std::vector<std::vector<double> >(1, samples))){
+    ROS_ERROR("Could not write %s", output.c_str());
+    return 1;
+  }
+
+  const double* s0 = &samples[0];
+  ROS_INFO("'%s' written to %s : %.1f s, condition number %g", name.c_str(), output.c_str(), (nb_points - 1) * period, best_cost);
+  ROS_INFO("Start pose (x y z qx qy qz qw) : %g %g %g %g %g %g %g", s0[0], s0[1], s0[2], s0[3], s0[4], s0[5], s0[6]);
+  std::ostringstream configuration;
+  configuration << start.transpose();
+  ROS_INFO("Start configuration : %s", configuration.str().c_str());
+  return 0;
+}
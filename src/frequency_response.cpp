@@ -0,0 +1,269 @@
+#include "cart_opt_ctrl/frequency_response.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+ExcitationSignal::ExcitationSignal() : type_(CHIRP), f_min_(0.0), f_max_(0.0), period_(0.0), end_(0.0), fade_(0.0), rate_(0.0), scale_(1.0),
+                                       size_(0), analysis_start_(0), analysis_size_(0), period_size_(0)
+{
+}
+
+bool ExcitationSignal::init(Type type, double f_min, double f_max, double duration, double period, int nb_sines, int nb_periods){
+  size_ = 0;
+  if(period <= 0.0 || f_min <= 0.0 || f_max <= f_min || f_max >= 0.5 / period)
+    return false;
+  type_ = type;
+  f_min_ = f_min;
+  f_max_ = f_max;
+  period_ = period;
+  bins_.clear();
+  omegas_.clear();
+  phases_.clear();
+
+  if(type == CHIRP){
+    if(duration <= 0.0)
+      return false;
+    size_ = static_cast<int>(std::round(duration / period)) + 1;
+    end_ = (size_ - 1) * period;
+    fade_ = 0.1 * end_;
+    rate_ = std::log(f_max / f_min) / end_;
+    scale_ = 1.0;
+    analysis_start_ = 0;
+    analysis_size_ = size_;
+    period_size_ = 0;
+    return true;
+  }
+
+  if(nb_sines < 1 || nb_periods < 1)
+    return false;
+  period_size_ = 1;
+  while(period_size_ * period < 1.0 / f_min)
+    period_size_ *= 2;
+  const double tp = period_size_ * period;
+  for(int i=0; i<nb_sines; i++){
+    const double f = nb_sines > 1 ? f_min * std::pow(f_max / f_min, double(i) / (nb_sines - 1)) : f_min;
+    const int bin = std::max(1, static_cast<int>(std::round(f * tp)));
+    if(bin < period_size_ / 2 && (bins_.empty() || bin > bins_.back()))
+      bins_.push_back(bin);
+  }
+  const int n = bins_.size();
+  for(int i=0; i<n; i++){
+    omegas_.push_back(2.0 * M_PI * bins_[i] / tp);
+    phases_.push_back(- M_PI * i * (i + 1) / n);
+  }
+
+  // Peak over a period, the sum is periodic
+  double peak = 0.0;
+  for(int k=0; k<period_size_; k++){
+    double x = 0.0;
+    for(int i=0; i<n; i++)
+      x += std::sin(omegas_[i] * k * period + phases_[i]);
+    peak = std::max(peak, std::abs(x));
+  }
+  scale_ = 1.0 / peak;
+  size_ = (nb_periods + 2) * period_size_;
+  end_ = size_ * period;
+  fade_ = tp;
+  analysis_start_ = period_size_;
+  analysis_size_ = nb_periods * period_size_;
+  return true;
+}
+
+void ExcitationSignal::window(double t, double& w, double& wd, double& wdd) const{
+  // Raised cosine over fade_ at both ends
+  const double c = M_PI / fade_;
+  w = 1.0;
+  wd = wdd = 0.0;
+  if(t < fade_){
+    w = 0.5 * (1.0 - std::cos(c * t));
+    wd = 0.5 * c * std::sin(c * t);
+    wdd = 0.5 * c * c * std::cos(c * t);
+  }
+  else if(t > end_ - fade_){
+    const double u = end_ - t;
+    w = 0.5 * (1.0 - std::cos(c * u));
+    wd = - 0.5 * c * std::sin(c * u);
+    wdd = 0.5 * c * c * std::cos(c * u);
+  }
+}
+
+void ExcitationSignal::sample(int k, double& x, double& xd, double& xdd) const{
+  x = xd = xdd = 0.0;
+  if(k < 0 || k >= size_)
+    return;
+  const double t = k * period_;
+  double s = 0.0, sd = 0.0, sdd = 0.0;
+  if(type_ == CHIRP){
+    // phi(t) = 2.pi.f_min.(exp(rate.t) - 1) / rate, the instantaneous frequency goes from f_min to f_max
+    const double e = std::exp(rate_ * t);
+    const double phi = 2.0 * M_PI * f_min_ * (e - 1.0) / rate_;
+    const double dphi = 2.0 * M_PI * f_min_ * e;
+    s = std::sin(phi);
+    sd = std::cos(phi) * dphi;
+    sdd = - s * dphi * dphi + std::cos(phi) * dphi * rate_;
+  }
+  else{
+    for(unsigned int i=0; i<omegas_.size(); i++){
+      const double a = omegas_[i] * t + phases_[i];
+      const double sa = std::sin(a);
+      s += sa;
+      sd += omegas_[i] * std::cos(a);
+      sdd -= omegas_[i] * omegas_[i] * sa;
+    }
+    s *= scale_;
+    sd *= scale_;
+    sdd *= scale_;
+  }
+  double w, wd, wdd;
+  window(t, w, wd, wdd);
+  x = w * s;
+  xd = wd * s + w * sd;
+  xdd = wdd * s + 2.0 * wd * sd + w * sdd;
+}
+
+void FrequencyResponse::fft(std::vector<std::complex<double> >& data){
+  const size_t n = data.size();
+  // Bit reversal permutation
+  for(size_t i=1, j=0; i<n; i++){
+    size_t bit = n >> 1;
+    for(; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if(i < j)
+      std::swap(data[i], data[j]);
+  }
+  for(size_t len=2; len<=n; len<<=1){
+    const std::complex<double> step = std::polar(1.0, -2.0 * M_PI / len);
+    for(size_t i=0; i<n; i+=len){
+      std::complex<double> w(1.0, 0.0);
+      for(size_t j=0; j<len/2; j++){
+        const std::complex<double> u = data[i+j];
+        const std::complex<double> v = data[i+j+len/2] * w;
+        data[i+j] = u + v;
+        data[i+j+len/2] = u - v;
+        w *= step;
+      }
+    }
+  }
+}
+
+bool FrequencyResponse::estimate(const ExcitationSignal& signal, const double* input, const double* output, Result& result,
+                                 double resonance_ratio){
+  result = Result();
+  result.bandwidth_found = result.margin_found = false;
+  result.low_frequency_gain = result.bandwidth = result.crossover = result.phase_margin = 0.0;
+  std::vector<std::complex<double> > response;
+
+  if(signal.type() == ExcitationSignal::CHIRP){
+    size_t n = 1;
+    while(n < static_cast<size_t>(signal.analysisSize()))
+      n *= 2;
+    std::vector<std::complex<double> > u(n), y(n);
+    for(int k=0; k<signal.analysisSize(); k++){
+      u[k] = input[signal.analysisStart() + k];
+      y[k] = output[signal.analysisStart() + k];
+    }
+    fft(u);
+    fft(y);
+    const double df = 1.0 / (n * signal.period());
+    const double ratio = signal.maxFrequency() / signal.minFrequency();
+    const int nb_bands = std::max(1, static_cast<int>(std::ceil(10.0 * std::log10(ratio))));
+    for(int b=0; b<nb_bands; b++){
+      const double low = signal.minFrequency() * std::pow(ratio, double(b) / nb_bands);
+      const double high = signal.minFrequency() * std::pow(ratio, double(b + 1) / nb_bands);
+      std::complex<double> suy(0.0, 0.0);
+      double suu = 0.0;
+      for(size_t k=std::max<size_t>(1, std::ceil(low / df)); k<n/2 && k*df<high; k++){
+        suy += y[k] * std::conj(u[k]);
+        suu += std::norm(u[k]);
+      }
+      if(suu > 0.0){
+        result.frequencies.push_back(std::sqrt(low * high));
+        response.push_back(suy / suu);
+      }
+    }
+  }
+  else{
+    const int n = signal.periodSize();
+    const std::vector<int>& bins = signal.bins();
+    std::vector<std::complex<double> > suy(bins.size()), u(n), y(n);
+    std::vector<double> suu(bins.size(), 0.0);
+    for(int p=0; p<signal.analysisSize()/n; p++){
+      const int start = signal.analysisStart() + p * n;
+      for(int k=0; k<n; k++){
+        u[k] = input[start + k];
+        y[k] = output[start + k];
+      }
+      fft(u);
+      fft(y);
+      for(unsigned int i=0; i<bins.size(); i++){
+        suy[i] += y[bins[i]] * std::conj(u[bins[i]]);
+        suu[i] += std::norm(u[bins[i]]);
+      }
+    }
+    for(unsigned int i=0; i<bins.size(); i++){
+      if(suu[i] > 0.0){
+        result.frequencies.push_back(bins[i] / (n * signal.period()));
+        response.push_back(suy[i] / suu[i]);
+      }
+    }
+  }
+  if(response.size() < 2)
+    return false;
+
+  // Gains, unwrapped phases of H and of the open loop
+  const int m = response.size();
+  std::vector<double> loop_gains(m), loop_phases(m);
+  for(int i=0; i<m; i++){
+    const std::complex<double> loop = std::abs(1.0 - response[i]) > 1e-12 ? response[i] / (1.0 - response[i]) : std::complex<double>(1e12, 0.0);
+    result.gains.push_back(std::abs(response[i]));
+    result.phases.push_back(std::arg(response[i]) * 180.0 / M_PI);
+    loop_gains[i] = std::abs(loop);
+    loop_phases[i] = std::arg(loop) * 180.0 / M_PI;
+    if(i > 0){
+      result.phases[i] -= 360.0 * std::round((result.phases[i] - result.phases[i-1]) / 360.0);
+      loop_phases[i] -= 360.0 * std::round((loop_phases[i] - loop_phases[i-1]) / 360.0);
+    }
+  }
+  result.low_frequency_gain = result.gains[0];
+
+  // First crossings, interpolated in log frequency
+  const double cutoff = result.low_frequency_gain / std::sqrt(2.0);
+  for(int i=1; i<m && !result.bandwidth_found; i++){
+    if(result.gains[i] < cutoff){
+      const double a = (result.gains[i-1] - cutoff) / (result.gains[i-1] - result.gains[i]);
+      result.bandwidth = result.frequencies[i-1] * std::pow(result.frequencies[i] / result.frequencies[i-1], a);
+      result.bandwidth_found = true;
+    }
+  }
+  for(int i=1; i<m && !result.margin_found; i++){
+    if(loop_gains[i-1] >= 1.0 && loop_gains[i] < 1.0){
+      const double a = std::log(loop_gains[i-1]) / (std::log(loop_gains[i-1]) - std::log(loop_gains[i]));
+      result.crossover = result.frequencies[i-1] * std::pow(result.frequencies[i] / result.frequencies[i-1], a);
+      const double phase = loop_phases[i-1] + a * (loop_phases[i] - loop_phases[i-1]);
+      result.phase_margin = 180.0 + phase - 360.0 * std::round((180.0 + phase) / 360.0);
+      result.margin_found = true;
+    }
+  }
+
+  for(int i=1; i<m-1; i++){
+    if(result.gains[i] > result.gains[i-1] && result.gains[i] >= result.gains[i+1]
+       && result.gains[i] > resonance_ratio * result.low_frequency_gain){
+      Resonance resonance = {result.frequencies[i], result.gains[i]};
+      result.resonances.push_back(resonance);
+    }
+  }
+  std::sort(result.resonances.begin(), result.resonances.end(),
+            [](const Resonance& a, const Resonance& b){ return a.gain > b.gain; });
+  return true;
+}
+
+bool FrequencyResponse::save(const std::string& file, const Result& result){
+  FILE* f = std::fopen(file.c_str(), "w");
+  if(!f)
+    return false;
+  std::fprintf(f, "# frequency (Hz), gain (dB), phase (deg)\n");
+  for(unsigned int i=0; i<result.frequencies.size(); i++)
+    std::fprintf(f, "%g %g %g\n", result.frequencies[i], 20.0 * std::log10(result.gains[i]), result.phases[i]);
+  return std::fclose(f) == 0;
+}
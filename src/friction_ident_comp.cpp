@@ -0,0 +1,330 @@
+#include "cart_opt_ctrl/friction_ident_comp.hpp"
+#include <cmath>
+#include <cstdio>
+
+using namespace RTT;
+
+FrictionIdentComp::FrictionIdentComp(const std::string& name) : RTT::TaskContext(name)
+{
+  this->addPort("JointPosition",port_joint_position_in_);
+  this->addPort("JointVelocity",port_joint_velocity_in_);
+  this->addPort("JointTorqueCommand",port_joint_torque_out_);
+
+  this->addProperty("p_gains",p_gains_).doc("Joint proportional gains (N.m/rad)");
+  this->addProperty("d_gains",d_gains_).doc("Joint derivative gains (N.m.s/rad)");
+  this->addProperty("select_joints",select_joints_).doc("1 for the joints to identify");
+  this->addProperty("sweep_velocities",sweep_velocities_).doc("Velocities of the sweeps (rad/s), 2 at least");
+  this->addProperty("sweep_range",sweep_range_).doc("Range swept around the initial position (rad)");
+  this->addProperty("sweep_acc",sweep_acc_).doc("Acceleration at the ends of the sweeps (rad/s^2)");
+  this->addProperty("settle_time",settle_time_).doc("Time skipped at the beginning of the constant velocity phase (s)");
+  this->addProperty("friction_velocity_deadband",deadband_).doc("Velocity under which the compensation ramps to 0 (rad/s)");
+  this->addProperty("joint_vel_max",jnt_vel_max_).doc("Max velocity for each joint, range of the friction tables as in CartOptCtrl");
+  this->addProperty("friction_file",friction_file_).doc("File the parameters are written to on stop, empty for none");
+}
+
+bool FrictionIdentComp::configureHook(){
+  // Initialise the model, the internal solvers etc
+  if( ! arm_.init() ){
+    log(RTT::Error) << "Could not init chain utils !" << endlog();
+    return false;
+  }
+  // The number of joints
+  const int dof = arm_.getNrOfJoints();
+
+  // Default params
+  p_gains_.setConstant(dof,500.0);
+  d_gains_.setConstant(dof,20.0);
+  select_joints_.setOnes(dof);
+  sweep_velocities_.resize(6);
+  sweep_velocities_ << 0.02,0.05,0.1,0.2,0.4,0.6;
+  sweep_range_ = 0.6;
+  sweep_acc_ = 2.0;
+  settle_time_ = 0.2;
+  deadband_ = 0.005;
+  jnt_vel_max_.setOnes(dof);
+  friction_file_ = "";
+
+  // Match all properties (defined in the constructor)
+  // with the rosparams in the namespace :
+  // nameOfThisComponent/nameOftheProperty
+  rtt_ros_kdl_tools::getAllPropertiesFromROSParam(this);
+
+  if(p_gains_.size() != dof || d_gains_.size() != dof || select_joints_.size() != dof || jnt_vel_max_.size() != dof){
+    log(RTT::Error) << "p_gains, d_gains, select_joints and joint_vel_max need " << dof << " elements" << endlog();
+    return false;
+  }
+  if(sweep_velocities_.size() < 2 || (sweep_velocities_.array() <= 0.0).any() || sweep_range_ <= 0.0 || sweep_acc_ <= 0.0){
+    log(RTT::Error) << "Invalid sweeps, 2 positive sweep_velocities at least, positive sweep_range and sweep_acc" << endlog();
+    return false;
+  }
+
+  // Identification pass then compensated pass, each joint goes to the end of its range at the slowest
+  // velocity, sweeps back and forth at each velocity and comes back
+  const double v_min = sweep_velocities_.minCoeff();
+  const double half = 0.5 * sweep_range_;
+  sweeps_.clear();
+  for(int pass=0; pass<2; pass++){
+    for(int j=0; j<dof; j++){
+      if(select_joints_[j] == 0)
+        continue;
+      Sweep approach = {j, 0.0, -half, v_min, false, pass == 1};
+      sweeps_.push_back(approach);
+      for(int v=0; v<sweep_velocities_.size(); v++){
+        Sweep forth = {j, -half, half, sweep_velocities_[v], true, pass == 1};
+        Sweep back = {j, half, -half, sweep_velocities_[v], true, pass == 1};
+        sweeps_.push_back(forth);
+        sweeps_.push_back(back);
+      }
+      Sweep ret = {j, -half, 0.0, v_min, false, pass == 1};
+      sweeps_.push_back(ret);
+    }
+  }
+  if(sweeps_.empty()){
+    log(RTT::Error) << "No joint selected" << endlog();
+    return false;
+  }
+
+  // The compensation is validated with the tables CartOptCtrl builds
+  if(sweep_velocities_.maxCoeff() > jnt_vel_max_.minCoeff()){
+    log(RTT::Error) << "sweep_velocities over joint_vel_max" << endlog();
+    return false;
+  }
+  FrictionModel::Parameters zero = {0.0, 0.0, 0.05, 0.0};
+  params_.assign(dof,zero);
+  if(!table_.configure(params_,jnt_vel_max_,deadband_)){
+    log(RTT::Error) << "Invalid friction_velocity_deadband for the friction tables over joint_vel_max" << endlog();
+    return false;
+  }
+
+  // A sweep too fast for its range has no constant velocity phase
+  const double v_max = sweep_velocities_.maxCoeff();
+  if(sweep_range_ < v_max * v_max / sweep_acc_ + v_max * settle_time_){
+    log(RTT::Error) << "sweep_range is too short to reach " << v_max << " rad/s and settle" << endlog();
+    return false;
+  }
+  double duration = 0.0;
+  for(unsigned int i=0; i<sweeps_.size(); i++)
+    duration += sweepDuration(sweeps_[i]);
+  log(RTT::Info) << sweeps_.size() << " sweeps, " << duration << " s" << endlog();
+
+  // Resize the vectors
+  joint_position_in_.setZero(dof);
+  joint_velocity_in_.setZero(dof);
+  joint_torque_out_.setZero(dof);
+  q_start_.setZero(dof);
+  q_des_.setZero(dof);
+  qd_des_.setZero(dof);
+  qdd_des_.setZero(dof);
+  friction_torque_.setZero(dof);
+  sum_vel_.assign(sweeps_.size(),0.0);
+  sum_torque_.assign(sweeps_.size(),0.0);
+  nb_samples_.assign(sweeps_.size(),0);
+  error_sq_.setZero(dof,2);
+  error_count_.setZero(dof,2);
+  return true;
+}
+
+bool FrictionIdentComp::startHook(){
+  has_start_ = false;
+  identified_ = false;
+  done_ = false;
+  current_sweep_ = 0;
+  sweep_time_ = 0.0;
+  std::fill(sum_vel_.begin(),sum_vel_.end(),0.0);
+  std::fill(sum_torque_.begin(),sum_torque_.end(),0.0);
+  std::fill(nb_samples_.begin(),nb_samples_.end(),0);
+  error_sq_.setZero();
+  error_count_.setZero();
+  if(this->getPeriod() <= 0.0){
+    log(RTT::Error) << "FrictionIdentComp needs a periodic activity" << endlog();
+    return false;
+  }
+  return true;
+}
+
+double FrictionIdentComp::sweepDuration(const Sweep& sweep) const{
+  // Trapezoidal, or triangular if the velocity is not reached
+  const double distance = std::abs(sweep.to - sweep.from);
+  const double v = std::min(sweep.velocity, std::sqrt(distance * sweep_acc_));
+  return v > 0.0 ? distance / v + v / sweep_acc_ : 0.0;
+}
+
+void FrictionIdentComp::sampleSweep(const Sweep& sweep, double t, double& s, double& sd, double& sdd, bool& steady) const{
+  const double distance = std::abs(sweep.to - sweep.from);
+  const double sign = sweep.to > sweep.from ? 1.0 : -1.0;
+  const double v = std::min(sweep.velocity, std::sqrt(distance * sweep_acc_));
+  const double t_acc = v / sweep_acc_;
+  const double duration = sweepDuration(sweep);
+  t = std::min(std::max(t, 0.0), duration);
+  double p;
+  if(t < t_acc){
+    p = 0.5 * sweep_acc_ * t * t;
+    sd = sweep_acc_ * t;
+    sdd = sweep_acc_;
+  }
+  else if(t < duration - t_acc){
+    p = 0.5 * sweep_acc_ * t_acc * t_acc + v * (t - t_acc);
+    sd = v;
+    sdd = 0.0;
+  }
+  else{
+    p = distance - 0.5 * sweep_acc_ * (duration - t) * (duration - t);
+    sd = sweep_acc_ * (duration - t);
+    sdd = - sweep_acc_;
+  }
+  s = sweep.from + sign * p;
+  sd *= sign;
+  sdd *= sign;
+  steady = t >= t_acc + settle_time_ && t <= duration - t_acc;
+}
+
+void FrictionIdentComp::updateHook(){
+  // Read the current state of the robot
+  RTT::FlowStatus fp = this->port_joint_position_in_.read(this->joint_position_in_);
+  RTT::FlowStatus fv = this->port_joint_velocity_in_.read(this->joint_velocity_in_);
+
+  // Return if not giving anything (might happend during startup)
+  if(fp == RTT::NoData || fv == RTT::NoData)
+    return;
+
+  // The sweeps are around the first position received
+  if(!has_start_){
+    q_start_ = joint_position_in_;
+    for(unsigned int i=0; i<sweeps_.size(); i++){
+      const int j = sweeps_[i].joint;
+      if(q_start_[j] - 0.5 * sweep_range_ < arm_.getJointLowerLimit()[j] || q_start_[j] + 0.5 * sweep_range_ > arm_.getJointUpperLimit()[j]){
+        log(RTT::Error) << "Joint " << j << " would leave its limits, move it or reduce sweep_range" << endlog();
+        this->error();
+        return;
+      }
+    }
+    has_start_ = true;
+    log(RTT::Info) << "Sweeping joint " << sweeps_[0].joint << endlog();
+  }
+
+  // Setpoint, every joint but the swept one holds its position
+  q_des_ = q_start_;
+  qd_des_.setZero();
+  qdd_des_.setZero();
+  const Sweep* sweep = done_ ? 0 : &sweeps_[current_sweep_];
+  bool steady = false;
+  if(sweep){
+    const int j = sweep->joint;
+    double s, sd, sdd;
+    sampleSweep(*sweep,sweep_time_,s,sd,sdd,steady);
+    q_des_[j] += s;
+    qd_des_[j] = sd;
+    qdd_des_[j] = sdd;
+  }
+
+  // Feed the internal model
+  arm_.setState(this->joint_position_in_,this->joint_velocity_in_);
+  arm_.updateModel();
+
+  // Joint PD, the torque measures the friction where the velocity is constant
+  joint_torque_out_ = p_gains_.cwiseProduct(q_des_ - joint_position_in_) + d_gains_.cwiseProduct(qd_des_ - joint_velocity_in_);
+  if(sweep && sweep->recorded && steady){
+    const int j = sweep->joint;
+    const int pass = sweep->compensated ? 1 : 0;
+    const double error = q_des_[j] - joint_position_in_[j];
+    error_sq_(j,pass) += error * error;
+    error_count_(j,pass) += 1.0;
+    if(!sweep->compensated){
+      sum_vel_[current_sweep_] += joint_velocity_in_[j];
+      sum_torque_[current_sweep_] += joint_torque_out_[j];
+      nb_samples_[current_sweep_]++;
+    }
+  }
+  joint_torque_out_.noalias() += arm_.getInertiaMatrix().data * qdd_des_;
+  joint_torque_out_ += arm_.getCoriolisTorque().data;
+  if(sweep && sweep->compensated){
+    table_.compute(qd_des_,friction_torque_);
+    joint_torque_out_ += friction_torque_;
+  }
+  port_joint_torque_out_.write(joint_torque_out_);
+
+  if(!sweep)
+    return;
+  sweep_time_ += this->getPeriod();
+  if(sweep_time_ < sweepDuration(*sweep))
+    return;
+
+  // Next sweep, the fit happens once between the passes (small allocations)
+  sweep_time_ = 0.0;
+  if(++current_sweep_ == static_cast<int>(sweeps_.size())){
+    done_ = true;
+    log(RTT::Info) << "RMS position error of the sweeps (rad) without / with friction compensation :" << endlog();
+    for(int j=0; j<error_sq_.rows(); j++)
+      if(error_count_(j,0) > 0.0 && error_count_(j,1) > 0.0)
+        log(RTT::Info) << "  joint " << j << " : " << std::sqrt(error_sq_(j,0) / error_count_(j,0))
+                       << " / " << std::sqrt(error_sq_(j,1) / error_count_(j,1)) << endlog();
+    return;
+  }
+  if(sweeps_[current_sweep_].compensated && !identified_){
+    if(!identify()){
+      this->error();
+      return;
+    }
+    identified_ = true;
+  }
+  if(sweeps_[current_sweep_].joint != sweep->joint || sweeps_[current_sweep_].compensated != sweep->compensated)
+    log(RTT::Info) << "Sweeping joint " << sweeps_[current_sweep_].joint
+                   << (sweeps_[current_sweep_].compensated ? " with compensation" : "") << endlog();
+}
+
+bool FrictionIdentComp::identify(){
+  const int dof = params_.size();
+  for(int j=0; j<dof; j++){
+    std::vector<double> velocities, torques;
+    for(unsigned int i=0; i<sweeps_.size(); i++){
+      if(sweeps_[i].joint == j && nb_samples_[i] > 0){
+        velocities.push_back(sum_vel_[i] / nb_samples_[i]);
+        torques.push_back(sum_torque_[i] / nb_samples_[i]);
+      }
+    }
+    if(velocities.empty())
+      continue;
+    double rms;
+    if(!FrictionModel::fit(velocities,torques,params_[j],&rms)){
+      log(RTT::Error) << "Not enough steady sweeps to identify joint " << j << endlog();
+      return false;
+    }
+    log(RTT::Info) << "Joint " << j << " : coulomb " << params_[j].coulomb << ", static " << params_[j].stat
+                   << ", stribeck velocity " << params_[j].stribeck_velocity << ", viscous " << params_[j].viscous
+                   << " (residual " << rms << " N.m)" << endlog();
+  }
+  if(!table_.configure(params_,jnt_vel_max_,deadband_)){
+    log(RTT::Error) << "Could not build the friction tables" << endlog();
+    return false;
+  }
+  return true;
+}
+
+bool FrictionIdentComp::writeParameters(const std::string& file) const{
+  FILE* f = std::fopen(file.c_str(), "w");
+  if(!f)
+    return false;
+  const char* names[4] = {"friction_coulomb", "friction_static", "friction_stribeck_velocity", "friction_viscous"};
+  std::fprintf(f, "# Identified by FrictionIdentComp, CartOptCtrl parameters\n");
+  for(int n=0; n<4; n++){
+    std::fprintf(f, "%s : [", names[n]);
+    for(unsigned int j=0; j<params_.size(); j++){
+      const FrictionModel::Parameters& p = params_[j];
+      const double values[4] = {p.coulomb, p.stat, p.stribeck_velocity, p.viscous};
+      std::fprintf(f, "%s%g", j > 0 ? ", " : "", values[n]);
+    }
+    std::fprintf(f, "]\n");
+  }
+  std::fprintf(f, "friction_velocity_deadband : %g\n", deadband_);
+  return std::fclose(f) == 0;
+}
+
+void FrictionIdentComp::stopHook(){
+  // Written outside of the loop
+  if(identified_ && !friction_file_.empty()){
+    if(writeParameters(friction_file_))
+      log(RTT::Info) << "Friction parameters written to " << friction_file_ << endlog();
+    else
+      log(RTT::Error) << "Could not write the friction parameters to " << friction_file_ << endlog();
+  }
+}
@@ -0,0 +1,105 @@
+#include "cart_opt_ctrl/friction_model.hpp"
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+double FrictionModel::torque(const Parameters& p, double v){
+  const double sign = (v > 0.0) - (v < 0.0);
+  const double r = v / p.stribeck_velocity;
+  return (p.coulomb + (p.stat - p.coulomb) * std::exp(- r * r)) * sign + p.viscous * v;
+}
+
+bool FrictionModel::fit(const std::vector<double>& velocities, const std::vector<double>& torques, Parameters& p, double* rms){
+  if(velocities.size() != torques.size())
+    return false;
+  std::vector<double> positive, negative;
+  for(unsigned int i=0; i<velocities.size(); i++){
+    if(velocities[i] > 0.0)
+      positive.push_back(velocities[i]);
+    else if(velocities[i] < 0.0)
+      negative.push_back(-velocities[i]);
+  }
+  if(positive.size() < 2 || negative.size() < 2)
+    return false;
+
+  // From well under to well over the slowest sweep
+  const double v_low = std::min(*std::min_element(positive.begin(), positive.end()), *std::min_element(negative.begin(), negative.end()));
+  const int nb_grid = 60;
+  double best = std::numeric_limits<double>::infinity();
+  Eigen::Matrix4d normal;
+  Eigen::Vector4d rhs, row, x;
+  for(int g=0; g<nb_grid; g++){
+    const double vs = 0.1 * v_low * std::pow(100.0, double(g) / (nb_grid - 1));
+    normal.setZero();
+    rhs.setZero();
+    for(unsigned int i=0; i<velocities.size(); i++){
+      const double v = velocities[i];
+      const double sign = (v > 0.0) - (v < 0.0);
+      const double e = std::exp(- (v / vs) * (v / vs));
+      row << sign * (1.0 - e), sign * e, v, 1.0;
+      normal.noalias() += row * row.transpose();
+      rhs += row * torques[i];
+    }
+    // The Stribeck column vanishes when vs is far under the sweeps
+    normal.diagonal().array() += 1e-9 * normal.trace();
+    x = normal.ldlt().solve(rhs);
+    double residual = 0.0;
+    for(unsigned int i=0; i<velocities.size(); i++){
+      const double v = velocities[i];
+      const double sign = (v > 0.0) - (v < 0.0);
+      const double e = std::exp(- (v / vs) * (v / vs));
+      const double r = x[0] * sign * (1.0 - e) + x[1] * sign * e + x[2] * v + x[3] - torques[i];
+      residual += r * r;
+    }
+    if(residual < best){
+      best = residual;
+      p.coulomb = x[0];
+      p.stat = x[1];
+      p.viscous = x[2];
+      p.stribeck_velocity = vs;
+    }
+  }
+  if(rms)
+    *rms = std::sqrt(best / velocities.size());
+  return true;
+}
+
+FrictionTable::FrictionTable() : nb_samples_(0), last_(0.0)
+{
+}
+
+int FrictionTable::requiredSize(double v_max, double deadband){
+  if(deadband <= 0.0)
+    return 2;
+  const double intervals = std::ceil(4.0 * v_max / deadband);
+  return intervals < MAX_SIZE ? static_cast<int>(intervals) + 1 : MAX_SIZE + 1;
+}
+
+bool FrictionTable::configure(const std::vector<FrictionModel::Parameters>& params, const Eigen::VectorXd& v_max, double deadband,
+                              int nb_samples){
+  const int dof = params.size();
+  if(v_max.size() != dof || nb_samples < 0 || deadband < 0.0 || (v_max.array() <= 0.0).any() || !v_max.allFinite())
+    return false;
+  const int required = std::max(2, requiredSize(v_max.maxCoeff(), deadband));
+  if(nb_samples == 0){
+    nb_samples = required;
+    if(deadband <= 0.0)
+      nb_samples = DEFAULT_SIZE;
+  }
+  if(nb_samples < required || nb_samples > MAX_SIZE)
+    return false;
+  nb_samples_ = nb_samples;
+  last_ = nb_samples - 1 - 1e-9;
+  v_min_ = - v_max;
+  inv_step_ = (nb_samples - 1) / (2.0 * v_max.array());
+  table_.resize(dof * nb_samples);
+  for(int j=0; j<dof; j++){
+    const double edge = deadband > 0.0 ? FrictionModel::torque(params[j], deadband) : 0.0;
+    for(int k=0; k<nb_samples; k++){
+      const double v = v_min_[j] + k / inv_step_[j];
+      table_[j * nb_samples + k] = std::abs(v) < deadband ? edge * v / deadband : FrictionModel::torque(params[j], v);
+    }
+  }
+  return true;
+}
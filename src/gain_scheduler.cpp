@@ -0,0 +1,89 @@
+#include "cart_opt_ctrl/gain_scheduler.hpp"
+#include <rtt/Logger.hpp>
+#include <algorithm>
+#include <cmath>
+
+using namespace RTT;
+
+const int GainScheduler::NB_AXES;
+const int GainScheduler::NB_GAINS;
+
+GainScheduler::GainScheduler() : configured_(false)
+{
+  min_.setZero();
+  inv_step_.setZero();
+  max_index_.setZero();
+  samples_.setZero();
+  strides_.setZero();
+}
+
+bool GainScheduler::configure(const Eigen::VectorXd& axis_min, const Eigen::VectorXd& axis_max, const Eigen::VectorXd& axis_samples,
+                              const Eigen::VectorXd& p_table, const Eigen::VectorXd& d_table){
+  configured_ = false;
+  if(axis_min.size() != NB_AXES || axis_max.size() != NB_AXES || axis_samples.size() != NB_AXES){
+    log(Error) << "Gain schedule axes must have " << NB_AXES << " components (lambda, payload, speed)" << endlog();
+    return false;
+  }
+
+  if(!axis_min.allFinite() || !axis_max.allFinite() || !axis_samples.allFinite() || (axis_samples.array().abs() > 1e6).any()){
+    log(Error) << "Gain schedule axes must be finite, with at most 1e6 samples" << endlog();
+    return false;
+  }
+
+  int nb_points = 1;
+  for(int i=0; i<NB_AXES; i++){
+    samples_(i) = static_cast<int>(axis_samples(i));
+    // At least two samples per axis so that there is always a cell to interpolate in
+    if(samples_(i) < 2 || axis_max(i) <= axis_min(i)){
+      log(Error) << "Gain schedule axis #" << i << " needs at least 2 samples and max > min" << endlog();
+      return false;
+    }
+    min_(i) = axis_min(i);
+    inv_step_(i) = (samples_(i) - 1) / (axis_max(i) - axis_min(i));
+    max_index_(i) = samples_(i) - 1;
+    nb_points *= samples_(i);
+  }
+  strides_ << samples_(1) * samples_(2), samples_(2), 1;
+
+  if(p_table.size() != nb_points * NB_GAINS || d_table.size() != nb_points * NB_GAINS){
+    log(Error) << "Gain schedule tables must have " << nb_points * NB_GAINS << " elements, got "
+               << p_table.size() << " and " << d_table.size() << endlog();
+    return false;
+  }
+  p_table_ = Eigen::Map<const Eigen::Matrix<double,NB_GAINS,Eigen::Dynamic> >(p_table.data(), NB_GAINS, nb_points);
+  d_table_ = Eigen::Map<const Eigen::Matrix<double,NB_GAINS,Eigen::Dynamic> >(d_table.data(), NB_GAINS, nb_points);
+
+  configured_ = true;
+  return true;
+}
+
+bool GainScheduler::interpolate(double lambda, double payload, double speed, Eigen::VectorXd& p_gains, Eigen::VectorXd& d_gains) const{
+  // NaN goes through the clamps and its cast to int is undefined
+  if(!std::isfinite(lambda) || !std::isfinite(payload) || !std::isfinite(speed))
+    return false;
+  const double query[NB_AXES] = {lambda, payload, speed};
+  int base = 0;
+  double frac[NB_AXES];
+  for(int i=0; i<NB_AXES; i++){
+    // Continuous grid coordinate, clamped to the table (min/max compile to branchless instructions)
+    const double u = std::min(std::max((query[i] - min_(i)) * inv_step_(i), 0.0), max_index_(i));
+    // Lower corner of the cell, the last sample belongs to the last cell
+    const int idx = std::min(static_cast<int>(u), samples_(i) - 2);
+    frac[i] = u - idx;
+    base += idx * strides_(i);
+  }
+
+  p_gains.setZero();
+  d_gains.setZero();
+  // Accumulate the 8 corners of the cell, the weight of each corner is selected arithmetically
+  for(int c=0; c<8; c++){
+    const int b0 = (c >> 2) & 1, b1 = (c >> 1) & 1, b2 = c & 1;
+    const double w = ((1.0 - frac[0]) + b0 * (2.0 * frac[0] - 1.0))
+                   * ((1.0 - frac[1]) + b1 * (2.0 * frac[1] - 1.0))
+                   * ((1.0 - frac[2]) + b2 * (2.0 * frac[2] - 1.0));
+    const int col = base + b0 * strides_(0) + b1 * strides_(1) + b2 * strides_(2);
+    p_gains.noalias() += w * p_table_.col(col);
+    d_gains.noalias() += w * d_table_.col(col);
+  }
+  return true;
+}
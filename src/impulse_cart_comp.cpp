@@ -1,8 +1,9 @@
 #include "cart_opt_ctrl/impulse_cart_comp.hpp"
+#include <chrono>
 
 using namespace RTT;
 
-ImpulseComp::ImpulseComp(const std::string& name) : RTT::TaskContext(name)
+ImpulseComp::ImpulseComp(const std::string& name) : RTT::TaskContext(name), state_(IDLE), stop_analysis_(false)
 { 
   this->addPort("JointPosition",port_joint_position_in_);
   this->addPort("JointVelocity",port_joint_velocity_in_);
@@ -14,6 +15,22 @@ ImpulseComp::ImpulseComp(const std::string& name) : RTT::TaskContext(name)
   this->addProperty("component",component_).doc("Choose between rot or lin impulse");
   this->addProperty("send_impulse",send_).doc("Send the impulse");
   this->addProperty("amplitude",amplitude_).doc("Send the impulse");
+  this->addProperty("mode",mode_).doc("step, chirp or multisine");
+  this->addProperty("f_min",f_min_).doc("Lowest excited frequency (Hz)");
+  this->addProperty("f_max",f_max_).doc("Highest excited frequency (Hz)");
+  this->addProperty("excitation_duration",excitation_duration_).doc("Duration of the chirp (s)");
+  this->addProperty("nb_sines",nb_sines_).doc("Number of sines of the multisine");
+  this->addProperty("nb_periods",nb_periods_).doc("Number of measured periods of the multisine");
+  this->addProperty("response_file",response_file_).doc("File the frequency response is written to, empty for none");
+  this->addPort("FrequencyResponse",port_response_out_);
+
+  mode_ = "step";
+  f_min_ = 0.5;
+  f_max_ = 30.0;
+  excitation_duration_ = 20.0;
+  nb_sines_ = 40;
+  nb_periods_ = 3;
+  response_file_ = "";
   
   // Match all properties (defined in the constructor) 
   // with the rosparams in the namespace : 
@@ -47,10 +64,66 @@ bool ImpulseComp::configureHook(){
   
   // Default params
   ee_frame_ = arm_.getSegmentName( arm_.getNrOfSegments() - 1 );
+
+  // Excitation and its capture, the multisine needs no duration
+  stopAnalysis();
+  signal_ = ExcitationSignal();
+  if(mode_ != "step"){
+    if(mode_ != "chirp" && mode_ != "multisine"){
+      log(RTT::Error) << "Choose between step, chirp and multisine for mode" << endlog();
+      return false;
+    }
+    if(!signal_.init(mode_ == "chirp" ? ExcitationSignal::CHIRP : ExcitationSignal::MULTISINE,
+                     f_min_,f_max_,excitation_duration_,this->getPeriod(),nb_sines_,nb_periods_)){
+      log(RTT::Error) << "Invalid excitation, it needs a periodic activity, 0 < f_min < f_max < 1/(2 period)"
+                      << " and a positive duration, nb_sines and nb_periods" << endlog();
+      return false;
+    }
+    input_.assign(signal_.size(),0.0);
+    output_.assign(signal_.size(),0.0);
+
+    // Peak setpoint derivatives, they scale with the amplitude
+    double peak_vel = 0.0, peak_acc = 0.0, x, xd, xdd;
+    for(int k=0; k<signal_.size(); k++){
+      signal_.sample(k,x,xd,xdd);
+      peak_vel = std::max(peak_vel,std::abs(xd));
+      peak_acc = std::max(peak_acc,std::abs(xdd));
+    }
+    log(RTT::Info) << mode_ << " excitation of " << signal_.duration() << " s from " << f_min_ << " to " << f_max_
+                   << " Hz, peak velocity " << peak_vel << " and acceleration " << peak_acc << " per unit of amplitude" << endlog();
+  }
+  response_summary_.setZero(ResponseSummary::SIZE);
+  port_response_out_.setDataSample(response_summary_);
+
+  stop_analysis_ = false;
+  state_ = IDLE;
+  analysis_thread_ = std::thread(&ImpulseComp::analysisLoop,this);
   return true;
 }
 
+ImpulseComp::~ImpulseComp(){
+  stopAnalysis();
+}
+
+void ImpulseComp::cleanupHook(){
+  stopAnalysis();
+}
+
+void ImpulseComp::stopAnalysis(){
+  if(!analysis_thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(analysis_mutex_);
+    stop_analysis_ = true;
+  }
+  analysis_wake_.notify_one();
+  analysis_thread_.join();
+}
+
 bool ImpulseComp::startHook(){ 
+  // An interrupted excitation is dropped
+  if(state_ == EXCITING)
+    state_ = IDLE;
   return true;
 }
 
@@ -61,6 +134,20 @@ constexpr unsigned int str2int(const char* str, int h = 0)
 
 void ImpulseComp::updateHook(){ 
 
+  if (state_ == EXCITING){
+    updateExcitation();
+    return;
+  }
+
+  if (send_ && mode_ != "step"){
+    send_ = false;
+    if (state_ == ANALYSING)
+      log(RTT::Warning) << "The previous response is still being analysed" << endlog();
+    else if (startExcitation())
+      updateExcitation();
+    return;
+  }
+
   if (send_){
     // Read the current state of the robot
     RTT::FlowStatus fp = this->port_joint_position_in_.read(this->joint_position_in_);
@@ -133,4 +220,138 @@ void ImpulseComp::updateHook(){
   
 }
 
+bool ImpulseComp::startExcitation(){
+  if (signal_.size() == 0){
+    log(RTT::Error) << "The excitation is set at configure, configure again after changing mode" << endlog();
+    return false;
+  }
+  KDL::Vector axis;
+  switch (str2int(axis_.c_str())){
+    case str2int("x"):
+      axis = KDL::Vector(1.0,0.0,0.0);
+      break;
+    case str2int("y"):
+      axis = KDL::Vector(0.0,1.0,0.0);
+      break;
+    case str2int("z"):
+      axis = KDL::Vector(0.0,0.0,1.0);
+      break;
+    default:
+      log(RTT::Error) << "Choose between x, y ,z in axis" << endlog();
+      return false;
+  }
+  if (component_ != "lin" && component_ != "rot"){
+    log(RTT::Error) << "Choose between lin and rot for component" << endlog();
+    return false;
+  }
+
+  RTT::FlowStatus fp = this->port_joint_position_in_.read(this->joint_position_in_);
+  RTT::FlowStatus fv = this->port_joint_velocity_in_.read(this->joint_velocity_in_);
+  if(fp == RTT::NoData || fv == RTT::NoData){
+    log(RTT::Error) << "Robot ports empty !" << endlog();
+    return false;
+  }
+  arm_.setState(this->joint_position_in_,this->joint_velocity_in_);
+  arm_.updateModel();
+
+  // Offsets along the axis from the current pose, in the base frame as the step in position
+  // and in the end effector frame as the step in rotation
+  start_pose_ = arm_.getSegmentPosition(ee_frame_);
+  excitation_rot_ = (component_ == "rot");
+  excitation_axis_ = axis;
+  excitation_sample_ = 0;
+  state_ = EXCITING;
+  return true;
+}
+
+void ImpulseComp::updateExcitation(){
+  RTT::FlowStatus fp = this->port_joint_position_in_.read(this->joint_position_in_);
+  RTT::FlowStatus fv = this->port_joint_velocity_in_.read(this->joint_velocity_in_);
+  if(fp == RTT::NoData || fv == RTT::NoData)
+    return;
+  arm_.setState(this->joint_position_in_,this->joint_velocity_in_);
+  arm_.updateModel();
+
+  // Measured offset, along with the setpoint offset sent at this cycle
+  const KDL::Frame& pose = arm_.getSegmentPosition(ee_frame_);
+  double x, xd, xdd;
+  signal_.sample(excitation_sample_,x,xd,xdd);
+  x *= amplitude_;
+  xd *= amplitude_;
+  xdd *= amplitude_;
+  input_[excitation_sample_] = x;
+  if(excitation_rot_){
+    output_[excitation_sample_] = KDL::dot((start_pose_.M.Inverse() * pose.M).GetRot(),excitation_axis_);
+    const KDL::Vector axis = start_pose_.M * excitation_axis_;
+    current_pos_ = KDL::Frame(start_pose_.M * KDL::Rotation::Rot2(excitation_axis_,x),start_pose_.p);
+    current_vel_ = KDL::Twist(KDL::Vector::Zero(),axis * xd);
+    current_acc_ = KDL::Twist(KDL::Vector::Zero(),axis * xdd);
+  }
+  else{
+    output_[excitation_sample_] = KDL::dot(pose.p - start_pose_.p,excitation_axis_);
+    current_pos_ = KDL::Frame(start_pose_.M,start_pose_.p + excitation_axis_ * x);
+    current_vel_ = KDL::Twist(excitation_axis_ * xd,KDL::Vector::Zero());
+    current_acc_ = KDL::Twist(excitation_axis_ * xdd,KDL::Vector::Zero());
+  }
+  port_pnt_pos_out_.write(current_pos_);
+  port_pnt_vel_out_.write(current_vel_);
+  port_pnt_acc_out_.write(current_acc_);
+
+  // Capture complete, the analysis thread may be waiting : no lock on this side, it also wakes up periodically
+  if(++excitation_sample_ == signal_.size()){
+    state_ = ANALYSING;
+    analysis_wake_.notify_one();
+  }
+}
+
+void ImpulseComp::analysisLoop(){
+  FrequencyResponse::Result result;
+  while(true){
+    {
+      std::unique_lock<std::mutex> lock(analysis_mutex_);
+      analysis_wake_.wait_for(lock,std::chrono::milliseconds(50),[this]{ return stop_analysis_ || state_ == ANALYSING; });
+      if(stop_analysis_)
+        return;
+      if(state_ != ANALYSING)
+        continue;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const bool valid = FrequencyResponse::estimate(signal_,input_.data(),output_.data(),result);
+    const double analysis_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(!valid){
+      log(RTT::Error) << "No frequency response, the excitation did not reach the measured output" << endlog();
+      state_ = IDLE;
+      continue;
+    }
+
+    response_summary_.setZero();
+    response_summary_[ResponseSummary::LOW_FREQUENCY_GAIN] = result.low_frequency_gain;
+    response_summary_[ResponseSummary::BANDWIDTH] = result.bandwidth;
+    response_summary_[ResponseSummary::CROSSOVER] = result.crossover;
+    response_summary_[ResponseSummary::PHASE_MARGIN] = result.phase_margin;
+    response_summary_[ResponseSummary::NB_RESONANCES] = result.resonances.size();
+    if(!result.resonances.empty()){
+      response_summary_[ResponseSummary::PEAK_FREQUENCY] = result.resonances[0].frequency;
+      response_summary_[ResponseSummary::PEAK_GAIN] = result.resonances[0].gain;
+    }
+    port_response_out_.write(response_summary_);
+
+    log(RTT::Info) << "Frequency response (" << component_ << " " << axis_ << ") over " << result.frequencies.size()
+                   << " points in " << 1e3 * analysis_time << " ms : low frequency gain " << result.low_frequency_gain << endlog();
+    if(result.bandwidth_found)
+      log(RTT::Info) << "  bandwidth (-3dB) " << result.bandwidth << " Hz" << endlog();
+    else
+      log(RTT::Info) << "  bandwidth above " << f_max_ << " Hz" << endlog();
+    if(result.margin_found)
+      log(RTT::Info) << "  crossover " << result.crossover << " Hz, phase margin " << result.phase_margin << " deg" << endlog();
+    for(unsigned int i=0; i<result.resonances.size(); i++)
+      log(RTT::Info) << "  resonance at " << result.resonances[i].frequency << " Hz, gain "
+                     << 20.0 * std::log10(result.resonances[i].gain) << " dB" << endlog();
+    if(!response_file_.empty() && !FrequencyResponse::save(response_file_,result))
+      log(RTT::Error) << "Could not write the frequency response to " << response_file_ << endlog();
+    state_ = IDLE;
+  }
+}
+
 void ImpulseComp::stopHook(){}
@@ -0,0 +1,26 @@
+#include "cart_opt_ctrl/joint_acceleration_limit.hpp"
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+
+namespace cart_opt_ctrl
+{
+  bool JointAccelerationLimit::configure(const std::string& ns, int dof){
+    dof_ = dof;
+    std::vector<double> acc_max;
+    if(!ros::param::get(ns + "/joint_acc_max", acc_max) || acc_max.size() != static_cast<size_t>(dof)){
+      ROS_ERROR_STREAM(ns << "/joint_acc_max needs " << dof << " elements");
+      return false;
+    }
+    joint_acc_max_ = Eigen::Map<Eigen::VectorXd>(acc_max.data(), dof);
+    ros::param::param(ns + "/slack_weight", slack_weight_, 0.0);
+    return true;
+  }
+
+  void JointAccelerationLimit::update(const QPState& state, QPSlice& slice){
+    slice.A = *state.inertia_inverse;
+    slice.lbA = *state.nonlinear_terms - joint_acc_max_;
+    slice.ubA = *state.nonlinear_terms + joint_acc_max_;
+  }
+}
+
+PLUGINLIB_EXPORT_CLASS(cart_opt_ctrl::JointAccelerationLimit, cart_opt_ctrl::QPPlugin)
@@ -0,0 +1,72 @@
+#include "cart_opt_ctrl/joint_record.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+namespace
+{
+  const char MAGIC[4] = {'C','J','R','C'};
+}
+
+JointRecord::JointRecord() : nb_joints_(0), flags_(0), capacity_(0), sample_size_(1), first_(0), count_(0)
+{
+}
+
+void JointRecord::configure(int nb_joints, int capacity, int flags){
+  nb_joints_ = nb_joints;
+  flags_ = flags;
+  capacity_ = std::max(0, capacity);
+  sample_size_ = 1 + 4 * nb_joints;
+  data_.assign(capacity_ * sample_size_, 0.0);
+  clear();
+}
+
+void JointRecord::clear(){
+  first_ = 0;
+  count_ = 0;
+}
+
+void JointRecord::push(double time, const Eigen::VectorXd& q, const Eigen::VectorXd& qd, const Eigen::VectorXd& tau_measured, const Eigen::VectorXd& tau_command){
+  if(capacity_ == 0)
+    return;
+  // Overwrites the oldest sample once full
+  double* p = data_.data() + ((first_ + count_) % capacity_) * sample_size_;
+  if(count_ < capacity_)
+    ++count_;
+  else
+    first_ = (first_ + 1) % capacity_;
+  *p++ = time;
+  std::memcpy(p, q.data(), nb_joints_*sizeof(double)); p += nb_joints_;
+  std::memcpy(p, qd.data(), nb_joints_*sizeof(double)); p += nb_joints_;
+  std::memcpy(p, tau_measured.data(), nb_joints_*sizeof(double)); p += nb_joints_;
+  std::memcpy(p, tau_command.data(), nb_joints_*sizeof(double));
+}
+
+bool JointRecord::save(const std::string& file) const{
+  FILE* f = std::fopen(file.c_str(), "wb");
+  if(!f)
+    return false;
+  const int32_t header[3] = {nb_joints_, count_, flags_};
+  bool ok = std::fwrite(MAGIC, 1, 4, f) == 4 && std::fwrite(header, sizeof(int32_t), 3, f) == 3;
+  for(int i=0; ok && i<count_; i++)
+    ok = std::fwrite(sample(i), sizeof(double), sample_size_, f) == static_cast<size_t>(sample_size_);
+  return std::fclose(f) == 0 && ok;
+}
+
+bool JointRecord::load(const std::string& file){
+  FILE* f = std::fopen(file.c_str(), "rb");
+  if(!f)
+    return false;
+  char magic[4];
+  int32_t header[3];
+  bool ok = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, MAGIC, 4) == 0
+            && std::fread(header, sizeof(int32_t), 3, f) == 3 && header[0] > 0 && header[1] >= 0;
+  if(ok){
+    configure(header[0], header[1], header[2]);
+    ok = std::fread(data_.data(), sizeof(double), data_.size(), f) == data_.size();
+    count_ = ok ? capacity_ : 0;
+  }
+  std::fclose(f);
+  return ok;
+}
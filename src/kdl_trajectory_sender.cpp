@@ -2,12 +2,8 @@
 #include <kdl/chainjnttojacsolver.hpp>
 #include <kdl/chainfksolvervel_recursive.hpp>
 #include <trajectory_msgs/JointTrajectory.h>
-#include <kdl/path_roundedcomposite.hpp>
-#include <kdl/trajectory_composite.hpp>
-#include <kdl/rotational_interpolation_sa.hpp>
-#include <kdl/velocityprofile_trap.hpp>
-#include <kdl/trajectory_segment.hpp>
-#include <kdl/trajectory_stationary.hpp>
+#include <cart_opt_ctrl/trajectory_plan.hpp>
+#include <chrono>
 #include <std_msgs/Empty.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <geometry_msgs/PoseArray.h>
@@ -18,10 +14,8 @@
 boost::shared_ptr<KDL::ChainJntToJacSolver> jntToJacDotSolver_;
 KDL::Frame frame_des_kdl;
 KDL::FrameVel frame_vel_des_kdl;
-KDL::Path_RoundedComposite* path_;
-KDL::Trajectory* traject_;
-KDL::Trajectory_Composite* ctraject_;
-KDL::VelocityProfile* vel_profile_;
+// Rebuilt in place at each call, between two trajectories
+TrajectoryPlan plan_;
 
 bool computeTrajectory(const double radius, const double eqradius,const double vmax, const double accmax);
 void computeTrajectory(const geometry_msgs::Pose::ConstPtr& start);
@@ -73,11 +67,11 @@ int main(int argc, char** argv){
 
         if (traj_computed)
         {
-            if (current_traj_time < ctraject_->Duration())
+            if (current_traj_time < plan_.Duration())
             {
-                current_pose = ctraject_->Pos(current_traj_time);
-                current_vel = ctraject_->Vel(current_traj_time);
-                current_acc = ctraject_->Acc(current_traj_time);
+                current_pose = plan_.Pos(current_traj_time);
+                current_vel = plan_.Vel(current_traj_time);
+                current_acc = plan_.Acc(current_traj_time);
 
                 tf::poseKDLToMsg(current_pose, pos_out);
                 tf::twistKDLToMsg(current_vel, vel_out);
@@ -128,22 +122,19 @@ bool computeTrajectory(const double radius, const double eqradius,const double v
         second_frame = KDL::Frame(first_frame.M, KDL::Vector(first_frame.p.x(), first_frame.p.y() + 0.1, first_frame.p.z() + 0.1));
         third_frame = KDL::Frame(first_frame.M, KDL::Vector(first_frame.p.x(), first_frame.p.y() + 0.2, first_frame.p.z()));
 
-        path_ = new KDL::Path_RoundedComposite(radius,eqradius,new KDL::RotationalInterpolation_SingleAxis());
-        path_->Add(first_frame);
-        path_->Add(second_frame);
-        path_->Add(third_frame);
-        //     path_->Add(KDL::Frame(KDL::Rotation::RPY(0.*deg2rad, -0.*deg2rad, -0.*deg2rad), KDL::Vector(0.5,0.1,.6)));
-        //     path_->Add(KDL::Frame(KDL::Rotation::RPY(0.*deg2rad, -0.*deg2rad, -0.*deg2rad), KDL::Vector(0.5,0.2,.5)));
-        path_->Add(first_frame);
-        path_->Finish();
+        std::vector<KDL::Frame> waypoints;
+        waypoints.push_back(first_frame);
+        waypoints.push_back(second_frame);
+        waypoints.push_back(third_frame);
+        //     waypoints.push_back(KDL::Frame(KDL::Rotation::RPY(0.*deg2rad, -0.*deg2rad, -0.*deg2rad), KDL::Vector(0.5,0.1,.6)));
+        //     waypoints.push_back(KDL::Frame(KDL::Rotation::RPY(0.*deg2rad, -0.*deg2rad, -0.*deg2rad), KDL::Vector(0.5,0.2,.5)));
+        waypoints.push_back(first_frame);
 
-        vel_profile_ = new KDL::VelocityProfile_Trap(vmax,accmax);
-        vel_profile_->SetProfile(0,path_->PathLength());
-        traject_ = new KDL::Trajectory_Segment(path_, vel_profile_);
-
-        ctraject_ = new KDL::Trajectory_Composite();
-        ctraject_->Add(traject_);
-        ctraject_->Add(new KDL::Trajectory_Stationary(1.0,first_frame));
+        // The previous trajectory is finished, its plan is reused
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        plan_.build(waypoints, radius, eqradius, vmax, accmax, TrajectoryPlan::TRAPEZOIDAL, 1.0);
+        ROS_INFO_STREAM("Trajectory planned in " << 1e3 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
+                        << " ms, " << plan_.getMemoryUsed() << " bytes in its arena");
 
     } catch(...) {
         ROS_ERROR("Encountered an error while computing KDL trajectory");
@@ -163,13 +154,13 @@ void publishTrajectory()
     geometry_msgs::PoseArray pose_array;
     pose_array.header.frame_id = path_ros.header.frame_id;
 
-    for (double t=0.0; t <= ctraject_->Duration(); t+= 0.1) {
+    for (double t=0.0; t <= plan_.Duration(); t+= 0.1) {
         KDL::Frame current_pose;
         KDL::Twist current_vel,current_acc;
 
-        current_pose = ctraject_->Pos(t);
-        current_vel = ctraject_->Vel(t);
-        current_acc = ctraject_->Acc(t);
+        current_pose = plan_.Pos(t);
+        current_vel = plan_.Vel(t);
+        current_acc = plan_.Acc(t);
 
         geometry_msgs::Pose pose;
         geometry_msgs::PoseStamped pose_st;
@@ -0,0 +1,55 @@
+#include "cart_opt_ctrl/momentum_observer.hpp"
+
+MomentumObserver::MomentumObserver() : initialized_(false)
+{
+}
+
+bool MomentumObserver::configure(int dof, const Eigen::VectorXd& gains){
+  if(gains.size() != dof)
+    return false;
+  gains_ = gains;
+  residual_.setZero(dof);
+  p0_.setZero(dof);
+  integral_.setZero(dof);
+  momentum_.setZero(dof);
+  beta_.setZero(dof);
+  inertia_prev_.setZero(dof,dof);
+  inertia_dot_.setZero(dof,dof);
+  reset();
+  return true;
+}
+
+void MomentumObserver::reset(){
+  initialized_ = false;
+  residual_.setZero();
+}
+
+const Eigen::VectorXd& MomentumObserver::update(const Eigen::MatrixXd& inertia, const Eigen::VectorXd& coriolis, const Eigen::VectorXd& gravity,
+                                                const Eigen::VectorXd& qd, const Eigen::VectorXd& tau, double dt){
+  if(initialized_ && dt <= 0.0)
+    return residual_;
+  momentum_.noalias() = inertia * qd;
+
+  if(!initialized_){
+    p0_ = momentum_;
+    integral_.setZero();
+    residual_.setZero();
+    inertia_prev_ = inertia;
+    initialized_ = true;
+    return residual_;
+  }
+
+  // beta = tau + Mdot.qd - C.qd - g + r
+  inertia_dot_ = (inertia - inertia_prev_) / dt;
+  beta_.noalias() = inertia_dot_ * qd;
+  beta_ += tau - coriolis - gravity + residual_;
+  integral_ += beta_ * dt;
+  inertia_prev_ = inertia;
+
+  residual_ = gains_.cwiseProduct(momentum_ - p0_ - integral_);
+  return residual_;
+}
+
+bool MomentumObserver::exceeds(const Eigen::VectorXd& thresholds) const{
+  return (residual_.cwiseAbs().array() > thresholds.array()).any();
+}
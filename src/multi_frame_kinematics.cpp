@@ -0,0 +1,136 @@
+#include "cart_opt_ctrl/multi_frame_kinematics.hpp"
+#include <kdl/chain.hpp>
+#include <Eigen/Geometry>
+
+MultiFrameKinematics::MultiFrameKinematics() : nb_joints_(0)
+{
+}
+
+bool MultiFrameKinematics::init(const KDL::Chain& chain){
+  BatchedDynamics::SegmentModels segments;
+  int nb_joints;
+  if(!BatchedDynamics::extractSegments(chain, segments, nb_joints))
+    return false;
+  std::vector<std::string> segment_names(chain.getNrOfSegments());
+  for(unsigned int k=0; k<chain.getNrOfSegments(); k++)
+    segment_names[k] = chain.getSegment(k).getName();
+  return init(segments, segment_names, nb_joints);
+}
+
+bool MultiFrameKinematics::init(const BatchedDynamics::SegmentModels& segments, const std::vector<std::string>& segment_names, int nb_joints){
+  int nb_moving = 0;
+  for(unsigned int k=0; k<segments.size(); k++)
+    nb_moving += segments[k].type != BatchedDynamics::SegmentModel::FIXED;
+  if(segment_names.size() != segments.size() || nb_moving != nb_joints)
+    return false;
+  segments_ = segments;
+  segment_names_ = segment_names;
+  nb_joints_ = nb_joints;
+  joints_.resize(nb_joints_);
+  segment_states_.resize(segments_.size());
+  clearFrames();
+  return true;
+}
+
+int MultiFrameKinematics::addFrame(const std::string& segment_name){
+  for(unsigned int h=0; h<frames_.size(); h++)
+    if(segment_names_[frames_[h].segment] == segment_name)
+      return h;
+  for(unsigned int k=0; k<segment_names_.size(); k++){
+    if(segment_names_[k] != segment_name)
+      continue;
+    Frame frame;
+    frame.segment = k;
+    frame.rotation.setIdentity();
+    frame.position.setZero();
+    frame.twist.setZero();
+    frame.jdot_qdot.setZero();
+    frame.jacobian.setZero(6, nb_joints_);
+    frames_.push_back(frame);
+    return frames_.size() - 1;
+  }
+  return -1;
+}
+
+void MultiFrameKinematics::clearFrames(){
+  frames_.clear();
+}
+
+void MultiFrameKinematics::update(const Eigen::VectorXd& q, const Eigen::VectorXd& qd){
+  // Forward pass, the velocity of each tip comes with it
+  Eigen::Matrix3d rot = Eigen::Matrix3d::Identity();
+  Eigen::Vector3d pos = Eigen::Vector3d::Zero(), w = Eigen::Vector3d::Zero(), v = Eigen::Vector3d::Zero();
+  int j = 0;
+  for(unsigned int k=0; k<segments_.size(); k++){
+    const BatchedDynamics::SegmentModel& model = segments_[k];
+    Eigen::Vector3d joint_pos = pos;
+    Eigen::Vector3d o = pos, o_dot = v;
+    if(model.type != BatchedDynamics::SegmentModel::FIXED){
+      JointState& joint = joints_[j];
+      joint.rotational = model.type == BatchedDynamics::SegmentModel::ROTATIONAL;
+      joint.z.noalias() = rot * model.axis;
+      joint.w_parent = w;
+      o.noalias() = pos + rot * model.origin;
+      o_dot = v + w.cross(o - pos);
+      joint.o = o;
+      joint.o_dot = o_dot;
+      if(joint.rotational){
+        const Eigen::Matrix3d joint_rot = Eigen::AngleAxisd(q(j), model.axis).toRotationMatrix();
+        joint_pos.noalias() = o - rot * joint_rot * model.origin;
+        rot = rot * joint_rot;
+        w += joint.z * qd(j);
+      }
+      else{
+        joint_pos += joint.z * q(j);
+        o = joint_pos;
+        o_dot = v + w.cross(o - pos) + joint.z * qd(j);
+      }
+      ++j;
+    }
+    SegmentState& state = segment_states_[k];
+    state.position.noalias() = joint_pos + rot * model.tip_pos;
+    rot = rot * model.tip_rot;
+    v = o_dot + w.cross(state.position - o);
+    pos = state.position;
+    state.rotation = rot;
+    state.w = w;
+    state.v = v;
+    state.nb_joints = j;
+  }
+
+  for(unsigned int h=0; h<frames_.size(); h++)
+    computeFrame(frames_[h], qd);
+}
+
+void MultiFrameKinematics::computeFrame(Frame& frame, const Eigen::VectorXd& qd){
+  const SegmentState& state = segment_states_[frame.segment];
+  frame.rotation = state.rotation;
+  frame.position = state.position;
+  frame.twist.head<3>() = state.v;
+  frame.twist.tail<3>() = state.w;
+  for(int i=0; i<3; i++){
+    frame.pose.p(i) = state.position(i);
+    for(int c=0; c<3; c++)
+      frame.pose.M(i,c) = state.rotation(i,c);
+  }
+
+  // Columns of the joints before the frame, the others stay at zero.
+  // d/dt (z x (p - o)) = (w_parent x z) x (p - o) + z x (p_dot - o_dot) and d/dt z = w_parent x z
+  frame.jdot_qdot.setZero();
+  for(int j=0; j<state.nb_joints; j++){
+    const JointState& joint = joints_[j];
+    const Eigen::Vector3d z_dot = joint.w_parent.cross(joint.z);
+    if(joint.rotational){
+      const Eigen::Vector3d r = state.position - joint.o;
+      frame.jacobian.col(j).head<3>() = joint.z.cross(r);
+      frame.jacobian.col(j).tail<3>() = joint.z;
+      frame.jdot_qdot.head<3>() += (z_dot.cross(r) + joint.z.cross(state.v - joint.o_dot)) * qd(j);
+      frame.jdot_qdot.tail<3>() += z_dot * qd(j);
+    }
+    else{
+      frame.jacobian.col(j).head<3>() = joint.z;
+      frame.jacobian.col(j).tail<3>().setZero();
+      frame.jdot_qdot.head<3>() += z_dot * qd(j);
+    }
+  }
+}
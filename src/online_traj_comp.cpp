@@ -0,0 +1,127 @@
+#include "cart_opt_ctrl/online_traj_comp.hpp"
+
+using namespace RTT;
+
+OnlineTrajComp::OnlineTrajComp(const std::string& name) : RTT::TaskContext(name)
+{
+  this->addPort("JointPosition",port_joint_position_in_);
+  this->addPort("JointVelocity",port_joint_velocity_in_);
+  this->addPort("TargetPose",port_target_pose_in_);
+  this->addPort("TargetTwist",port_target_twist_in_);
+  this->addPort("TrajectoryPointPosOut",port_pnt_pos_out_);
+  this->addPort("TrajectoryPointVelOut",port_pnt_vel_out_);
+  this->addPort("TrajectoryPointAccOut",port_pnt_acc_out_);
+  this->addPort("TargetReached",port_target_reached_out_);
+
+  this->addProperty("vel_max",vel_max_).doc("Max cartesian velocity (m/s)");
+  this->addProperty("acc_max",acc_max_).doc("Max cartesian acceleration (m/s^2)");
+  this->addProperty("jerk_max",jerk_max_).doc("Max cartesian jerk (m/s^3)");
+  this->addProperty("rot_vel_max",rot_vel_max_).doc("Max angular velocity (rad/s)");
+  this->addProperty("rot_acc_max",rot_acc_max_).doc("Max angular acceleration (rad/s^2)");
+  this->addProperty("rot_jerk_max",rot_jerk_max_).doc("Max angular jerk (rad/s^3)");
+  this->addProperty("twist_timeout",twist_timeout_).doc("Stop if no TargetTwist is received during this time (s)");
+  this->addProperty("position_tolerance",position_tolerance_).doc("Position tolerance for TargetReached (m)");
+  this->addProperty("rotation_tolerance",rotation_tolerance_).doc("Rotation tolerance for TargetReached (rad)");
+
+  // Default params
+  vel_max_ = 0.1;
+  acc_max_ = 0.5;
+  jerk_max_ = 5.0;
+  rot_vel_max_ = 0.5;
+  rot_acc_max_ = 2.0;
+  rot_jerk_max_ = 20.0;
+  twist_timeout_ = 0.1;
+  position_tolerance_ = 0.001;
+  rotation_tolerance_ = 0.01;
+
+  // Match all properties (defined in the constructor)
+  // with the rosparams in the namespace :
+  // nameOfThisComponent/nameOftheProperty
+  // Equivalent to ros::param::get("CartOptCtrl/p_gains_");
+  rtt_ros_kdl_tools::getAllPropertiesFromROSParam(this);
+
+  reference_initialized_ = false;
+  twist_elapsed_ = 0.0;
+}
+
+bool OnlineTrajComp::configureHook(){
+  // Initialise the model, the internal solvers etc
+  if( ! arm_.init() ){
+    log(RTT::Error) << "Could not init chain utils !" << endlog();
+    return false;
+  }
+  // The number of joints
+  const int dof = arm_.getNrOfJoints();
+
+  // Resize the vectors
+  joint_position_in_.setZero(dof);
+  joint_velocity_in_.setZero(dof);
+
+  ee_frame_ = arm_.getSegmentName( arm_.getNrOfSegments() - 1 );
+
+  Eigen::Matrix<double,6,1> vel_max, acc_max, jerk_max;
+  vel_max << vel_max_, vel_max_, vel_max_, rot_vel_max_, rot_vel_max_, rot_vel_max_;
+  acc_max << acc_max_, acc_max_, acc_max_, rot_acc_max_, rot_acc_max_, rot_acc_max_;
+  jerk_max << jerk_max_, jerk_max_, jerk_max_, rot_jerk_max_, rot_jerk_max_, rot_jerk_max_;
+  if( ! otg_.setLimits(vel_max, acc_max, jerk_max) ){
+    log(RTT::Error) << "Velocity, acceleration and jerk limits must be positive" << endlog();
+    return false;
+  }
+
+  port_target_reached_out_.setDataSample(false);
+  return true;
+}
+
+bool OnlineTrajComp::startHook(){
+  // Restart from the robot pose
+  reference_initialized_ = false;
+  twist_elapsed_ = 0.0;
+  return true;
+}
+
+void OnlineTrajComp::updateHook(){
+  if(!reference_initialized_){
+    // Read the current state of the robot
+    RTT::FlowStatus fp = this->port_joint_position_in_.read(this->joint_position_in_);
+    RTT::FlowStatus fv = this->port_joint_velocity_in_.read(this->joint_velocity_in_);
+
+    // Return if not giving anything (might happend during startup)
+    if(fp == RTT::NoData || fv == RTT::NoData){
+      log(RTT::Error) << "Robot ports empty !" << endlog();
+      return;
+    }
+
+    arm_.setState(this->joint_position_in_,this->joint_velocity_in_);
+    arm_.updateModel();
+    otg_.reset(arm_.getSegmentPosition(ee_frame_));
+    reference_initialized_ = true;
+  }
+
+  const double dt = this->getPeriod();
+
+  // Only the last target counts, a new pose replaces a twist and vice versa
+  if(port_target_pose_in_.read(target_pose_in_) == RTT::NewData){
+    tf::poseMsgToKDL(target_pose_in_.pose, target_pose_);
+    otg_.setTargetPose(target_pose_);
+  }
+  if(port_target_twist_in_.read(target_twist_in_) == RTT::NewData){
+    tf::twistMsgToKDL(target_twist_in_, target_twist_);
+    otg_.setTargetTwist(target_twist_);
+    twist_elapsed_ = 0.0;
+  }else{
+    // The teleoperation stopped sending, brake down to rest
+    twist_elapsed_ += dt;
+    if(otg_.trackingTwist() && twist_elapsed_ > twist_timeout_)
+      otg_.setTargetTwist(KDL::Twist::Zero());
+  }
+
+  otg_.update(dt);
+
+  // Send point via ports
+  port_pnt_pos_out_.write(otg_.getPose());
+  port_pnt_vel_out_.write(otg_.getTwist());
+  port_pnt_acc_out_.write(otg_.getAcceleration());
+  port_target_reached_out_.write(otg_.targetReached(position_tolerance_, rotation_tolerance_));
+}
+
+void OnlineTrajComp::stopHook(){}
@@ -0,0 +1,116 @@
+#include "cart_opt_ctrl/online_traj_gen.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace{
+  // The braking curves are not used below this number of periods of error,
+  // their slope is infinite at zero and makes the discrete loop chatter
+  const double LINEAR_ZONE_PERIODS = 5.0;
+
+  inline double sign(double x){ return x < 0.0 ? -1.0 : 1.0; }
+
+  // Highest velocity from which the distance d can be stopped with bounded acceleration and jerk
+  inline double brakingVelocity(double d, double acc_max, double jerk_max){
+    if(d >= acc_max * acc_max * acc_max / (jerk_max * jerk_max)){
+      const double a2_j = acc_max * acc_max / jerk_max;
+      return -0.5 * a2_j + std::sqrt(0.25 * a2_j * a2_j + 2.0 * acc_max * d);
+    }
+    return std::cbrt(d * d * jerk_max);
+  }
+}
+
+OnlineTrajectoryGenerator::OnlineTrajectoryGenerator() : position_mode_(true)
+{
+  vel_max_.setConstant(0.1);
+  acc_max_.setConstant(0.5);
+  jerk_max_.setConstant(5.0);
+}
+
+bool OnlineTrajectoryGenerator::setLimits(const Eigen::Matrix<double,6,1>& vel_max,
+                                          const Eigen::Matrix<double,6,1>& acc_max,
+                                          const Eigen::Matrix<double,6,1>& jerk_max){
+  if((vel_max.array() <= 0.0).any() || (acc_max.array() <= 0.0).any() || (jerk_max.array() <= 0.0).any())
+    return false;
+  vel_max_ = vel_max;
+  acc_max_ = acc_max;
+  jerk_max_ = jerk_max;
+  return true;
+}
+
+void OnlineTrajectoryGenerator::reset(const KDL::Frame& pose, const KDL::Twist& vel, const KDL::Twist& acc){
+  pose_ = pose;
+  vel_ = vel;
+  acc_ = acc;
+  target_pose_ = pose;
+  target_vel_ = KDL::Twist::Zero();
+  position_mode_ = true;
+}
+
+void OnlineTrajectoryGenerator::setTargetPose(const KDL::Frame& target){
+  target_pose_ = target;
+  target_vel_ = KDL::Twist::Zero();
+  position_mode_ = true;
+}
+
+void OnlineTrajectoryGenerator::setTargetTwist(const KDL::Twist& target){
+  target_vel_ = target;
+  position_mode_ = false;
+}
+
+double OnlineTrajectoryGenerator::axisStep(bool position_mode, double error, double target_vel,
+                                           double vel_max, double acc_max, double jerk_max, double dt,
+                                           double& vel, double& acc){
+  // State once the acceleration is brought back to zero at full jerk
+  const double t = std::abs(acc) / jerk_max;
+  const double vel_pred = vel + 0.5 * acc * std::abs(acc) / jerk_max;
+  const double linear_gain = 1.0 / (LINEAR_ZONE_PERIODS * dt);
+
+  double vel_ref;
+  if(position_mode){
+    const double e = error - (vel * t + 0.5 * acc * t * t - sign(acc) * jerk_max * t * t * t / 6.0);
+    vel_ref = sign(e) * std::min(std::min(vel_max, brakingVelocity(std::abs(e), acc_max, jerk_max)),
+                                 std::abs(e) * linear_gain);
+  }else{
+    vel_ref = std::min(std::max(target_vel, -vel_max), vel_max);
+  }
+
+  const double dv = vel_ref - vel_pred;
+  const double acc_ref = sign(dv) * std::min(std::min(acc_max, std::sqrt(2.0 * jerk_max * std::abs(dv))),
+                                             std::abs(dv) * linear_gain);
+  const double jerk = std::min(std::max((acc_ref - acc) / dt, -jerk_max), jerk_max);
+
+  // Exact integration over the period with a constant jerk
+  const double dp = vel * dt + 0.5 * acc * dt * dt + jerk * dt * dt * dt / 6.0;
+  vel += acc * dt + 0.5 * jerk * dt * dt;
+  acc += jerk * dt;
+  return dp;
+}
+
+void OnlineTrajectoryGenerator::update(double dt){
+  if(dt <= 0.0)
+    return;
+
+  const KDL::Vector pos_err = target_pose_.p - pose_.p;
+  const KDL::Vector rot_err = KDL::diff(pose_.M, target_pose_.M);
+  KDL::Vector dp, dtheta;
+  for(int i=0; i<3; i++){
+    dp(i) = axisStep(position_mode_, pos_err(i), target_vel_.vel(i),
+                     vel_max_(i), acc_max_(i), jerk_max_(i), dt, vel_.vel(i), acc_.vel(i));
+    dtheta(i) = axisStep(position_mode_, rot_err(i), target_vel_.rot(i),
+                         vel_max_(i+3), acc_max_(i+3), jerk_max_(i+3), dt, vel_.rot(i), acc_.rot(i));
+  }
+
+  pose_.p += dp;
+  const double angle = dtheta.Norm();
+  if(angle > 1e-12)
+    pose_.M = KDL::Rotation::Rot2(dtheta / angle, angle) * pose_.M;
+}
+
+bool OnlineTrajectoryGenerator::targetReached(double position_tolerance, double rotation_tolerance) const{
+  if(!position_mode_)
+    return false;
+  return (target_pose_.p - pose_.p).Norm() <= position_tolerance
+      && KDL::diff(pose_.M, target_pose_.M).Norm() <= rotation_tolerance
+      && vel_.vel.Norm() <= position_tolerance
+      && vel_.rot.Norm() <= rotation_tolerance;
+}
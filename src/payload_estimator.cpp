@@ -0,0 +1,87 @@
+#include "cart_opt_ctrl/payload_estimator.hpp"
+#include <Eigen/Eigenvalues>
+#include <cmath>
+
+const int PayloadEstimator::NB_PARAMS;
+
+static inline Eigen::Matrix3d skew(const Eigen::Vector3d& v){
+  Eigen::Matrix3d s;
+  s <<     0, -v(2),  v(1),
+        v(2),     0, -v(0),
+       -v(1),  v(0),     0;
+  return s;
+}
+
+// I.v written as L(v).[Ixx, Ixy, Ixz, Iyy, Iyz, Izz]
+static inline Eigen::Matrix<double,3,6> inertiaMap(const Eigen::Vector3d& v){
+  Eigen::Matrix<double,3,6> l;
+  l << v(0), v(1), v(2),    0,    0,    0,
+          0, v(0),    0, v(1), v(2),    0,
+          0,    0, v(0),    0, v(1), v(2);
+  return l;
+}
+
+PayloadEstimator::PayloadEstimator() : forgetting_factor_(1.0)
+{
+  reset(1e3);
+}
+
+void PayloadEstimator::reset(double initial_covariance){
+  phi_.setZero();
+  P_.setIdentity();
+  P_ *= initial_covariance;
+  max_covariance_trace_ = P_.trace();
+  nb_updates_ = 0;
+}
+
+void PayloadEstimator::computeRegressor(const Eigen::Vector3d& acc, const Eigen::Vector3d& omega,
+                                        const Eigen::Vector3d& domega, const Eigen::Vector3d& gravity, Regressor& A){
+  // f = m.(a - g) + dw x mc + w x (w x mc)
+  // t = I.dw + w x (I.w) + mc x (a - g)
+  const Eigen::Vector3d acc_g = acc - gravity;
+  const Eigen::Matrix3d omega_x = skew(omega);
+  A.setZero();
+  A.block<3,1>(0,0) = acc_g;
+  A.block<3,3>(0,1) = skew(domega) + omega_x * omega_x;
+  A.block<3,3>(3,1) = -skew(acc_g);
+  A.block<3,6>(3,4) = inertiaMap(domega) + omega_x * inertiaMap(omega);
+}
+
+void PayloadEstimator::projectPhysical(double* p, double min_eigenvalue){
+  Eigen::Matrix3d inertia;
+  inertia << p[4], p[5], p[6],
+             p[5], p[7], p[8],
+             p[6], p[8], p[9];
+  Eigen::Matrix4d pseudo;
+  pseudo.topLeftCorner<3,3>() = 0.5 * inertia.trace() * Eigen::Matrix3d::Identity() - inertia;
+  pseudo.topRightCorner<3,1>() << p[1], p[2], p[3];
+  pseudo.bottomLeftCorner<1,3>() << p[1], p[2], p[3];
+  pseudo(3,3) = p[0];
+  const Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> eigen(pseudo);
+  pseudo = eigen.eigenvectors() * eigen.eigenvalues().cwiseMax(min_eigenvalue).asDiagonal() * eigen.eigenvectors().transpose();
+  const Eigen::Matrix3d sigma = pseudo.topLeftCorner<3,3>();
+  inertia = sigma.trace() * Eigen::Matrix3d::Identity() - sigma;
+  p[0] = pseudo(3,3);
+  p[1] = pseudo(0,3); p[2] = pseudo(1,3); p[3] = pseudo(2,3);
+  p[4] = inertia(0,0); p[5] = inertia(0,1); p[6] = inertia(0,2);
+  p[7] = inertia(1,1); p[8] = inertia(1,2); p[9] = inertia(2,2);
+}
+
+bool PayloadEstimator::isPhysical(const double* p){
+  const double mass = p[0];
+  if(mass <= 0.0){
+    for(int i=0; i<NB_PARAMS; i++)
+      if(std::abs(p[i]) > 1e-12)
+        return false;
+    return true;
+  }
+  // Inertia about the center of mass
+  const Eigen::Vector3d c = Eigen::Vector3d(p[1], p[2], p[3]) / mass;
+  Eigen::Matrix3d inertia;
+  inertia << p[4], p[5], p[6],
+             p[5], p[7], p[8],
+             p[6], p[8], p[9];
+  inertia -= mass * (c.squaredNorm() * Eigen::Matrix3d::Identity() - c * c.transpose());
+  const Eigen::Vector3d moments = Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d>(inertia, Eigen::EigenvaluesOnly).eigenvalues();
+  return moments[0] >= 0.0 && moments[0] + moments[1] >= moments[2];
+}
@@ -0,0 +1,155 @@
+#include "cart_opt_ctrl/payload_ident_comp.hpp"
+
+using namespace RTT;
+
+PayloadIdentComp::PayloadIdentComp(const std::string& name) : RTT::TaskContext(name)
+{
+  this->addPort("JointPosition",port_joint_position_in_);
+  this->addPort("JointVelocity",port_joint_velocity_in_);
+  this->addPort("JointExternalTorque",port_joint_ext_torque_in_);
+  this->addPort("FTData",port_ftdata_);
+  this->addPort("PayloadParameters",port_payload_out_);
+
+  this->addProperty("frame_of_interest",ee_frame_).doc("The frame the payload is attached to (FT sensor frame)");
+  this->addProperty("use_ft_data",use_ft_data_).doc("Identify from the FT sensor wrench");
+  this->addProperty("use_torque_residuals",use_torque_residuals_).doc("Identify from the external joint torques");
+  this->addProperty("forgetting_factor",forgetting_factor_).doc("RLS forgetting factor, 1.0 for no forgetting");
+  this->addProperty("initial_covariance",initial_covariance_).doc("RLS initial covariance");
+  this->addProperty("acc_filter_gain",acc_filter_gain_).doc("Low pass gain on the differentiated joint accelerations");
+  this->addProperty("convergence_trace",convergence_trace_).doc("Trace of the RLS covariance of the mass and first moment, then of the inertia, under which they are published");
+  this->addProperty("ft_sign",ft_sign_).doc("1 if the FT sensor measures the wrench applied on the payload, -1 otherwise");
+
+  this->addOperation("resetEstimate",&PayloadIdentComp::resetEstimate,this,RTT::OwnThread);
+}
+
+void PayloadIdentComp::resetEstimate(){
+  estimator_.reset(initial_covariance_);
+  has_previous_state_ = false;
+}
+
+bool PayloadIdentComp::configureHook(){
+  // Initialise the model, the internal solvers etc
+  if( ! arm_.init() ){
+    log(RTT::Error) << "Could not init chain utils !" << endlog();
+    return false;
+  }
+  // The number of joints
+  const int dof = arm_.getNrOfJoints();
+
+  // Default params
+  ee_frame_ = arm_.getSegmentName( arm_.getNrOfSegments() - 1 );
+  use_ft_data_ = true;
+  use_torque_residuals_ = false;
+  forgetting_factor_ = 0.999;
+  initial_covariance_ = 1e3;
+  acc_filter_gain_ = 0.1;
+  ft_sign_ = 1.0;
+  convergence_trace_ = 1e-2;
+
+  // Match all properties (defined in the constructor)
+  // with the rosparams in the namespace :
+  // nameOfThisComponent/nameOftheProperty
+  rtt_ros_kdl_tools::getAllPropertiesFromROSParam(this);
+
+  if(this->getPeriod() <= 0.0){
+    log(RTT::Error) << "PayloadIdentComp needs a periodic activity to differentiate the velocities" << endlog();
+    return false;
+  }
+
+  // Resize the vectors
+  joint_position_in_.setZero(dof);
+  joint_velocity_in_.setZero(dof);
+  joint_velocity_prev_.setZero(dof);
+  joint_acc_.setZero(dof);
+  joint_ext_torque_in_.setZero(dof);
+  torque_regressor_.setZero(dof,PayloadEstimator::NB_PARAMS);
+  payload_out_.setZero(PayloadEstimator::NB_PARAMS);
+  port_payload_out_.setDataSample(payload_out_);
+
+  estimator_.setForgettingFactor(forgetting_factor_);
+  resetEstimate();
+  return true;
+}
+
+bool PayloadIdentComp::startHook(){
+  has_previous_state_ = false;
+  joint_acc_.setZero();
+  return true;
+}
+
+void PayloadIdentComp::updateHook(){
+  // Read the current state of the robot
+  RTT::FlowStatus fp = this->port_joint_position_in_.read(this->joint_position_in_);
+  RTT::FlowStatus fv = this->port_joint_velocity_in_.read(this->joint_velocity_in_);
+
+  // Return if not giving anything (might happend during startup)
+  if(fp == RTT::NoData || fv == RTT::NoData)
+    return;
+
+  // Joint accelerations by filtered finite differences
+  if(!has_previous_state_){
+    joint_velocity_prev_ = joint_velocity_in_;
+    has_previous_state_ = true;
+    return;
+  }
+  joint_acc_ += acc_filter_gain_ * ((joint_velocity_in_ - joint_velocity_prev_) / this->getPeriod() - joint_acc_);
+  joint_velocity_prev_ = joint_velocity_in_;
+
+  // Feed the internal model
+  arm_.setState(this->joint_position_in_,this->joint_velocity_in_);
+  arm_.updateModel();
+
+  // Kinematics of the payload frame, in the base frame
+  const KDL::Frame& X = arm_.getSegmentPosition(ee_frame_);
+  const KDL::Jacobian& J = arm_.getSegmentJacobian(ee_frame_);
+  tf::twistKDLToEigen(arm_.getSegmentVelocity(ee_frame_),vel_base_);
+  tf::twistKDLToEigen(arm_.getSegmentJdotQdot(ee_frame_),acc_base_);
+  acc_base_.noalias() += J.data * joint_acc_;
+  for(int i=0; i<3; i++)
+    for(int j=0; j<3; j++)
+      rot_(i,j) = X.M(i,j);
+
+  // Then in the payload frame
+  acc_.noalias() = rot_.transpose() * acc_base_.head<3>();
+  omega_.noalias() = rot_.transpose() * vel_base_.tail<3>();
+  domega_.noalias() = rot_.transpose() * acc_base_.tail<3>();
+  gravity_.noalias() = rot_.transpose() * Eigen::Vector3d(0.0,0.0,-9.81);
+  PayloadEstimator::computeRegressor(acc_,omega_,domega_,gravity_,regressor_);
+
+  // Wrench measured at the sensor
+  if(use_ft_data_ && port_ftdata_.read(ft_msg_) == RTT::NewData){
+    wrench_ << ft_msg_.wrench.force.x, ft_msg_.wrench.force.y, ft_msg_.wrench.force.z,
+               ft_msg_.wrench.torque.x, ft_msg_.wrench.torque.y, ft_msg_.wrench.torque.z;
+    wrench_ *= ft_sign_;
+    estimator_.update(regressor_,wrench_);
+  }
+
+  // External torques caused by the payload, tau_ext = - J^T.w expressed in the base frame
+  if(use_torque_residuals_ && port_joint_ext_torque_in_.read(joint_ext_torque_in_) == RTT::NewData){
+    regressor_base_.topRows<3>().noalias() = rot_ * regressor_.topRows<3>();
+    regressor_base_.bottomRows<3>().noalias() = rot_ * regressor_.bottomRows<3>();
+    torque_regressor_.noalias() = - J.data.transpose() * regressor_base_;
+    estimator_.update(torque_regressor_,joint_ext_torque_in_);
+  }
+
+  // Publish the parts of the estimate that converged
+  const PayloadEstimator::Parameters& estimate = estimator_.getParameters();
+  const Eigen::Matrix<double,PayloadEstimator::NB_PARAMS,PayloadEstimator::NB_PARAMS>& P = estimator_.getCovariance();
+  if(P.topLeftCorner<4,4>().trace() > convergence_trace_)
+    return;
+  payload_out_.head<4>() = estimate.head<4>();
+  if(P.bottomRightCorner<6,6>().trace() <= convergence_trace_)
+    payload_out_.tail<6>() = estimate.tail<6>();
+  else if(estimate(0) > 0.0){
+    // Point mass at the center of mass, I = (|h|^2.Id - h.h^T) / m with h = m.c
+    const Eigen::Vector3d h = estimate.segment<3>(1);
+    const Eigen::Matrix3d inertia = (h.squaredNorm() * Eigen::Matrix3d::Identity() - h * h.transpose()) / estimate(0);
+    payload_out_.tail<6>() << inertia(0,0), inertia(0,1), inertia(0,2), inertia(1,1), inertia(1,2), inertia(2,2);
+  }
+  // Positive mass and positive pseudo inertia, as CartOptCtrl expects
+  if(!PayloadEstimator::isPhysical(payload_out_.data()))
+    PayloadEstimator::projectPhysical(payload_out_.data(), 1e-6);
+  port_payload_out_.write(payload_out_);
+}
+
+void PayloadIdentComp::stopHook(){}
@@ -0,0 +1,117 @@
+#include "cart_opt_ctrl/pipeline_comp.hpp"
+#include <cmath>
+
+using namespace RTT;
+
+PipelineComp::PipelineComp(const std::string& name) : RTT::TaskContext(name)
+{
+  this->addPort("PipelineStats",port_stats_out_);
+
+  this->addProperty("trajectory_component",trajectory_component_).doc("Peer that computes the setpoints, run first");
+  this->addProperty("controller_component",controller_component_).doc("Peer that computes the torques, run second");
+  this->addProperty("telemetry_component",telemetry_component_).doc("Optional peer run last, empty to disable");
+  this->addProperty("stats_window",stats_window_).doc("Number of cycles over which PipelineStats is computed");
+
+  // Default params
+  trajectory_component_ = "KDLTrajCompute";
+  controller_component_ = "CartOptCtrl";
+  telemetry_component_ = "";
+  stats_window_ = 1000;
+
+  // Match all properties (defined in the constructor)
+  // with the rosparams in the namespace :
+  // nameOfThisComponent/nameOftheProperty
+  // Equivalent to ros::param::get("CartOptCtrl/p_gains_");
+  rtt_ros_kdl_tools::getAllPropertiesFromROSParam(this);
+
+  trajectory_ = controller_ = telemetry_ = 0;
+}
+
+RTT::TaskContext* PipelineComp::getStage(const std::string& name){
+  RTT::TaskContext* stage = this->getPeer(name);
+  if(!stage){
+    log(RTT::Error) << name << " is not a peer of " << this->getName() << endlog();
+    return 0;
+  }
+  // Only a slave activity is executed by update(), a periodic one would run on its own
+  if(!dynamic_cast<RTT::extras::SlaveActivity*>(stage->getActivity())){
+    log(RTT::Error) << name << " needs a slave activity of " << this->getName() << endlog();
+    return 0;
+  }
+  return stage;
+}
+
+bool PipelineComp::configureHook(){
+  trajectory_ = getStage(trajectory_component_);
+  controller_ = getStage(controller_component_);
+  if(!trajectory_ || !controller_)
+    return false;
+
+  telemetry_ = 0;
+  if(!telemetry_component_.empty() && !(telemetry_ = getStage(telemetry_component_)))
+    return false;
+
+  if(stats_window_ <= 0){
+    log(RTT::Error) << "stats_window must be positive" << endlog();
+    return false;
+  }
+  stats_.setZero(PipelineStats::SIZE);
+  stats_out_.setZero(PipelineStats::SIZE);
+  port_stats_out_.setDataSample(stats_out_);
+  return true;
+}
+
+bool PipelineComp::startHook(){
+  resetStats();
+  last_start_ = 0;
+  return true;
+}
+
+void PipelineComp::resetStats(){
+  stats_.setZero();
+  stats_count_ = 0;
+  jitter_count_ = 0;
+}
+
+void PipelineComp::updateHook(){
+  RTT::os::TimeService* time_service = RTT::os::TimeService::Instance();
+  const RTT::os::TimeService::nsecs start = time_service->getNSecs();
+  const double period = this->getPeriod();
+
+  // Fixed order : setpoint, torque, telemetry
+  trajectory_->update();
+  const RTT::os::TimeService::nsecs trajectory_end = time_service->getNSecs();
+  controller_->update();
+  const RTT::os::TimeService::nsecs controller_end = time_service->getNSecs();
+  if(telemetry_)
+    telemetry_->update();
+
+  // Stats, the jitter needs the previous start
+  const double latency = RTT::os::TimeService::nsecs2Seconds(controller_end - start);
+  stats_(PipelineStats::LATENCY_MEAN) += latency;
+  stats_(PipelineStats::LATENCY_MAX) = std::max(stats_(PipelineStats::LATENCY_MAX), latency);
+  if(last_start_ > 0){
+    const double jitter = std::abs(RTT::os::TimeService::nsecs2Seconds(start - last_start_) - period);
+    stats_(PipelineStats::JITTER_MEAN) += jitter;
+    stats_(PipelineStats::JITTER_MAX) = std::max(stats_(PipelineStats::JITTER_MAX), jitter);
+    ++jitter_count_;
+  }
+  stats_(PipelineStats::TRAJECTORY_MEAN) += RTT::os::TimeService::nsecs2Seconds(trajectory_end - start);
+  stats_(PipelineStats::CONTROLLER_MEAN) += RTT::os::TimeService::nsecs2Seconds(controller_end - trajectory_end);
+  if(RTT::os::TimeService::nsecs2Seconds(time_service->getNSecs() - start) > period)
+    stats_(PipelineStats::OVERRUNS) += 1.0;
+  last_start_ = start;
+
+  if(++stats_count_ >= stats_window_){
+    stats_out_ = stats_;
+    stats_out_(PipelineStats::LATENCY_MEAN) /= stats_count_;
+    stats_out_(PipelineStats::JITTER_MEAN) /= std::max(1, jitter_count_);
+    stats_out_(PipelineStats::TRAJECTORY_MEAN) /= stats_count_;
+    stats_out_(PipelineStats::CONTROLLER_MEAN) /= stats_count_;
+    port_stats_out_.write(stats_out_);
+    log(RTT::Debug) << "Pipeline stats : " << stats_out_.transpose() << endlog();
+    resetStats();
+  }
+}
+
+void PipelineComp::stopHook(){}
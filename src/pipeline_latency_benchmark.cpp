@@ -0,0 +1,138 @@
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Setpoint to torque latency and period jitter of the two deployments of run.ops, with plain threads
+// standing for the activities and busy loops for the stages :
+//   separate : KDLTrajCompute and CartOptCtrl on their own periodic activity, the setpoint goes through
+//              a data connection and is used at the next controller cycle
+//   pipeline : PipelineComp runs both in order from one periodic activity
+// The latency is measured as PipelineStats does, from the start of the trajectory cycle that computed the
+// setpoint to the end of the controller cycle that used it. SCHED_FIFO is used when it is permitted.
+// Usage : pipeline_latency_benchmark [nb_cycles] [trajectory_us] [controller_us] [period_us]
+namespace{
+  typedef long long nsecs;
+
+  nsecs now(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<nsecs>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+  }
+
+  void sleepUntil(nsecs t){
+    timespec ts;
+    ts.tv_sec = t / 1000000000LL;
+    ts.tv_nsec = t % 1000000000LL;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) != 0){}
+  }
+
+  void work(nsecs duration){
+    const nsecs end = now() + duration;
+    while(now() < end){}
+  }
+
+  bool setRealtime(int priority){
+    sched_param param;
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+  }
+
+  struct Stats{
+    std::vector<double> latency, jitter;
+
+    void print(const char* name) const{
+      std::vector<double> l(latency), j(jitter);
+      std::sort(l.begin(), l.end());
+      std::sort(j.begin(), j.end());
+      double lm = 0.0, jm = 0.0;
+      for(unsigned int i=0; i<l.size(); i++) lm += l[i];
+      for(unsigned int i=0; i<j.size(); i++) jm += j[i];
+      std::printf("  %-9s latency mean %7.1f us, p99 %7.1f us, max %7.1f us | jitter mean %6.1f us, p99 %6.1f us, max %6.1f us\n",
+                  name, 1e-3 * lm / l.size(), 1e-3 * l[l.size() * 99 / 100], 1e-3 * l.back(),
+                  1e-3 * jm / j.size(), 1e-3 * j[j.size() * 99 / 100], 1e-3 * j.back());
+    }
+  };
+
+  // Controller cycle, last is the start of the previous one
+  void controllerCycle(nsecs start, nsecs& last, nsecs period, nsecs setpoint_time, nsecs controller, Stats& stats){
+    if(last > 0)
+      stats.jitter.push_back(std::abs(static_cast<double>(start - last - period)));
+    last = start;
+    work(controller);
+    if(setpoint_time > 0)
+      stats.latency.push_back(static_cast<double>(now() - setpoint_time));
+  }
+}
+
+int main(int argc, char** argv){
+  const int nb_cycles = argc > 1 ? std::atoi(argv[1]) : 10000;
+  const nsecs trajectory = 1000LL * (argc > 2 ? std::atoi(argv[2]) : 20);
+  const nsecs controller = 1000LL * (argc > 3 ? std::atoi(argv[3]) : 150);
+  const nsecs period = 1000LL * (argc > 4 ? std::atoi(argv[4]) : 1000);
+  if(nb_cycles < 100 || trajectory + controller >= period){
+    std::fprintf(stderr, "Usage : pipeline_latency_benchmark [nb_cycles >= 100] [trajectory_us] [controller_us] [period_us > stages]\n");
+    return 1;
+  }
+  std::atomic<int> not_realtime(0);
+
+  // Separate activities with the same period, their phase depends on when the deployer created them :
+  // the cycles are split between NB_PHASES phases over the period
+  const int NB_PHASES = 8;
+  Stats separate;
+  for(int k=0; k<NB_PHASES; k++){
+    // Start time of the trajectory cycle of the last setpoint, the data connection
+    std::atomic<nsecs> setpoint_time(0);
+    const nsecs start = now() + 10 * period;
+    const nsecs phase = k * period / NB_PHASES;
+    std::thread trajectory_thread([&](){
+      not_realtime += !setRealtime(60);
+      for(int n=0; n<nb_cycles / NB_PHASES; n++){
+        const nsecs cycle_start = start + n * period;
+        sleepUntil(cycle_start);
+        const nsecs wake = now();
+        work(trajectory);
+        setpoint_time = wake;
+      }
+    });
+    std::thread controller_thread([&](){
+      not_realtime += !setRealtime(50);
+      nsecs last = 0;
+      for(int n=0; n<nb_cycles / NB_PHASES; n++){
+        sleepUntil(start + phase + n * period);
+        controllerCycle(now(), last, period, setpoint_time, controller, separate);
+      }
+    });
+    trajectory_thread.join();
+    controller_thread.join();
+  }
+
+  // Pipeline, the controller uses the setpoint of the same cycle
+  Stats pipeline;
+  {
+    std::thread pipeline_thread([&](){
+      not_realtime += !setRealtime(60);
+      const nsecs start = now() + 10 * period;
+      nsecs last = 0;
+      for(int n=0; n<nb_cycles; n++){
+        sleepUntil(start + n * period);
+        const nsecs cycle_start = now();
+        work(trajectory);
+        controllerCycle(now(), last, period, cycle_start, controller, pipeline);
+      }
+    });
+    pipeline_thread.join();
+  }
+
+  std::printf("%d cycles of %.0f us, stages of %.0f us and %.0f us%s\n", nb_cycles, 1e-3 * period, 1e-3 * trajectory,
+              1e-3 * controller, not_realtime == 0 ? ", SCHED_FIFO" : ", SCHED_OTHER (no permission for SCHED_FIFO)");
+  separate.print("separate");
+  pipeline.print("pipeline");
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include <cart_opt_ctrl/qp_record.hpp>
+#include <cart_opt_ctrl/qp_options.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Replays the QPs recorded by CartOptCtrl (qp_record_size, qp_record_file) through the qpOASES
+// option combinations, the same way the controller calls the solver (init, then hotstart until a failure).
+// A problem counts as solved if qpOASES succeeds and the solution violates no bound or row by more than 1e-6.
+// Prints the success rate and the p50/p99/max solve times of each combination and writes the best one
+// (most problems solved, then lowest p99) in the yaml loaded by CartOptCtrl.
+// Usage : qp_option_tuner record_file [output_yaml]
+namespace{
+  struct Result{
+    QPSolverOptions options;
+    int solved;
+    double p50, p99, max;
+  };
+
+  double maxViolation(const QPRecord& record, int i, const std::vector<double>& x, std::vector<double>& Ax){
+    const int nv = record.numberOfVariables(), nc = record.numberOfConstraints();
+    double violation = 0.0;
+    for(int j=0; j<nv; j++)
+      violation = std::max(violation, std::max(record.lb(i)[j] - x[j], x[j] - record.ub(i)[j]));
+    for(int r=0; r<nc; r++){
+      Ax[r] = 0.0;
+      for(int j=0; j<nv; j++)
+        Ax[r] += record.A(i)[r*nv + j] * x[j];
+      violation = std::max(violation, std::max(record.lbA(i)[r] - Ax[r], Ax[r] - record.ubA(i)[r]) / (1.0 + std::abs(Ax[r])));
+    }
+    return violation;
+  }
+
+  Result replay(const QPRecord& record, const QPSolverOptions& solver_options){
+    const int nv = record.numberOfVariables(), nc = record.numberOfConstraints();
+    qpOASES::SQProblem solver(nv, nc, qpOASES::HST_POSDEF);
+    qpOASES::Options options;
+    solver_options.toOptions(options);
+    solver.setOptions(options);
+    solver.setPrintLevel(qpOASES::PL_NONE);
+
+    Result result;
+    result.options = solver_options;
+    result.solved = 0;
+    std::vector<double> times, x(nv), Ax(nc);
+    times.reserve(record.size());
+    bool initialized = false;
+    for(int i=0; i<record.size(); i++){
+      int nWSR = 1e6;
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      qpOASES::returnValue ret;
+      if(!initialized)
+        ret = solver.init(record.H(i), record.g(i), record.A(i), record.lb(i), record.ub(i), record.lbA(i), record.ubA(i), nWSR);
+      else
+        ret = solver.hotstart(record.H(i), record.g(i), record.A(i), record.lb(i), record.ub(i), record.lbA(i), record.ubA(i), nWSR);
+      times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+      initialized = ret == qpOASES::SUCCESSFUL_RETURN;
+      if(!initialized)
+        continue;
+      solver.getPrimalSolution(x.data());
+      if(maxViolation(record, i, x, Ax) <= 1e-6)
+        ++result.solved;
+    }
+
+    std::sort(times.begin(), times.end());
+    result.p50 = times[times.size() / 2];
+    result.p99 = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+    result.max = times.back();
+    return result;
+  }
+
+  bool better(const Result& a, const Result& b){
+    if(a.solved != b.solved)
+      return a.solved > b.solved;
+    return a.p99 != b.p99 ? a.p99 < b.p99 : a.p50 < b.p50;
+  }
+}
+
+int main(int argc, char** argv){
+  if(argc < 2){
+    std::printf("Usage : qp_option_tuner record_file [output_yaml]\n");
+    return 1;
+  }
+  const std::string output = argc > 2 ? argv[2] : "qp_options.yaml";
+
+  QPRecord record;
+  if(!record.load(argv[1]) || record.size() == 0){
+    std::printf("Could not load any problem from %s\n", argv[1]);
+    return 1;
+  }
+  std::printf("%d problems, %d variables, %d constraints\n", record.size(), record.numberOfVariables(), record.numberOfConstraints());
+
+  const char* presets[] = {"MPC", "Default", "Reliable"};
+  const double tolerances[] = {0.0, 1e-9, 1e-6};
+  std::vector<Result> results;
+  QPSolverOptions candidate;
+  for(int p=0; p<3; p++)
+    for(int flip=0; flip<2; flip++)
+      for(int ramp=0; ramp<2; ramp++)
+        for(int far=0; far<2; far++)
+          for(int reg=0; reg<2; reg++)
+            for(int t=0; t<3; t++){
+              candidate.preset = presets[p];
+              candidate.flipping_bounds = flip;
+              candidate.ramping = ramp;
+              candidate.far_bounds = far;
+              candidate.regularisation = reg;
+              candidate.termination_tolerance = tolerances[t];
+              results.push_back(replay(record, candidate));
+            }
+
+  // The options used so far, as a reference
+  results.push_back(replay(record, QPSolverOptions()));
+  const Result current = results.back();
+
+  std::sort(results.begin(), results.end(), better);
+  std::printf("%-50s %8s %10s %10s %10s\n", "options", "success", "p50 (us)", "p99 (us)", "max (us)");
+  for(unsigned int i=0; i<results.size(); i++)
+    std::printf("%-50s %7.2f%% %10.1f %10.1f %10.1f\n", results[i].options.toString().c_str(),
+                100.0 * results[i].solved / record.size(), 1e6 * results[i].p50, 1e6 * results[i].p99, 1e6 * results[i].max);
+
+  const Result& best = results.front();
+  std::printf("Current : %s, %.2f%%, p99 %.1f us\nBest : %s, %.2f%%, p99 %.1f us\n",
+              current.options.toString().c_str(), 100.0 * current.solved / record.size(), 1e6 * current.p99,
+              best.options.toString().c_str(), 100.0 * best.solved / record.size(), 1e6 * best.p99);
+
+  char comment[256];
+  std::snprintf(comment, sizeof(comment), "qp_option_tuner on %s : %d problems, %.2f%% solved, p50 %.1f us, p99 %.1f us, max %.1f us",
+                argv[1], record.size(), 100.0 * best.solved / record.size(), 1e6 * best.p50, 1e6 * best.p99, 1e6 * best.max);
+  if(!best.options.writeYAML(output, comment)){
+    std::printf("Could not write %s\n", output.c_str());
+    return 1;
+  }
+  std::printf("Options written to %s\n", output.c_str());
+  return 0;
+}
@@ -0,0 +1,71 @@
+#include "cart_opt_ctrl/qp_options.hpp"
+#include <ros/ros.h>
+#include <cstdio>
+#include <sstream>
+
+namespace
+{
+  void setFlag(int flag, qpOASES::BooleanType& option){
+    if(flag >= 0)
+      option = flag > 0 ? qpOASES::BT_TRUE : qpOASES::BT_FALSE;
+  }
+}
+
+// Defaults are the options CartOptCtrl always used
+QPSolverOptions::QPSolverOptions() : preset("MPC"), flipping_bounds(-1), ramping(-1), far_bounds(-1),
+                                     regularisation(false), equalities(true), termination_tolerance(0.0)
+{
+}
+
+void QPSolverOptions::getFromROSParam(const std::string& ns){
+  ros::param::get(ns + "/preset", preset);
+  ros::param::get(ns + "/enable_flipping_bounds", flipping_bounds);
+  ros::param::get(ns + "/enable_ramping", ramping);
+  ros::param::get(ns + "/enable_far_bounds", far_bounds);
+  ros::param::get(ns + "/enable_regularisation", regularisation);
+  ros::param::get(ns + "/enable_equalities", equalities);
+  ros::param::get(ns + "/termination_tolerance", termination_tolerance);
+}
+
+bool QPSolverOptions::toOptions(qpOASES::Options& options) const{
+  if(preset == "MPC")
+    options.setToMPC();
+  else if(preset == "Default")
+    options.setToDefault();
+  else if(preset == "Reliable")
+    options.setToReliable();
+  else
+    return false;
+  setFlag(flipping_bounds, options.enableFlippingBounds);
+  setFlag(ramping, options.enableRamping);
+  setFlag(far_bounds, options.enableFarBounds);
+  // The hessian type is given to the solver, the automatic regularisation is not needed
+  options.enableRegularisation = regularisation ? qpOASES::BT_TRUE : qpOASES::BT_FALSE;
+  // Equalities are always treated as active constraints
+  options.enableEqualities = equalities ? qpOASES::BT_TRUE : qpOASES::BT_FALSE;
+  if(termination_tolerance > 0.0)
+    options.terminationTolerance = termination_tolerance;
+  return true;
+}
+
+bool QPSolverOptions::writeYAML(const std::string& file, const std::string& comment) const{
+  FILE* f = std::fopen(file.c_str(), "w");
+  if(!f)
+    return false;
+  std::fprintf(f, "# %s\n", comment.c_str());
+  std::fprintf(f, "preset : \"%s\"\n", preset.c_str());
+  std::fprintf(f, "enable_flipping_bounds : %d\n", flipping_bounds);
+  std::fprintf(f, "enable_ramping : %d\n", ramping);
+  std::fprintf(f, "enable_far_bounds : %d\n", far_bounds);
+  std::fprintf(f, "enable_regularisation : %s\n", regularisation ? "true" : "false");
+  std::fprintf(f, "enable_equalities : %s\n", equalities ? "true" : "false");
+  std::fprintf(f, "termination_tolerance : %g\n", termination_tolerance);
+  return std::fclose(f) == 0;
+}
+
+std::string QPSolverOptions::toString() const{
+  std::ostringstream s;
+  s << preset << " flip " << flipping_bounds << " ramp " << ramping << " far " << far_bounds
+    << " reg " << regularisation << " tol " << termination_tolerance;
+  return s.str();
+}
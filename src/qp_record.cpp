@@ -0,0 +1,74 @@
+#include "cart_opt_ctrl/qp_record.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+namespace
+{
+  const char MAGIC[4] = {'C','Q','P','R'};
+}
+
+QPRecord::QPRecord() : nv_(0), nc_(0), capacity_(0), problem_size_(0), first_(0), count_(0)
+{
+}
+
+void QPRecord::configure(int nv, int nc, int capacity){
+  nv_ = nv;
+  nc_ = nc;
+  capacity_ = std::max(0, capacity);
+  problem_size_ = nv*nv + 3*nv + nc*nv + 2*nc;
+  data_.assign(capacity_ * problem_size_, 0.0);
+  clear();
+}
+
+void QPRecord::clear(){
+  first_ = 0;
+  count_ = 0;
+}
+
+void QPRecord::push(const double* H, const double* g, const double* A, const double* lb, const double* ub, const double* lbA, const double* ubA){
+  if(capacity_ == 0)
+    return;
+  // Overwrites the oldest problem once full
+  double* p = data_.data() + ((first_ + count_) % capacity_) * problem_size_;
+  if(count_ < capacity_)
+    ++count_;
+  else
+    first_ = (first_ + 1) % capacity_;
+  std::memcpy(p, H, nv_*nv_*sizeof(double)); p += nv_*nv_;
+  std::memcpy(p, g, nv_*sizeof(double)); p += nv_;
+  std::memcpy(p, lb, nv_*sizeof(double)); p += nv_;
+  std::memcpy(p, ub, nv_*sizeof(double)); p += nv_;
+  std::memcpy(p, A, nc_*nv_*sizeof(double)); p += nc_*nv_;
+  std::memcpy(p, lbA, nc_*sizeof(double)); p += nc_;
+  std::memcpy(p, ubA, nc_*sizeof(double));
+}
+
+bool QPRecord::save(const std::string& file) const{
+  FILE* f = std::fopen(file.c_str(), "wb");
+  if(!f)
+    return false;
+  const int32_t header[3] = {nv_, nc_, count_};
+  bool ok = std::fwrite(MAGIC, 1, 4, f) == 4 && std::fwrite(header, sizeof(int32_t), 3, f) == 3;
+  for(int i=0; ok && i<count_; i++)
+    ok = std::fwrite(problem(i), sizeof(double), problem_size_, f) == static_cast<size_t>(problem_size_);
+  return std::fclose(f) == 0 && ok;
+}
+
+bool QPRecord::load(const std::string& file){
+  FILE* f = std::fopen(file.c_str(), "rb");
+  if(!f)
+    return false;
+  char magic[4];
+  int32_t header[3];
+  bool ok = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, MAGIC, 4) == 0
+            && std::fread(header, sizeof(int32_t), 3, f) == 3 && header[0] > 0 && header[1] >= 0 && header[2] >= 0;
+  if(ok){
+    configure(header[0], header[1], header[2]);
+    ok = std::fread(data_.data(), sizeof(double), data_.size(), f) == data_.size();
+    count_ = ok ? capacity_ : 0;
+  }
+  std::fclose(f);
+  return ok;
+}
@@ -0,0 +1,224 @@
+#include <cart_opt_ctrl/signed_distance_field.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+// Builds the signed distance field of the static cell for CartOptCtrl (see SignedDistanceField)
+// from a triangle mesh (.obj) or a point cloud (one "x y z" per line), both in the robot base frame.
+// The surface is rasterised, the cells that cannot be reached from the grid border are inside the obstacles,
+// then an exact euclidean distance transform gives the distance to the surface on both sides.
+// Usage : sdf_builder input.{obj,xyz} output.sdf [resolution (m), default 0.01] [padding (m), default 0.2]
+namespace{
+  typedef std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > Points;
+
+  bool loadObj(const std::string& file, Points& vertices, std::vector<Eigen::Vector3i>& triangles){
+    std::ifstream in(file.c_str());
+    if(!in)
+      return false;
+    std::string line;
+    while(std::getline(in, line)){
+      std::istringstream s(line);
+      std::string tag;
+      s >> tag;
+      if(tag == "v"){
+        Eigen::Vector3d v;
+        s >> v(0) >> v(1) >> v(2);
+        vertices.push_back(v);
+      }
+      else if(tag == "f"){
+        // Faces as "i", "i/t" or "i/t/n", polygons are split in a fan
+        std::vector<int> face;
+        std::string vertex;
+        while(s >> vertex)
+          face.push_back(std::atoi(vertex.c_str()) - 1);
+        for(unsigned int k=2; k<face.size(); k++)
+          triangles.push_back(Eigen::Vector3i(face[0], face[k-1], face[k]));
+      }
+    }
+    return !vertices.empty();
+  }
+
+  bool loadPointCloud(const std::string& file, Points& points){
+    std::ifstream in(file.c_str());
+    Eigen::Vector3d p;
+    while(in >> p(0) >> p(1) >> p(2))
+      points.push_back(p);
+    return !points.empty();
+  }
+
+  // Squared distance transform of a 1D sampled function (Felzenszwalb and Huttenlocher)
+  void distanceTransform1D(const double* f, double* d, int n, int* v, double* z){
+    int k = 0;
+    v[0] = 0;
+    z[0] = -std::numeric_limits<double>::infinity();
+    z[1] = std::numeric_limits<double>::infinity();
+    for(int q=1; q<n; q++){
+      double s = ((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]);
+      while(s <= z[k]){
+        --k;
+        s = ((f[q] + q*q) - (f[v[k]] + v[k]*v[k])) / (2*q - 2*v[k]);
+      }
+      ++k;
+      v[k] = q;
+      z[k] = s;
+      z[k+1] = std::numeric_limits<double>::infinity();
+    }
+    k = 0;
+    for(int q=0; q<n; q++){
+      while(z[k+1] < q)
+        ++k;
+      d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+  }
+
+  // Distance (in cells) from every cell to the nearest cell of the mask
+  void distanceTransform(const std::vector<char>& mask, const int size[3], std::vector<double>& distance){
+    const int n = std::max(size[0], std::max(size[1], size[2]));
+    const double far = 1e20;
+    std::vector<double> f(n), d(n), z(n+1);
+    std::vector<int> v(n);
+    distance.resize(mask.size());
+    for(size_t c=0; c<mask.size(); c++)
+      distance[c] = mask[c] ? 0.0 : far;
+    const int stride[3] = {1, size[0], size[0] * size[1]};
+    for(int axis=0; axis<3; axis++){
+      const int a1 = (axis + 1) % 3, a2 = (axis + 2) % 3;
+      for(int i2=0; i2<size[a2]; i2++)
+        for(int i1=0; i1<size[a1]; i1++){
+          const size_t base = size_t(i1) * stride[a1] + size_t(i2) * stride[a2];
+          for(int q=0; q<size[axis]; q++)
+            f[q] = distance[base + size_t(q) * stride[axis]];
+          distanceTransform1D(f.data(), d.data(), size[axis], v.data(), z.data());
+          for(int q=0; q<size[axis]; q++)
+            distance[base + size_t(q) * stride[axis]] = d[q];
+        }
+    }
+    for(size_t c=0; c<distance.size(); c++)
+      distance[c] = std::sqrt(distance[c]);
+  }
+}
+
+int main(int argc, char** argv){
+  if(argc < 3){
+    std::printf("Usage : sdf_builder input.{obj,xyz} output.sdf [resolution (m), default 0.01] [padding (m), default 0.2]\n");
+    return 1;
+  }
+  const std::string input = argv[1];
+  const double resolution = argc > 3 ? std::atof(argv[3]) : 0.01;
+  const double padding = argc > 4 ? std::atof(argv[4]) : 0.2;
+
+  Points points;
+  std::vector<Eigen::Vector3i> triangles;
+  const bool is_mesh = input.size() > 4 && input.substr(input.size() - 4) == ".obj";
+  if(resolution <= 0.0 || !(is_mesh ? loadObj(input, points, triangles) : loadPointCloud(input, points))){
+    std::printf("Could not load %s\n", input.c_str());
+    return 1;
+  }
+
+  // Grid around the input
+  Eigen::Vector3d lower = points[0], upper = points[0];
+  for(unsigned int k=0; k<points.size(); k++){
+    lower = lower.cwiseMin(points[k]);
+    upper = upper.cwiseMax(points[k]);
+  }
+  lower.array() -= padding;
+  upper.array() += padding;
+  int size[3];
+  for(int a=0; a<3; a++)
+    size[a] = std::max(2, static_cast<int>(std::ceil((upper(a) - lower(a)) / resolution)) + 1);
+  const size_t nb_cells = size_t(size[0]) * size[1] * size[2];
+  std::printf("%d x %d x %d cells (%.1f MB), %lu points, %lu triangles\n", size[0], size[1], size[2],
+              nb_cells * sizeof(float) / 1e6, points.size(), triangles.size());
+
+  // Surface cells, the triangles are sampled at half the resolution
+  std::vector<char> surface(nb_cells, 0);
+  struct Raster{
+    static void mark(const Eigen::Vector3d& p, const Eigen::Vector3d& lower, double resolution, const int size[3], std::vector<char>& surface){
+      int i[3];
+      for(int a=0; a<3; a++)
+        i[a] = std::max(0, std::min(size[a] - 1, static_cast<int>(std::floor((p(a) - lower(a)) / resolution + 0.5))));
+      surface[i[0] + size_t(size[0]) * (i[1] + size_t(size[1]) * i[2])] = 1;
+    }
+  };
+  for(unsigned int k=0; k<points.size(); k++)
+    Raster::mark(points[k], lower, resolution, size, surface);
+  for(unsigned int t=0; t<triangles.size(); t++){
+    const Eigen::Vector3d& a = points[triangles[t](0)];
+    const Eigen::Vector3d& b = points[triangles[t](1)];
+    const Eigen::Vector3d& c = points[triangles[t](2)];
+    const int steps = std::max(1, static_cast<int>(std::ceil(2.0 * std::max((b - a).norm(), (c - a).norm()) / resolution)));
+    for(int i=0; i<=steps; i++)
+      for(int j=0; i+j<=steps; j++)
+        Raster::mark(a + (b - a) * double(i) / steps + (c - a) * double(j) / steps, lower, resolution, size, surface);
+  }
+
+  // Outside : flood fill from the border through the free cells, everything else is solid
+  std::vector<char> outside(nb_cells, 0);
+  std::deque<size_t> queue;
+  const int stride[3] = {1, size[0], size[0] * size[1]};
+  for(int z=0; z<size[2]; z++)
+    for(int y=0; y<size[1]; y++)
+      for(int x=0; x<size[0]; x++){
+        if(x > 0 && x < size[0] - 1 && y > 0 && y < size[1] - 1 && z > 0 && z < size[2] - 1)
+          continue;
+        const size_t c = x + size_t(stride[1]) * y + size_t(stride[2]) * z;
+        if(!surface[c] && !outside[c]){
+          outside[c] = 1;
+          queue.push_back(c);
+        }
+      }
+  while(!queue.empty()){
+    const size_t c = queue.front();
+    queue.pop_front();
+    const int coords[3] = {int(c % size[0]), int((c / size[0]) % size[1]), int(c / stride[2])};
+    for(int a=0; a<3; a++)
+      for(int s=-1; s<=1; s+=2){
+        if(coords[a] + s < 0 || coords[a] + s >= size[a])
+          continue;
+        const size_t n = c + s * stride[a];
+        if(!surface[n] && !outside[n]){
+          outside[n] = 1;
+          queue.push_back(n);
+        }
+      }
+  }
+  std::vector<char> solid(nb_cells);
+  for(size_t c=0; c<nb_cells; c++)
+    solid[c] = !outside[c];
+
+  // The surface is half a cell from the center of the solid cells
+  std::vector<double> to_solid, to_outside;
+  distanceTransform(solid, size, to_solid);
+  distanceTransform(outside, size, to_outside);
+  std::vector<float> field(nb_cells);
+  for(size_t c=0; c<nb_cells; c++)
+    field[c] = outside[c] ? (to_solid[c] - 0.5) * resolution : -(to_outside[c] - 0.5) * resolution;
+
+  if(!SignedDistanceField::save(argv[2], size, lower, resolution, field)){
+    std::printf("Could not write %s\n", argv[2]);
+    return 1;
+  }
+
+  // Check the file and the query cost
+  SignedDistanceField sdf;
+  if(!sdf.load(argv[2])){
+    std::printf("Could not map %s\n", argv[2]);
+    return 1;
+  }
+  const int nb_queries = 1000000;
+  Points samples(1024);
+  for(unsigned int k=0; k<samples.size(); k++)
+    samples[k] = lower + (upper - lower).cwiseProduct(0.5 * (Eigen::Vector3d::Random() + Eigen::Vector3d::Ones()));
+  Eigen::Vector3d gradient;
+  double sum = 0.0;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(int k=0; k<nb_queries; k++)
+    sum += sdf.query(samples[k & 1023], gradient) + gradient(0);
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::printf("Written to %s, query with gradient : %.1f ns (checksum %g)\n", argv[2], 1e9 * elapsed / nb_queries, sum);
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include "cart_opt_ctrl/sdf_damper.hpp"
+#include <pluginlib/class_list_macros.h>
+#include <ros/ros.h>
+#include <qpOASES.hpp>
+#include <Eigen/Geometry>
+
+namespace cart_opt_ctrl
+{
+  bool SDFDamper::configure(const std::string& ns, int dof){
+    std::string sdf_file;
+    std::vector<double> capsules;
+    int samples;
+    ros::param::get(ns + "/sdf_file", sdf_file);
+    ros::param::get(ns + "/frames", frame_names_);
+    ros::param::get(ns + "/capsules", capsules);
+    ros::param::param(ns + "/samples_per_capsule", samples, 3);
+    ros::param::param(ns + "/influence_distance", influence_distance_, 0.15);
+    ros::param::param(ns + "/safety_distance", safety_distance_, 0.02);
+    ros::param::param(ns + "/max_approach_velocity", max_approach_velocity_, 0.5);
+    ros::param::param(ns + "/slack_weight", slack_weight_, 0.0);
+
+    if(!sdf_.load(sdf_file)){
+      ROS_ERROR_STREAM("Could not map the signed distance field " << sdf_file);
+      return false;
+    }
+    if(capsules.size() != 7 * frame_names_.size() || samples < 1 || influence_distance_ <= safety_distance_){
+      ROS_ERROR_STREAM(ns << "/capsules needs 7 elements per frame, samples_per_capsule > 0 and influence_distance > safety_distance");
+      return false;
+    }
+
+    // Spheres along each capsule axis, the frame handles are set in registerFrames()
+    spheres_.clear();
+    for(unsigned int c=0; c<frame_names_.size(); c++){
+      const Eigen::Vector3d a(capsules[7*c], capsules[7*c+1], capsules[7*c+2]);
+      const Eigen::Vector3d b(capsules[7*c+3], capsules[7*c+4], capsules[7*c+5]);
+      for(int s=0; s<samples; s++){
+        Sphere sphere;
+        sphere.frame = c;
+        if(samples > 1)
+          sphere.center = a + (b - a) * double(s) / (samples - 1);
+        else
+          sphere.center = 0.5 * (a + b);
+        // Covers the capsule between two samples
+        const double half_gap = samples > 1 ? 0.5 * (b - a).norm() / (samples - 1) : 0.5 * (b - a).norm();
+        sphere.radius = std::sqrt(capsules[7*c+6] * capsules[7*c+6] + half_gap * half_gap);
+        spheres_.push_back(sphere);
+      }
+    }
+    jacobian_row_.setZero(dof);
+    return true;
+  }
+
+  bool SDFDamper::registerFrames(MultiFrameKinematics& kinematics){
+    std::vector<int> handles(frame_names_.size());
+    for(unsigned int c=0; c<frame_names_.size(); c++){
+      handles[c] = kinematics.addFrame(frame_names_[c]);
+      if(handles[c] < 0){
+        ROS_ERROR_STREAM("Unknown frame " << frame_names_[c]);
+        return false;
+      }
+    }
+    for(unsigned int s=0; s<spheres_.size(); s++)
+      spheres_[s].frame = handles[spheres_[s].frame];
+    return true;
+  }
+
+  void SDFDamper::update(const QPState& state, QPSlice& slice){
+    const MultiFrameKinematics& kinematics = *state.kinematics;
+    const double h = state.horizon_dt;
+    Eigen::Vector3d r, p, normal, w, v, bias;
+    for(unsigned int s=0; s<spheres_.size(); s++){
+      const Sphere& sphere = spheres_[s];
+      r.noalias() = kinematics.getRotation(sphere.frame) * sphere.center;
+      p = kinematics.getPosition(sphere.frame) + r;
+      const double distance = sdf_.query(p, normal) - sphere.radius;
+      if(distance > influence_distance_){
+        // Inactive, the row stays in the problem so its size never changes
+        slice.A.row(s).setZero();
+        slice.lbA(s) = -qpOASES::INFTY;
+        slice.ubA(s) = qpOASES::INFTY;
+        continue;
+      }
+
+      // Sphere center : p_dot = v + w x r, p_ddot = J_p.qdd + Jdot_lin.qd + Jdot_ang.qd x r + w x (w x r)
+      const MultiFrameKinematics::Jacobian& jacobian = kinematics.getJacobian(sphere.frame);
+      const MultiFrameKinematics::Vector6d& twist = kinematics.getTwist(sphere.frame);
+      const MultiFrameKinematics::Vector6d& jdot_qdot = kinematics.getJdotQdot(sphere.frame);
+      w = twist.tail<3>();
+      v = twist.head<3>() + w.cross(r);
+      bias = jdot_qdot.head<3>() + jdot_qdot.tail<3>().cross(r) + w.cross(w.cross(r));
+
+      // n^T.J_p = n^T.J_lin + (r x n)^T.J_ang, the gradient is the normal
+      jacobian_row_.noalias() = jacobian.topRows<3>().transpose() * normal + jacobian.bottomRows<3>().transpose() * r.cross(normal);
+      const double distance_dot = normal.dot(v);
+      const double damper_velocity = -max_approach_velocity_ * (distance - safety_distance_) / (influence_distance_ - safety_distance_);
+
+      // d_ddot = n^T.J_p.(M^-1.tau - nonlinear_terms) + n^T.bias >= (damper_velocity - d_dot) / h
+      slice.A.row(s).noalias() = jacobian_row_.transpose() * (*state.inertia_inverse);
+      slice.lbA(s) = (damper_velocity - distance_dot) / h + jacobian_row_.dot(*state.nonlinear_terms) - normal.dot(bias);
+      slice.ubA(s) = qpOASES::INFTY;
+    }
+  }
+}
+
+PLUGINLIB_EXPORT_CLASS(cart_opt_ctrl::SDFDamper, cart_opt_ctrl::QPPlugin)
@@ -0,0 +1,91 @@
+#include "cart_opt_ctrl/signed_distance_field.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  const char MAGIC[4] = {'C','S','D','F'};
+  const size_t HEADER_SIZE = 4 + 3 * sizeof(int32_t) + 4 * sizeof(double);
+}
+
+SignedDistanceField::SignedDistanceField() : mapping_(0), mapping_size_(0), data_(0), stride_y_(0), stride_z_(0),
+                                             resolution_(1.0), inv_resolution_(1.0)
+{
+  size_[0] = size_[1] = size_[2] = 0;
+  origin_.setZero();
+  upper_.setZero();
+}
+
+SignedDistanceField::~SignedDistanceField(){
+  unload();
+}
+
+void SignedDistanceField::unload(){
+  if(mapping_)
+    munmap(mapping_, mapping_size_);
+  mapping_ = 0;
+  mapping_size_ = 0;
+  data_ = 0;
+}
+
+bool SignedDistanceField::load(const std::string& file){
+  unload();
+  const int fd = open(file.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HEADER_SIZE)){
+    close(fd);
+    return false;
+  }
+  void* mapping = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(mapping == MAP_FAILED)
+    return false;
+
+  const char* bytes = static_cast<const char*>(mapping);
+  int32_t size[3];
+  double header[4];
+  std::memcpy(size, bytes + 4, sizeof(size));
+  std::memcpy(header, bytes + 4 + sizeof(size), sizeof(header));
+  const size_t nb_cells = size_t(std::max(0, size[0])) * std::max(0, size[1]) * std::max(0, size[2]);
+  if(std::memcmp(bytes, MAGIC, 4) != 0 || size[0] < 2 || size[1] < 2 || size[2] < 2 || header[3] <= 0.0
+     || static_cast<size_t>(st.st_size) != HEADER_SIZE + nb_cells * sizeof(float)){
+    munmap(mapping, st.st_size);
+    return false;
+  }
+
+  mapping_ = mapping;
+  mapping_size_ = st.st_size;
+  data_ = reinterpret_cast<const float*>(bytes + HEADER_SIZE);
+  for(int a=0; a<3; a++){
+    size_[a] = size[a];
+    origin_(a) = header[a];
+    upper_(a) = size[a] - 1;
+  }
+  stride_y_ = size_[0];
+  stride_z_ = size_[0] * size_[1];
+  resolution_ = header[3];
+  inv_resolution_ = 1.0 / resolution_;
+  // Keep the field in memory, the control loop must not fault on it
+  mlock(mapping_, mapping_size_);
+  return true;
+}
+
+bool SignedDistanceField::save(const std::string& file, const int size[3], const Eigen::Vector3d& origin, double resolution, const std::vector<float>& data){
+  if(data.size() != size_t(size[0]) * size[1] * size[2])
+    return false;
+  FILE* f = std::fopen(file.c_str(), "wb");
+  if(!f)
+    return false;
+  const int32_t header_size[3] = {size[0], size[1], size[2]};
+  const double header[4] = {origin(0), origin(1), origin(2), resolution};
+  bool ok = std::fwrite(MAGIC, 1, 4, f) == 4 && std::fwrite(header_size, sizeof(int32_t), 3, f) == 3
+            && std::fwrite(header, sizeof(double), 4, f) == 4 && std::fwrite(data.data(), sizeof(float), data.size(), f) == data.size();
+  return std::fclose(f) == 0 && ok;
+}
@@ -0,0 +1,178 @@
+#include "cart_opt_ctrl/trajectory_library.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  const char MAGIC[4] = {'C','T','L','B'};
+  const size_t HEADER_SIZE = 4 + 3 * sizeof(uint32_t) + sizeof(double) + sizeof(int64_t);
+}
+
+TrajectoryLibrary::TrajectoryLibrary() : mapping_(0), mapping_size_(0), index_(0), nb_trajectories_(0), period_(0.0), creation_time_(0)
+{
+}
+
+TrajectoryLibrary::~TrajectoryLibrary(){
+  unload();
+}
+
+void TrajectoryLibrary::unload(){
+  if(mapping_)
+    munmap(mapping_, mapping_size_);
+  mapping_ = 0;
+  mapping_size_ = 0;
+  index_ = 0;
+  nb_trajectories_ = 0;
+}
+
+bool TrajectoryLibrary::load(const std::string& file){
+  unload();
+  const int fd = open(file.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HEADER_SIZE)){
+    close(fd);
+    return false;
+  }
+  void* mapping = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(mapping == MAP_FAILED)
+    return false;
+
+  const char* bytes = static_cast<const char*>(mapping);
+  uint32_t header[3];
+  double period;
+  int64_t creation_time;
+  std::memcpy(header, bytes + 4, sizeof(header));
+  std::memcpy(&period, bytes + 4 + sizeof(header), sizeof(period));
+  std::memcpy(&creation_time, bytes + 4 + sizeof(header) + sizeof(period), sizeof(creation_time));
+  const size_t file_size = st.st_size;
+  bool valid = std::memcmp(bytes, MAGIC, 4) == 0 && header[0] == VERSION && header[2] == SAMPLE_SIZE && period > 0.0
+               && HEADER_SIZE + size_t(header[1]) * sizeof(IndexEntry) <= file_size;
+
+  // Every trajectory must be inside the file, with at least one sample
+  const IndexEntry* index = reinterpret_cast<const IndexEntry*>(bytes + HEADER_SIZE);
+  for(uint32_t t=0; valid && t<header[1]; t++){
+    valid = index[t].nb_samples > 0 && index[t].offset >= static_cast<int64_t>(HEADER_SIZE)
+            && index[t].offset % sizeof(double) == 0 && std::memchr(index[t].name, 0, NAME_SIZE) != 0
+            && size_t(index[t].offset) + size_t(index[t].nb_samples) * SAMPLE_SIZE * sizeof(double) <= file_size;
+  }
+  if(!valid){
+    munmap(mapping, st.st_size);
+    return false;
+  }
+
+  mapping_ = mapping;
+  mapping_size_ = st.st_size;
+  index_ = index;
+  nb_trajectories_ = header[1];
+  period_ = period;
+  creation_time_ = creation_time;
+  // Keep the samples in memory, playing must not fault on them
+  mlock(mapping_, mapping_size_);
+  return true;
+}
+
+bool TrajectoryLibrary::save(const std::string& file, double period, const std::vector<std::string>& names, const std::vector<std::vector<double> >& samples){
+  if(period <= 0.0 || names.size() != samples.size())
+    return false;
+
+  // Index sorted by name for find()
+  std::vector<int> order(names.size());
+  for(unsigned int t=0; t<order.size(); t++){
+    order[t] = t;
+    if(names[t].empty() || names[t].size() >= NAME_SIZE || samples[t].empty() || samples[t].size() % SAMPLE_SIZE != 0)
+      return false;
+  }
+  struct ByName{
+    const std::vector<std::string>& names;
+    bool operator()(int a, int b) const { return names[a] < names[b]; }
+  };
+  std::sort(order.begin(), order.end(), ByName{names});
+  for(unsigned int t=1; t<order.size(); t++)
+    if(names[order[t]] == names[order[t-1]])
+      return false;
+
+  std::vector<IndexEntry> index(names.size());
+  int64_t offset = HEADER_SIZE + index.size() * sizeof(IndexEntry);
+  offset += (sizeof(double) - offset % sizeof(double)) % sizeof(double);
+  const int64_t data_start = offset;
+  for(unsigned int t=0; t<order.size(); t++){
+    std::memset(index[t].name, 0, NAME_SIZE);
+    std::memcpy(index[t].name, names[order[t]].c_str(), names[order[t]].size());
+    index[t].offset = offset;
+    index[t].nb_samples = samples[order[t]].size() / SAMPLE_SIZE;
+    offset += samples[order[t]].size() * sizeof(double);
+  }
+
+  FILE* f = std::fopen(file.c_str(), "wb");
+  if(!f)
+    return false;
+  const uint32_t header[3] = {VERSION, static_cast<uint32_t>(names.size()), SAMPLE_SIZE};
+  const int64_t creation_time = std::time(0);
+  const char padding[sizeof(double)] = {0};
+  const size_t padding_size = data_start - HEADER_SIZE - index.size() * sizeof(IndexEntry);
+  bool ok = std::fwrite(MAGIC, 1, 4, f) == 4 && std::fwrite(header, sizeof(uint32_t), 3, f) == 3
+            && std::fwrite(&period, sizeof(double), 1, f) == 1 && std::fwrite(&creation_time, sizeof(int64_t), 1, f) == 1
+            && std::fwrite(index.data(), sizeof(IndexEntry), index.size(), f) == index.size()
+            && std::fwrite(padding, 1, padding_size, f) == padding_size;
+  for(unsigned int t=0; ok && t<order.size(); t++)
+    ok = std::fwrite(samples[order[t]].data(), sizeof(double), samples[order[t]].size(), f) == samples[order[t]].size();
+  return std::fclose(f) == 0 && ok;
+}
+
+int TrajectoryLibrary::find(const std::string& name) const{
+  int first = 0, last = nb_trajectories_;
+  while(first < last){
+    const int middle = (first + last) / 2;
+    const int c = std::strncmp(index_[middle].name, name.c_str(), NAME_SIZE);
+    if(c == 0)
+      return middle;
+    if(c < 0)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+  return -1;
+}
+
+std::string TrajectoryLibrary::name(int trajectory) const{
+  return std::string(index_[trajectory].name);
+}
+
+double TrajectoryLibrary::duration(int trajectory) const{
+  return (index_[trajectory].nb_samples - 1) * period_;
+}
+
+void TrajectoryLibrary::sample(int trajectory, double time, KDL::Frame& pos, KDL::Twist& vel, KDL::Twist& acc) const{
+  const IndexEntry& entry = index_[trajectory];
+  const double* samples = reinterpret_cast<const double*>(static_cast<const char*>(mapping_) + entry.offset);
+
+  // Samples around time, the last one is held
+  const double s = std::min(std::max(time / period_, 0.0), static_cast<double>(entry.nb_samples - 1));
+  const int64_t k = std::min(static_cast<int64_t>(s), entry.nb_samples - 1);
+  const int64_t k1 = std::min(k + 1, entry.nb_samples - 1);
+  const double f = s - k;
+  const double* a = samples + k * SAMPLE_SIZE;
+  const double* b = samples + k1 * SAMPLE_SIZE;
+  double x[SAMPLE_SIZE];
+  for(int i=0; i<SAMPLE_SIZE; i++)
+    x[i] = a[i] + f * (b[i] - a[i]);
+
+  // The samples are close, the interpolated quaternion only needs to be normalized (same hemisphere from the compiler)
+  const double norm = std::sqrt(x[3]*x[3] + x[4]*x[4] + x[5]*x[5] + x[6]*x[6]);
+  pos.p = KDL::Vector(x[0], x[1], x[2]);
+  pos.M = KDL::Rotation::Quaternion(x[3] / norm, x[4] / norm, x[5] / norm, x[6] / norm);
+  vel.vel = KDL::Vector(x[7], x[8], x[9]);
+  vel.rot = KDL::Vector(x[10], x[11], x[12]);
+  acc.vel = KDL::Vector(x[13], x[14], x[15]);
+  acc.rot = KDL::Vector(x[16], x[17], x[18]);
+}
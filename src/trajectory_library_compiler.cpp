@@ -0,0 +1,142 @@
+#include <cart_opt_ctrl/trajectory_library.hpp>
+#include <cart_opt_ctrl/trajectory_plan.hpp>
+#include <kdl/utilities/error.h>
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Compiles waypoint files into a trajectory library for KDLTrajCompute (see TrajectoryLibrary).
+// Each trajectory is planned as KDLTrajCompute would (rounded path, trapezoidal or quintic profile, pause at the end)
+// then sampled at the period of the component. The waypoints are in the base frame of the robot.
+//   trajectories:
+//     - name: pick
+//       vel_max: 0.1            # optional, the KDLTrajCompute defaults otherwise
+//       acc_max: 2.0
+//       radius: 0.01
+//       eqradius: 0.05
+//       profile: trapezoidal    # or quintic
+//       end_pause: 0.5
+//       waypoints:              # x y z qx qy qz qw
+//         - [0.5, 0.0, 0.4, 0.0, 1.0, 0.0, 0.0]
+// Usage : trajectory_library_compiler output.ctl input.yaml [input.yaml ...] [--period 0.001]
+namespace{
+  template<class T> T get(const YAML::Node& node, const char* key, const T& fallback){
+    return node[key] ? node[key].as<T>() : fallback;
+  }
+
+  bool sampleTrajectory(const YAML::Node& node, double period, std::string& name, std::vector<double>& samples){
+    name = get<std::string>(node, "name", "");
+    const YAML::Node& points = node["waypoints"];
+    if(name.empty() || !points || !points.IsSequence()){
+      std::printf("Each trajectory needs a name and waypoints\n");
+      return false;
+    }
+    std::vector<KDL::Frame> waypoints;
+    for(unsigned int i=0; i<points.size(); i++){
+      const std::vector<double> p = points[i].as<std::vector<double> >();
+      if(p.size() != 7){
+        std::printf("%s : waypoint #%u needs x y z qx qy qz qw\n", name.c_str(), i);
+        return false;
+      }
+      waypoints.push_back(KDL::Frame(KDL::Rotation::Quaternion(p[3], p[4], p[5], p[6]), KDL::Vector(p[0], p[1], p[2])));
+    }
+
+    const std::string profile = get<std::string>(node, "profile", "trapezoidal");
+    TrajectoryPlan plan;
+    try{
+      if(!plan.build(waypoints, get(node, "radius", 0.01), get(node, "eqradius", 0.05), get(node, "vel_max", 0.1), get(node, "acc_max", 2.0),
+                     profile == "quintic" ? TrajectoryPlan::QUINTIC : TrajectoryPlan::TRAPEZOIDAL, get(node, "end_pause", 0.5))){
+        std::printf("%s : no waypoints\n", name.c_str());
+        return false;
+      }
+    } catch(KDL::Error& error) {
+      std::printf("%s : %s\n", name.c_str(), error.Description());
+      return false;
+    }
+
+    // Samples up to the end included, the quaternions stay in the same hemisphere for the interpolation
+    const long nb_samples = static_cast<long>(std::ceil(plan.Duration() / period)) + 1;
+    samples.resize(nb_samples * TrajectoryLibrary::SAMPLE_SIZE);
+    double previous[4] = {0.0, 0.0, 0.0, 1.0};
+    for(long k=0; k<nb_samples; k++){
+      const double t = std::min(k * period, plan.Duration());
+      const KDL::Frame pos = plan.Pos(t);
+      const KDL::Twist vel = plan.Vel(t);
+      const KDL::Twist acc = plan.Acc(t);
+      double* s = &samples[k * TrajectoryLibrary::SAMPLE_SIZE];
+      double q[4];
+      pos.M.GetQuaternion(q[0], q[1], q[2], q[3]);
+      const double sign = q[0]*previous[0] + q[1]*previous[1] + q[2]*previous[2] + q[3]*previous[3] < 0.0 ? -1.0 : 1.0;
+      for(int i=0; i<3; i++){
+        s[i] = pos.p(i);
+        s[7+i] = vel.vel(i);
+        s[10+i] = vel.rot(i);
+        s[13+i] = acc.vel(i);
+        s[16+i] = acc.rot(i);
+      }
+      for(int i=0; i<4; i++)
+        s[3+i] = previous[i] = sign * q[i];
+    }
+    std::printf("  %-32s %4lu waypoints, %8.3f s, %7ld samples, %8.1f kB\n", name.c_str(), waypoints.size(), plan.Duration(),
+                nb_samples, samples.size() * sizeof(double) / 1e3);
+    return true;
+  }
+}
+
+int main(int argc, char** argv){
+  std::string output;
+  std::vector<std::string> inputs;
+  double period = 0.001;
+  for(int a=1; a<argc; a++){
+    if(std::strcmp(argv[a], "--period") == 0 && a + 1 < argc)
+      period = std::atof(argv[++a]);
+    else if(output.empty())
+      output = argv[a];
+    else
+      inputs.push_back(argv[a]);
+  }
+  if(inputs.empty() || period <= 0.0){
+    std::printf("Usage : trajectory_library_compiler output.ctl input.yaml [input.yaml ...] [--period 0.001]\n");
+    return 1;
+  }
+
+  std::vector<std::string> names;
+  std::vector<std::vector<double> > samples;
+  for(unsigned int f=0; f<inputs.size(); f++){
+    YAML::Node root;
+    try{
+      root = YAML::LoadFile(inputs[f]);
+    } catch(YAML::Exception& error) {
+      std::printf("Could not read %s : %s\n", inputs[f].c_str(), error.what());
+      return 1;
+    }
+    std::printf("%s\n", inputs[f].c_str());
+    const YAML::Node& trajectories = root["trajectories"];
+    for(unsigned int t=0; trajectories && t<trajectories.size(); t++){
+      names.push_back(std::string());
+      samples.push_back(std::vector<double>());
+      try{
+        if(!sampleTrajectory(trajectories[t], period, names.back(), samples.back()))
+          return 1;
+      } catch(YAML::Exception& error) {
+        std::printf("Invalid trajectory #%u in %s : %s\n", t, inputs[f].c_str(), error.what());
+        return 1;
+      }
+    }
+  }
+
+  if(!TrajectoryLibrary::save(output, period, names, samples)){
+    std::printf("Could not write %s (names must be unique and shorter than %d characters)\n", output.c_str(), TrajectoryLibrary::NAME_SIZE);
+    return 1;
+  }
+  TrajectoryLibrary library;
+  if(!library.load(output)){
+    std::printf("Could not map %s\n", output.c_str());
+    return 1;
+  }
+  std::printf("Written %d trajectories to %s (format version %u, period %g s)\n", library.size(), output.c_str(), TrajectoryLibrary::VERSION, period);
+  return 0;
+}
@@ -0,0 +1,157 @@
+#include "cart_opt_ctrl/trajectory_plan.hpp"
+#include <kdl/path_roundedcomposite.hpp>
+#include <kdl/path_point.hpp>
+#include <kdl/rotational_interpolation_sa.hpp>
+#include <kdl/trajectory_segment.hpp>
+#include <kdl/trajectory_stationary.hpp>
+#include <kdl/velocityprofile_trap.hpp>
+#include <kdl/velocityprofile_spline.hpp>
+#include <algorithm>
+#include <cmath>
+
+TrajectoryPlan::TrajectoryPlan(size_t block_size) : block_size_(block_size), block_(0), offset_(0), used_(0)
+{
+  destructors_.reserve(8);
+  segments_.reserve(4);
+  ends_.reserve(4);
+}
+
+TrajectoryPlan::~TrajectoryPlan(){
+  clear();
+}
+
+bool TrajectoryPlan::build(const std::vector<KDL::Frame>& waypoints, double radius, double eqradius, double vel_max, double acc_max,
+                           Profile profile, double end_pause){
+  clear();
+  if(waypoints.empty())
+    return false;
+  try{
+    if(waypoints.size() > 1){
+      // Initialize path with roundness between waypoints, the plan owns the interpolator
+      KDL::Path_RoundedComposite* path = create<KDL::Path_RoundedComposite>(radius, eqradius, create<KDL::RotationalInterpolation_SingleAxis>(), false);
+      for(unsigned int i=0; i<waypoints.size(); i++)
+        path->Add(waypoints[i]);
+      path->Finish();
+
+      // Set velocity profile of the trajectory
+      const double length = path->PathLength();
+      KDL::VelocityProfile* vel_profile;
+      if(profile == QUINTIC){
+        // Rest to rest quintic : peak velocity 15/8.L/T, peak acceleration 10/sqrt(3).L/T^2
+        const double duration = std::max(15.0 / 8.0 * length / vel_max, std::sqrt(10.0 / std::sqrt(3.0) * length / acc_max));
+        KDL::VelocityProfile_Spline* spline = create<KDL::VelocityProfile_Spline>();
+        // The 3 arguments overload is linear, the quintic one needs the boundary velocities and accelerations
+        spline->SetProfileDuration(0, 0, 0, length, 0, 0, duration);
+        const double t_peak = (3.0 - std::sqrt(3.0)) / 6.0 * duration;
+        if(length > 0.0 && (std::abs(spline->Vel(0)) > 1e-9 * length || std::abs(spline->Vel(duration)) > 1e-9 * length
+                            || spline->Acc(t_peak) <= 0.0)){
+          clear();
+          return false;
+        }
+        vel_profile = spline;
+      }
+      else{
+        vel_profile = create<KDL::VelocityProfile_Trap>(vel_max, acc_max);
+        vel_profile->SetProfile(0, length);
+      }
+      add(create<KDL::Trajectory_Segment>(path, vel_profile, false));
+    }
+    else{
+      add(create<KDL::Trajectory_Segment>(create<KDL::Path_Point>(waypoints.back()), create<KDL::VelocityProfile_Trap>(vel_max, acc_max), false));
+    }
+
+    // Wait at the end of the trajectory
+    add(create<KDL::Trajectory_Stationary>(end_pause, waypoints.back()));
+  } catch(...) {
+    clear();
+    throw;
+  }
+  return true;
+}
+
+void TrajectoryPlan::clear(){
+  // Reverse order of construction, the segments do not own their path and profile
+  for(size_t d=destructors_.size(); d>0; d--)
+    destructors_[d-1].destroy(destructors_[d-1].object);
+  destructors_.clear();
+  segments_.clear();
+  ends_.clear();
+  block_ = 0;
+  offset_ = 0;
+  used_ = 0;
+}
+
+void TrajectoryPlan::swap(TrajectoryPlan& other){
+  std::swap(block_size_, other.block_size_);
+  std::swap(block_, other.block_);
+  std::swap(offset_, other.offset_);
+  std::swap(used_, other.used_);
+  blocks_.swap(other.blocks_);
+  destructors_.swap(other.destructors_);
+  segments_.swap(other.segments_);
+  ends_.swap(other.ends_);
+}
+
+size_t TrajectoryPlan::getMemoryReserved() const{
+  size_t reserved = 0;
+  for(unsigned int b=0; b<blocks_.size(); b++)
+    reserved += blocks_[b].size;
+  return reserved;
+}
+
+void* TrajectoryPlan::allocate(size_t size, size_t alignment){
+  // Bump in the current block, then in the next ones, a new block only when all the kept ones are full
+  while(block_ < blocks_.size()){
+    const size_t start = (offset_ + alignment - 1) & ~(alignment - 1);
+    if(start + size <= blocks_[block_].size){
+      offset_ = start + size;
+      used_ += size;
+      return blocks_[block_].data.get() + start;
+    }
+    ++block_;
+    offset_ = 0;
+  }
+  Block block;
+  block.size = std::max(block_size_, size + alignment);
+  block.data.reset(new char[block.size]);
+  blocks_.push_back(std::move(block));
+  return allocate(size, alignment);
+}
+
+void TrajectoryPlan::add(KDL::Trajectory* segment){
+  segments_.push_back(segment);
+  ends_.push_back(Duration() + segment->Duration());
+}
+
+const KDL::Trajectory& TrajectoryPlan::segmentAt(double& time) const{
+  // Same lookup as KDL::Trajectory_Composite, time becomes the time in the segment
+  if(time < 0.0){
+    time = 0.0;
+    return *segments_.front();
+  }
+  double previous_end = 0.0;
+  for(unsigned int i=0; i<segments_.size(); i++){
+    if(time <= ends_[i]){
+      time -= previous_end;
+      return *segments_[i];
+    }
+    previous_end = ends_[i];
+  }
+  time = segments_.back()->Duration();
+  return *segments_.back();
+}
+
+KDL::Frame TrajectoryPlan::Pos(double time) const{
+  const KDL::Trajectory& segment = segmentAt(time);
+  return segment.Pos(time);
+}
+
+KDL::Twist TrajectoryPlan::Vel(double time) const{
+  const KDL::Trajectory& segment = segmentAt(time);
+  return segment.Vel(time);
+}
+
+KDL::Twist TrajectoryPlan::Acc(double time) const{
+  const KDL::Trajectory& segment = segmentAt(time);
+  return segment.Acc(time);
+}
@@ -0,0 +1,67 @@
+#include <cart_opt_ctrl/trajectory_plan.hpp>
+#include <kdl/path_roundedcomposite.hpp>
+#include <kdl/rotational_interpolation_sa.hpp>
+#include <kdl/trajectory_composite.hpp>
+#include <kdl/trajectory_segment.hpp>
+#include <kdl/trajectory_stationary.hpp>
+#include <kdl/velocityprofile_trap.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Planning throughput of TrajectoryPlan against the heap allocated KDL::Trajectory_Composite
+// that KDLTrajCompute used to build (and delete here), on random waypoint sets.
+// Usage : trajectory_plan_benchmark [nb_plans] [nb_waypoints]
+namespace{
+  KDL::Trajectory_Composite* buildComposite(const std::vector<KDL::Frame>& waypoints){
+    KDL::Path_RoundedComposite* path = new KDL::Path_RoundedComposite(0.01, 0.05, new KDL::RotationalInterpolation_SingleAxis());
+    for(unsigned int i=0; i<waypoints.size(); i++)
+      path->Add(waypoints[i]);
+    path->Finish();
+    KDL::VelocityProfile* vel_profile = new KDL::VelocityProfile_Trap(0.1, 2.0);
+    vel_profile->SetProfile(0, path->PathLength());
+    KDL::Trajectory_Composite* trajectory = new KDL::Trajectory_Composite();
+    trajectory->Add(new KDL::Trajectory_Segment(path, vel_profile));
+    trajectory->Add(new KDL::Trajectory_Stationary(0.5, waypoints.back()));
+    return trajectory;
+  }
+}
+
+int main(int argc, char** argv){
+  const int nb_plans = argc > 1 ? std::atoi(argv[1]) : 10000;
+  const int nb_waypoints = argc > 2 ? std::atoi(argv[2]) : 8;
+
+  // Waypoints far enough apart for the blends
+  std::vector<std::vector<KDL::Frame> > sets(64);
+  for(unsigned int s=0; s<sets.size(); s++)
+    for(int i=0; i<nb_waypoints; i++)
+      sets[s].push_back(KDL::Frame(KDL::Rotation::RPY(0.3 * (std::rand() % 5), 0.0, 0.2 * i),
+                                   KDL::Vector(0.4 + 0.1 * (i % 2), -0.3 + 0.6 * i / nb_waypoints, 0.3 + 0.05 * (std::rand() % 4))));
+
+  double checksum = 0.0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for(int n=0; n<nb_plans; n++){
+    KDL::Trajectory_Composite* trajectory = buildComposite(sets[n % sets.size()]);
+    checksum += trajectory->Duration();
+    delete trajectory;
+  }
+  const double heap_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  TrajectoryPlan plan;
+  size_t max_used = 0;
+  start = std::chrono::steady_clock::now();
+  for(int n=0; n<nb_plans; n++){
+    plan.build(sets[n % sets.size()], 0.01, 0.05, 0.1, 2.0, TrajectoryPlan::TRAPEZOIDAL, 0.5);
+    checksum += plan.Duration();
+    max_used = std::max(max_used, plan.getMemoryUsed());
+  }
+  const double arena_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::printf("%d plans of %d waypoints\n", nb_plans, nb_waypoints);
+  std::printf("  heap  : %8.2f us/plan, %8.0f plans/s\n", 1e6 * heap_time / nb_plans, nb_plans / heap_time);
+  std::printf("  arena : %8.2f us/plan, %8.0f plans/s, %lu bytes per plan, %lu reserved\n", 1e6 * arena_time / nb_plans,
+              nb_plans / arena_time, max_used, plan.getMemoryReserved());
+  std::printf("  (checksum %g)\n", checksum);
+  return 0;
+}
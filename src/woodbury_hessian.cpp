@@ -0,0 +1,73 @@
+#include "cart_opt_ctrl/woodbury_hessian.hpp"
+#include <cmath>
+
+WoodburyHessian::WoodburyHessian() : M_(0), M_inv_(0), regularisation_weight_(0.0), rank_(0)
+{
+}
+
+void WoodburyHessian::configure(int dof, int max_tasks){
+  V_.setZero(dof, 6 * max_tasks);
+  M_inv_V_.setZero(dof, 6 * max_tasks);
+  capacitance_.setZero(6 * max_tasks, 6 * max_tasks);
+  Vt_b_.setZero(6 * max_tasks);
+  hessian_inverse_.setZero(dof, dof);
+  rank_ = 0;
+}
+
+void WoodburyHessian::reset(const Eigen::MatrixXd& M, const Eigen::MatrixXd& M_inv, double regularisation_weight){
+  M_ = &M;
+  M_inv_ = &M_inv;
+  regularisation_weight_ = regularisation_weight;
+  rank_ = 0;
+}
+
+void WoodburyHessian::addTask(const Eigen::Matrix<double,6,Eigen::Dynamic>& jacobian, const Eigen::VectorXd& axes, const Eigen::Matrix<double,6,1>& weights){
+  for(int c=0; c<6 && rank_ < V_.cols(); c++){
+    if(weights(c) <= 0.0)
+      continue;
+    V_.col(rank_) = std::sqrt(weights(c)) * axes.cwiseProduct(jacobian.row(c).transpose());
+    ++rank_;
+  }
+}
+
+bool WoodburyHessian::factorize(){
+  if(!M_ || regularisation_weight_ <= 0.0)
+    return false;
+  if(rank_ == 0)
+    return true;
+
+  const int k = rank_;
+  const double s = 1.0 / (2.0 * regularisation_weight_);
+  M_inv_V_.leftCols(k).noalias() = (*M_inv_) * V_.leftCols(k);
+  capacitance_.topLeftCorner(k,k).noalias() = s * V_.leftCols(k).transpose() * M_inv_V_.leftCols(k);
+  capacitance_.topLeftCorner(k,k).diagonal().array() += 1.0;
+  capacitance_ldlt_.compute(capacitance_.topLeftCorner(k,k));
+  return capacitance_ldlt_.info() == Eigen::Success;
+}
+
+void WoodburyHessian::solve(const Eigen::Ref<const Eigen::VectorXd>& b, Eigen::VectorXd& x){
+  const double s = 1.0 / (2.0 * regularisation_weight_);
+  x.noalias() = s * (*M_) * b;
+  if(rank_ == 0)
+    return;
+  const int k = rank_;
+  Eigen::VectorXd::SegmentReturnType Vt_b = Vt_b_.head(k);
+  Vt_b.noalias() = V_.leftCols(k).transpose() * b;
+  capacitance_ldlt_.solveInPlace(Vt_b);
+  x.noalias() -= (s * s) * V_.leftCols(k) * Vt_b;
+}
+
+bool WoodburyHessian::compute(){
+  if(!factorize())
+    return false;
+  const double s = 1.0 / (2.0 * regularisation_weight_);
+  hessian_inverse_ = s * (*M_);
+  if(rank_ == 0)
+    return true;
+
+  // H^-1 -= s^2.V.C^-1.V^T, reusing M_inv_V_ for C^-1.V^T
+  const int k = rank_;
+  M_inv_V_.leftCols(k).transpose() = capacitance_ldlt_.solve(V_.leftCols(k).transpose());
+  hessian_inverse_.noalias() -= (s * s) * V_.leftCols(k) * M_inv_V_.leftCols(k).transpose();
+  return true;
+}
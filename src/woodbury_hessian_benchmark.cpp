@@ -0,0 +1,72 @@
+#include <cart_opt_ctrl/woodbury_hessian.hpp>
+#include <Eigen/Cholesky>
+#include <Eigen/LU>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Compares WoodburyHessian with the dense factorization of the CartOptCtrl hessian
+// (build H = 2.r.M^-1 + a^T.W.a, LLT, solve) on random inertia matrices and jacobians.
+// Usage : woodbury_hessian_benchmark [nb_iterations]
+namespace{
+  void benchmark(int dof, int nb_iterations){
+    const double regularisation_weight = 1e-05;
+    Eigen::MatrixXd R = Eigen::MatrixXd::Random(dof,dof);
+    const Eigen::MatrixXd M = R * R.transpose() + Eigen::MatrixXd::Identity(dof,dof);
+    const Eigen::MatrixXd M_inv = M.inverse();
+    const Eigen::Matrix<double,6,Eigen::Dynamic> J = Eigen::MatrixXd::Random(6,dof);
+    const Eigen::VectorXd axes = Eigen::VectorXd::Ones(dof);
+    const Eigen::Matrix<double,6,1> weights = Eigen::Matrix<double,6,1>::Constant(2.0);
+    const Eigen::VectorXd g = Eigen::VectorXd::Random(dof);
+
+    // Dense
+    Eigen::Matrix<double,6,Eigen::Dynamic> a(6,dof);
+    Eigen::MatrixXd H(dof,dof);
+    Eigen::LLT<Eigen::MatrixXd> llt(dof);
+    Eigen::VectorXd x_dense(dof);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int n=0; n<nb_iterations; n++){
+      a.noalias() = J * axes.asDiagonal() * M_inv;
+      H = 2.0 * regularisation_weight * M_inv;
+      H.noalias() += a.transpose() * weights.asDiagonal() * a;
+      llt.compute(H);
+      x_dense = llt.solve(g);
+    }
+    const double dense_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Woodbury
+    WoodburyHessian woodbury;
+    woodbury.configure(dof,1);
+    Eigen::VectorXd x_woodbury(dof);
+    start = std::chrono::steady_clock::now();
+    for(int n=0; n<nb_iterations; n++){
+      woodbury.reset(M,M_inv,regularisation_weight);
+      woodbury.addTask(J,axes,weights);
+      woodbury.compute();
+      x_woodbury.noalias() = woodbury.inverse() * g;
+    }
+    const double woodbury_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Woodbury, solve only (what the unconstrained fast path needs)
+    Eigen::VectorXd x_solve(dof);
+    start = std::chrono::steady_clock::now();
+    for(int n=0; n<nb_iterations; n++){
+      woodbury.reset(M,M_inv,regularisation_weight);
+      woodbury.addTask(J,axes,weights);
+      woodbury.factorize();
+      woodbury.solve(g,x_solve);
+    }
+    const double solve_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%2d joints : dense %.3f us, woodbury inverse %.3f us, woodbury solve %.3f us, relative errors %g %g\n", dof,
+           1e6 * dense_time / nb_iterations, 1e6 * woodbury_time / nb_iterations, 1e6 * solve_time / nb_iterations,
+           (x_dense - x_woodbury).norm() / x_dense.norm(), (x_dense - x_solve).norm() / x_dense.norm());
+  }
+}
+
+int main(int argc, char** argv){
+  const int nb_iterations = argc > 1 ? std::atoi(argv[1]) : 100000;
+  benchmark(7,nb_iterations);
+  benchmark(14,nb_iterations);
+  return 0;
+}
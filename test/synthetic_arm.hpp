@@ -0,0 +1,36 @@
+#ifndef CARTOPTCTRL_TEST_SYNTHETICARM_HPP_
+#define CARTOPTCTRL_TEST_SYNTHETICARM_HPP_
+
+#include <cart_opt_ctrl/batched_dynamics.hpp>
+
+// Segment models of a 4 joints arm (yaw, pitch, pitch, roll) and a fixed tool, built without KDL.
+// scale changes the masses so that the same arm gives a prior and a different "true" robot.
+inline BatchedDynamics::SegmentModels syntheticArm(double scale = 1.0){
+  const double masses[5] = {4.0, 3.0, 2.0, 1.0, 0.5};
+  const Eigen::Vector3d axes[5] = {Eigen::Vector3d::UnitZ(), Eigen::Vector3d::UnitY(), Eigen::Vector3d::UnitY(),
+                                   Eigen::Vector3d::UnitZ(), Eigen::Vector3d::Zero()};
+  const Eigen::Vector3d tips[5] = {Eigen::Vector3d(0.0,0.0,0.3), Eigen::Vector3d(0.0,0.0,0.4), Eigen::Vector3d(0.0,0.0,0.35),
+                                   Eigen::Vector3d(0.0,0.0,0.1), Eigen::Vector3d(0.0,0.0,0.05)};
+  BatchedDynamics::SegmentModels segments(5);
+  for(int k=0; k<5; k++){
+    BatchedDynamics::SegmentModel& s = segments[k];
+    s.type = k < 4 ? BatchedDynamics::SegmentModel::ROTATIONAL : BatchedDynamics::SegmentModel::FIXED;
+    s.joint_index = k < 4 ? k : -1;
+    s.axis = axes[k];
+    s.origin.setZero();
+    s.tip_rot.setIdentity();
+    s.tip_pos = tips[k];
+    // Center of mass off the link axis, inertia of a box about the center of mass moved to the origin
+    const double m = scale * masses[k];
+    const Eigen::Vector3d c = 0.5 * tips[k] + Eigen::Vector3d(0.01 * (k + 1), -0.005 * k, 0.0) * scale;
+    const Eigen::Vector3d sides(0.08, 0.06, tips[k].norm());
+    const Eigen::Vector3d sq = sides.cwiseProduct(sides);
+    const Eigen::Matrix3d Ic = (m / 12.0 * Eigen::Vector3d(sq(1) + sq(2), sq(0) + sq(2), sq(0) + sq(1))).asDiagonal();
+    s.mass = m;
+    s.first_moment = m * c;
+    s.rot_inertia = Ic + m * (c.squaredNorm() * Eigen::Matrix3d::Identity() - c * c.transpose());
+  }
+  return segments;
+}
+
+#endif // CARTOPTCTRL_TEST_SYNTHETICARM_HPP_
@@ -0,0 +1,146 @@
+#include <cart_opt_ctrl/batched_dynamics.hpp>
+#include "synthetic_arm.hpp"
+#include <gtest/gtest.h>
+#include <Eigen/LU>
+#include <cmath>
+#include <cstdlib>
+
+namespace{
+  typedef BatchedDynamicsResult::Matrix Matrix;
+
+  // 4 joints, a number of configurations that is not a multiple of the lanes
+  class BatchedDynamicsTest : public testing::Test{
+    protected:
+      void SetUp(){
+        std::srand(1);
+        ASSERT_TRUE(dynamics.init(syntheticArm(), 4));
+        dynamics.setNbThreads(1);
+        const int n = 4 * BatchedDynamics::Lanes + 3;
+        q = Matrix::Random(4, n) * 3.0;
+        qd = Matrix::Random(4, n) * 2.0;
+        qdd = Matrix::Random(4, n) * 5.0;
+      }
+
+      BatchedDynamics dynamics;
+      Matrix q, qd, qdd;
+  };
+}
+
+TEST_F(BatchedDynamicsTest, RegressorGivesTheInverseDynamics){
+  Matrix tau, y;
+  dynamics.computeInverseDynamics(q, qd, qdd, tau);
+  dynamics.computeRegressor(q, qd, qdd, y);
+  const int np = dynamics.getNrOfParameters();
+  ASSERT_EQ(5 * BatchedDynamics::NB_SEGMENT_PARAMETERS, np);
+  Eigen::VectorXd parameters(np);
+  for(int k=0; k<dynamics.getNrOfSegments(); k++)
+    BatchedDynamics::getParameters(dynamics.getSegments()[k], parameters.data() + k * BatchedDynamics::NB_SEGMENT_PARAMETERS);
+  for(int j=0; j<4; j++)
+    for(int i=0; i<q.cols(); i++)
+      EXPECT_NEAR(tau(j,i), y.middleRows(j*np,np).col(i).dot(parameters), 1e-9) << "joint " << j << " configuration " << i;
+}
+
+TEST_F(BatchedDynamicsTest, MatchesTheInverseDynamicsAtRest){
+  BatchedDynamicsResult result;
+  dynamics.compute(q, result, BatchedDynamics::GRAVITY | BatchedDynamics::INERTIA | BatchedDynamics::INERTIA_INVERSE);
+  const Matrix zero = Matrix::Zero(4, q.cols());
+  Matrix gravity, tau;
+  dynamics.computeInverseDynamics(q, zero, zero, gravity);
+  EXPECT_LT((result.gravity - gravity).norm(), 1e-9);
+
+  // Column c of the inertia matrix from a unit acceleration of joint c
+  for(int c=0; c<4; c++){
+    Matrix unit = zero;
+    unit.row(c).setOnes();
+    dynamics.computeInverseDynamics(q, zero, unit, tau);
+    for(int r=0; r<4; r++)
+      for(int i=0; i<q.cols(); i++)
+        EXPECT_NEAR(tau(r,i) - gravity(r,i), result.inertia(r * 4 + c, i), 1e-9);
+  }
+
+  Eigen::Matrix<double,4,4,Eigen::RowMajor> inertia, inertia_inverse;
+  for(int i=0; i<q.cols(); i++){
+    Eigen::Map<Eigen::Matrix<double,16,1> >(inertia.data()) = result.inertia.col(i);
+    Eigen::Map<Eigen::Matrix<double,16,1> >(inertia_inverse.data()) = result.inertia_inverse.col(i);
+    EXPECT_LT((inertia * inertia_inverse - Eigen::Matrix4d::Identity()).norm(), 1e-9);
+  }
+}
+
+TEST_F(BatchedDynamicsTest, SameResultWithThreads){
+  Matrix tau, tau_threads;
+  dynamics.computeInverseDynamics(q, qd, qdd, tau);
+  dynamics.setNbThreads(3);
+  dynamics.computeInverseDynamics(q, qd, qdd, tau_threads);
+  EXPECT_EQ(0.0, (tau - tau_threads).norm());
+}
+
+// Planar arm of two links along x rotating about z, point masses and an inertia about z at the link tips,
+// gravity along -y : pose, jacobian, inertia and inverse dynamics in closed form
+TEST(BatchedDynamics, MatchesTheClosedFormOfATwoLinkArm){
+  const double l1 = 0.7, l2 = 0.4, m1 = 3.0, m2 = 1.5, i1 = 0.02, i2 = 0.01, g = 9.81;
+  BatchedDynamics::SegmentModels segments(2);
+  for(int k=0; k<2; k++){
+    BatchedDynamics::SegmentModel& s = segments[k];
+    s.type = BatchedDynamics::SegmentModel::ROTATIONAL;
+    s.joint_index = k;
+    s.axis = Eigen::Vector3d::UnitZ();
+    s.origin.setZero();
+    s.tip_rot.setIdentity();
+    s.tip_pos = Eigen::Vector3d(k == 0 ? l1 : l2, 0.0, 0.0);
+    s.mass = k == 0 ? m1 : m2;
+    s.first_moment.setZero();
+    s.rot_inertia = Eigen::Vector3d(0.5, 0.5, 1.0).asDiagonal() * (k == 0 ? i1 : i2);
+  }
+  BatchedDynamics dynamics;
+  ASSERT_TRUE(dynamics.init(segments, 2, Eigen::Vector3d(0.0,-g,0.0)));
+
+  std::srand(2);
+  const int n = 2 * BatchedDynamics::Lanes + 1;
+  const Matrix q = Matrix::Random(2, n) * 3.0, qd = Matrix::Random(2, n) * 2.0, qdd = Matrix::Random(2, n) * 5.0;
+  BatchedDynamicsResult result;
+  dynamics.compute(q, result);
+  Matrix tau;
+  dynamics.computeInverseDynamics(q, qd, qdd, tau);
+
+  for(int i=0; i<n; i++){
+    const double c1 = std::cos(q(0,i)), s1 = std::sin(q(0,i)), c12 = std::cos(q(0,i) + q(1,i)), s12 = std::sin(q(0,i) + q(1,i));
+    const double c2 = std::cos(q(1,i)), s2 = std::sin(q(1,i));
+
+    Eigen::Matrix<double,12,1> pose;
+    pose << l1 * c1 + l2 * c12, l1 * s1 + l2 * s12, 0.0,
+            c12, -s12, 0.0,
+            s12,  c12, 0.0,
+            0.0,  0.0, 1.0;
+    EXPECT_LT((result.pose.col(i) - pose).norm(), 1e-12) << "configuration " << i;
+
+    Eigen::Matrix<double,6,2,Eigen::RowMajor> jacobian;
+    jacobian << -l1 * s1 - l2 * s12, -l2 * s12,
+                 l1 * c1 + l2 * c12,  l2 * c12,
+                 0.0, 0.0,
+                 0.0, 0.0,
+                 0.0, 0.0,
+                 1.0, 1.0;
+    EXPECT_LT((result.jacobian.col(i) - Eigen::Map<const Eigen::Matrix<double,12,1> >(jacobian.data())).norm(), 1e-12) << "configuration " << i;
+
+    Eigen::Matrix2d inertia;
+    inertia(0,0) = m1 * l1 * l1 + i1 + m2 * (l1 * l1 + l2 * l2 + 2.0 * l1 * l2 * c2) + i2;
+    inertia(0,1) = inertia(1,0) = m2 * (l2 * l2 + l1 * l2 * c2) + i2;
+    inertia(1,1) = m2 * l2 * l2 + i2;
+    EXPECT_LT((result.inertia.col(i) - Eigen::Map<const Eigen::Vector4d>(inertia.data())).norm(), 1e-12) << "configuration " << i;
+    const Eigen::Matrix2d inertia_inverse = inertia.inverse();
+    EXPECT_LT((result.inertia_inverse.col(i) - Eigen::Map<const Eigen::Vector4d>(inertia_inverse.data())).norm(), 1e-9) << "configuration " << i;
+
+    const Eigen::Vector2d gravity(( m1 + m2) * g * l1 * c1 + m2 * g * l2 * c12, m2 * g * l2 * c12);
+    EXPECT_LT((result.gravity.col(i) - gravity).norm(), 1e-12) << "configuration " << i;
+
+    const double h = m2 * l1 * l2 * s2;
+    const Eigen::Vector2d coriolis(-h * (2.0 * qd(0,i) * qd(1,i) + qd(1,i) * qd(1,i)), h * qd(0,i) * qd(0,i));
+    const Eigen::Vector2d torque = inertia * qdd.col(i) + coriolis + gravity;
+    EXPECT_LT((tau.col(i) - torque).norm(), 1e-10) << "configuration " << i;
+  }
+}
+
+int main(int argc, char** argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,107 @@
+#include <cart_opt_ctrl/dynamic_identification.hpp>
+#include <cart_opt_ctrl/payload_estimator.hpp>
+#include "synthetic_arm.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace{
+  typedef BatchedDynamicsResult::Matrix Matrix;
+  const int NB_JOINTS = 4;
+  const double DEADBAND = 0.01;
+
+  // Random samples of the joints and the torques of dynamics with a Coulomb and a viscous friction per joint
+  void torques(const BatchedDynamics& dynamics, const Eigen::VectorXd& coulomb, const Eigen::VectorXd& viscous, int n,
+               Matrix& q, Matrix& qd, Matrix& qdd, Matrix& tau){
+    q = Matrix::Random(NB_JOINTS, n) * 3.0;
+    qd = Matrix::Random(NB_JOINTS, n) * 2.0;
+    qdd = Matrix::Random(NB_JOINTS, n) * 5.0;
+    dynamics.computeInverseDynamics(q, qd, qdd, tau);
+    for(int j=0; j<NB_JOINTS; j++)
+      for(int i=0; i<n; i++){
+        const double v = qd(j,i);
+        tau(j,i) += (std::abs(v) < DEADBAND ? 0.0 : (v > 0.0 ? coulomb[j] : -coulomb[j])) + viscous[j] * v;
+      }
+  }
+
+  // Torques of the segment parameters and friction of DynamicIdentification::Result
+  Matrix predict(const BatchedDynamics& dynamics, const Eigen::VectorXd& parameters, const Matrix& q, const Matrix& qd, const Matrix& qdd){
+    const int np = dynamics.getNrOfParameters();
+    Matrix y;
+    dynamics.computeRegressor(q, qd, qdd, y);
+    Matrix tau(NB_JOINTS, q.cols());
+    for(int j=0; j<NB_JOINTS; j++)
+      for(int i=0; i<q.cols(); i++){
+        const double v = qd(j,i);
+        tau(j,i) = y.middleRows(j*np,np).col(i).dot(parameters.head(np))
+                   + (std::abs(v) < DEADBAND ? 0.0 : (v > 0.0 ? 1.0 : -1.0)) * parameters[np+j] + parameters[np+NB_JOINTS+j] * v;
+      }
+    return tau;
+  }
+}
+
+TEST(DynamicIdentification, RecoversTheParametersOfSyntheticData){
+  std::srand(1);
+  // The model is the prior, the robot has other masses, centers of mass and inertias
+  BatchedDynamics model, robot;
+  ASSERT_TRUE(model.init(syntheticArm(1.0), NB_JOINTS));
+  ASSERT_TRUE(robot.init(syntheticArm(1.3), NB_JOINTS));
+  Eigen::VectorXd coulomb(NB_JOINTS), viscous(NB_JOINTS);
+  coulomb << 0.8, 0.6, 0.4, 0.2;
+  viscous << 0.3, 0.2, 0.1, 0.05;
+
+  DynamicIdentification identification;
+  ASSERT_TRUE(identification.init(model, true, DEADBAND));
+  Matrix q, qd, qdd, tau;
+  torques(robot, coulomb, viscous, 5000, q, qd, qdd, tau);
+  // Noise of a few mN.m
+  tau += Matrix::Random(NB_JOINTS, tau.cols()) * 5e-3;
+  identification.addSamples(q, qd, qdd, tau, 2, 512);
+  EXPECT_EQ(5000, identification.getNrOfSamples());
+
+  DynamicIdentification::Result result;
+  ASSERT_TRUE(identification.solve(result));
+  EXPECT_TRUE(result.prior_segments.empty());
+  for(int j=0; j<NB_JOINTS; j++){
+    // Uniform noise of 5e-3 has a standard deviation of 2.9e-3
+    EXPECT_NEAR(2.9e-3, result.sigma[j], 5e-4) << "joint " << j;
+    EXPECT_LT(result.rms[j], 0.1 * result.prior_rms[j]) << "joint " << j;
+  }
+
+  // The friction is identifiable, the segments through the torques they give on other samples
+  const int np = model.getNrOfParameters();
+  for(int j=0; j<NB_JOINTS; j++){
+    EXPECT_NEAR(coulomb[j], result.parameters[np+j], 1e-3) << "joint " << j;
+    EXPECT_NEAR(viscous[j], result.parameters[np+NB_JOINTS+j], 1e-3) << "joint " << j;
+  }
+  for(int k=0; k<model.getNrOfSegments(); k++)
+    EXPECT_TRUE(PayloadEstimator::isPhysical(result.parameters.data() + k * BatchedDynamics::NB_SEGMENT_PARAMETERS)) << "segment " << k;
+  Matrix q_test, qd_test, qdd_test, tau_test;
+  torques(robot, coulomb, viscous, 1000, q_test, qd_test, qdd_test, tau_test);
+  const Matrix error = predict(model, result.parameters, q_test, qd_test, qdd_test) - tau_test;
+  EXPECT_LT(std::sqrt(error.squaredNorm() / error.size()), 1e-3);
+}
+
+TEST(FourierExcitation, StartsAndEndsAtRest){
+  std::srand(3);
+  Eigen::VectorXd start(NB_JOINTS);
+  start << 0.1, -0.5, 1.2, 0.0;
+  FourierExcitation excitation;
+  excitation.init(start, 5, 0.1);
+  excitation.sineCoefficients() = Eigen::MatrixXd::Random(NB_JOINTS, 5);
+  excitation.cosineCoefficients() = Eigen::MatrixXd::Random(NB_JOINTS, 5);
+  excitation.project();
+  Eigen::VectorXd q(NB_JOINTS), qd(NB_JOINTS), qdd(NB_JOINTS);
+  for(int n=0; n<2; n++){
+    excitation.sample(n * excitation.period(), q, qd, qdd);
+    EXPECT_LT((q - start).norm(), 1e-9);
+    EXPECT_LT(qd.norm(), 1e-9);
+    EXPECT_LT(qdd.norm(), 1e-9);
+  }
+}
+
+int main(int argc, char** argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,167 @@
+#include <cart_opt_ctrl/multi_frame_kinematics.hpp>
+#include <kdl/chain.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/chainfksolvervel_recursive.hpp>
+#include <kdl/chainjnttojacsolver.hpp>
+#include <kdl/chainjnttojacdotsolver.hpp>
+#include <gtest/gtest.h>
+#include <Eigen/Geometry>
+#include <cstdlib>
+#include <sstream>
+
+namespace{
+  typedef MultiFrameKinematics::Vector6d Vector6d;
+
+  // Revolute joints about the principal and an arbitrary axis off the origin, a prismatic joint,
+  // rotated segment tips and a fixed tool
+  KDL::Chain kdlChain(){
+    KDL::Chain chain;
+    chain.addSegment(KDL::Segment("base", KDL::Joint("base_joint", KDL::Joint::None), KDL::Frame(KDL::Vector(0.0,0.0,0.1))));
+    chain.addSegment(KDL::Segment("link_1", KDL::Joint("joint_1", KDL::Joint::RotZ),
+                                  KDL::Frame(KDL::Rotation::RPY(0.3,-0.2,0.1), KDL::Vector(0.05,0.0,0.3))));
+    chain.addSegment(KDL::Segment("link_2", KDL::Joint("joint_2", KDL::Joint::RotY),
+                                  KDL::Frame(KDL::Rotation::RPY(-0.4,0.1,0.7), KDL::Vector(0.0,0.1,0.4))));
+    chain.addSegment(KDL::Segment("link_3", KDL::Joint("joint_3", KDL::Vector(0.02,-0.03,0.05), KDL::Vector(1.0,1.0,0.5), KDL::Joint::RotAxis),
+                                  KDL::Frame(KDL::Rotation::RPY(0.2,0.5,-0.3), KDL::Vector(0.1,0.0,0.25))));
+    chain.addSegment(KDL::Segment("link_4", KDL::Joint("joint_4", KDL::Joint::TransZ),
+                                  KDL::Frame(KDL::Rotation::RPY(0.0,0.3,0.2), KDL::Vector(0.0,0.0,0.1))));
+    chain.addSegment(KDL::Segment("link_5", KDL::Joint("joint_5", KDL::Joint::RotX), KDL::Frame(KDL::Vector(0.0,0.05,0.1))));
+    chain.addSegment(KDL::Segment("tool", KDL::Joint("tool_joint", KDL::Joint::None),
+                                  KDL::Frame(KDL::Rotation::RPY(0.1,0.2,0.3), KDL::Vector(0.0,0.0,0.15))));
+    return chain;
+  }
+
+  // Same kind of chain as segment models, without KDL
+  void segmentModels(BatchedDynamics::SegmentModels& segments, std::vector<std::string>& names){
+    typedef BatchedDynamics::SegmentModel Model;
+    const Model::JointType types[6] = {Model::FIXED, Model::ROTATIONAL, Model::ROTATIONAL, Model::ROTATIONAL, Model::TRANSLATIONAL, Model::FIXED};
+    const Eigen::Vector3d axes[6] = {Eigen::Vector3d::Zero(), Eigen::Vector3d::UnitZ(), Eigen::Vector3d::UnitY(),
+                                     Eigen::Vector3d(1.0,1.0,0.5).normalized(), Eigen::Vector3d::UnitZ(), Eigen::Vector3d::Zero()};
+    segments.resize(6);
+    names.resize(6);
+    int joint = 0;
+    for(int k=0; k<6; k++){
+      Model& s = segments[k];
+      s.type = types[k];
+      s.joint_index = s.type == Model::FIXED ? -1 : joint++;
+      s.axis = axes[k];
+      s.origin = k == 3 ? Eigen::Vector3d(0.02,-0.03,0.05) : Eigen::Vector3d::Zero();
+      s.tip_rot = Eigen::AngleAxisd(0.3 * k + 0.1, Eigen::Vector3d(0.2 * k, 1.0, -0.5).normalized()).toRotationMatrix();
+      s.tip_pos = Eigen::Vector3d(0.05 * k, 0.02, 0.3);
+      s.mass = 1.0;
+      s.first_moment.setZero();
+      s.rot_inertia = 1e-2 * Eigen::Matrix3d::Identity();
+      std::ostringstream name;
+      name << "link_" << k;
+      names[k] = name.str();
+    }
+  }
+
+  Vector6d twistToEigen(const KDL::Twist& t){
+    Vector6d v;
+    v << t.vel.x(), t.vel.y(), t.vel.z(), t.rot.x(), t.rot.y(), t.rot.z();
+    return v;
+  }
+}
+
+TEST(MultiFrameKinematics, MatchesTheKDLSolvers){
+  const KDL::Chain chain = kdlChain();
+  MultiFrameKinematics kinematics;
+  ASSERT_TRUE(kinematics.init(chain));
+  const int nj = chain.getNrOfJoints();
+  ASSERT_EQ(nj, kinematics.getNrOfJoints());
+  for(unsigned int k=0; k<chain.getNrOfSegments(); k++)
+    ASSERT_EQ(int(k), kinematics.addFrame(chain.getSegment(k).getName()));
+  EXPECT_EQ(-1, kinematics.addFrame("unknown"));
+
+  KDL::ChainFkSolverPos_recursive fk_pos(chain);
+  KDL::ChainFkSolverVel_recursive fk_vel(chain);
+  KDL::ChainJntToJacSolver jac_solver(chain);
+  KDL::ChainJntToJacDotSolver jac_dot_solver(chain);
+  jac_dot_solver.setRepresentation(KDL::ChainJntToJacDotSolver::HYBRID);
+  KDL::JntArrayVel q(nj);
+  KDL::Jacobian jacobian(nj);
+  KDL::Frame pose;
+  KDL::FrameVel frame_vel;
+  KDL::Twist jdot_qdot;
+
+  std::srand(1);
+  for(int n=0; n<20; n++){
+    q.q.data = Eigen::VectorXd::Random(nj) * 2.0;
+    q.qdot.data = Eigen::VectorXd::Random(nj) * 1.5;
+    kinematics.update(q.q.data, q.qdot.data);
+    for(unsigned int k=0; k<chain.getNrOfSegments(); k++){
+      // The KDL solvers take the number of segments up to the frame
+      ASSERT_GE(fk_pos.JntToCart(q.q, pose, k+1), 0);
+      ASSERT_GE(fk_vel.JntToCart(q, frame_vel, k+1), 0);
+      jacobian.data.setZero();
+      ASSERT_GE(jac_solver.JntToJac(q.q, jacobian, k+1), 0);
+      ASSERT_GE(jac_dot_solver.JntToJacDot(q, jdot_qdot, k+1), 0);
+
+      const KDL::Frame& frame = kinematics.getPose(k);
+      for(int i=0; i<3; i++){
+        EXPECT_NEAR(pose.p(i), frame.p(i), 1e-12) << "segment " << k;
+        EXPECT_NEAR(pose.p(i), kinematics.getPosition(k)(i), 1e-12) << "segment " << k;
+        for(int c=0; c<3; c++){
+          EXPECT_NEAR(pose.M(i,c), frame.M(i,c), 1e-12) << "segment " << k;
+          EXPECT_NEAR(pose.M(i,c), kinematics.getRotation(k)(i,c), 1e-12) << "segment " << k;
+        }
+      }
+      EXPECT_LT((kinematics.getTwist(k) - twistToEigen(frame_vel.GetTwist())).norm(), 1e-12) << "segment " << k;
+      EXPECT_LT((kinematics.getJacobian(k) - jacobian.data).norm(), 1e-12) << "segment " << k;
+      EXPECT_LT((kinematics.getJdotQdot(k) - twistToEigen(jdot_qdot)).norm(), 1e-10) << "segment " << k;
+    }
+  }
+}
+
+TEST(MultiFrameKinematics, MatchesFiniteDifferences){
+  BatchedDynamics::SegmentModels segments;
+  std::vector<std::string> names;
+  segmentModels(segments, names);
+  MultiFrameKinematics kinematics, shifted;
+  ASSERT_TRUE(kinematics.init(segments, names, 4));
+  ASSERT_TRUE(shifted.init(segments, names, 4));
+  EXPECT_FALSE(shifted.init(segments, names, 3));
+  ASSERT_TRUE(shifted.init(segments, names, 4));
+  for(unsigned int k=0; k<names.size(); k++){
+    ASSERT_EQ(int(k), kinematics.addFrame(names[k]));
+    ASSERT_EQ(int(k), shifted.addFrame(names[k]));
+  }
+
+  const double h = 1e-6;
+  std::srand(2);
+  for(int n=0; n<20; n++){
+    const Eigen::VectorXd q = Eigen::VectorXd::Random(4) * 2.0, qd = Eigen::VectorXd::Random(4) * 1.5;
+    kinematics.update(q, qd);
+    for(unsigned int k=0; k<names.size(); k++){
+      // Jacobian columns from the pose, linear then angular velocity
+      MultiFrameKinematics::Jacobian jacobian(6,4);
+      for(int j=0; j<4; j++){
+        Eigen::VectorXd q_plus = q, q_minus = q;
+        q_plus(j) += h;
+        q_minus(j) -= h;
+        shifted.update(q_plus, qd);
+        const Eigen::Vector3d p_plus = shifted.getPosition(k);
+        const Eigen::Matrix3d r_plus = shifted.getRotation(k);
+        shifted.update(q_minus, qd);
+        const Eigen::AngleAxisd rotation(r_plus * shifted.getRotation(k).transpose());
+        jacobian.col(j).head<3>() = (p_plus - shifted.getPosition(k)) / (2.0 * h);
+        jacobian.col(j).tail<3>() = rotation.angle() * rotation.axis() / (2.0 * h);
+      }
+      EXPECT_LT((kinematics.getJacobian(k) - jacobian).norm(), 1e-8) << "segment " << k;
+      EXPECT_LT((kinematics.getTwist(k) - kinematics.getJacobian(k) * qd).norm(), 1e-12) << "segment " << k;
+
+      // Jdot.qdot from the jacobian along qdot
+      shifted.update(q + h * qd, qd);
+      const MultiFrameKinematics::Jacobian j_plus = shifted.getJacobian(k);
+      shifted.update(q - h * qd, qd);
+      const Vector6d jdot_qdot = (j_plus - shifted.getJacobian(k)) / (2.0 * h) * qd;
+      EXPECT_LT((kinematics.getJdotQdot(k) - jdot_qdot).norm(), 1e-7) << "segment " << k;
+    }
+  }
+}
+
+int main(int argc, char** argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,124 @@
+#include <cart_opt_ctrl/payload_estimator.hpp>
+#include <gtest/gtest.h>
+#include <Eigen/Geometry>
+#include <cstdlib>
+
+namespace{
+  // Payload of mass m, center of mass c and inertia about its center of mass Ic, about the frame origin
+  PayloadEstimator::Parameters payload(double m, const Eigen::Vector3d& c, const Eigen::Matrix3d& Ic){
+    const Eigen::Matrix3d I = Ic + m * (c.squaredNorm() * Eigen::Matrix3d::Identity() - c * c.transpose());
+    PayloadEstimator::Parameters phi;
+    phi << m, m * c(0), m * c(1), m * c(2), I(0,0), I(0,1), I(0,2), I(1,1), I(1,2), I(2,2);
+    return phi;
+  }
+
+  // Random frame motion and orientation with respect to gravity, the wrench of the payload phi
+  void sample(const PayloadEstimator::Parameters& phi, PayloadEstimator::Regressor& A, Eigen::Matrix<double,6,1>& w){
+    const Eigen::Vector3d gravity = Eigen::Quaterniond(Eigen::Vector4d::Random().normalized()) * Eigen::Vector3d(0.0,0.0,-9.81);
+    PayloadEstimator::computeRegressor(2.0 * Eigen::Vector3d::Random(), Eigen::Vector3d::Random(), 5.0 * Eigen::Vector3d::Random(), gravity, A);
+    w = A * phi;
+  }
+}
+
+TEST(PayloadEstimator, ConvergesToKnownParameters){
+  std::srand(1);
+  const PayloadEstimator::Parameters phi = payload(1.5, Eigen::Vector3d(0.01,-0.02,0.05), Eigen::Vector3d(2e-3,3e-3,4e-3).asDiagonal());
+  PayloadEstimator estimator;
+  estimator.reset(1e3);
+  PayloadEstimator::Regressor A;
+  Eigen::Matrix<double,6,1> w;
+  for(int n=0; n<200; n++){
+    sample(phi, A, w);
+    estimator.update(A, w);
+  }
+  EXPECT_EQ(200u, estimator.getNbUpdates());
+  for(int i=0; i<PayloadEstimator::NB_PARAMS; i++)
+    EXPECT_NEAR(phi(i), estimator.getParameters()(i), 1e-6) << "parameter " << i;
+}
+
+TEST(PayloadEstimator, TracksAPayloadChange){
+  std::srand(2);
+  const PayloadEstimator::Parameters before = payload(0.5, Eigen::Vector3d(0.0,0.0,0.03), 1e-3 * Eigen::Matrix3d::Identity());
+  const PayloadEstimator::Parameters after = payload(2.0, Eigen::Vector3d(0.02,0.01,0.08), Eigen::Vector3d(5e-3,6e-3,3e-3).asDiagonal());
+  PayloadEstimator estimator;
+  estimator.reset(1e3);
+  estimator.setForgettingFactor(0.95);
+  PayloadEstimator::Regressor A;
+  Eigen::Matrix<double,6,1> w;
+  for(int n=0; n<200; n++){
+    sample(before, A, w);
+    estimator.update(A, w);
+  }
+  EXPECT_LT((estimator.getParameters() - before).norm(), 1e-6);
+  for(int n=0; n<1000; n++){
+    sample(after, A, w);
+    estimator.update(A, w);
+  }
+  EXPECT_LT((estimator.getParameters() - after).norm(), 1e-6);
+}
+
+TEST(PayloadEstimator, CovarianceStaysBoundedWithoutExcitation){
+  PayloadEstimator estimator;
+  estimator.reset(1e3);
+  estimator.setForgettingFactor(0.9);
+  const double initial_trace = estimator.getCovariance().trace();
+  // At rest with a constant orientation, only the mass and the first moment about two axes are seen
+  PayloadEstimator::Regressor A;
+  PayloadEstimator::computeRegressor(Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(),
+                                     Eigen::Vector3d(0.0,0.0,-9.81), A);
+  const Eigen::Matrix<double,6,1> w = A * payload(1.0, Eigen::Vector3d(0.0,0.0,0.05), 1e-3 * Eigen::Matrix3d::Identity());
+  for(int n=0; n<1000; n++)
+    estimator.update(A, w);
+  EXPECT_LE(estimator.getCovariance().trace(), initial_trace * (1.0 + 1e-12));
+  EXPECT_TRUE(estimator.getParameters().allFinite());
+}
+
+TEST(PayloadEstimator, ProjectPhysicalOutputIsPhysical){
+  std::srand(4);
+  int nb_not_physical = 0;
+  for(int n=0; n<1000; n++){
+    PayloadEstimator::Parameters phi = PayloadEstimator::Parameters::Random();
+    nb_not_physical += !PayloadEstimator::isPhysical(phi.data());
+    PayloadEstimator::projectPhysical(phi.data(), 1e-6);
+    EXPECT_TRUE(PayloadEstimator::isPhysical(phi.data())) << phi.transpose();
+  }
+  // Most random parameters are not
+  EXPECT_GT(nb_not_physical, 500);
+}
+
+TEST(PayloadEstimator, ProjectPhysicalKeepsPhysicalParameters){
+  std::srand(5);
+  for(int n=0; n<100; n++){
+    // Box of random sides about a random orientation
+    const Eigen::Vector3d sides = 0.05 * (Eigen::Vector3d::Random() + Eigen::Vector3d::Constant(1.5));
+    const Eigen::Vector3d sq = sides.cwiseProduct(sides);
+    const double m = 1.0 + Eigen::Matrix<double,1,1>::Random()(0);
+    const Eigen::Matrix3d R = Eigen::Quaterniond(Eigen::Vector4d::Random().normalized()).toRotationMatrix();
+    const Eigen::Matrix3d Ic = R * (m / 12.0 * Eigen::Vector3d(sq(1) + sq(2), sq(0) + sq(2), sq(0) + sq(1))).asDiagonal() * R.transpose();
+    const PayloadEstimator::Parameters phi = payload(m, 0.1 * Eigen::Vector3d::Random(), Ic);
+    ASSERT_TRUE(PayloadEstimator::isPhysical(phi.data()));
+    PayloadEstimator::Parameters projected = phi;
+    PayloadEstimator::projectPhysical(projected.data(), 1e-6);
+    EXPECT_LT((projected - phi).norm(), 1e-12) << phi.transpose();
+  }
+}
+
+TEST(PayloadEstimator, IsPhysical){
+  // Unit mass at (0.1, 0, 0) with a small inertia about its center of mass, about the origin
+  PayloadEstimator::Parameters phi;
+  phi << 1.0, 0.1, 0.0, 0.0, 1e-3, 0.0, 0.0, 1e-3 + 0.01, 0.0, 1e-3 + 0.01;
+  EXPECT_TRUE(PayloadEstimator::isPhysical(phi.data()));
+  // Moments of inertia breaking the triangle inequality
+  phi(9) = 3e-3 + 0.01;
+  EXPECT_FALSE(PayloadEstimator::isPhysical(phi.data()));
+  phi(9) = 1e-3 + 0.01;
+  phi(0) = -1.0;
+  EXPECT_FALSE(PayloadEstimator::isPhysical(phi.data()));
+  // No payload
+  EXPECT_TRUE(PayloadEstimator::isPhysical(PayloadEstimator::Parameters::Zero().eval().data()));
+}
+
+int main(int argc, char** argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,113 @@
+#include <cart_opt_ctrl/woodbury_hessian.hpp>
+#include <gtest/gtest.h>
+#include <Eigen/LU>
+#include <cstdlib>
+
+namespace{
+  // Random inertia matrix and two tasks, the second one with an unselected axis and a zero weight
+  struct Problem{
+    Eigen::MatrixXd M, M_inv;
+    Eigen::Matrix<double,6,Eigen::Dynamic> J1, J2;
+    Eigen::VectorXd axes1, axes2;
+    Eigen::Matrix<double,6,1> weights1, weights2;
+    double regularisation_weight;
+
+    Problem(int dof) : regularisation_weight(1e-5){
+      const Eigen::MatrixXd R = Eigen::MatrixXd::Random(dof,dof);
+      M = R * R.transpose() + Eigen::MatrixXd::Identity(dof,dof);
+      M_inv = M.inverse();
+      J1 = Eigen::MatrixXd::Random(6,dof);
+      J2 = Eigen::MatrixXd::Random(6,dof);
+      axes1.setOnes(dof);
+      axes2.setOnes(dof);
+      axes2(dof-1) = 0.0;
+      weights1.setConstant(2.0);
+      weights2 << 4.0, 4.0, 4.0, 0.0, 1.0, 1.0;
+    }
+
+    // H = 2.r.M^-1 + sum_i a_i^T.diag(w_i).a_i with a_i = J_i.diag(s_i).M^-1
+    Eigen::MatrixXd hessian() const{
+      const Eigen::MatrixXd a1 = J1 * axes1.asDiagonal() * M_inv, a2 = J2 * axes2.asDiagonal() * M_inv;
+      return 2.0 * regularisation_weight * M_inv + a1.transpose() * weights1.asDiagonal() * a1
+                                                 + a2.transpose() * weights2.asDiagonal() * a2;
+    }
+  };
+}
+
+TEST(WoodburyHessian, InverseEqualsDirectInverse){
+  std::srand(1);
+  for(int dof=6; dof<=14; dof+=4){
+    const Problem p(dof);
+    WoodburyHessian woodbury;
+    woodbury.configure(dof, 2);
+    woodbury.reset(p.M, p.M_inv, p.regularisation_weight);
+    woodbury.addTask(p.J1, p.axes1, p.weights1);
+    woodbury.addTask(p.J2, p.axes2, p.weights2);
+    ASSERT_TRUE(woodbury.compute());
+    EXPECT_EQ(11, woodbury.rank());
+    const Eigen::MatrixXd H = p.hessian();
+    EXPECT_LT((woodbury.inverse() * H - Eigen::MatrixXd::Identity(dof,dof)).norm(), 1e-6) << dof << " joints";
+  }
+}
+
+TEST(WoodburyHessian, SolveEqualsDirectSolve){
+  std::srand(2);
+  for(int dof=6; dof<=14; dof+=4){
+    const Problem p(dof);
+    WoodburyHessian woodbury;
+    woodbury.configure(dof, 2);
+    woodbury.reset(p.M, p.M_inv, p.regularisation_weight);
+    woodbury.addTask(p.J1, p.axes1, p.weights1);
+    woodbury.addTask(p.J2, p.axes2, p.weights2);
+    ASSERT_TRUE(woodbury.factorize());
+    const Eigen::VectorXd b = Eigen::VectorXd::Random(dof);
+    Eigen::VectorXd x;
+    woodbury.solve(b, x);
+    const Eigen::VectorXd x_direct = p.hessian().ldlt().solve(b);
+    EXPECT_LT((x - x_direct).norm() / x_direct.norm(), 1e-6) << dof << " joints";
+  }
+}
+
+TEST(WoodburyHessian, WithoutTaskIsTheRegularisation){
+  std::srand(3);
+  const Problem p(7);
+  WoodburyHessian woodbury;
+  woodbury.configure(7, 1);
+  woodbury.reset(p.M, p.M_inv, p.regularisation_weight);
+  ASSERT_TRUE(woodbury.compute());
+  EXPECT_EQ(0, woodbury.rank());
+  EXPECT_LT((woodbury.inverse() - p.M / (2.0 * p.regularisation_weight)).norm(), 1e-9 * p.M.norm() / p.regularisation_weight);
+}
+
+TEST(WoodburyHessian, RejectsANonPositiveRegularisation){
+  std::srand(4);
+  const Problem p(7);
+  WoodburyHessian woodbury;
+  woodbury.configure(7, 1);
+  woodbury.reset(p.M, p.M_inv, 0.0);
+  woodbury.addTask(p.J1, p.axes1, p.weights1);
+  EXPECT_FALSE(woodbury.factorize());
+  EXPECT_FALSE(woodbury.compute());
+}
+
+TEST(WoodburyHessian, TaskTermsGiveTheDenseHessian){
+  std::srand(5);
+  const Problem p(7);
+  WoodburyHessian woodbury;
+  woodbury.configure(7, 2);
+  woodbury.reset(p.M, p.M_inv, p.regularisation_weight);
+  woodbury.addTask(p.J1, p.axes1, p.weights1);
+  woodbury.addTask(p.J2, p.axes2, p.weights2);
+  // Row major block as in the QP hessian
+  Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> H = Eigen::MatrixXd::Zero(9,9);
+  H.topLeftCorner(7,7) = 2.0 * p.regularisation_weight * p.M_inv;
+  woodbury.addTaskTerms(H.topLeftCorner(7,7));
+  EXPECT_LT((H.topLeftCorner(7,7) - p.hessian()).norm(), 1e-9 * p.hessian().norm());
+  EXPECT_EQ(0.0, H.bottomRows(2).norm());
+  EXPECT_EQ(0.0, H.rightCols(2).norm());
+}
+
+int main(int argc, char** argv){
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}